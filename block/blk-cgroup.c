@@ -1022,8 +1022,9 @@ static void __blkcg_rstat_flush(struct blkcg *blkcg, int cpu)
 	/*
 	 * For covering concurrent parent blkg update from blkg_release().
 	 *
-	 * When flushing from cgroup, cgroup_rstat_lock is always held, so
-	 * this lock won't cause contention most of time.
+	 * When flushing from cgroup, the flushed subtree is owned by the
+	 * flusher, so this lock is only contended by concurrent flushes of
+	 * unrelated subtrees.
 	 */
 	raw_spin_lock_irqsave(&blkg_stat_lock, flags);
 
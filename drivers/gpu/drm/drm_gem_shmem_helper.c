@@ -5,10 +5,15 @@
 
 #include <linux/dma-buf.h>
 #include <linux/export.h>
+#include <linux/ktime.h>
 #include <linux/module.h>
 #include <linux/mutex.h>
+#include <linux/sched/mm.h>
+#include <linux/seq_file.h>
 #include <linux/shmem_fs.h>
+#include <linux/shrinker.h>
 #include <linux/slab.h>
+#include <linux/swap.h>
 #include <linux/vmalloc.h>
 
 #ifdef CONFIG_X86
@@ -16,9 +21,11 @@
 #endif
 
 #include <drm/drm.h>
+#include <drm/drm_debugfs.h>
 #include <drm/drm_device.h>
 #include <drm/drm_drv.h>
 #include <drm/drm_gem_shmem_helper.h>
+#include <drm/drm_managed.h>
 #include <drm/drm_prime.h>
 #include <drm/drm_print.h>
 
@@ -34,6 +41,18 @@ MODULE_IMPORT_NS("DMA_BUF");
  * For GEM callback helpers in struct &drm_gem_object functions, see likewise
  * named functions with an _object_ infix (e.g., drm_gem_shmem_object_vmap() wraps
  * drm_gem_shmem_vmap()). These helpers perform the necessary type conversion.
+ *
+ * Drivers can have the pages of idle objects reclaimed under memory pressure
+ * by calling drmm_gem_shmem_init() for their device. The objects are then
+ * kept on LRUs by the helpers, and a shrinker purges the objects marked as
+ * purgeable with drm_gem_shmem_madvise() and, if there is swap, writes out
+ * the pages of the objects that are neither pinned nor vmapped. Evicted pages
+ * are brought back on the next use of the object, through
+ * drm_gem_shmem_get_pages_sgt(), drm_gem_shmem_vmap(), drm_gem_shmem_pin() or
+ * a page fault on an mmap of the object. Objects are only reclaimed once
+ * their fences have signaled, through &drm_gem_object_funcs.evict, where
+ * drivers that map objects to the GPU have to tear down these mappings
+ * before calling drm_gem_shmem_evict_locked().
  */
 
 static const struct drm_gem_object_funcs drm_gem_shmem_funcs = {
@@ -45,9 +64,39 @@ static const struct drm_gem_object_funcs drm_gem_shmem_funcs = {
 	.vmap = drm_gem_shmem_object_vmap,
 	.vunmap = drm_gem_shmem_object_vunmap,
 	.mmap = drm_gem_shmem_object_mmap,
+	.evict = drm_gem_shmem_object_evict,
+	.export = drm_gem_shmem_prime_export,
 	.vm_ops = &drm_gem_shmem_vm_ops,
 };
 
+/* Puts the object on the LRU matching its state, at the most recently used end */
+static void drm_gem_shmem_update_lru(struct drm_gem_shmem_object *shmem)
+{
+	struct drm_gem_object *obj = &shmem->base;
+	struct drm_gem_shmem *shmem_mm = obj->dev->shmem_mm;
+
+	dma_resv_assert_held(obj->resv);
+
+	if (!shmem_mm || obj->import_attach)
+		return;
+
+	/* Purging evicted objects marked as purgeable frees their swap */
+	if (shmem->evicted && drm_gem_shmem_is_purgeable(shmem))
+		drm_gem_lru_move_tail(&shmem_mm->lru_purgeable, obj);
+	else if (shmem->evicted)
+		drm_gem_lru_move_tail(&shmem_mm->lru_evicted, obj);
+	else if (!shmem->pages)
+		drm_gem_lru_remove(obj);
+	else if (shmem->pages_pin_count || !obj->funcs->evict)
+		drm_gem_lru_move_tail(&shmem_mm->lru_pinned, obj);
+	else if (drm_gem_shmem_is_purgeable(shmem))
+		drm_gem_lru_move_tail(&shmem_mm->lru_purgeable, obj);
+	else if (drm_gem_shmem_is_evictable(shmem))
+		drm_gem_lru_move_tail(&shmem_mm->lru_evictable, obj);
+	else
+		drm_gem_lru_move_tail(&shmem_mm->lru_pinned, obj);
+}
+
 static struct drm_gem_shmem_object *
 __drm_gem_shmem_create(struct drm_device *dev, size_t size, bool private,
 		       struct vfsmount *gemfs)
@@ -186,21 +235,16 @@ void drm_gem_shmem_free(struct drm_gem_shmem_object *shmem)
 }
 EXPORT_SYMBOL_GPL(drm_gem_shmem_free);
 
-static int drm_gem_shmem_get_pages(struct drm_gem_shmem_object *shmem)
+static int drm_gem_shmem_acquire_pages(struct drm_gem_shmem_object *shmem)
 {
 	struct drm_gem_object *obj = &shmem->base;
+	struct drm_gem_shmem *shmem_mm = obj->dev->shmem_mm;
 	struct page **pages;
 
-	dma_resv_assert_held(shmem->base.resv);
-
-	if (shmem->pages_use_count++ > 0)
-		return 0;
-
 	pages = drm_gem_get_pages(obj);
 	if (IS_ERR(pages)) {
 		drm_dbg_kms(obj->dev, "Failed to get pages (%ld)\n",
 			    PTR_ERR(pages));
-		shmem->pages_use_count = 0;
 		return PTR_ERR(pages);
 	}
 
@@ -216,6 +260,45 @@ static int drm_gem_shmem_get_pages(struct drm_gem_shmem_object *shmem)
 
 	shmem->pages = pages;
 
+	if (shmem->evicted) {
+		shmem->evicted = false;
+		if (shmem_mm)
+			atomic64_inc(&shmem_mm->stats.swapped_in);
+	}
+
+	return 0;
+}
+
+static void drm_gem_shmem_release_pages(struct drm_gem_shmem_object *shmem,
+					bool dirty, bool accessed)
+{
+	struct drm_gem_object *obj = &shmem->base;
+
+#ifdef CONFIG_X86
+	if (shmem->map_wc)
+		set_pages_array_wb(shmem->pages, obj->size >> PAGE_SHIFT);
+#endif
+
+	drm_gem_put_pages(obj, shmem->pages, dirty, accessed);
+	shmem->pages = NULL;
+}
+
+static int drm_gem_shmem_get_pages(struct drm_gem_shmem_object *shmem)
+{
+	int ret;
+
+	dma_resv_assert_held(shmem->base.resv);
+
+	/* Evicted objects that are still in use come back here */
+	if (!shmem->pages) {
+		ret = drm_gem_shmem_acquire_pages(shmem);
+		if (ret)
+			return ret;
+	}
+
+	shmem->pages_use_count++;
+	drm_gem_shmem_update_lru(shmem);
+
 	return 0;
 }
 
@@ -234,18 +317,12 @@ void drm_gem_shmem_put_pages(struct drm_gem_shmem_object *shmem)
 	if (drm_WARN_ON_ONCE(obj->dev, !shmem->pages_use_count))
 		return;
 
-	if (--shmem->pages_use_count > 0)
-		return;
-
-#ifdef CONFIG_X86
-	if (shmem->map_wc)
-		set_pages_array_wb(shmem->pages, obj->size >> PAGE_SHIFT);
-#endif
+	if (--shmem->pages_use_count == 0 && shmem->pages)
+		drm_gem_shmem_release_pages(shmem,
+					    shmem->pages_mark_dirty_on_put,
+					    shmem->pages_mark_accessed_on_put);
 
-	drm_gem_put_pages(obj, shmem->pages,
-			  shmem->pages_mark_dirty_on_put,
-			  shmem->pages_mark_accessed_on_put);
-	shmem->pages = NULL;
+	drm_gem_shmem_update_lru(shmem);
 }
 EXPORT_SYMBOL(drm_gem_shmem_put_pages);
 
@@ -257,7 +334,10 @@ int drm_gem_shmem_pin_locked(struct drm_gem_shmem_object *shmem)
 
 	drm_WARN_ON(shmem->base.dev, shmem->base.import_attach);
 
+	shmem->pages_pin_count++;
 	ret = drm_gem_shmem_get_pages(shmem);
+	if (ret)
+		shmem->pages_pin_count--;
 
 	return ret;
 }
@@ -267,6 +347,10 @@ void drm_gem_shmem_unpin_locked(struct drm_gem_shmem_object *shmem)
 {
 	dma_resv_assert_held(shmem->base.resv);
 
+	if (drm_WARN_ON_ONCE(shmem->base.dev, !shmem->pages_pin_count))
+		return;
+
+	shmem->pages_pin_count--;
 	drm_gem_shmem_put_pages(shmem);
 }
 EXPORT_SYMBOL(drm_gem_shmem_unpin_locked);
@@ -375,6 +459,10 @@ int drm_gem_shmem_vmap(struct drm_gem_shmem_object *shmem,
 		goto err_put_pages;
 	}
 
+	/* A mapped object can neither be evicted nor purged */
+	if (!obj->import_attach)
+		drm_gem_shmem_update_lru(shmem);
+
 	return 0;
 
 err_put_pages:
@@ -382,6 +470,8 @@ int drm_gem_shmem_vmap(struct drm_gem_shmem_object *shmem,
 		drm_gem_shmem_put_pages(shmem);
 err_zero_use:
 	shmem->vmap_use_count = 0;
+	if (!obj->import_attach)
+		drm_gem_shmem_update_lru(shmem);
 
 	return ret;
 }
@@ -416,6 +506,7 @@ void drm_gem_shmem_vunmap(struct drm_gem_shmem_object *shmem,
 			return;
 
 		vunmap(shmem->vaddr);
+		/* This puts the object back on the LRU it now belongs to */
 		drm_gem_shmem_put_pages(shmem);
 	}
 
@@ -458,6 +549,8 @@ int drm_gem_shmem_madvise(struct drm_gem_shmem_object *shmem, int madv)
 
 	madv = shmem->madv;
 
+	drm_gem_shmem_update_lru(shmem);
+
 	return (madv >= 0);
 }
 EXPORT_SYMBOL(drm_gem_shmem_madvise);
@@ -466,19 +559,24 @@ void drm_gem_shmem_purge(struct drm_gem_shmem_object *shmem)
 {
 	struct drm_gem_object *obj = &shmem->base;
 	struct drm_device *dev = obj->dev;
+	struct drm_gem_shmem *shmem_mm = dev->shmem_mm;
 
 	dma_resv_assert_held(shmem->base.resv);
 
 	drm_WARN_ON(obj->dev, !drm_gem_shmem_is_purgeable(shmem));
 
-	dma_unmap_sgtable(dev->dev, shmem->sgt, DMA_BIDIRECTIONAL, 0);
-	sg_free_table(shmem->sgt);
-	kfree(shmem->sgt);
-	shmem->sgt = NULL;
+	/* Evicted objects already dropped their table and their pages */
+	if (shmem->sgt) {
+		dma_unmap_sgtable(dev->dev, shmem->sgt, DMA_BIDIRECTIONAL, 0);
+		sg_free_table(shmem->sgt);
+		kfree(shmem->sgt);
+		shmem->sgt = NULL;
 
-	drm_gem_shmem_put_pages(shmem);
+		drm_gem_shmem_put_pages(shmem);
+	}
 
 	shmem->madv = -1;
+	shmem->evicted = false;
 
 	drm_vma_node_unmap(&obj->vma_node, dev->anon_inode->i_mapping);
 	drm_gem_free_mmap_offset(obj);
@@ -491,9 +589,85 @@ void drm_gem_shmem_purge(struct drm_gem_shmem_object *shmem)
 	shmem_truncate_range(file_inode(obj->filp), 0, (loff_t)-1);
 
 	invalidate_mapping_pages(file_inode(obj->filp)->i_mapping, 0, (loff_t)-1);
+
+	drm_gem_shmem_update_lru(shmem);
+
+	if (shmem_mm) {
+		atomic64_inc(&shmem_mm->stats.purged);
+		/* Other users, like mmap, keep the pages until they let go */
+		if (!shmem->pages)
+			atomic64_add(obj->size >> PAGE_SHIFT,
+				     &shmem_mm->stats.purged_pages);
+	}
 }
 EXPORT_SYMBOL(drm_gem_shmem_purge);
 
+/**
+ * drm_gem_shmem_evict_locked - Release the pages of an idle shmem GEM object
+ * @shmem: shmem GEM object
+ *
+ * This function purges the object if it is purgeable. Otherwise, it drops
+ * the scatter/gather table and the kernel's and userspace's mappings of the
+ * object, and writes its pages back to shmem, from where they can be
+ * swapped out. The pages are brought back on next use of the object.
+ *
+ * Drivers that map the object to the GPU must tear these mappings down
+ * before calling this function, typically from their
+ * &drm_gem_object_funcs.evict callback, which the shrinker calls once the
+ * object is idle.
+ *
+ * Returns:
+ * 0 on success, or -EBUSY if the object is pinned or in use by the CPU.
+ */
+int drm_gem_shmem_evict_locked(struct drm_gem_shmem_object *shmem)
+{
+	struct drm_gem_object *obj = &shmem->base;
+	struct drm_device *dev = obj->dev;
+	struct drm_gem_shmem *shmem_mm = dev->shmem_mm;
+
+	dma_resv_assert_held(shmem->base.resv);
+
+	if (shmem->pages_pin_count)
+		return -EBUSY;
+
+	if (drm_gem_shmem_is_purgeable(shmem)) {
+		drm_gem_shmem_purge(shmem);
+		return 0;
+	}
+
+	if (!drm_gem_shmem_is_evictable(shmem))
+		return -EBUSY;
+
+	/* The table held a reference on the pages, it is rebuilt on next use */
+	if (shmem->sgt) {
+		dma_unmap_sgtable(dev->dev, shmem->sgt, DMA_BIDIRECTIONAL, 0);
+		sg_free_table(shmem->sgt);
+		kfree(shmem->sgt);
+		shmem->sgt = NULL;
+		shmem->pages_use_count--;
+	}
+
+	drm_vma_node_unmap(&obj->vma_node, dev->anon_inode->i_mapping);
+
+	/*
+	 * The GPU may have written to the pages, which shmem would drop
+	 * instead of writing them to swap if they weren't marked as dirty.
+	 */
+	drm_gem_shmem_release_pages(shmem, true, false);
+	shmem->evicted = true;
+
+	drm_gem_shmem_update_lru(shmem);
+
+	if (shmem_mm) {
+		atomic64_inc(&shmem_mm->stats.evicted);
+		atomic64_add(obj->size >> PAGE_SHIFT,
+			     &shmem_mm->stats.evicted_pages);
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(drm_gem_shmem_evict_locked);
+
 /**
  * drm_gem_shmem_dumb_create - Create a dumb shmem buffer object
  * @file: DRM file structure to create the dumb buffer for
@@ -540,12 +714,22 @@ static vm_fault_t drm_gem_shmem_fault(struct vm_fault *vmf)
 	vm_fault_t ret;
 	struct page *page;
 	pgoff_t page_offset;
+	int err;
 
 	/* We don't use vmf->pgoff since that has the fake offset */
 	page_offset = (vmf->address - vma->vm_start) >> PAGE_SHIFT;
 
 	dma_resv_lock(shmem->base.resv, NULL);
 
+	if (shmem->evicted && shmem->madv >= 0) {
+		err = drm_gem_shmem_acquire_pages(shmem);
+		if (err) {
+			ret = vmf_error(err);
+			goto out_unlock;
+		}
+		drm_gem_shmem_update_lru(shmem);
+	}
+
 	if (page_offset >= num_pages ||
 	    drm_WARN_ON_ONCE(obj->dev, !shmem->pages) ||
 	    shmem->madv < 0) {
@@ -556,6 +740,7 @@ static vm_fault_t drm_gem_shmem_fault(struct vm_fault *vmf)
 		ret = vmf_insert_pfn(vma, vmf->address, page_to_pfn(page));
 	}
 
+out_unlock:
 	dma_resv_unlock(shmem->base.resv);
 
 	return ret;
@@ -667,6 +852,8 @@ void drm_gem_shmem_print_info(const struct drm_gem_shmem_object *shmem,
 		return;
 
 	drm_printf_indent(p, indent, "pages_use_count=%u\n", shmem->pages_use_count);
+	drm_printf_indent(p, indent, "pages_pin_count=%u\n", shmem->pages_pin_count);
+	drm_printf_indent(p, indent, "evicted=%d\n", shmem->evicted);
 	drm_printf_indent(p, indent, "vmap_use_count=%u\n", shmem->vmap_use_count);
 	drm_printf_indent(p, indent, "vaddr=%p\n", shmem->vaddr);
 }
@@ -696,14 +883,28 @@ struct sg_table *drm_gem_shmem_get_sg_table(struct drm_gem_shmem_object *shmem)
 }
 EXPORT_SYMBOL_GPL(drm_gem_shmem_get_sg_table);
 
-static struct sg_table *drm_gem_shmem_get_pages_sgt_locked(struct drm_gem_shmem_object *shmem)
+/**
+ * drm_gem_shmem_get_pages_sgt_locked - Like drm_gem_shmem_get_pages_sgt(),
+ *					with the reservation lock held
+ * @shmem: shmem GEM object
+ *
+ * Drivers that map the pages to the GPU call this with the reservation
+ * lock held until the mapping is in place, so that the shrinker can't evict
+ * the pages in between.
+ *
+ * Returns:
+ * A pointer to the scatter/gather table of pinned pages or errno on failure.
+ */
+struct sg_table *drm_gem_shmem_get_pages_sgt_locked(struct drm_gem_shmem_object *shmem)
 {
 	struct drm_gem_object *obj = &shmem->base;
 	int ret;
 	struct sg_table *sgt;
 
-	if (shmem->sgt)
+	if (shmem->sgt) {
+		drm_gem_shmem_update_lru(shmem);
 		return shmem->sgt;
+	}
 
 	drm_WARN_ON(obj->dev, obj->import_attach);
 
@@ -732,6 +933,7 @@ static struct sg_table *drm_gem_shmem_get_pages_sgt_locked(struct drm_gem_shmem_
 	drm_gem_shmem_put_pages(shmem);
 	return ERR_PTR(ret);
 }
+EXPORT_SYMBOL_GPL(drm_gem_shmem_get_pages_sgt_locked);
 
 /**
  * drm_gem_shmem_get_pages_sgt - Pin pages, dma map them, and return a
@@ -799,6 +1001,292 @@ drm_gem_shmem_prime_import_sg_table(struct drm_device *dev,
 }
 EXPORT_SYMBOL_GPL(drm_gem_shmem_prime_import_sg_table);
 
+static void drm_gem_shmem_dmabuf_release(struct dma_buf *dma_buf)
+{
+	struct drm_gem_object *obj = dma_buf->priv;
+
+	/*
+	 * The object let go of its dma-buf when its last handle was closed,
+	 * it may have become evictable or purgeable again.
+	 */
+	dma_resv_lock(obj->resv, NULL);
+	drm_gem_shmem_update_lru(to_drm_gem_shmem_obj(obj));
+	dma_resv_unlock(obj->resv);
+
+	drm_gem_dmabuf_release(dma_buf);
+}
+
+static const struct dma_buf_ops drm_gem_shmem_dmabuf_ops = {
+	.cache_sgt_mapping = true,
+	.attach = drm_gem_map_attach,
+	.detach = drm_gem_map_detach,
+	.map_dma_buf = drm_gem_map_dma_buf,
+	.unmap_dma_buf = drm_gem_unmap_dma_buf,
+	.release = drm_gem_shmem_dmabuf_release,
+	.mmap = drm_gem_dmabuf_mmap,
+	.vmap = drm_gem_dmabuf_vmap,
+	.vunmap = drm_gem_dmabuf_vunmap,
+};
+
+/**
+ * drm_gem_shmem_prime_export - Export a shmem GEM object as a dma-buf
+ * @obj: GEM object to export
+ * @flags: flags like DRM_CLOEXEC and DRM_RDWR
+ *
+ * This function is the &drm_gem_object_funcs.export handler of shmem GEM
+ * objects. It works like drm_gem_prime_export(), and additionally keeps
+ * the object off the shrinker's evictable and purgeable LRUs while the
+ * dma-buf is around.
+ *
+ * Returns:
+ * The new dma-buf on success or an error pointer on failure.
+ */
+struct dma_buf *drm_gem_shmem_prime_export(struct drm_gem_object *obj,
+					   int flags)
+{
+	struct drm_gem_shmem_object *shmem = to_drm_gem_shmem_obj(obj);
+	struct drm_device *dev = obj->dev;
+	struct drm_gem_shmem *shmem_mm = dev->shmem_mm;
+	struct dma_buf_export_info exp_info = {
+		.exp_name = KBUILD_MODNAME, /* white lie for debug */
+		.owner = dev->driver->fops->owner,
+		.ops = &drm_gem_shmem_dmabuf_ops,
+		.size = obj->size,
+		.flags = flags,
+		.priv = obj,
+		.resv = obj->resv,
+	};
+	struct dma_buf *dma_buf;
+
+	dma_buf = drm_gem_dmabuf_export(dev, &exp_info);
+	if (IS_ERR(dma_buf) || !shmem_mm)
+		return dma_buf;
+
+	/*
+	 * obj->dma_buf is only set once this returns, so the LRU can't be
+	 * picked by drm_gem_shmem_update_lru() yet.
+	 */
+	dma_resv_lock(obj->resv, NULL);
+	if (shmem->evicted)
+		drm_gem_lru_move_tail(&shmem_mm->lru_evicted, obj);
+	else if (shmem->pages)
+		drm_gem_lru_move_tail(&shmem_mm->lru_pinned, obj);
+	dma_resv_unlock(obj->resv);
+
+	return dma_buf;
+}
+EXPORT_SYMBOL_GPL(drm_gem_shmem_prime_export);
+
+static bool drm_gem_shmem_can_swap(void)
+{
+	return get_nr_swap_pages() > 0;
+}
+
+static bool drm_gem_shmem_can_block(struct shrink_control *sc)
+{
+	if (!(sc->gfp_mask & __GFP_DIRECT_RECLAIM))
+		return false;
+	return current_is_kswapd() || (sc->gfp_mask & __GFP_RECLAIM);
+}
+
+static unsigned long
+drm_gem_shmem_shrinker_count(struct shrinker *shrinker, struct shrink_control *sc)
+{
+	struct drm_gem_shmem *shmem_mm = shrinker->private_data;
+	unsigned long count = READ_ONCE(shmem_mm->lru_purgeable.count);
+
+	if (drm_gem_shmem_can_swap())
+		count += READ_ONCE(shmem_mm->lru_evictable.count);
+
+	return count ?: SHRINK_EMPTY;
+}
+
+static bool drm_gem_shmem_shrinker_purge(struct drm_gem_object *obj)
+{
+	struct drm_gem_shmem_object *shmem = to_drm_gem_shmem_obj(obj);
+
+	/* E.g. exported since it was put on the LRU, file it where it belongs */
+	if (!drm_gem_shmem_is_purgeable(shmem)) {
+		drm_gem_shmem_update_lru(shmem);
+		return false;
+	}
+
+	return !drm_gem_evict(obj);
+}
+
+static bool drm_gem_shmem_shrinker_evict(struct drm_gem_object *obj)
+{
+	struct drm_gem_shmem_object *shmem = to_drm_gem_shmem_obj(obj);
+
+	if (!drm_gem_shmem_is_evictable(shmem)) {
+		drm_gem_shmem_update_lru(shmem);
+		return false;
+	}
+
+	return !drm_gem_evict(obj);
+}
+
+static bool drm_gem_shmem_wait_for_idle(struct drm_gem_object *obj)
+{
+	return dma_resv_wait_timeout(obj->resv, DMA_RESV_USAGE_READ, false, 10) > 0;
+}
+
+static bool drm_gem_shmem_shrinker_active_purge(struct drm_gem_object *obj)
+{
+	if (!drm_gem_shmem_wait_for_idle(obj))
+		return false;
+
+	return drm_gem_shmem_shrinker_purge(obj);
+}
+
+static bool drm_gem_shmem_shrinker_active_evict(struct drm_gem_object *obj)
+{
+	if (!drm_gem_shmem_wait_for_idle(obj))
+		return false;
+
+	return drm_gem_shmem_shrinker_evict(obj);
+}
+
+static unsigned long
+drm_gem_shmem_shrinker_scan(struct shrinker *shrinker, struct shrink_control *sc)
+{
+	struct drm_gem_shmem *shmem_mm = shrinker->private_data;
+	bool can_swap = drm_gem_shmem_can_swap();
+	bool can_block = drm_gem_shmem_can_block(sc);
+	struct {
+		struct drm_gem_lru *lru;
+		bool (*shrink)(struct drm_gem_object *obj);
+		bool cond;
+	} stages[] = {
+		/* Stages of progressively more expensive reclaim: */
+		{ &shmem_mm->lru_purgeable, drm_gem_shmem_shrinker_purge, true },
+		{ &shmem_mm->lru_evictable, drm_gem_shmem_shrinker_evict, can_swap },
+		{ &shmem_mm->lru_purgeable, drm_gem_shmem_shrinker_active_purge,
+		  can_block },
+		{ &shmem_mm->lru_evictable, drm_gem_shmem_shrinker_active_evict,
+		  can_swap && can_block },
+	};
+	unsigned long freed = 0, remaining = 0;
+	long nr = sc->nr_to_scan;
+	u64 start, ns, max;
+	unsigned int i;
+
+	start = ktime_get_ns();
+
+	for (i = 0; nr > 0 && i < ARRAY_SIZE(stages); i++) {
+		unsigned long stage_freed;
+
+		if (!stages[i].cond)
+			continue;
+
+		stage_freed = drm_gem_lru_scan(stages[i].lru, nr, &remaining,
+					       stages[i].shrink);
+		nr -= stage_freed;
+		freed += stage_freed;
+	}
+
+	ns = ktime_get_ns() - start;
+	atomic64_inc(&shmem_mm->stats.scans);
+	atomic64_add(ns, &shmem_mm->stats.scan_ns);
+	max = atomic64_read(&shmem_mm->stats.scan_ns_max);
+	while (ns > max &&
+	       !atomic64_try_cmpxchg(&shmem_mm->stats.scan_ns_max, &max, ns))
+		;
+
+	return (freed > 0 && remaining > 0) ? freed : SHRINK_STOP;
+}
+
+static int drm_gem_shmem_shrinker_show(struct seq_file *m, void *data)
+{
+	struct drm_debugfs_entry *entry = m->private;
+	struct drm_gem_shmem *shmem_mm = entry->dev->shmem_mm;
+	struct drm_printer p = drm_seq_file_printer(m);
+	u64 scans = atomic64_read(&shmem_mm->stats.scans);
+	u64 scan_ns = atomic64_read(&shmem_mm->stats.scan_ns);
+
+	drm_printf(&p, "pinned pages: %ld\n", READ_ONCE(shmem_mm->lru_pinned.count));
+	drm_printf(&p, "evictable pages: %ld\n", READ_ONCE(shmem_mm->lru_evictable.count));
+	drm_printf(&p, "purgeable pages: %ld\n", READ_ONCE(shmem_mm->lru_purgeable.count));
+	drm_printf(&p, "evicted pages: %ld\n", READ_ONCE(shmem_mm->lru_evicted.count));
+	drm_printf(&p, "purged: %lld objects, %lld pages\n",
+		   atomic64_read(&shmem_mm->stats.purged),
+		   atomic64_read(&shmem_mm->stats.purged_pages));
+	drm_printf(&p, "evicted: %lld objects, %lld pages\n",
+		   atomic64_read(&shmem_mm->stats.evicted),
+		   atomic64_read(&shmem_mm->stats.evicted_pages));
+	drm_printf(&p, "swapped in: %lld objects\n",
+		   atomic64_read(&shmem_mm->stats.swapped_in));
+	drm_printf(&p, "scans: %llu\n", scans);
+	drm_printf(&p, "scan latency: %llu ns avg, %lld ns max\n",
+		   scans ? div64_u64(scan_ns, scans) : 0,
+		   atomic64_read(&shmem_mm->stats.scan_ns_max));
+
+	return 0;
+}
+
+static void drm_gem_shmem_release(struct drm_device *dev, void *ptr)
+{
+	struct drm_gem_shmem *shmem_mm = ptr;
+
+	shrinker_free(shmem_mm->shrinker);
+	dev->shmem_mm = NULL;
+}
+
+/**
+ * drmm_gem_shmem_init - Set up the memory shrinker of shmem GEM objects
+ * @dev: DRM device
+ *
+ * This function registers a shrinker for the shmem GEM objects of @dev, which
+ * purges and evicts idle objects under memory pressure, see the overview.
+ * Reclaim statistics are reported in the "shmem_shrinker" debugfs file of
+ * the device, so this has to be called before drm_dev_register(). The
+ * shrinker is unregistered when the device is released.
+ *
+ * Returns:
+ * 0 on success or a negative error code on failure.
+ */
+int drmm_gem_shmem_init(struct drm_device *dev)
+{
+	struct drm_gem_shmem *shmem_mm;
+	int ret;
+
+	if (drm_WARN_ON(dev, dev->shmem_mm))
+		return -EBUSY;
+
+	shmem_mm = drmm_kzalloc(dev, sizeof(*shmem_mm), GFP_KERNEL);
+	if (!shmem_mm)
+		return -ENOMEM;
+
+	ret = drmm_mutex_init(dev, &shmem_mm->lock);
+	if (ret)
+		return ret;
+
+	drm_gem_lru_init(&shmem_mm->lru_pinned, &shmem_mm->lock);
+	drm_gem_lru_init(&shmem_mm->lru_evictable, &shmem_mm->lock);
+	drm_gem_lru_init(&shmem_mm->lru_purgeable, &shmem_mm->lock);
+	drm_gem_lru_init(&shmem_mm->lru_evicted, &shmem_mm->lock);
+
+	shmem_mm->shrinker = shrinker_alloc(0, "drm-shmem:%s", dev_name(dev->dev));
+	if (!shmem_mm->shrinker)
+		return -ENOMEM;
+
+	shmem_mm->shrinker->count_objects = drm_gem_shmem_shrinker_count;
+	shmem_mm->shrinker->scan_objects = drm_gem_shmem_shrinker_scan;
+	shmem_mm->shrinker->private_data = shmem_mm;
+
+	dev->shmem_mm = shmem_mm;
+	shrinker_register(shmem_mm->shrinker);
+
+	ret = drmm_add_action_or_reset(dev, drm_gem_shmem_release, shmem_mm);
+	if (ret)
+		return ret;
+
+	drm_debugfs_add_file(dev, "shmem_shrinker", drm_gem_shmem_shrinker_show, NULL);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(drmm_gem_shmem_init);
+
 MODULE_DESCRIPTION("DRM SHMEM memory-management helpers");
 MODULE_IMPORT_NS("DMA_BUF");
 MODULE_LICENSE("GPL v2");
@@ -19,16 +19,6 @@ static void panfrost_gem_free_object(struct drm_gem_object *obj)
 	struct panfrost_gem_object *bo = to_panfrost_bo(obj);
 	struct panfrost_device *pfdev = obj->dev->dev_private;
 
-	/*
-	 * Make sure the BO is no longer inserted in the shrinker list before
-	 * taking care of the destruction itself. If we don't do that we have a
-	 * race condition between this function and what's done in
-	 * panfrost_gem_shrinker_scan().
-	 */
-	mutex_lock(&pfdev->shrinker_lock);
-	list_del_init(&bo->base.madv_list);
-	mutex_unlock(&pfdev->shrinker_lock);
-
 	/*
 	 * If we still have mappings attached to the BO, there's a problem in
 	 * our refcounting.
@@ -149,17 +139,24 @@ int panfrost_gem_open(struct drm_gem_object *obj, struct drm_file *file_priv)
 	if (ret)
 		goto err;
 
-	if (!bo->is_heap) {
-		ret = panfrost_mmu_map(mapping);
-		if (ret)
-			goto err;
-	}
-
+	/*
+	 * Listed before it is mapped, so that the shrinker unmaps it if it
+	 * evicts the BO right after.
+	 */
 	mutex_lock(&bo->mappings.lock);
 	WARN_ON(bo->base.madv != PANFROST_MADV_WILLNEED);
 	list_add_tail(&mapping->node, &bo->mappings.list);
 	mutex_unlock(&bo->mappings.lock);
 
+	if (!bo->is_heap) {
+		ret = panfrost_mmu_map(mapping);
+		if (ret) {
+			mutex_lock(&bo->mappings.lock);
+			list_del(&mapping->node);
+			mutex_unlock(&bo->mappings.lock);
+		}
+	}
+
 err:
 	if (ret)
 		panfrost_gem_mapping_put(mapping);
@@ -195,6 +192,44 @@ static int panfrost_gem_pin(struct drm_gem_object *obj)
 	return drm_gem_shmem_pin_locked(&bo->base);
 }
 
+/*
+ * Called by the shmem shrinker, with the reservation held, once the BO's
+ * fences have signaled. Purged BOs lose their GPU VA like before, evicted
+ * ones keep it and are mapped again by panfrost_mmu_map() on next submit.
+ */
+static int panfrost_gem_evict(struct drm_gem_object *obj)
+{
+	struct panfrost_gem_object *bo = to_panfrost_bo(obj);
+	struct panfrost_gem_mapping *mapping;
+	bool purge = drm_gem_shmem_is_purgeable(&bo->base);
+	int ret;
+
+	/* Jobs being set up hold a use count before they add their fence */
+	if (atomic_read(&bo->gpu_usecount))
+		return -EBUSY;
+
+	/* Heap BOs get their pages on GPU faults, they can only be purged */
+	if (!purge && (bo->is_heap || !drm_gem_shmem_is_evictable(&bo->base)))
+		return -EBUSY;
+
+	if (!mutex_trylock(&bo->mappings.lock))
+		return -EBUSY;
+
+	if (purge) {
+		panfrost_gem_teardown_mappings_locked(bo);
+	} else {
+		list_for_each_entry(mapping, &bo->mappings.list, node) {
+			if (mapping->active)
+				panfrost_mmu_unmap(mapping);
+		}
+	}
+	ret = drm_gem_shmem_evict_locked(&bo->base);
+
+	mutex_unlock(&bo->mappings.lock);
+
+	return ret;
+}
+
 static enum drm_gem_object_status panfrost_gem_status(struct drm_gem_object *obj)
 {
 	struct panfrost_gem_object *bo = to_panfrost_bo(obj);
@@ -234,6 +269,8 @@ static const struct drm_gem_object_funcs panfrost_gem_funcs = {
 	.vmap = drm_gem_shmem_object_vmap,
 	.vunmap = drm_gem_shmem_object_vunmap,
 	.mmap = drm_gem_shmem_object_mmap,
+	.evict = panfrost_gem_evict,
+	.export = drm_gem_shmem_prime_export,
 	.status = panfrost_gem_status,
 	.rss = panfrost_gem_rss,
 	.vm_ops = &drm_gem_shmem_vm_ops,
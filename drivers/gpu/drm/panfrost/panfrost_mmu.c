@@ -328,22 +328,36 @@ int panfrost_mmu_map(struct panfrost_gem_mapping *mapping)
 	struct panfrost_device *pfdev = to_panfrost_device(obj->dev);
 	struct sg_table *sgt;
 	int prot = IOMMU_READ | IOMMU_WRITE;
-
-	if (WARN_ON(mapping->active))
-		return 0;
+	int ret;
 
 	if (bo->noexec)
 		prot |= IOMMU_NOEXEC;
 
-	sgt = drm_gem_shmem_get_pages_sgt(shmem);
-	if (WARN_ON(IS_ERR(sgt)))
-		return PTR_ERR(sgt);
+	/*
+	 * The reservation keeps the shrinker from evicting the pages before
+	 * they are mapped. Mappings it evicted are mapped again here, purged
+	 * ones are left alone.
+	 */
+	ret = dma_resv_lock_interruptible(obj->resv, NULL);
+	if (ret)
+		return ret;
+
+	if (mapping->active || shmem->madv < 0)
+		goto out_unlock;
+
+	sgt = drm_gem_shmem_get_pages_sgt_locked(shmem);
+	if (WARN_ON(IS_ERR(sgt))) {
+		ret = PTR_ERR(sgt);
+		goto out_unlock;
+	}
 
 	mmu_map_sg(pfdev, mapping->mmu, mapping->mmnode.start << PAGE_SHIFT,
 		   prot, sgt);
 	mapping->active = true;
 
-	return 0;
+out_unlock:
+	dma_resv_unlock(obj->resv);
+	return ret;
 }
 
 void panfrost_mmu_unmap(struct panfrost_gem_mapping *mapping)
@@ -9,6 +9,7 @@
 
 #include <linux/dma-buf.h>
 #include <linux/iosys-map.h>
+#include <linux/shrinker.h>
 #include <linux/sizes.h>
 
 #include <kunit/test.h>
@@ -335,6 +336,263 @@ static void drm_gem_shmem_test_purge(struct kunit *test)
 	KUNIT_EXPECT_EQ(test, shmem->madv, -1);
 }
 
+/*
+ * Test the LRU a shmem GEM object is kept on by the shrinker. The test
+ * case succeeds if the object is only tracked once it has pages, and
+ * moves between the evictable, pinned and purgeable LRUs as it gets
+ * pinned, unpinned and marked as purgeable.
+ */
+static void drm_gem_shmem_test_shrinker_lru(struct kunit *test)
+{
+	struct drm_device *drm_dev = test->priv;
+	struct drm_gem_shmem_object *shmem;
+	struct drm_gem_shmem *shmem_mm;
+	struct sg_table *sgt;
+	int ret;
+
+	ret = drmm_gem_shmem_init(drm_dev);
+	KUNIT_ASSERT_EQ(test, ret, 0);
+	shmem_mm = drm_dev->shmem_mm;
+	KUNIT_ASSERT_NOT_NULL(test, shmem_mm);
+
+	shmem = drm_gem_shmem_create(drm_dev, TEST_SIZE);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, shmem);
+	KUNIT_EXPECT_NULL(test, shmem->base.lru);
+
+	ret = kunit_add_action_or_reset(test, drm_gem_shmem_free_wrapper, shmem);
+	KUNIT_ASSERT_EQ(test, ret, 0);
+
+	/* The scatter/gather table will be freed by drm_gem_shmem_free */
+	sgt = drm_gem_shmem_get_pages_sgt(shmem);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, sgt);
+	KUNIT_EXPECT_PTR_EQ(test, shmem->base.lru, &shmem_mm->lru_evictable);
+	KUNIT_EXPECT_EQ(test, shmem_mm->lru_evictable.count,
+			TEST_SIZE >> PAGE_SHIFT);
+
+	ret = drm_gem_shmem_pin(shmem);
+	KUNIT_ASSERT_EQ(test, ret, 0);
+	KUNIT_EXPECT_PTR_EQ(test, shmem->base.lru, &shmem_mm->lru_pinned);
+	KUNIT_EXPECT_EQ(test, shmem_mm->lru_evictable.count, 0);
+
+	drm_gem_shmem_unpin(shmem);
+	KUNIT_EXPECT_PTR_EQ(test, shmem->base.lru, &shmem_mm->lru_evictable);
+
+	dma_resv_lock(shmem->base.resv, NULL);
+	ret = drm_gem_shmem_madvise(shmem, 1);
+	dma_resv_unlock(shmem->base.resv);
+	KUNIT_EXPECT_TRUE(test, ret);
+	KUNIT_EXPECT_PTR_EQ(test, shmem->base.lru, &shmem_mm->lru_purgeable);
+	KUNIT_EXPECT_EQ(test, shmem_mm->lru_purgeable.count,
+			TEST_SIZE >> PAGE_SHIFT);
+}
+
+/*
+ * Test purging a shmem GEM object from the shrinker. The test case
+ * succeeds if the shrinker reports the pages of an object marked as
+ * purgeable, and a scan releases them and accounts for the purge.
+ */
+static void drm_gem_shmem_test_shrinker_purge(struct kunit *test)
+{
+	struct drm_device *drm_dev = test->priv;
+	struct shrink_control sc = {
+		.gfp_mask = GFP_KERNEL,
+		.nr_to_scan = TEST_SIZE >> PAGE_SHIFT,
+	};
+	struct drm_gem_shmem_object *shmem;
+	struct drm_gem_shmem *shmem_mm;
+	struct shrinker *shrinker;
+	struct sg_table *sgt;
+	int ret;
+
+	ret = drmm_gem_shmem_init(drm_dev);
+	KUNIT_ASSERT_EQ(test, ret, 0);
+	shmem_mm = drm_dev->shmem_mm;
+	shrinker = shmem_mm->shrinker;
+
+	shmem = drm_gem_shmem_create(drm_dev, TEST_SIZE);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, shmem);
+
+	ret = kunit_add_action_or_reset(test, drm_gem_shmem_free_wrapper, shmem);
+	KUNIT_ASSERT_EQ(test, ret, 0);
+
+	dma_resv_lock(shmem->base.resv, NULL);
+	ret = drm_gem_shmem_madvise(shmem, 1);
+	dma_resv_unlock(shmem->base.resv);
+	KUNIT_EXPECT_TRUE(test, ret);
+
+	/* The scatter/gather table will be freed by drm_gem_shmem_free */
+	sgt = drm_gem_shmem_get_pages_sgt(shmem);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, sgt);
+	KUNIT_EXPECT_GE(test, shrinker->count_objects(shrinker, &sc),
+			TEST_SIZE >> PAGE_SHIFT);
+
+	shrinker->scan_objects(shrinker, &sc);
+	KUNIT_EXPECT_NULL(test, shmem->pages);
+	KUNIT_EXPECT_NULL(test, shmem->sgt);
+	KUNIT_EXPECT_EQ(test, shmem->madv, -1);
+	KUNIT_EXPECT_NULL(test, shmem->base.lru);
+	KUNIT_EXPECT_EQ(test, atomic64_read(&shmem_mm->stats.purged), 1);
+	KUNIT_EXPECT_EQ(test, atomic64_read(&shmem_mm->stats.purged_pages),
+			TEST_SIZE >> PAGE_SHIFT);
+	KUNIT_EXPECT_EQ(test, atomic64_read(&shmem_mm->stats.scans), 1);
+}
+
+/*
+ * Test evicting a shmem GEM object and bringing it back. First, write a
+ * test pattern to the object and get its scatter/gather table. Then,
+ * evict it and assert that the pages and the table are gone. Finally,
+ * map the object again and check that the test pattern was preserved.
+ */
+static void drm_gem_shmem_test_evict(struct kunit *test)
+{
+	struct drm_device *drm_dev = test->priv;
+	struct drm_gem_shmem_object *shmem;
+	struct drm_gem_shmem *shmem_mm;
+	struct iosys_map map;
+	struct sg_table *sgt;
+	int ret, i;
+
+	ret = drmm_gem_shmem_init(drm_dev);
+	KUNIT_ASSERT_EQ(test, ret, 0);
+	shmem_mm = drm_dev->shmem_mm;
+
+	shmem = drm_gem_shmem_create(drm_dev, TEST_SIZE);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, shmem);
+
+	ret = kunit_add_action_or_reset(test, drm_gem_shmem_free_wrapper, shmem);
+	KUNIT_ASSERT_EQ(test, ret, 0);
+
+	dma_resv_lock(shmem->base.resv, NULL);
+	ret = drm_gem_shmem_vmap(shmem, &map);
+	KUNIT_ASSERT_EQ(test, ret, 0);
+	iosys_map_memset(&map, 0, TEST_BYTE, TEST_SIZE);
+	drm_gem_shmem_vunmap(shmem, &map);
+	dma_resv_unlock(shmem->base.resv);
+
+	sgt = drm_gem_shmem_get_pages_sgt(shmem);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, sgt);
+	KUNIT_EXPECT_TRUE(test, drm_gem_shmem_is_evictable(shmem));
+
+	dma_resv_lock(shmem->base.resv, NULL);
+	ret = drm_gem_shmem_evict_locked(shmem);
+	dma_resv_unlock(shmem->base.resv);
+	KUNIT_ASSERT_EQ(test, ret, 0);
+	KUNIT_EXPECT_TRUE(test, shmem->evicted);
+	KUNIT_EXPECT_NULL(test, shmem->pages);
+	KUNIT_EXPECT_NULL(test, shmem->sgt);
+	KUNIT_EXPECT_EQ(test, shmem->pages_use_count, 0);
+	KUNIT_EXPECT_PTR_EQ(test, shmem->base.lru, &shmem_mm->lru_evicted);
+	KUNIT_EXPECT_EQ(test, atomic64_read(&shmem_mm->stats.evicted), 1);
+
+	dma_resv_lock(shmem->base.resv, NULL);
+	ret = drm_gem_shmem_vmap(shmem, &map);
+	KUNIT_ASSERT_EQ(test, ret, 0);
+	KUNIT_EXPECT_FALSE(test, shmem->evicted);
+	KUNIT_EXPECT_NOT_NULL(test, shmem->pages);
+	for (i = 0; i < TEST_SIZE; i++)
+		KUNIT_EXPECT_EQ(test, iosys_map_rd(&map, i, u8), TEST_BYTE);
+	drm_gem_shmem_vunmap(shmem, &map);
+	dma_resv_unlock(shmem->base.resv);
+	KUNIT_EXPECT_EQ(test, atomic64_read(&shmem_mm->stats.swapped_in), 1);
+}
+
+/*
+ * Test purging an evicted shmem GEM object. The test case succeeds if
+ * the object moves from the evicted to the purgeable LRU once it is
+ * marked as purgeable, and the shrinker then purges it.
+ */
+static void drm_gem_shmem_test_evict_purge(struct kunit *test)
+{
+	struct drm_device *drm_dev = test->priv;
+	struct shrink_control sc = {
+		.gfp_mask = GFP_KERNEL,
+		.nr_to_scan = TEST_SIZE >> PAGE_SHIFT,
+	};
+	struct drm_gem_shmem_object *shmem;
+	struct drm_gem_shmem *shmem_mm;
+	struct shrinker *shrinker;
+	struct sg_table *sgt;
+	int ret;
+
+	ret = drmm_gem_shmem_init(drm_dev);
+	KUNIT_ASSERT_EQ(test, ret, 0);
+	shmem_mm = drm_dev->shmem_mm;
+	shrinker = shmem_mm->shrinker;
+
+	shmem = drm_gem_shmem_create(drm_dev, TEST_SIZE);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, shmem);
+
+	ret = kunit_add_action_or_reset(test, drm_gem_shmem_free_wrapper, shmem);
+	KUNIT_ASSERT_EQ(test, ret, 0);
+
+	sgt = drm_gem_shmem_get_pages_sgt(shmem);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, sgt);
+
+	dma_resv_lock(shmem->base.resv, NULL);
+	ret = drm_gem_shmem_evict_locked(shmem);
+	KUNIT_ASSERT_EQ(test, ret, 0);
+	KUNIT_EXPECT_PTR_EQ(test, shmem->base.lru, &shmem_mm->lru_evicted);
+
+	ret = drm_gem_shmem_madvise(shmem, 1);
+	KUNIT_EXPECT_TRUE(test, ret);
+	KUNIT_EXPECT_TRUE(test, drm_gem_shmem_is_purgeable(shmem));
+	KUNIT_EXPECT_PTR_EQ(test, shmem->base.lru, &shmem_mm->lru_purgeable);
+	dma_resv_unlock(shmem->base.resv);
+
+	shrinker->scan_objects(shrinker, &sc);
+	KUNIT_EXPECT_FALSE(test, shmem->evicted);
+	KUNIT_EXPECT_NULL(test, shmem->pages);
+	KUNIT_EXPECT_EQ(test, shmem->madv, -1);
+	KUNIT_EXPECT_NULL(test, shmem->base.lru);
+	KUNIT_EXPECT_EQ(test, atomic64_read(&shmem_mm->stats.purged), 1);
+}
+
+/*
+ * Test that pinned and vmapped shmem GEM objects can't be evicted. The
+ * test case succeeds if eviction fails with -EBUSY and the pages are
+ * kept while the object is pinned or mapped.
+ */
+static void drm_gem_shmem_test_evict_pinned(struct kunit *test)
+{
+	struct drm_device *drm_dev = test->priv;
+	struct drm_gem_shmem_object *shmem;
+	struct iosys_map map;
+	int ret;
+
+	ret = drmm_gem_shmem_init(drm_dev);
+	KUNIT_ASSERT_EQ(test, ret, 0);
+
+	shmem = drm_gem_shmem_create(drm_dev, TEST_SIZE);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, shmem);
+
+	ret = kunit_add_action_or_reset(test, drm_gem_shmem_free_wrapper, shmem);
+	KUNIT_ASSERT_EQ(test, ret, 0);
+
+	ret = drm_gem_shmem_pin(shmem);
+	KUNIT_ASSERT_EQ(test, ret, 0);
+	KUNIT_EXPECT_EQ(test, shmem->pages_pin_count, 1);
+	KUNIT_EXPECT_FALSE(test, drm_gem_shmem_is_evictable(shmem));
+
+	dma_resv_lock(shmem->base.resv, NULL);
+	ret = drm_gem_shmem_evict_locked(shmem);
+	dma_resv_unlock(shmem->base.resv);
+	KUNIT_EXPECT_EQ(test, ret, -EBUSY);
+	KUNIT_EXPECT_NOT_NULL(test, shmem->pages);
+
+	drm_gem_shmem_unpin(shmem);
+	KUNIT_EXPECT_EQ(test, shmem->pages_pin_count, 0);
+
+	dma_resv_lock(shmem->base.resv, NULL);
+	ret = drm_gem_shmem_vmap(shmem, &map);
+	KUNIT_ASSERT_EQ(test, ret, 0);
+	KUNIT_EXPECT_FALSE(test, drm_gem_shmem_is_evictable(shmem));
+	ret = drm_gem_shmem_evict_locked(shmem);
+	KUNIT_EXPECT_EQ(test, ret, -EBUSY);
+	KUNIT_EXPECT_NOT_NULL(test, shmem->pages);
+	drm_gem_shmem_vunmap(shmem, &map);
+	dma_resv_unlock(shmem->base.resv);
+}
+
 static int drm_gem_shmem_test_init(struct kunit *test)
 {
 	struct device *dev;
@@ -367,6 +625,11 @@ static struct kunit_case drm_gem_shmem_test_cases[] = {
 	KUNIT_CASE(drm_gem_shmem_test_get_sg_table),
 	KUNIT_CASE(drm_gem_shmem_test_madvise),
 	KUNIT_CASE(drm_gem_shmem_test_purge),
+	KUNIT_CASE(drm_gem_shmem_test_shrinker_lru),
+	KUNIT_CASE(drm_gem_shmem_test_shrinker_purge),
+	KUNIT_CASE(drm_gem_shmem_test_evict),
+	KUNIT_CASE(drm_gem_shmem_test_evict_purge),
+	KUNIT_CASE(drm_gem_shmem_test_evict_pinned),
 	{}
 };
 
@@ -0,0 +1,259 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Page tables of the Rockchip IOMMU
+ *
+ * Map and unmap work on ranges spanning any number of page tables, and the
+ * entries written to a page table are flushed at once. Shooting down the
+ * IOTLB is left to the caller.
+ *
+ * rk_pgtable_map() and rk_pgtable_unmap() run under the caller's lock, and
+ * the former only fills page tables which are already there. Page tables
+ * are created by rk_pgtable_map_pages(): as they are only freed with the
+ * directory, it looks for a missing one without the lock, allocates it, and
+ * takes the lock through the mem ops to install and fill it, one page table
+ * at a time.
+ */
+
+#include <kunit/visibility.h>
+#include <linux/errno.h>
+#include <linux/minmax.h>
+#include <linux/mm.h>
+#include <linux/printk.h>
+
+#include "rockchip-iommu.h"
+
+static u32 *rk_pgtable_pt(struct rk_pgtable *pgt, u32 dte)
+{
+	return phys_to_virt(pgt->fmt->pt_address(dte));
+}
+
+/* Number of entries from @iova to the end of its page table, within @size */
+static unsigned int rk_pgtable_span(dma_addr_t iova, size_t size)
+{
+	return min_t(size_t, NUM_PT_ENTRIES - rk_iova_pte_index(iova),
+		     size / SPAGE_SIZE);
+}
+
+int rk_pgtable_init(struct rk_pgtable *pgt, gfp_t gfp)
+{
+	pgt->dt = pgt->mem->alloc_table(pgt, gfp, &pgt->dt_dma);
+
+	return pgt->dt ? 0 : -ENOMEM;
+}
+EXPORT_SYMBOL_IF_KUNIT(rk_pgtable_init);
+
+void rk_pgtable_free(struct rk_pgtable *pgt)
+{
+	int i;
+
+	for (i = 0; i < NUM_DT_ENTRIES; i++) {
+		u32 dte = pgt->dt[i];
+
+		if (rk_dte_is_pt_valid(dte))
+			pgt->mem->free_table(pgt, rk_pgtable_pt(pgt, dte),
+					     pgt->fmt->pt_address(dte));
+	}
+
+	pgt->mem->free_table(pgt, pgt->dt, pgt->dt_dma);
+	pgt->dt = NULL;
+}
+EXPORT_SYMBOL_IF_KUNIT(rk_pgtable_free);
+
+size_t rk_pgtable_unmap(struct rk_pgtable *pgt, dma_addr_t iova, size_t size)
+{
+	size_t unmapped = 0;
+
+	while (unmapped < size) {
+		dma_addr_t cur = iova + unmapped;
+		unsigned int pte_index = rk_iova_pte_index(cur);
+		unsigned int pte_total = rk_pgtable_span(cur, size - unmapped);
+		unsigned int pte_count;
+		u32 dte, *pte_addr;
+
+		dte = pgt->dt[rk_iova_dte_index(cur)];
+		if (!rk_dte_is_pt_valid(dte))
+			break;
+
+		pte_addr = rk_pgtable_pt(pgt, dte) + pte_index;
+		for (pte_count = 0; pte_count < pte_total; pte_count++) {
+			u32 pte = pte_addr[pte_count];
+
+			if (!rk_pte_is_page_valid(pte))
+				break;
+
+			pte_addr[pte_count] = rk_mk_pte_invalid(pte);
+		}
+
+		if (pte_count)
+			pgt->mem->flush(pgt, pgt->fmt->pt_address(dte) +
+					pte_index * sizeof(u32), pte_count);
+
+		unmapped += pte_count * SPAGE_SIZE;
+		if (pte_count < pte_total)
+			break;
+	}
+
+	return unmapped;
+}
+EXPORT_SYMBOL_IF_KUNIT(rk_pgtable_unmap);
+
+bool rk_pgtable_has_pt(struct rk_pgtable *pgt, dma_addr_t iova)
+{
+	return rk_dte_is_pt_valid(READ_ONCE(pgt->dt[rk_iova_dte_index(iova)]));
+}
+EXPORT_SYMBOL_IF_KUNIT(rk_pgtable_has_pt);
+
+/*
+ * Installs @table as the page table of @iova. Returns false, leaving @table
+ * to the caller, if someone else installed one in the meantime.
+ */
+bool rk_pgtable_set_pt(struct rk_pgtable *pgt, dma_addr_t iova, u32 *table,
+		       dma_addr_t dma)
+{
+	u32 dte_index = rk_iova_dte_index(iova);
+
+	if (rk_dte_is_pt_valid(pgt->dt[dte_index]))
+		return false;
+
+	WRITE_ONCE(pgt->dt[dte_index], pgt->fmt->mk_dtentries(dma));
+	pgt->mem->flush(pgt, pgt->dt_dma + dte_index * sizeof(u32), 1);
+
+	return true;
+}
+EXPORT_SYMBOL_IF_KUNIT(rk_pgtable_set_pt);
+
+/*
+ * Maps the whole range or nothing: on error, the entries written so far are
+ * invalidated again, and *@mapped is left at 0. The page tables of the range
+ * must all be there, see rk_pgtable_map_pages().
+ */
+int rk_pgtable_map(struct rk_pgtable *pgt, dma_addr_t iova, phys_addr_t paddr,
+		   size_t size, int prot, size_t *mapped)
+{
+	size_t done = 0;
+	int ret = 0;
+
+	while (done < size) {
+		dma_addr_t cur = iova + done;
+		unsigned int pte_index = rk_iova_pte_index(cur);
+		unsigned int pte_total = rk_pgtable_span(cur, size - done);
+		unsigned int pte_count;
+		u32 dte, *pte_addr;
+
+		dte = pgt->dt[rk_iova_dte_index(cur)];
+		if (!rk_dte_is_pt_valid(dte)) {
+			ret = -ENOENT;
+			break;
+		}
+
+		pte_addr = rk_pgtable_pt(pgt, dte) + pte_index;
+		for (pte_count = 0; pte_count < pte_total; pte_count++) {
+			if (rk_pte_is_page_valid(pte_addr[pte_count])) {
+				ret = -EADDRINUSE;
+				break;
+			}
+
+			pte_addr[pte_count] = pgt->fmt->mk_ptentries(paddr + done,
+								    prot);
+			done += SPAGE_SIZE;
+		}
+
+		if (pte_count)
+			pgt->mem->flush(pgt, pgt->fmt->pt_address(dte) +
+					pte_index * sizeof(u32), pte_count);
+
+		if (ret) {
+			phys_addr_t page_phys = pgt->fmt->pt_address(pte_addr[pte_count]);
+			dma_addr_t busy = iova + done;
+			phys_addr_t busy_paddr = paddr + done;
+
+			pr_err("iova: %pad already mapped to %pa cannot remap to phys: %pa prot: %#x\n",
+			       &busy, &page_phys, &busy_paddr, prot);
+			break;
+		}
+	}
+
+	if (ret) {
+		rk_pgtable_unmap(pgt, iova, done);
+		return ret;
+	}
+
+	*mapped = done;
+
+	return 0;
+}
+EXPORT_SYMBOL_IF_KUNIT(rk_pgtable_map);
+
+/*
+ * Like rk_pgtable_map(), but creates the missing page tables, allocated with
+ * @gfp, and takes the lock itself, once per page table so that it isn't held
+ * over the whole range.
+ */
+int rk_pgtable_map_pages(struct rk_pgtable *pgt, dma_addr_t iova,
+			 phys_addr_t paddr, size_t size, int prot, gfp_t gfp,
+			 size_t *mapped)
+{
+	size_t done = 0, pt_mapped;
+	unsigned long flags;
+	int ret = 0;
+
+	while (done < size) {
+		dma_addr_t cur = iova + done;
+		size_t chunk = rk_pgtable_span(cur, size - done) * SPAGE_SIZE;
+		dma_addr_t pt_dma;
+		u32 *pt = NULL;
+
+		if (!rk_pgtable_has_pt(pgt, cur)) {
+			pt = pgt->mem->alloc_table(pgt, gfp, &pt_dma);
+			if (!pt) {
+				ret = -ENOMEM;
+				break;
+			}
+		}
+
+		pgt->mem->lock(pgt, &flags);
+		if (pt && rk_pgtable_set_pt(pgt, cur, pt, pt_dma))
+			pt = NULL;
+		ret = rk_pgtable_map(pgt, cur, paddr + done, chunk, prot,
+				     &pt_mapped);
+		pgt->mem->unlock(pgt, flags);
+
+		/* Someone else installed the page table in the meantime */
+		if (pt)
+			pgt->mem->free_table(pgt, pt, pt_dma);
+		if (ret)
+			break;
+
+		done += chunk;
+	}
+
+	if (ret) {
+		if (done) {
+			pgt->mem->lock(pgt, &flags);
+			rk_pgtable_unmap(pgt, iova, done);
+			pgt->mem->unlock(pgt, flags);
+		}
+		return ret;
+	}
+
+	*mapped = done;
+
+	return 0;
+}
+EXPORT_SYMBOL_IF_KUNIT(rk_pgtable_map_pages);
+
+phys_addr_t rk_pgtable_iova_to_phys(struct rk_pgtable *pgt, dma_addr_t iova)
+{
+	u32 dte, pte;
+
+	dte = pgt->dt[rk_iova_dte_index(iova)];
+	if (!rk_dte_is_pt_valid(dte))
+		return 0;
+
+	pte = rk_pgtable_pt(pgt, dte)[rk_iova_pte_index(iova)];
+	if (!rk_pte_is_page_valid(pte))
+		return 0;
+
+	return pgt->fmt->pt_address(pte) + rk_iova_page_offset(iova);
+}
+EXPORT_SYMBOL_IF_KUNIT(rk_pgtable_iova_to_phys);
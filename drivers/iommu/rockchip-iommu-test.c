@@ -0,0 +1,517 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * KUnit tests of the Rockchip IOMMU page tables
+ *
+ * The tables live in plain kernel memory and their physical address stands
+ * in for the DMA address, so the page table code runs without an IOMMU.
+ */
+#include <kunit/test.h>
+#include <kunit/test-bug.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/sizes.h>
+
+#include "iommu-pages.h"
+#include "rockchip-iommu.h"
+
+#define RK_TEST_PT_SIZE		(NUM_PT_ENTRIES * SPAGE_SIZE)
+#define RK_TEST_PADDR		0x10000000
+#define RK_TEST_PROT		(IOMMU_READ | IOMMU_WRITE)
+
+struct rk_test_pgtable {
+	struct rk_pgtable pgt;
+	unsigned int num_tables;
+	unsigned int num_flushes;
+	unsigned int num_flushed;
+	unsigned int num_locks;
+	bool locked;
+	/* page tables left to allocate before failing, or -1 */
+	int allocs_left;
+	/* if set, the next allocation races with an install at @race_iova */
+	bool race;
+	dma_addr_t race_iova;
+};
+
+static const struct rk_iommu_ops rk_test_fmts[] = {
+	{
+		.pt_address = &rk_dte_pt_address,
+		.mk_dtentries = &rk_mk_dte,
+		.mk_ptentries = &rk_mk_pte,
+		.gfp_flags = GFP_DMA32,
+	},
+	{
+		.pt_address = &rk_dte_pt_address_v2,
+		.mk_dtentries = &rk_mk_dte_v2,
+		.mk_ptentries = &rk_mk_pte_v2,
+	},
+};
+
+static struct rk_test_pgtable *to_test_pgtable(struct rk_pgtable *pgt)
+{
+	return container_of(pgt, struct rk_test_pgtable, pgt);
+}
+
+static u32 *rk_test_new_table(struct rk_pgtable *pgt, gfp_t gfp,
+			      dma_addr_t *dma)
+{
+	u32 *table = iommu_alloc_page(gfp | pgt->fmt->gfp_flags);
+
+	if (!table)
+		return NULL;
+
+	to_test_pgtable(pgt)->num_tables++;
+	*dma = virt_to_phys(table);
+
+	return table;
+}
+
+static u32 *rk_test_alloc_table(struct rk_pgtable *pgt, gfp_t gfp,
+				dma_addr_t *dma)
+{
+	struct rk_test_pgtable *tp = to_test_pgtable(pgt);
+
+	/* page tables are allocated without the lock */
+	KUNIT_EXPECT_FALSE(kunit_get_current_test(), tp->locked);
+
+	if (!tp->allocs_left)
+		return NULL;
+	if (tp->allocs_left > 0)
+		tp->allocs_left--;
+
+	if (tp->race) {
+		dma_addr_t racer_dma;
+		u32 *racer;
+
+		tp->race = false;
+		racer = rk_test_new_table(pgt, gfp, &racer_dma);
+		if (racer)
+			KUNIT_EXPECT_TRUE(kunit_get_current_test(),
+					  rk_pgtable_set_pt(pgt, tp->race_iova,
+							    racer, racer_dma));
+	}
+
+	return rk_test_new_table(pgt, gfp, dma);
+}
+
+static void rk_test_free_table(struct rk_pgtable *pgt, u32 *table,
+			       dma_addr_t dma)
+{
+	to_test_pgtable(pgt)->num_tables--;
+	iommu_free_page(table);
+}
+
+static void rk_test_flush(struct rk_pgtable *pgt, dma_addr_t dma,
+			  unsigned int count)
+{
+	struct rk_test_pgtable *tp = to_test_pgtable(pgt);
+
+	tp->num_flushes++;
+	tp->num_flushed += count;
+}
+
+static void rk_test_lock(struct rk_pgtable *pgt, unsigned long *flags)
+{
+	struct rk_test_pgtable *tp = to_test_pgtable(pgt);
+
+	KUNIT_EXPECT_FALSE(kunit_get_current_test(), tp->locked);
+	tp->locked = true;
+	tp->num_locks++;
+}
+
+static void rk_test_unlock(struct rk_pgtable *pgt, unsigned long flags)
+{
+	struct rk_test_pgtable *tp = to_test_pgtable(pgt);
+
+	KUNIT_EXPECT_TRUE(kunit_get_current_test(), tp->locked);
+	tp->locked = false;
+}
+
+static const struct rk_pgtable_mem_ops rk_test_mem_ops = {
+	.alloc_table = rk_test_alloc_table,
+	.free_table = rk_test_free_table,
+	.flush = rk_test_flush,
+	.lock = rk_test_lock,
+	.unlock = rk_test_unlock,
+};
+
+static void rk_test_reset_counts(struct rk_test_pgtable *tp)
+{
+	tp->num_flushes = 0;
+	tp->num_flushed = 0;
+	tp->num_locks = 0;
+}
+
+static struct rk_test_pgtable *rk_test_pgtable_init(struct kunit *test)
+{
+	struct rk_test_pgtable *tp;
+
+	tp = kunit_kzalloc(test, sizeof(*tp), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, tp);
+
+	tp->pgt.fmt = test->param_value;
+	tp->pgt.mem = &rk_test_mem_ops;
+	tp->allocs_left = -1;
+	KUNIT_ASSERT_EQ(test, rk_pgtable_init(&tp->pgt, GFP_KERNEL), 0);
+	rk_test_reset_counts(tp);
+
+	return tp;
+}
+
+static void rk_test_pgtable_free(struct kunit *test,
+				 struct rk_test_pgtable *tp)
+{
+	rk_pgtable_free(&tp->pgt);
+	KUNIT_EXPECT_EQ(test, tp->num_tables, 0);
+}
+
+static void rk_test_expect_mapped(struct kunit *test, struct rk_pgtable *pgt,
+				  dma_addr_t iova, phys_addr_t paddr,
+				  size_t size)
+{
+	size_t off;
+
+	for (off = 0; off < size; off += SPAGE_SIZE) {
+		dma_addr_t cur = iova + off + 8;
+		phys_addr_t phys = rk_pgtable_iova_to_phys(pgt, cur);
+		phys_addr_t expected = paddr + off + 8;
+
+		if (phys != expected) {
+			KUNIT_FAIL(test, "iova %pad: phys %pa, expected %pa",
+				   &cur, &phys, &expected);
+			return;
+		}
+	}
+}
+
+static void rk_test_expect_unmapped(struct kunit *test,
+				    struct rk_pgtable *pgt, dma_addr_t iova,
+				    size_t size)
+{
+	size_t off;
+
+	for (off = 0; off < size; off += SPAGE_SIZE) {
+		dma_addr_t cur = iova + off;
+
+		if (rk_pgtable_iova_to_phys(pgt, cur)) {
+			KUNIT_FAIL(test, "iova %pad still mapped", &cur);
+			return;
+		}
+	}
+}
+
+static void rk_iommu_test_map_many_tables(struct kunit *test)
+{
+	struct rk_test_pgtable *tp = rk_test_pgtable_init(test);
+	dma_addr_t iova = SZ_256M;
+	size_t size = 16 * RK_TEST_PT_SIZE;
+	size_t mapped = 0;
+
+	KUNIT_ASSERT_EQ(test, rk_pgtable_map_pages(&tp->pgt, iova,
+						   RK_TEST_PADDR, size,
+						   RK_TEST_PROT, GFP_KERNEL,
+						   &mapped), 0);
+	KUNIT_EXPECT_EQ(test, mapped, size);
+	rk_test_expect_mapped(test, &tp->pgt, iova, RK_TEST_PADDR, size);
+	KUNIT_EXPECT_EQ(test, rk_pgtable_iova_to_phys(&tp->pgt, iova - 1), 0);
+	KUNIT_EXPECT_EQ(test, rk_pgtable_iova_to_phys(&tp->pgt, iova + size), 0);
+
+	/* one lock per page table, which flushes its DTE and its PTEs */
+	KUNIT_EXPECT_EQ(test, tp->num_locks, 16);
+	KUNIT_EXPECT_FALSE(test, tp->locked);
+	KUNIT_EXPECT_EQ(test, tp->num_tables, 1 + 16);
+	KUNIT_EXPECT_EQ(test, tp->num_flushes, 16 + 16);
+	KUNIT_EXPECT_EQ(test, tp->num_flushed, 16 * NUM_PT_ENTRIES + 16);
+
+	rk_test_reset_counts(tp);
+	KUNIT_EXPECT_EQ(test, rk_pgtable_unmap(&tp->pgt, iova, size), size);
+	KUNIT_EXPECT_EQ(test, tp->num_flushes, 16);
+	rk_test_expect_unmapped(test, &tp->pgt, iova, size);
+
+	rk_test_pgtable_free(test, tp);
+}
+
+static void rk_iommu_test_map_unaligned(struct kunit *test)
+{
+	struct rk_test_pgtable *tp = rk_test_pgtable_init(test);
+	dma_addr_t iova = RK_TEST_PT_SIZE - 3 * SPAGE_SIZE;
+	size_t size = 5 * SPAGE_SIZE;
+	size_t mapped = 0;
+
+	KUNIT_ASSERT_EQ(test, rk_pgtable_map_pages(&tp->pgt, iova,
+						   RK_TEST_PADDR, size,
+						   RK_TEST_PROT, GFP_KERNEL,
+						   &mapped), 0);
+	KUNIT_EXPECT_EQ(test, mapped, size);
+	rk_test_expect_mapped(test, &tp->pgt, iova, RK_TEST_PADDR, size);
+	KUNIT_EXPECT_EQ(test, tp->num_locks, 2);
+	KUNIT_EXPECT_EQ(test, tp->num_flushes, 2 + 2);
+	KUNIT_EXPECT_EQ(test, tp->num_flushed, 5 + 2);
+
+	/* a neighbouring map reuses the page table and flushes no DTE */
+	rk_test_reset_counts(tp);
+	KUNIT_ASSERT_EQ(test, rk_pgtable_map_pages(&tp->pgt, iova + size,
+						   RK_TEST_PADDR + size,
+						   SPAGE_SIZE, RK_TEST_PROT,
+						   GFP_KERNEL, &mapped), 0);
+	KUNIT_EXPECT_EQ(test, tp->num_tables, 1 + 2);
+	KUNIT_EXPECT_EQ(test, tp->num_locks, 1);
+	KUNIT_EXPECT_EQ(test, tp->num_flushes, 1);
+	KUNIT_EXPECT_EQ(test, tp->num_flushed, 1);
+
+	KUNIT_EXPECT_EQ(test, rk_pgtable_unmap(&tp->pgt, iova, 6 * SPAGE_SIZE),
+			6 * SPAGE_SIZE);
+	rk_test_expect_unmapped(test, &tp->pgt, iova, 6 * SPAGE_SIZE);
+
+	rk_test_pgtable_free(test, tp);
+}
+
+static void rk_iommu_test_map_busy(struct kunit *test)
+{
+	struct rk_test_pgtable *tp = rk_test_pgtable_init(test);
+	dma_addr_t busy = 3 * RK_TEST_PT_SIZE + 7 * SPAGE_SIZE;
+	size_t size = 4 * RK_TEST_PT_SIZE;
+	size_t mapped = 0;
+
+	KUNIT_ASSERT_EQ(test, rk_pgtable_map_pages(&tp->pgt, busy,
+						   RK_TEST_PADDR, SPAGE_SIZE,
+						   RK_TEST_PROT, GFP_KERNEL,
+						   &mapped), 0);
+
+	/*
+	 * A range running into a mapped page in its last page table leaves
+	 * nothing behind in the page tables mapped before it.
+	 */
+	rk_test_reset_counts(tp);
+	mapped = 0;
+	KUNIT_EXPECT_EQ(test, rk_pgtable_map_pages(&tp->pgt, 0, RK_TEST_PADDR,
+						   size, RK_TEST_PROT,
+						   GFP_KERNEL, &mapped),
+			-EADDRINUSE);
+	KUNIT_EXPECT_EQ(test, mapped, 0);
+	KUNIT_EXPECT_EQ(test, tp->num_locks, 4 + 1);
+	KUNIT_EXPECT_FALSE(test, tp->locked);
+	rk_test_expect_unmapped(test, &tp->pgt, 0, busy);
+	rk_test_expect_unmapped(test, &tp->pgt, busy + SPAGE_SIZE,
+				size - busy - SPAGE_SIZE);
+	KUNIT_EXPECT_EQ(test, rk_pgtable_iova_to_phys(&tp->pgt, busy),
+			RK_TEST_PADDR);
+
+	rk_test_pgtable_free(test, tp);
+}
+
+static void rk_iommu_test_map_nomem(struct kunit *test)
+{
+	struct rk_test_pgtable *tp = rk_test_pgtable_init(test);
+	size_t size = 4 * RK_TEST_PT_SIZE;
+	size_t mapped = 0;
+
+	/* the third page table can't be allocated */
+	tp->allocs_left = 2;
+	KUNIT_EXPECT_EQ(test, rk_pgtable_map_pages(&tp->pgt, 0, RK_TEST_PADDR,
+						   size, RK_TEST_PROT,
+						   GFP_KERNEL, &mapped),
+			-ENOMEM);
+	KUNIT_EXPECT_EQ(test, mapped, 0);
+	KUNIT_EXPECT_EQ(test, tp->num_locks, 2 + 1);
+	KUNIT_EXPECT_FALSE(test, tp->locked);
+	rk_test_expect_unmapped(test, &tp->pgt, 0, size);
+
+	/* the page tables stay until the directory is freed */
+	KUNIT_EXPECT_EQ(test, tp->num_tables, 1 + 2);
+
+	rk_test_pgtable_free(test, tp);
+}
+
+static void rk_iommu_test_map_no_pt(struct kunit *test)
+{
+	struct rk_test_pgtable *tp = rk_test_pgtable_init(test);
+	size_t mapped = 0;
+	dma_addr_t dma;
+	u32 *pt;
+
+	pt = tp->pgt.mem->alloc_table(&tp->pgt, GFP_KERNEL, &dma);
+	KUNIT_ASSERT_NOT_NULL(test, pt);
+	KUNIT_ASSERT_TRUE(test, rk_pgtable_set_pt(&tp->pgt, 0, pt, dma));
+
+	/* rk_pgtable_map() doesn't create page tables */
+	KUNIT_EXPECT_EQ(test, rk_pgtable_map(&tp->pgt, 0, RK_TEST_PADDR,
+					     2 * RK_TEST_PT_SIZE, RK_TEST_PROT,
+					     &mapped), -ENOENT);
+	KUNIT_EXPECT_EQ(test, mapped, 0);
+	KUNIT_EXPECT_EQ(test, tp->num_tables, 1 + 1);
+	KUNIT_EXPECT_FALSE(test, rk_pgtable_has_pt(&tp->pgt, RK_TEST_PT_SIZE));
+	rk_test_expect_unmapped(test, &tp->pgt, 0, RK_TEST_PT_SIZE);
+
+	rk_test_pgtable_free(test, tp);
+}
+
+static void rk_iommu_test_unmap_hole(struct kunit *test)
+{
+	struct rk_test_pgtable *tp = rk_test_pgtable_init(test);
+	size_t mapped;
+
+	KUNIT_ASSERT_EQ(test, rk_pgtable_map_pages(&tp->pgt, 0, RK_TEST_PADDR,
+						   2 * RK_TEST_PT_SIZE,
+						   RK_TEST_PROT, GFP_KERNEL,
+						   &mapped), 0);
+	KUNIT_ASSERT_EQ(test, rk_pgtable_map_pages(&tp->pgt,
+						   3 * RK_TEST_PT_SIZE,
+						   RK_TEST_PADDR, SPAGE_SIZE,
+						   RK_TEST_PROT, GFP_KERNEL,
+						   &mapped), 0);
+
+	/* unmapping stops at the first page not mapped */
+	KUNIT_EXPECT_EQ(test, rk_pgtable_unmap(&tp->pgt, RK_TEST_PT_SIZE,
+					       3 * RK_TEST_PT_SIZE),
+			RK_TEST_PT_SIZE);
+	KUNIT_EXPECT_NE(test, rk_pgtable_iova_to_phys(&tp->pgt, 0), 0);
+	KUNIT_EXPECT_NE(test, rk_pgtable_iova_to_phys(&tp->pgt,
+						      3 * RK_TEST_PT_SIZE), 0);
+	KUNIT_EXPECT_EQ(test, rk_pgtable_unmap(&tp->pgt, RK_TEST_PT_SIZE,
+					       SPAGE_SIZE), 0);
+
+	rk_test_pgtable_free(test, tp);
+}
+
+static void rk_iommu_test_set_pt(struct kunit *test)
+{
+	struct rk_test_pgtable *tp = rk_test_pgtable_init(test);
+	dma_addr_t iova = 5 * RK_TEST_PT_SIZE;
+	dma_addr_t dma, dma2;
+	u32 *pt, *pt2;
+	size_t mapped;
+
+	KUNIT_EXPECT_FALSE(test, rk_pgtable_has_pt(&tp->pgt, iova));
+	pt = tp->pgt.mem->alloc_table(&tp->pgt, GFP_KERNEL, &dma);
+	KUNIT_ASSERT_NOT_NULL(test, pt);
+	KUNIT_EXPECT_TRUE(test, rk_pgtable_set_pt(&tp->pgt, iova, pt, dma));
+	KUNIT_EXPECT_TRUE(test, rk_pgtable_has_pt(&tp->pgt, iova));
+
+	/* the loser of a race gets its page table back */
+	pt2 = tp->pgt.mem->alloc_table(&tp->pgt, GFP_KERNEL, &dma2);
+	KUNIT_ASSERT_NOT_NULL(test, pt2);
+	KUNIT_EXPECT_FALSE(test, rk_pgtable_set_pt(&tp->pgt, iova, pt2, dma2));
+	tp->pgt.mem->free_table(&tp->pgt, pt2, dma2);
+
+	/* a map then allocates nothing and flushes no DTE */
+	rk_test_reset_counts(tp);
+	KUNIT_ASSERT_EQ(test, rk_pgtable_map(&tp->pgt, iova, RK_TEST_PADDR,
+					     RK_TEST_PT_SIZE, RK_TEST_PROT,
+					     &mapped), 0);
+	KUNIT_EXPECT_EQ(test, tp->num_tables, 1 + 1);
+	KUNIT_EXPECT_EQ(test, tp->num_flushes, 1);
+	rk_test_expect_mapped(test, &tp->pgt, iova, RK_TEST_PADDR,
+			      RK_TEST_PT_SIZE);
+
+	rk_test_pgtable_free(test, tp);
+}
+
+static void rk_iommu_test_map_race(struct kunit *test)
+{
+	struct rk_test_pgtable *tp = rk_test_pgtable_init(test);
+	dma_addr_t iova = 5 * RK_TEST_PT_SIZE;
+	size_t mapped = 0;
+
+	/*
+	 * Another map installs the page table while this one allocates its
+	 * own: the latter is freed and the range goes into the former.
+	 */
+	tp->race = true;
+	tp->race_iova = iova;
+	KUNIT_ASSERT_EQ(test, rk_pgtable_map_pages(&tp->pgt, iova,
+						   RK_TEST_PADDR,
+						   RK_TEST_PT_SIZE,
+						   RK_TEST_PROT, GFP_KERNEL,
+						   &mapped), 0);
+	KUNIT_EXPECT_FALSE(test, tp->race);
+	KUNIT_EXPECT_EQ(test, mapped, RK_TEST_PT_SIZE);
+	KUNIT_EXPECT_EQ(test, tp->num_tables, 1 + 1);
+	KUNIT_EXPECT_EQ(test, tp->num_locks, 1);
+	rk_test_expect_mapped(test, &tp->pgt, iova, RK_TEST_PADDR,
+			      RK_TEST_PT_SIZE);
+
+	rk_test_pgtable_free(test, tp);
+}
+
+/* Time of mapping and unmapping @size at @iova in calls of @chunk bytes */
+static void rk_test_time(struct kunit *test, struct rk_test_pgtable *tp,
+			 dma_addr_t iova, size_t size, size_t chunk,
+			 u64 *map_ns, u64 *unmap_ns)
+{
+	size_t off, mapped;
+	ktime_t start;
+
+	start = ktime_get();
+	for (off = 0; off < size; off += chunk)
+		KUNIT_ASSERT_EQ(test, rk_pgtable_map_pages(&tp->pgt, iova + off,
+							   RK_TEST_PADDR + off,
+							   chunk, RK_TEST_PROT,
+							   GFP_KERNEL,
+							   &mapped), 0);
+	*map_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	start = ktime_get();
+	for (off = 0; off < size; off += chunk)
+		KUNIT_ASSERT_EQ(test, rk_pgtable_unmap(&tp->pgt, iova + off,
+						       chunk), chunk);
+	*unmap_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+}
+
+static void rk_iommu_test_throughput(struct kunit *test)
+{
+	static const size_t chunks[] = { SPAGE_SIZE, RK_TEST_PT_SIZE, SZ_64M };
+	struct rk_test_pgtable *tp = rk_test_pgtable_init(test);
+	size_t size = SZ_64M;
+	int i, loop;
+
+	for (i = 0; i < ARRAY_SIZE(chunks); i++) {
+		u64 map_ns = 0, unmap_ns = 0;
+
+		rk_test_reset_counts(tp);
+		for (loop = 0; loop < 8; loop++)
+			rk_test_time(test, tp, SZ_1G, size, chunks[i],
+				     &map_ns, &unmap_ns);
+
+		kunit_info(test,
+			   "%zu KiB per call: map %llu MiB/s, unmap %llu MiB/s, %u flushes\n",
+			   chunks[i] / SZ_1K,
+			   div64_u64(8ULL * (size / SZ_1M) * NSEC_PER_SEC,
+				     map_ns ?: 1),
+			   div64_u64(8ULL * (size / SZ_1M) * NSEC_PER_SEC,
+				     unmap_ns ?: 1),
+			   tp->num_flushes / 8);
+	}
+
+	rk_test_pgtable_free(test, tp);
+}
+
+static void rk_iommu_test_fmt_desc(const struct rk_iommu_ops *fmt, char *desc)
+{
+	snprintf(desc, KUNIT_PARAM_DESC_SIZE, "v%td", fmt - rk_test_fmts + 1);
+}
+
+KUNIT_ARRAY_PARAM(rk_iommu_test_fmt, rk_test_fmts, rk_iommu_test_fmt_desc);
+
+static struct kunit_case rk_iommu_test_cases[] = {
+	KUNIT_CASE_PARAM(rk_iommu_test_map_many_tables, rk_iommu_test_fmt_gen_params),
+	KUNIT_CASE_PARAM(rk_iommu_test_map_unaligned, rk_iommu_test_fmt_gen_params),
+	KUNIT_CASE_PARAM(rk_iommu_test_map_busy, rk_iommu_test_fmt_gen_params),
+	KUNIT_CASE_PARAM(rk_iommu_test_map_nomem, rk_iommu_test_fmt_gen_params),
+	KUNIT_CASE_PARAM(rk_iommu_test_map_no_pt, rk_iommu_test_fmt_gen_params),
+	KUNIT_CASE_PARAM(rk_iommu_test_unmap_hole, rk_iommu_test_fmt_gen_params),
+	KUNIT_CASE_PARAM(rk_iommu_test_set_pt, rk_iommu_test_fmt_gen_params),
+	KUNIT_CASE_PARAM(rk_iommu_test_map_race, rk_iommu_test_fmt_gen_params),
+	KUNIT_CASE_PARAM(rk_iommu_test_throughput, rk_iommu_test_fmt_gen_params),
+	{},
+};
+
+static struct kunit_suite rk_iommu_test_suite = {
+	.name = "rockchip-iommu-pgtable",
+	.test_cases = rk_iommu_test_cases,
+};
+
+kunit_test_suites(&rk_iommu_test_suite);
+
+MODULE_IMPORT_NS("EXPORTED_FOR_KUNIT_TESTING");
+MODULE_DESCRIPTION("KUnit tests of the Rockchip IOMMU page tables");
+MODULE_LICENSE("GPL");
@@ -27,6 +27,7 @@
 #include <linux/spinlock.h>
 
 #include "iommu-pages.h"
+#include "rockchip-iommu.h"
 
 /** MMU register offsets */
 #define RK_MMU_DTE_ADDR		0x00	/* Directory table address */
@@ -69,24 +70,24 @@
 #define RK_MMU_IRQ_BUS_ERROR     0x02  /* bus read error */
 #define RK_MMU_IRQ_MASK          (RK_MMU_IRQ_PAGE_FAULT | RK_MMU_IRQ_BUS_ERROR)
 
-#define NUM_DT_ENTRIES 1024
-#define NUM_PT_ENTRIES 1024
-
-#define SPAGE_ORDER 12
-#define SPAGE_SIZE (1 << SPAGE_ORDER)
-
  /*
-  * Support mapping any size that fits in one page table:
+  * The hardware only has 4 KiB pages, the larger sizes let the core hand
+  * over large buffers in few calls, which may span many page tables:
   *   4 KiB to 4 MiB
   */
 #define RK_IOMMU_PGSIZE_BITMAP 0x007ff000
 
+/*
+ * Zapping an IOTLB line takes a register write per page, past this many
+ * pages shooting down the entire IOTLB is cheaper.
+ */
+#define RK_IOMMU_ZAP_LINES_MAX	256
+
 struct rk_iommu_domain {
 	struct list_head iommus;
-	u32 *dt; /* page directory table */
-	dma_addr_t dt_dma;
+	struct rk_pgtable pgt;
 	spinlock_t iommus_lock; /* lock for iommus list */
-	spinlock_t dt_lock; /* lock for modifying page directory table */
+	spinlock_t dt_lock; /* lock for modifying page tables */
 
 	struct iommu_domain domain;
 };
@@ -96,14 +97,6 @@ static const char * const rk_iommu_clocks[] = {
 	"aclk", "iface",
 };
 
-struct rk_iommu_ops {
-	phys_addr_t (*pt_address)(u32 dte);
-	u32 (*mk_dtentries)(dma_addr_t pt_dma);
-	u32 (*mk_ptentries)(phys_addr_t page, int prot);
-	u64 dma_bit_mask;
-	gfp_t gfp_flags;
-};
-
 struct rk_iommu {
 	struct device *dev;
 	void __iomem **bases;
@@ -126,211 +119,65 @@ static struct device *dma_dev;
 static const struct rk_iommu_ops *rk_ops;
 static struct iommu_domain rk_identity_domain;
 
-static inline void rk_table_flush(struct rk_iommu_domain *dom, dma_addr_t dma,
-				  unsigned int count)
+static void rk_table_flush(struct rk_pgtable *pgt, dma_addr_t dma,
+			   unsigned int count)
 {
 	size_t size = count * sizeof(u32); /* count of u32 entry */
 
 	dma_sync_single_for_device(dma_dev, dma, size, DMA_TO_DEVICE);
 }
 
-static struct rk_iommu_domain *to_rk_domain(struct iommu_domain *dom)
-{
-	return container_of(dom, struct rk_iommu_domain, domain);
-}
-
-/*
- * The Rockchip rk3288 iommu uses a 2-level page table.
- * The first level is the "Directory Table" (DT).
- * The DT consists of 1024 4-byte Directory Table Entries (DTEs), each pointing
- * to a "Page Table".
- * The second level is the 1024 Page Tables (PT).
- * Each PT consists of 1024 4-byte Page Table Entries (PTEs), each pointing to
- * a 4 KB page of physical memory.
- *
- * The DT and each PT fits in a single 4 KB page (4-bytes * 1024 entries).
- * Each iommu device has a MMU_DTE_ADDR register that contains the physical
- * address of the start of the DT page.
- *
- * The structure of the page table is as follows:
- *
- *                   DT
- * MMU_DTE_ADDR -> +-----+
- *                 |     |
- *                 +-----+     PT
- *                 | DTE | -> +-----+
- *                 +-----+    |     |     Memory
- *                 |     |    +-----+     Page
- *                 |     |    | PTE | -> +-----+
- *                 +-----+    +-----+    |     |
- *                            |     |    |     |
- *                            |     |    |     |
- *                            +-----+    |     |
- *                                       |     |
- *                                       |     |
- *                                       +-----+
- */
-
-/*
- * Each DTE has a PT address and a valid bit:
- * +---------------------+-----------+-+
- * | PT address          | Reserved  |V|
- * +---------------------+-----------+-+
- *  31:12 - PT address (PTs always starts on a 4 KB boundary)
- *  11: 1 - Reserved
- *      0 - 1 if PT @ PT address is valid
- */
-#define RK_DTE_PT_ADDRESS_MASK    0xfffff000
-#define RK_DTE_PT_VALID           BIT(0)
-
-static inline phys_addr_t rk_dte_pt_address(u32 dte)
-{
-	return (phys_addr_t)dte & RK_DTE_PT_ADDRESS_MASK;
-}
-
-/*
- * In v2:
- * 31:12 - PT address bit 31:0
- * 11: 8 - PT address bit 35:32
- *  7: 4 - PT address bit 39:36
- *  3: 1 - Reserved
- *     0 - 1 if PT @ PT address is valid
- */
-#define RK_DTE_PT_ADDRESS_MASK_V2 GENMASK_ULL(31, 4)
-#define DTE_HI_MASK1	GENMASK(11, 8)
-#define DTE_HI_MASK2	GENMASK(7, 4)
-#define DTE_HI_SHIFT1	24 /* shift bit 8 to bit 32 */
-#define DTE_HI_SHIFT2	32 /* shift bit 4 to bit 36 */
-#define PAGE_DESC_HI_MASK1	GENMASK_ULL(35, 32)
-#define PAGE_DESC_HI_MASK2	GENMASK_ULL(39, 36)
-
-static inline phys_addr_t rk_dte_pt_address_v2(u32 dte)
+static u32 *rk_table_alloc(struct rk_pgtable *pgt, gfp_t gfp, dma_addr_t *dma)
 {
-	u64 dte_v2 = dte;
-
-	dte_v2 = ((dte_v2 & DTE_HI_MASK2) << DTE_HI_SHIFT2) |
-		 ((dte_v2 & DTE_HI_MASK1) << DTE_HI_SHIFT1) |
-		 (dte_v2 & RK_DTE_PT_ADDRESS_MASK);
-
-	return (phys_addr_t)dte_v2;
-}
-
-static inline bool rk_dte_is_pt_valid(u32 dte)
-{
-	return dte & RK_DTE_PT_VALID;
-}
+	u32 *table;
 
-static inline u32 rk_mk_dte(dma_addr_t pt_dma)
-{
-	return (pt_dma & RK_DTE_PT_ADDRESS_MASK) | RK_DTE_PT_VALID;
-}
-
-static inline u32 rk_mk_dte_v2(dma_addr_t pt_dma)
-{
-	pt_dma = (pt_dma & RK_DTE_PT_ADDRESS_MASK) |
-		 ((pt_dma & PAGE_DESC_HI_MASK1) >> DTE_HI_SHIFT1) |
-		 (pt_dma & PAGE_DESC_HI_MASK2) >> DTE_HI_SHIFT2;
-
-	return (pt_dma & RK_DTE_PT_ADDRESS_MASK_V2) | RK_DTE_PT_VALID;
-}
+	table = iommu_alloc_page(gfp | rk_ops->gfp_flags);
+	if (!table)
+		return NULL;
 
-/*
- * Each PTE has a Page address, some flags and a valid bit:
- * +---------------------+---+-------+-+
- * | Page address        |Rsv| Flags |V|
- * +---------------------+---+-------+-+
- *  31:12 - Page address (Pages always start on a 4 KB boundary)
- *  11: 9 - Reserved
- *   8: 1 - Flags
- *      8 - Read allocate - allocate cache space on read misses
- *      7 - Read cache - enable cache & prefetch of data
- *      6 - Write buffer - enable delaying writes on their way to memory
- *      5 - Write allocate - allocate cache space on write misses
- *      4 - Write cache - different writes can be merged together
- *      3 - Override cache attributes
- *          if 1, bits 4-8 control cache attributes
- *          if 0, the system bus defaults are used
- *      2 - Writable
- *      1 - Readable
- *      0 - 1 if Page @ Page address is valid
- */
-#define RK_PTE_PAGE_ADDRESS_MASK  0xfffff000
-#define RK_PTE_PAGE_FLAGS_MASK    0x000001fe
-#define RK_PTE_PAGE_WRITABLE      BIT(2)
-#define RK_PTE_PAGE_READABLE      BIT(1)
-#define RK_PTE_PAGE_VALID         BIT(0)
+	*dma = dma_map_single(dma_dev, table, SPAGE_SIZE, DMA_TO_DEVICE);
+	if (dma_mapping_error(dma_dev, *dma)) {
+		dev_err(dma_dev, "DMA mapping error while allocating page table\n");
+		iommu_free_page(table);
+		return NULL;
+	}
 
-static inline bool rk_pte_is_page_valid(u32 pte)
-{
-	return pte & RK_PTE_PAGE_VALID;
+	return table;
 }
 
-/* TODO: set cache flags per prot IOMMU_CACHE */
-static u32 rk_mk_pte(phys_addr_t page, int prot)
+static void rk_table_free(struct rk_pgtable *pgt, u32 *table, dma_addr_t dma)
 {
-	u32 flags = 0;
-	flags |= (prot & IOMMU_READ) ? RK_PTE_PAGE_READABLE : 0;
-	flags |= (prot & IOMMU_WRITE) ? RK_PTE_PAGE_WRITABLE : 0;
-	page &= RK_PTE_PAGE_ADDRESS_MASK;
-	return page | flags | RK_PTE_PAGE_VALID;
+	dma_unmap_single(dma_dev, dma, SPAGE_SIZE, DMA_TO_DEVICE);
+	iommu_free_page(table);
 }
 
-/*
- * In v2:
- * 31:12 - Page address bit 31:0
- * 11: 8 - Page address bit 35:32
- *  7: 4 - Page address bit 39:36
- *     3 - Security
- *     2 - Writable
- *     1 - Readable
- *     0 - 1 if Page @ Page address is valid
- */
-
-static u32 rk_mk_pte_v2(phys_addr_t page, int prot)
+static void rk_table_lock(struct rk_pgtable *pgt, unsigned long *flags)
 {
-	u32 flags = 0;
+	struct rk_iommu_domain *rk_domain =
+		container_of(pgt, struct rk_iommu_domain, pgt);
 
-	flags |= (prot & IOMMU_READ) ? RK_PTE_PAGE_READABLE : 0;
-	flags |= (prot & IOMMU_WRITE) ? RK_PTE_PAGE_WRITABLE : 0;
-
-	return rk_mk_dte_v2(page) | flags;
+	spin_lock_irqsave(&rk_domain->dt_lock, *flags);
 }
 
-static u32 rk_mk_pte_invalid(u32 pte)
+static void rk_table_unlock(struct rk_pgtable *pgt, unsigned long flags)
 {
-	return pte & ~RK_PTE_PAGE_VALID;
-}
+	struct rk_iommu_domain *rk_domain =
+		container_of(pgt, struct rk_iommu_domain, pgt);
 
-/*
- * rk3288 iova (IOMMU Virtual Address) format
- *  31       22.21       12.11          0
- * +-----------+-----------+-------------+
- * | DTE index | PTE index | Page offset |
- * +-----------+-----------+-------------+
- *  31:22 - DTE index   - index of DTE in DT
- *  21:12 - PTE index   - index of PTE in PT @ DTE.pt_address
- *  11: 0 - Page offset - offset into page @ PTE.page_address
- */
-#define RK_IOVA_DTE_MASK    0xffc00000
-#define RK_IOVA_DTE_SHIFT   22
-#define RK_IOVA_PTE_MASK    0x003ff000
-#define RK_IOVA_PTE_SHIFT   12
-#define RK_IOVA_PAGE_MASK   0x00000fff
-#define RK_IOVA_PAGE_SHIFT  0
-
-static u32 rk_iova_dte_index(dma_addr_t iova)
-{
-	return (u32)(iova & RK_IOVA_DTE_MASK) >> RK_IOVA_DTE_SHIFT;
+	spin_unlock_irqrestore(&rk_domain->dt_lock, flags);
 }
 
-static u32 rk_iova_pte_index(dma_addr_t iova)
-{
-	return (u32)(iova & RK_IOVA_PTE_MASK) >> RK_IOVA_PTE_SHIFT;
-}
+static const struct rk_pgtable_mem_ops rk_table_mem_ops = {
+	.alloc_table = rk_table_alloc,
+	.free_table = rk_table_free,
+	.flush = rk_table_flush,
+	.lock = rk_table_lock,
+	.unlock = rk_table_unlock,
+};
 
-static u32 rk_iova_page_offset(dma_addr_t iova)
+static struct rk_iommu_domain *to_rk_domain(struct iommu_domain *dom)
 {
-	return (u32)(iova & RK_IOVA_PAGE_MASK) >> RK_IOVA_PAGE_SHIFT;
+	return container_of(dom, struct rk_iommu_domain, domain);
 }
 
 static u32 rk_iommu_read(void __iomem *base, u32 offset)
@@ -360,10 +207,12 @@ static void rk_iommu_zap_lines(struct rk_iommu *iommu, dma_addr_t iova_start,
 {
 	int i;
 	dma_addr_t iova_end = iova_start + size;
-	/*
-	 * TODO(djkurtz): Figure out when it is more efficient to shootdown the
-	 * entire iotlb rather than iterate over individual iovas.
-	 */
+
+	if (size > RK_IOMMU_ZAP_LINES_MAX * SPAGE_SIZE) {
+		rk_iommu_command(iommu, RK_MMU_CMD_ZAP_CACHE);
+		return;
+	}
+
 	for (i = 0; i < iommu->num_mmu; i++) {
 		dma_addr_t iova;
 
@@ -652,24 +501,10 @@ static phys_addr_t rk_iommu_iova_to_phys(struct iommu_domain *domain,
 {
 	struct rk_iommu_domain *rk_domain = to_rk_domain(domain);
 	unsigned long flags;
-	phys_addr_t pt_phys, phys = 0;
-	u32 dte, pte;
-	u32 *page_table;
+	phys_addr_t phys;
 
 	spin_lock_irqsave(&rk_domain->dt_lock, flags);
-
-	dte = rk_domain->dt[rk_iova_dte_index(iova)];
-	if (!rk_dte_is_pt_valid(dte))
-		goto out;
-
-	pt_phys = rk_ops->pt_address(dte);
-	page_table = (u32 *)phys_to_virt(pt_phys);
-	pte = page_table[rk_iova_pte_index(iova)];
-	if (!rk_pte_is_page_valid(pte))
-		goto out;
-
-	phys = rk_ops->pt_address(pte) + rk_iova_page_offset(iova);
-out:
+	phys = rk_pgtable_iova_to_phys(&rk_domain->pgt, iova);
 	spin_unlock_irqrestore(&rk_domain->dt_lock, flags);
 
 	return phys;
@@ -704,6 +539,30 @@ static void rk_iommu_zap_iova(struct rk_iommu_domain *rk_domain,
 	spin_unlock_irqrestore(&rk_domain->iommus_lock, flags);
 }
 
+static void rk_iommu_zap_all(struct rk_iommu_domain *rk_domain)
+{
+	struct rk_iommu *iommu;
+	unsigned long flags;
+	int ret;
+
+	/* shootdown the entire iotlb of all iommus using this domain */
+	spin_lock_irqsave(&rk_domain->iommus_lock, flags);
+	list_for_each_entry(iommu, &rk_domain->iommus, node) {
+		/* Only zap TLBs of IOMMUs that are powered on. */
+		ret = pm_runtime_get_if_in_use(iommu->dev);
+		if (WARN_ON_ONCE(ret < 0))
+			continue;
+		if (ret) {
+			WARN_ON(clk_bulk_enable(iommu->num_clocks,
+						iommu->clocks));
+			rk_iommu_command(iommu, RK_MMU_CMD_ZAP_CACHE);
+			clk_bulk_disable(iommu->num_clocks, iommu->clocks);
+			pm_runtime_put(iommu->dev);
+		}
+	}
+	spin_unlock_irqrestore(&rk_domain->iommus_lock, flags);
+}
+
 static void rk_iommu_zap_iova_first_last(struct rk_iommu_domain *rk_domain,
 					 dma_addr_t iova, size_t size)
 {
@@ -713,149 +572,34 @@ static void rk_iommu_zap_iova_first_last(struct rk_iommu_domain *rk_domain,
 					SPAGE_SIZE);
 }
 
-static u32 *rk_dte_get_page_table(struct rk_iommu_domain *rk_domain,
-				  dma_addr_t iova)
-{
-	u32 *page_table, *dte_addr;
-	u32 dte_index, dte;
-	phys_addr_t pt_phys;
-	dma_addr_t pt_dma;
-
-	assert_spin_locked(&rk_domain->dt_lock);
-
-	dte_index = rk_iova_dte_index(iova);
-	dte_addr = &rk_domain->dt[dte_index];
-	dte = *dte_addr;
-	if (rk_dte_is_pt_valid(dte))
-		goto done;
-
-	page_table = iommu_alloc_page(GFP_ATOMIC | rk_ops->gfp_flags);
-	if (!page_table)
-		return ERR_PTR(-ENOMEM);
-
-	pt_dma = dma_map_single(dma_dev, page_table, SPAGE_SIZE, DMA_TO_DEVICE);
-	if (dma_mapping_error(dma_dev, pt_dma)) {
-		dev_err(dma_dev, "DMA mapping error while allocating page table\n");
-		iommu_free_page(page_table);
-		return ERR_PTR(-ENOMEM);
-	}
-
-	dte = rk_ops->mk_dtentries(pt_dma);
-	*dte_addr = dte;
-
-	rk_table_flush(rk_domain,
-		       rk_domain->dt_dma + dte_index * sizeof(u32), 1);
-done:
-	pt_phys = rk_ops->pt_address(dte);
-	return (u32 *)phys_to_virt(pt_phys);
-}
-
-static size_t rk_iommu_unmap_iova(struct rk_iommu_domain *rk_domain,
-				  u32 *pte_addr, dma_addr_t pte_dma,
-				  size_t size)
+static int rk_iommu_map(struct iommu_domain *domain, unsigned long _iova,
+			phys_addr_t paddr, size_t size, size_t count,
+			int prot, gfp_t gfp, size_t *mapped)
 {
-	unsigned int pte_count;
-	unsigned int pte_total = size / SPAGE_SIZE;
-
-	assert_spin_locked(&rk_domain->dt_lock);
-
-	for (pte_count = 0; pte_count < pte_total; pte_count++) {
-		u32 pte = pte_addr[pte_count];
-		if (!rk_pte_is_page_valid(pte))
-			break;
-
-		pte_addr[pte_count] = rk_mk_pte_invalid(pte);
-	}
-
-	rk_table_flush(rk_domain, pte_dma, pte_count);
+	struct rk_iommu_domain *rk_domain = to_rk_domain(domain);
 
-	return pte_count * SPAGE_SIZE;
+	/*
+	 * The range may span many page tables, dt_lock is only held for one
+	 * at a time, and missing ones are allocated with the caller's gfp
+	 * outside of it. The IOTLB is only zapped once the whole range of
+	 * iommu_map() is mapped, see rk_iommu_iotlb_sync_map().
+	 */
+	return rk_pgtable_map_pages(&rk_domain->pgt, (dma_addr_t)_iova, paddr,
+				    size * count, prot, gfp, mapped);
 }
 
-static int rk_iommu_map_iova(struct rk_iommu_domain *rk_domain, u32 *pte_addr,
-			     dma_addr_t pte_dma, dma_addr_t iova,
-			     phys_addr_t paddr, size_t size, int prot)
+static int rk_iommu_iotlb_sync_map(struct iommu_domain *domain,
+				   unsigned long iova, size_t size)
 {
-	unsigned int pte_count;
-	unsigned int pte_total = size / SPAGE_SIZE;
-	phys_addr_t page_phys;
-
-	assert_spin_locked(&rk_domain->dt_lock);
-
-	for (pte_count = 0; pte_count < pte_total; pte_count++) {
-		u32 pte = pte_addr[pte_count];
-
-		if (rk_pte_is_page_valid(pte))
-			goto unwind;
-
-		pte_addr[pte_count] = rk_ops->mk_ptentries(paddr, prot);
-
-		paddr += SPAGE_SIZE;
-	}
-
-	rk_table_flush(rk_domain, pte_dma, pte_total);
-
 	/*
 	 * Zap the first and last iova to evict from iotlb any previously
 	 * mapped cachelines holding stale values for its dte and pte.
 	 * We only zap the first and last iova, since only they could have
 	 * dte or pte shared with an existing mapping.
 	 */
-	rk_iommu_zap_iova_first_last(rk_domain, iova, size);
+	rk_iommu_zap_iova_first_last(to_rk_domain(domain), iova, size);
 
 	return 0;
-unwind:
-	/* Unmap the range of iovas that we just mapped */
-	rk_iommu_unmap_iova(rk_domain, pte_addr, pte_dma,
-			    pte_count * SPAGE_SIZE);
-
-	iova += pte_count * SPAGE_SIZE;
-	page_phys = rk_ops->pt_address(pte_addr[pte_count]);
-	pr_err("iova: %pad already mapped to %pa cannot remap to phys: %pa prot: %#x\n",
-	       &iova, &page_phys, &paddr, prot);
-
-	return -EADDRINUSE;
-}
-
-static int rk_iommu_map(struct iommu_domain *domain, unsigned long _iova,
-			phys_addr_t paddr, size_t size, size_t count,
-			int prot, gfp_t gfp, size_t *mapped)
-{
-	struct rk_iommu_domain *rk_domain = to_rk_domain(domain);
-	unsigned long flags;
-	dma_addr_t pte_dma, iova = (dma_addr_t)_iova;
-	u32 *page_table, *pte_addr;
-	u32 dte_index, pte_index;
-	int ret;
-
-	spin_lock_irqsave(&rk_domain->dt_lock, flags);
-
-	/*
-	 * pgsize_bitmap specifies iova sizes that fit in one page table
-	 * (1024 4-KiB pages = 4 MiB).
-	 * So, size will always be 4096 <= size <= 4194304.
-	 * Since iommu_map() guarantees that both iova and size will be
-	 * aligned, we will always only be mapping from a single dte here.
-	 */
-	page_table = rk_dte_get_page_table(rk_domain, iova);
-	if (IS_ERR(page_table)) {
-		spin_unlock_irqrestore(&rk_domain->dt_lock, flags);
-		return PTR_ERR(page_table);
-	}
-
-	dte_index = rk_domain->dt[rk_iova_dte_index(iova)];
-	pte_index = rk_iova_pte_index(iova);
-	pte_addr = &page_table[pte_index];
-
-	pte_dma = rk_ops->pt_address(dte_index) + pte_index * sizeof(u32);
-	ret = rk_iommu_map_iova(rk_domain, pte_addr, pte_dma, iova,
-				paddr, size, prot);
-
-	spin_unlock_irqrestore(&rk_domain->dt_lock, flags);
-	if (!ret)
-		*mapped = size;
-
-	return ret;
 }
 
 static size_t rk_iommu_unmap(struct iommu_domain *domain, unsigned long _iova,
@@ -863,39 +607,37 @@ static size_t rk_iommu_unmap(struct iommu_domain *domain, unsigned long _iova,
 {
 	struct rk_iommu_domain *rk_domain = to_rk_domain(domain);
 	unsigned long flags;
-	dma_addr_t pte_dma, iova = (dma_addr_t)_iova;
-	phys_addr_t pt_phys;
-	u32 dte;
-	u32 *pte_addr;
+	dma_addr_t iova = (dma_addr_t)_iova;
 	size_t unmap_size;
 
 	spin_lock_irqsave(&rk_domain->dt_lock, flags);
+	unmap_size = rk_pgtable_unmap(&rk_domain->pgt, iova, size * count);
+	spin_unlock_irqrestore(&rk_domain->dt_lock, flags);
 
-	/*
-	 * pgsize_bitmap specifies iova sizes that fit in one page table
-	 * (1024 4-KiB pages = 4 MiB).
-	 * So, size will always be 4096 <= size <= 4194304.
-	 * Since iommu_unmap() guarantees that both iova and size will be
-	 * aligned, we will always only be unmapping from a single dte here.
-	 */
-	dte = rk_domain->dt[rk_iova_dte_index(iova)];
-	/* Just return 0 if iova is unmapped */
-	if (!rk_dte_is_pt_valid(dte)) {
-		spin_unlock_irqrestore(&rk_domain->dt_lock, flags);
+	if (!unmap_size)
 		return 0;
-	}
 
-	pt_phys = rk_ops->pt_address(dte);
-	pte_addr = (u32 *)phys_to_virt(pt_phys) + rk_iova_pte_index(iova);
-	pte_dma = pt_phys + rk_iova_pte_index(iova) * sizeof(u32);
-	unmap_size = rk_iommu_unmap_iova(rk_domain, pte_addr, pte_dma, size);
+	/* The iotlb entries are shot down for the gathered range at once */
+	if (iommu_iotlb_gather_is_disjoint(gather, _iova, unmap_size))
+		iommu_iotlb_sync(domain, gather);
+	iommu_iotlb_gather_add_range(gather, _iova, unmap_size);
 
-	spin_unlock_irqrestore(&rk_domain->dt_lock, flags);
+	return unmap_size;
+}
+
+static void rk_iommu_iotlb_sync(struct iommu_domain *domain,
+				struct iommu_iotlb_gather *gather)
+{
+	if (gather->start > gather->end)
+		return;
 
-	/* Shootdown iotlb entries for iova range that was just unmapped */
-	rk_iommu_zap_iova(rk_domain, iova, unmap_size);
+	rk_iommu_zap_iova(to_rk_domain(domain), gather->start,
+			  gather->end - gather->start + 1);
+}
 
-	return unmap_size;
+static void rk_iommu_flush_iotlb_all(struct iommu_domain *domain)
+{
+	rk_iommu_zap_all(to_rk_domain(domain));
 }
 
 static struct rk_iommu *rk_iommu_from_dev(struct device *dev)
@@ -943,7 +685,7 @@ static int rk_iommu_enable(struct rk_iommu *iommu)
 
 	for (i = 0; i < iommu->num_mmu; i++) {
 		rk_iommu_write(iommu->bases[i], RK_MMU_DTE_ADDR,
-			       rk_ops->mk_dtentries(rk_domain->dt_dma));
+			       rk_ops->mk_dtentries(rk_domain->pgt.dt_dma));
 		rk_iommu_base_command(iommu->bases[i], RK_MMU_CMD_ZAP_CACHE);
 		rk_iommu_write(iommu->bases[i], RK_MMU_INT_MASK, RK_MMU_IRQ_MASK);
 	}
@@ -1063,17 +805,11 @@ static struct iommu_domain *rk_iommu_domain_alloc_paging(struct device *dev)
 	 * Each level1 (dt) and level2 (pt) table has 1024 4-byte entries.
 	 * Allocate one 4 KiB page for each table.
 	 */
-	rk_domain->dt = iommu_alloc_page(GFP_KERNEL | rk_ops->gfp_flags);
-	if (!rk_domain->dt)
+	rk_domain->pgt.fmt = rk_ops;
+	rk_domain->pgt.mem = &rk_table_mem_ops;
+	if (rk_pgtable_init(&rk_domain->pgt, GFP_KERNEL))
 		goto err_free_domain;
 
-	rk_domain->dt_dma = dma_map_single(dma_dev, rk_domain->dt,
-					   SPAGE_SIZE, DMA_TO_DEVICE);
-	if (dma_mapping_error(dma_dev, rk_domain->dt_dma)) {
-		dev_err(dma_dev, "DMA map error for DT\n");
-		goto err_free_dt;
-	}
-
 	spin_lock_init(&rk_domain->iommus_lock);
 	spin_lock_init(&rk_domain->dt_lock);
 	INIT_LIST_HEAD(&rk_domain->iommus);
@@ -1084,8 +820,6 @@ static struct iommu_domain *rk_iommu_domain_alloc_paging(struct device *dev)
 
 	return &rk_domain->domain;
 
-err_free_dt:
-	iommu_free_page(rk_domain->dt);
 err_free_domain:
 	kfree(rk_domain);
 
@@ -1095,24 +829,10 @@ static struct iommu_domain *rk_iommu_domain_alloc_paging(struct device *dev)
 static void rk_iommu_domain_free(struct iommu_domain *domain)
 {
 	struct rk_iommu_domain *rk_domain = to_rk_domain(domain);
-	int i;
 
 	WARN_ON(!list_empty(&rk_domain->iommus));
 
-	for (i = 0; i < NUM_DT_ENTRIES; i++) {
-		u32 dte = rk_domain->dt[i];
-		if (rk_dte_is_pt_valid(dte)) {
-			phys_addr_t pt_phys = rk_ops->pt_address(dte);
-			u32 *page_table = phys_to_virt(pt_phys);
-			dma_unmap_single(dma_dev, pt_phys,
-					 SPAGE_SIZE, DMA_TO_DEVICE);
-			iommu_free_page(page_table);
-		}
-	}
-
-	dma_unmap_single(dma_dev, rk_domain->dt_dma,
-			 SPAGE_SIZE, DMA_TO_DEVICE);
-	iommu_free_page(rk_domain->dt);
+	rk_pgtable_free(&rk_domain->pgt);
 
 	kfree(rk_domain);
 }
@@ -1174,6 +894,9 @@ static const struct iommu_ops rk_iommu_ops = {
 		.attach_dev	= rk_iommu_attach_device,
 		.map_pages	= rk_iommu_map,
 		.unmap_pages	= rk_iommu_unmap,
+		.iotlb_sync_map	= rk_iommu_iotlb_sync_map,
+		.iotlb_sync	= rk_iommu_iotlb_sync,
+		.flush_iotlb_all = rk_iommu_flush_iotlb_all,
 		.iova_to_phys	= rk_iommu_iova_to_phys,
 		.free		= rk_iommu_domain_free,
 	}
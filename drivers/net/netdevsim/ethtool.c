@@ -88,6 +88,15 @@ static int nsim_set_ringparam(struct net_device *dev,
 	return 0;
 }
 
+static void nsim_ethtool_rss_reset(struct netdevsim *ns)
+{
+	int i;
+
+	for (i = 0; i < NSIM_RSS_INDIR_SIZE; i++)
+		ns->ethtool.rss.indir[i] =
+			ethtool_rxfh_indir_default(i, ns->ethtool.channels);
+}
+
 static void
 nsim_get_channels(struct net_device *dev, struct ethtool_channels *ch)
 {
@@ -111,6 +120,64 @@ nsim_set_channels(struct net_device *dev, struct ethtool_channels *ch)
 		return err;
 
 	ns->ethtool.channels = ch->combined_count;
+	if (!netif_is_rxfh_configured(dev))
+		nsim_ethtool_rss_reset(ns);
+	return 0;
+}
+
+static int nsim_get_rxnfc(struct net_device *dev, struct ethtool_rxnfc *info,
+			  u32 *rule_locs)
+{
+	struct netdevsim *ns = netdev_priv(dev);
+
+	switch (info->cmd) {
+	case ETHTOOL_GRXRINGS:
+		info->data = ns->ethtool.channels;
+		return 0;
+	default:
+		return -EOPNOTSUPP;
+	}
+}
+
+static u32 nsim_get_rxfh_indir_size(struct net_device *dev)
+{
+	return NSIM_RSS_INDIR_SIZE;
+}
+
+static u32 nsim_get_rxfh_key_size(struct net_device *dev)
+{
+	return NSIM_RSS_KEY_SIZE;
+}
+
+static int nsim_get_rxfh(struct net_device *dev, struct ethtool_rxfh_param *rxfh)
+{
+	struct netdevsim *ns = netdev_priv(dev);
+
+	rxfh->hfunc = ETH_RSS_HASH_TOP;
+	if (rxfh->indir)
+		memcpy(rxfh->indir, ns->ethtool.rss.indir,
+		       sizeof(ns->ethtool.rss.indir));
+	if (rxfh->key)
+		memcpy(rxfh->key, ns->ethtool.rss.key,
+		       sizeof(ns->ethtool.rss.key));
+	return 0;
+}
+
+static int nsim_set_rxfh(struct net_device *dev, struct ethtool_rxfh_param *rxfh,
+			 struct netlink_ext_ack *extack)
+{
+	struct netdevsim *ns = netdev_priv(dev);
+
+	if (rxfh->hfunc != ETH_RSS_HASH_NO_CHANGE &&
+	    rxfh->hfunc != ETH_RSS_HASH_TOP)
+		return -EOPNOTSUPP;
+
+	if (rxfh->indir)
+		memcpy(ns->ethtool.rss.indir, rxfh->indir,
+		       sizeof(ns->ethtool.rss.indir));
+	if (rxfh->key)
+		memcpy(ns->ethtool.rss.key, rxfh->key,
+		       sizeof(ns->ethtool.rss.key));
 	return 0;
 }
 
@@ -170,6 +237,11 @@ static const struct ethtool_ops nsim_ethtool_ops = {
 	.set_ringparam			= nsim_set_ringparam,
 	.get_channels			= nsim_get_channels,
 	.set_channels			= nsim_set_channels,
+	.get_rxnfc			= nsim_get_rxnfc,
+	.get_rxfh_indir_size		= nsim_get_rxfh_indir_size,
+	.get_rxfh_key_size		= nsim_get_rxfh_key_size,
+	.get_rxfh			= nsim_get_rxfh,
+	.set_rxfh			= nsim_set_rxfh,
 	.get_fecparam			= nsim_get_fecparam,
 	.set_fecparam			= nsim_set_fecparam,
 	.get_fec_stats			= nsim_get_fec_stats,
@@ -199,6 +271,8 @@ void nsim_ethtool_init(struct netdevsim *ns)
 	ns->ethtool.fec.active_fec = ETHTOOL_FEC_NONE;
 
 	ns->ethtool.channels = ns->nsim_bus_dev->num_queues;
+	nsim_ethtool_rss_reset(ns);
+	netdev_rss_key_fill(ns->ethtool.rss.key, sizeof(ns->ethtool.rss.key));
 
 	ethtool = debugfs_create_dir("ethtool", ns->nsim_dev_port->ddir);
 
@@ -211,6 +285,9 @@ void nsim_ethtool_init(struct netdevsim *ns)
 	debugfs_create_bool("report_stats_tx", 0600, dir,
 			    &ns->ethtool.pauseparam.report_stats_tx);
 
+	dir = debugfs_create_dir("rss", ethtool);
+	debugfs_create_bool("enabled", 0600, dir, &ns->ethtool.rss.enabled);
+
 	dir = debugfs_create_dir("ring", ethtool);
 	debugfs_create_u32("rx_max_pending", 0600, dir,
 			   &ns->ethtool.ring.rx_max_pending);
@@ -19,6 +19,8 @@
 #include <linux/module.h>
 #include <linux/netdevice.h>
 #include <linux/slab.h>
+#include <linux/unaligned.h>
+#include <net/flow_dissector.h>
 #include <net/netdev_queues.h>
 #include <net/page_pool/helpers.h>
 #include <net/netlink.h>
@@ -29,7 +31,128 @@
 
 #include "netdevsim.h"
 
-#define NSIM_RING_SIZE		256
+/* Packets a transmit queue can have on the wire, like the default txqueuelen */
+#define NSIM_WIRE_LIMIT		1000
+
+struct nsim_wire_cb {
+	u64 due;
+};
+
+#define NSIM_WIRE_CB(skb)	((struct nsim_wire_cb *)(skb)->cb)
+
+static u32 nsim_toeplitz(const u8 *key, const u8 *data, unsigned int len)
+{
+	u32 v = get_unaligned_be32(key), hash = 0;
+	unsigned int i;
+	int bit;
+
+	for (i = 0; i < len; i++) {
+		for (bit = 7; bit >= 0; bit--) {
+			if (data[i] & BIT(bit))
+				hash ^= v;
+			v = v << 1 | !!(key[i + 4] & BIT(bit));
+		}
+	}
+
+	return hash;
+}
+
+/* Toeplitz hash of the addresses, and of the ports for TCP and UDP, as
+ * computed by most NICs.
+ */
+u32 nsim_rss_hash(struct netdevsim *ns, struct sk_buff *skb,
+		  enum pkt_hash_types *type)
+{
+	u8 data[sizeof(struct flow_dissector_key_ipv6_addrs) + sizeof(__be32)];
+	struct flow_keys keys;
+	unsigned int len;
+
+	*type = PKT_HASH_TYPE_NONE;
+	if (!skb_flow_dissect_flow_keys(skb, &keys, 0))
+		return 0;
+
+	switch (keys.control.addr_type) {
+	case FLOW_DISSECTOR_KEY_IPV4_ADDRS:
+		len = sizeof(keys.addrs.v4addrs);
+		memcpy(data, &keys.addrs.v4addrs, len);
+		break;
+	case FLOW_DISSECTOR_KEY_IPV6_ADDRS:
+		len = sizeof(keys.addrs.v6addrs);
+		memcpy(data, &keys.addrs.v6addrs, len);
+		break;
+	default:
+		return 0;
+	}
+
+	*type = PKT_HASH_TYPE_L3;
+	if ((keys.basic.ip_proto == IPPROTO_TCP ||
+	     keys.basic.ip_proto == IPPROTO_UDP) &&
+	    !(keys.control.flags & FLOW_DIS_IS_FRAGMENT)) {
+		memcpy(data + len, &keys.ports.ports, sizeof(keys.ports.ports));
+		len += sizeof(keys.ports.ports);
+		*type = PKT_HASH_TYPE_L4;
+	}
+
+	return nsim_toeplitz(ns->ethtool.rss.key, data, len);
+}
+
+unsigned int nsim_rss_queue(struct netdevsim *ns, u32 hash)
+{
+	u32 rxq = READ_ONCE(ns->ethtool.rss.indir[hash % NSIM_RSS_INDIR_SIZE]);
+
+	return rxq < ns->netdev->real_num_rx_queues ? rxq : 0;
+}
+
+static struct nsim_rq *nsim_rx_queue(struct netdevsim *ns, struct sk_buff *skb)
+{
+	struct net_device *dev = ns->netdev;
+	enum pkt_hash_types type;
+	unsigned int rxq;
+	u32 hash;
+
+	if (READ_ONCE(ns->ethtool.rss.enabled)) {
+		hash = nsim_rss_hash(ns, skb, &type);
+		skb_set_hash(skb, hash, type);
+		rxq = nsim_rss_queue(ns, hash);
+	} else {
+		rxq = skb_get_queue_mapping(skb);
+		if (rxq >= dev->num_rx_queues)
+			rxq = rxq % dev->num_rx_queues;
+	}
+	skb_record_rx_queue(skb, rxq);
+
+	return &ns->rq[rxq];
+}
+
+/* Raises the interrupt of @rq as moderated by the ethtool coalescing
+ * settings: right away once rx-frames packets are waiting, otherwise
+ * rx-usecs after the first of them.
+ */
+static void nsim_rq_kick(struct netdevsim *ns, struct nsim_rq *rq)
+{
+	u32 usecs = READ_ONCE(ns->ethtool.coalesce.rx_coalesce_usecs);
+	u32 frames = READ_ONCE(ns->ethtool.coalesce.rx_max_coalesced_frames);
+	u64 irq;
+
+	if (!usecs || (frames && skb_queue_len(&rq->skb_queue) >= frames)) {
+		napi_schedule(&rq->napi);
+		return;
+	}
+
+	irq = ktime_get_ns() + (u64)usecs * NSEC_PER_USEC;
+	if (!hrtimer_is_queued(&rq->irq_timer) ||
+	    ktime_to_ns(hrtimer_get_expires(&rq->irq_timer)) > irq)
+		hrtimer_start(&rq->irq_timer, ns_to_ktime(irq),
+			      HRTIMER_MODE_ABS_SOFT);
+}
+
+static enum hrtimer_restart nsim_rq_irq(struct hrtimer *timer)
+{
+	struct nsim_rq *rq = container_of(timer, struct nsim_rq, irq_timer);
+
+	napi_schedule(&rq->napi);
+	return HRTIMER_NORESTART;
+}
 
 static int nsim_napi_rx(struct nsim_rq *rq, struct sk_buff *skb)
 {
@@ -42,41 +165,160 @@ static int nsim_napi_rx(struct nsim_rq *rq, struct sk_buff *skb)
 	return NET_RX_SUCCESS;
 }
 
-static int nsim_forward_skb(struct net_device *dev, struct sk_buff *skb,
-			    struct nsim_rq *rq)
+/* Hands @skb over to the peer of @ns, called under rcu_read_lock() */
+static int nsim_deliver(struct netdevsim *ns, struct sk_buff *skb)
+{
+	struct netdevsim *peer_ns = rcu_dereference(ns->peer);
+	struct net_device *peer_dev;
+	struct nsim_rq *rq;
+
+	if (!peer_ns || !netif_running(peer_ns->netdev)) {
+		dev_kfree_skb_any(skb);
+		return NET_RX_DROP;
+	}
+
+	peer_dev = peer_ns->netdev;
+	if (__dev_forward_skb(peer_dev, skb))
+		return NET_RX_DROP;
+
+	rq = nsim_rx_queue(peer_ns, skb);
+	if (nsim_napi_rx(rq, skb) == NET_RX_DROP)
+		return NET_RX_DROP;
+
+	nsim_rq_kick(peer_ns, rq);
+	return NET_RX_SUCCESS;
+}
+
+static u64 nsim_tx_time(const struct sk_buff *skb, u64 bw_max, bool pps)
+{
+	if (pps)
+		return div64_u64((u64)(skb_shinfo(skb)->gso_segs ?: 1) *
+				 NSEC_PER_SEC, bw_max);
+	return div64_u64((u64)skb->len * BITS_PER_BYTE * NSEC_PER_SEC,
+			 bw_max);
+}
+
+/* Time at which @skb gets to the peer, after the queue and the link shapers
+ * let it through and the latency of the wire.
+ */
+static u64 nsim_wire_due(struct netdevsim *ns, struct nsim_sq *sq,
+			 const struct sk_buff *skb)
+{
+	u64 bw, due = ktime_get_ns();
+
+	bw = READ_ONCE(sq->bw_max);
+	if (bw) {
+		due = max(due, sq->next_ns) +
+		      nsim_tx_time(skb, bw, READ_ONCE(sq->pps));
+		sq->next_ns = due;
+	}
+
+	bw = READ_ONCE(ns->wire.bw_max);
+	if (bw) {
+		spin_lock(&ns->wire.lock);
+		due = max(due, ns->wire.next_ns) +
+		      nsim_tx_time(skb, bw, READ_ONCE(ns->wire.pps));
+		ns->wire.next_ns = due;
+		spin_unlock(&ns->wire.lock);
+	}
+
+	return due + (u64)READ_ONCE(ns->wire.latency_us) * NSEC_PER_USEC;
+}
+
+static bool nsim_sq_shaped(struct netdevsim *ns, struct nsim_sq *sq)
 {
-	return __dev_forward_skb(dev, skb) ?: nsim_napi_rx(rq, skb);
+	return READ_ONCE(sq->bw_max) || READ_ONCE(ns->wire.bw_max) ||
+	       READ_ONCE(ns->wire.latency_us) ||
+	       !skb_queue_empty_lockless(&sq->delay);
+}
+
+static int nsim_sq_delay(struct netdevsim *ns, struct nsim_sq *sq,
+			 struct sk_buff *skb)
+{
+	u32 limit = READ_ONCE(ns->ethtool.ring.tx_pending) ?: NSIM_WIRE_LIMIT;
+	bool first;
+	u64 due;
+
+	spin_lock(&sq->delay.lock);
+	if (skb_queue_len(&sq->delay) >= limit) {
+		spin_unlock(&sq->delay.lock);
+		dev_kfree_skb_any(skb);
+		return NET_RX_DROP;
+	}
+	due = nsim_wire_due(ns, sq, skb);
+	NSIM_WIRE_CB(skb)->due = due;
+	first = skb_queue_empty(&sq->delay);
+	__skb_queue_tail(&sq->delay, skb);
+	spin_unlock(&sq->delay.lock);
+
+	if (first)
+		hrtimer_start(&sq->timer, ns_to_ktime(due),
+			      HRTIMER_MODE_ABS_SOFT);
+	return NET_RX_SUCCESS;
+}
+
+static enum hrtimer_restart nsim_sq_timer(struct hrtimer *timer)
+{
+	struct nsim_sq *sq = container_of(timer, struct nsim_sq, timer);
+	u64 now = ktime_get_ns();
+	struct sk_buff *skb;
+
+	rcu_read_lock();
+	do {
+		spin_lock(&sq->delay.lock);
+		skb = skb_peek(&sq->delay);
+		if (skb && NSIM_WIRE_CB(skb)->due > now) {
+			hrtimer_start(timer, ns_to_ktime(NSIM_WIRE_CB(skb)->due),
+				      HRTIMER_MODE_ABS_SOFT);
+			skb = NULL;
+		} else if (skb) {
+			__skb_unlink(skb, &sq->delay);
+		}
+		spin_unlock(&sq->delay.lock);
+
+		if (skb && nsim_deliver(sq->ns, skb) == NET_RX_DROP)
+			dev_core_stats_tx_dropped_inc(sq->ns->netdev);
+	} while (skb);
+	rcu_read_unlock();
+
+	return HRTIMER_NORESTART;
+}
+
+static void nsim_sq_flush(struct netdevsim *ns)
+{
+	struct net_device *dev = ns->netdev;
+	int i;
+
+	for (i = 0; i < dev->num_tx_queues; i++) {
+		hrtimer_cancel(&ns->sq[i].timer);
+		skb_queue_purge_reason(&ns->sq[i].delay,
+				       SKB_DROP_REASON_QUEUE_PURGE);
+	}
 }
 
 static netdev_tx_t nsim_start_xmit(struct sk_buff *skb, struct net_device *dev)
 {
 	struct netdevsim *ns = netdev_priv(dev);
-	struct net_device *peer_dev;
 	unsigned int len = skb->len;
-	struct netdevsim *peer_ns;
-	struct nsim_rq *rq;
-	int rxq;
+	struct nsim_sq *sq;
+	int ret;
 
 	rcu_read_lock();
 	if (!nsim_ipsec_tx(ns, skb))
 		goto out_drop_free;
 
-	peer_ns = rcu_dereference(ns->peer);
-	if (!peer_ns)
+	if (!rcu_access_pointer(ns->peer))
 		goto out_drop_free;
 
-	peer_dev = peer_ns->netdev;
-	rxq = skb_get_queue_mapping(skb);
-	if (rxq >= peer_dev->num_rx_queues)
-		rxq = rxq % peer_dev->num_rx_queues;
-	rq = &peer_ns->rq[rxq];
-
 	skb_tx_timestamp(skb);
-	if (unlikely(nsim_forward_skb(peer_dev, skb, rq) == NET_RX_DROP))
+	sq = &ns->sq[skb_get_queue_mapping(skb)];
+	if (nsim_sq_shaped(ns, sq))
+		ret = nsim_sq_delay(ns, sq, skb);
+	else
+		ret = nsim_deliver(ns, skb);
+	if (unlikely(ret == NET_RX_DROP))
 		goto out_drop_cnt;
 
-	napi_schedule(&rq->napi);
-
 	rcu_read_unlock();
 	u64_stats_update_begin(&ns->syncp);
 	ns->tx_packets++;
@@ -114,7 +356,9 @@ static void
 nsim_get_stats64(struct net_device *dev, struct rtnl_link_stats64 *stats)
 {
 	struct netdevsim *ns = netdev_priv(dev);
+	u64 packets, bytes, missed;
 	unsigned int start;
+	int i;
 
 	do {
 		start = u64_stats_fetch_begin(&ns->syncp);
@@ -122,6 +366,21 @@ nsim_get_stats64(struct net_device *dev, struct rtnl_link_stats64 *stats)
 		stats->tx_packets = ns->tx_packets;
 		stats->tx_dropped = ns->tx_dropped;
 	} while (u64_stats_fetch_retry(&ns->syncp, start));
+
+	for (i = 0; ns->rq && i < dev->num_rx_queues; i++) {
+		struct nsim_rq *rq = &ns->rq[i];
+
+		do {
+			start = u64_stats_fetch_begin(&rq->syncp);
+			packets = rq->rx_packets;
+			bytes = rq->rx_bytes;
+			missed = rq->rx_missed;
+		} while (u64_stats_fetch_retry(&rq->syncp, start));
+
+		stats->rx_packets += packets;
+		stats->rx_bytes += bytes;
+		stats->rx_missed_errors += missed;
+	}
 }
 
 static int
@@ -335,6 +594,7 @@ static int nsim_get_iflink(const struct net_device *dev)
 static int nsim_rcv(struct nsim_rq *rq, int budget)
 {
 	struct sk_buff *skb;
+	u64 bytes = 0;
 	int i;
 
 	for (i = 0; i < budget; i++) {
@@ -342,19 +602,45 @@ static int nsim_rcv(struct nsim_rq *rq, int budget)
 			break;
 
 		skb = skb_dequeue(&rq->skb_queue);
-		netif_receive_skb(skb);
+		bytes += skb->len;
+		napi_gro_receive(&rq->napi, skb);
+	}
+
+	if (i) {
+		u64_stats_update_begin(&rq->syncp);
+		rq->rx_packets += i;
+		rq->rx_bytes += bytes;
+		u64_stats_update_end(&rq->syncp);
 	}
 
 	return i;
 }
 
+/* Re-arms the interrupt for packets that came in while polling, or for the
+ * next ones the generator will receive.
+ */
+static void nsim_rq_rearm(struct nsim_rq *rq)
+{
+	struct netdevsim *ns = netdev_priv(rq->napi.dev);
+
+	if (!skb_queue_empty(&rq->skb_queue))
+		nsim_rq_kick(ns, rq);
+	else if (nsim_rx_gen_active(rq))
+		hrtimer_start(&rq->irq_timer,
+			      ns_to_ktime(nsim_rx_gen_next_ns(rq)),
+			      HRTIMER_MODE_ABS_SOFT);
+}
+
 static int nsim_poll(struct napi_struct *napi, int budget)
 {
 	struct nsim_rq *rq = container_of(napi, struct nsim_rq, napi);
 	int done;
 
 	done = nsim_rcv(rq, budget);
-	napi_complete(napi);
+	if (done < budget && nsim_rx_gen_active(rq))
+		done += nsim_rx_gen_poll(rq, budget - done);
+	if (done < budget && napi_complete_done(napi, done))
+		nsim_rq_rearm(rq);
 
 	return done;
 }
@@ -451,8 +737,10 @@ static void nsim_del_napi(struct netdevsim *ns)
 		struct nsim_rq *rq = &ns->rq[i];
 
 		napi_disable(&rq->napi);
+		hrtimer_cancel(&rq->irq_timer);
 		__netif_napi_del(&rq->napi);
 	}
+	nsim_rx_gen_reset(ns);
 	synchronize_net();
 
 	for (i = 0; i < dev->num_rx_queues; i++) {
@@ -471,15 +759,43 @@ static int nsim_stop(struct net_device *dev)
 	if (peer)
 		netif_carrier_off(peer->netdev);
 
+	nsim_sq_flush(ns);
 	nsim_del_napi(ns);
 
 	return 0;
 }
 
+/* The maximum rate of the netdev and queue shapers is enforced on the wire,
+ * the other parameters and the node shapers are only accepted.
+ */
+static void nsim_shaper_apply(struct netdevsim *ns,
+			      const struct net_shaper_handle *handle,
+			      u64 bw_max, bool pps)
+{
+	switch (handle->scope) {
+	case NET_SHAPER_SCOPE_NETDEV:
+		WRITE_ONCE(ns->wire.pps, pps);
+		WRITE_ONCE(ns->wire.bw_max, bw_max);
+		break;
+	case NET_SHAPER_SCOPE_QUEUE:
+		if (handle->id >= ns->netdev->num_tx_queues)
+			break;
+		WRITE_ONCE(ns->sq[handle->id].pps, pps);
+		WRITE_ONCE(ns->sq[handle->id].bw_max, bw_max);
+		break;
+	default:
+		break;
+	}
+}
+
 static int nsim_shaper_set(struct net_shaper_binding *binding,
 			   const struct net_shaper *shaper,
 			   struct netlink_ext_ack *extack)
 {
+	struct netdevsim *ns = netdev_priv(binding->netdev);
+
+	nsim_shaper_apply(ns, &shaper->handle, shaper->bw_max,
+			  shaper->metric == NET_SHAPER_METRIC_PPS);
 	return 0;
 }
 
@@ -487,6 +803,9 @@ static int nsim_shaper_del(struct net_shaper_binding *binding,
 			   const struct net_shaper_handle *handle,
 			   struct netlink_ext_ack *extack)
 {
+	struct netdevsim *ns = netdev_priv(binding->netdev);
+
+	nsim_shaper_apply(ns, handle, 0, false);
 	return 0;
 }
 
@@ -496,6 +815,14 @@ static int nsim_shaper_group(struct net_shaper_binding *binding,
 			     const struct net_shaper *root,
 			     struct netlink_ext_ack *extack)
 {
+	struct netdevsim *ns = netdev_priv(binding->netdev);
+	int i;
+
+	for (i = 0; i < leaves_count; i++)
+		nsim_shaper_apply(ns, &leaves[i].handle, leaves[i].bw_max,
+				  leaves[i].metric == NET_SHAPER_METRIC_PPS);
+	nsim_shaper_apply(ns, &root->handle, root->bw_max,
+			  root->metric == NET_SHAPER_METRIC_PPS);
 	return 0;
 }
 
@@ -682,8 +1009,32 @@ static int nsim_queue_init(struct netdevsim *ns)
 	if (!ns->rq)
 		return -ENOMEM;
 
-	for (i = 0; i < dev->num_rx_queues; i++)
-		skb_queue_head_init(&ns->rq[i].skb_queue);
+	ns->sq = kvcalloc(dev->num_tx_queues, sizeof(*ns->sq),
+			  GFP_KERNEL_ACCOUNT | __GFP_RETRY_MAYFAIL);
+	if (!ns->sq) {
+		kvfree(ns->rq);
+		ns->rq = NULL;
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < dev->num_rx_queues; i++) {
+		struct nsim_rq *rq = &ns->rq[i];
+
+		skb_queue_head_init(&rq->skb_queue);
+		hrtimer_setup(&rq->irq_timer, nsim_rq_irq, CLOCK_MONOTONIC,
+			      HRTIMER_MODE_ABS_SOFT);
+		u64_stats_init(&rq->syncp);
+	}
+
+	for (i = 0; i < dev->num_tx_queues; i++) {
+		struct nsim_sq *sq = &ns->sq[i];
+
+		sq->ns = ns;
+		skb_queue_head_init(&sq->delay);
+		hrtimer_setup(&sq->timer, nsim_sq_timer, CLOCK_MONOTONIC,
+			      HRTIMER_MODE_ABS_SOFT);
+	}
+	spin_lock_init(&ns->wire.lock);
 
 	return 0;
 }
@@ -693,10 +1044,15 @@ static void nsim_queue_free(struct netdevsim *ns)
 	struct net_device *dev = ns->netdev;
 	int i;
 
-	for (i = 0; i < dev->num_rx_queues; i++)
+	for (i = 0; i < dev->num_rx_queues; i++) {
+		hrtimer_cancel(&ns->rq[i].irq_timer);
 		skb_queue_purge_reason(&ns->rq[i].skb_queue,
 				       SKB_DROP_REASON_QUEUE_PURGE);
+	}
+	nsim_sq_flush(ns);
 
+	kvfree(ns->sq);
+	ns->sq = NULL;
 	kvfree(ns->rq);
 	ns->rq = NULL;
 }
@@ -798,6 +1154,11 @@ nsim_create(struct nsim_dev *nsim_dev, struct nsim_dev_port *nsim_dev_port)
 
 	ns->pp_dfs = debugfs_create_file("pp_hold", 0600, nsim_dev_port->ddir,
 					 ns, &nsim_pp_hold_fops);
+	if (nsim_dev_port_is_pf(nsim_dev_port)) {
+		debugfs_create_u32("tx_latency_us", 0600, nsim_dev_port->ddir,
+				   &ns->wire.latency_us);
+		nsim_rx_gen_init(ns);
+	}
 
 	return ns;
 
@@ -812,6 +1173,8 @@ void nsim_destroy(struct netdevsim *ns)
 	struct netdevsim *peer;
 
 	debugfs_remove(ns->pp_dfs);
+	if (nsim_dev_port_is_pf(ns->nsim_dev_port))
+		nsim_rx_gen_exit(ns);
 
 	rtnl_lock();
 	peer = rtnl_dereference(ns->peer);
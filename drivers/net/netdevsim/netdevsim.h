@@ -16,6 +16,7 @@
 #include <linux/debugfs.h>
 #include <linux/device.h>
 #include <linux/ethtool.h>
+#include <linux/hrtimer.h>
 #include <linux/kernel.h>
 #include <linux/list.h>
 #include <linux/netdevice.h>
@@ -36,6 +37,10 @@
 #define NSIM_IPSEC_VALID		BIT(31)
 #define NSIM_UDP_TUNNEL_N_PORTS		4
 
+#define NSIM_RING_SIZE			256
+#define NSIM_RSS_INDIR_SIZE		128
+#define NSIM_RSS_KEY_SIZE		40
+
 struct nsim_sa {
 	struct xfrm_state *xs;
 	__be32 ipaddr[4];
@@ -80,6 +85,12 @@ struct nsim_ethtool_pauseparam {
 	bool report_stats_tx;
 };
 
+struct nsim_ethtool_rss {
+	bool enabled;
+	u32 indir[NSIM_RSS_INDIR_SIZE];
+	u8 key[NSIM_RSS_KEY_SIZE];
+};
+
 struct nsim_ethtool {
 	u32 get_err;
 	u32 set_err;
@@ -88,12 +99,64 @@ struct nsim_ethtool {
 	struct ethtool_coalesce coalesce;
 	struct ethtool_ringparam ring;
 	struct ethtool_fecparam fec;
+	struct nsim_ethtool_rss rss;
+};
+
+struct nsim_rx_gen_flow {
+	u32 hash;
+	u16 id;
+	u8 hash_type;
+};
+
+/* Share of the generated traffic received by one queue */
+struct nsim_rq_gen {
+	const struct nsim_rx_gen_flow *flows;
+	u32 nr_flows;
+	u32 next;
+	u64 total;
+	u64 done;	/* received or missed */
+	u64 rate;	/* packets per second, 0 for back to back */
+	u64 start;
 };
 
 struct nsim_rq {
 	struct napi_struct napi;
 	struct sk_buff_head skb_queue;
 	struct page_pool *page_pool;
+	struct hrtimer irq_timer;
+	struct nsim_rq_gen gen;
+
+	u64 rx_packets;
+	u64 rx_bytes;
+	u64 rx_missed;
+	struct u64_stats_sync syncp;
+};
+
+/* Packets sent on one queue that are still on the wire, in the order they
+ * are due at the peer.
+ */
+struct nsim_sq {
+	struct netdevsim *ns;
+	struct sk_buff_head delay;
+	struct hrtimer timer;
+	u64 next_ns;
+	u64 bw_max;
+	bool pps;
+};
+
+struct nsim_rx_gen {
+	struct dentry *ddir;
+	u8 *tmpl;
+	u32 tmpl_len;
+	u32 flows;
+	u32 flow_offset;
+	u32 rate_pps;
+
+	/* copies the generation in progress works from */
+	u8 *pkt;
+	u32 pkt_len;
+	u32 pkt_flow_offset;
+	struct nsim_rx_gen_flow *flow_map;
 };
 
 struct netdevsim {
@@ -102,6 +165,16 @@ struct netdevsim {
 	struct nsim_dev_port *nsim_dev_port;
 	struct mock_phc *phc;
 	struct nsim_rq *rq;
+	struct nsim_sq *sq;
+
+	/* link shaper and latency applied to all transmit queues */
+	struct {
+		spinlock_t lock;	/* protects next_ns */
+		u64 next_ns;
+		u64 bw_max;
+		bool pps;
+		u32 latency_us;
+	} wire;
 
 	u64 tx_packets;
 	u64 tx_bytes;
@@ -134,6 +207,7 @@ struct netdevsim {
 
 	struct page *page;
 	struct dentry *pp_dfs;
+	struct nsim_rx_gen rx_gen;
 
 	struct nsim_ethtool ethtool;
 	struct netdevsim __rcu *peer;
@@ -146,6 +220,21 @@ bool netdev_is_nsim(struct net_device *dev);
 
 void nsim_ethtool_init(struct netdevsim *ns);
 
+u32 nsim_rss_hash(struct netdevsim *ns, struct sk_buff *skb,
+		  enum pkt_hash_types *type);
+unsigned int nsim_rss_queue(struct netdevsim *ns, u32 hash);
+
+void nsim_rx_gen_init(struct netdevsim *ns);
+void nsim_rx_gen_exit(struct netdevsim *ns);
+void nsim_rx_gen_reset(struct netdevsim *ns);
+int nsim_rx_gen_poll(struct nsim_rq *rq, int budget);
+u64 nsim_rx_gen_next_ns(const struct nsim_rq *rq);
+
+static inline bool nsim_rx_gen_active(const struct nsim_rq *rq)
+{
+	return rq->gen.done < rq->gen.total;
+}
+
 void nsim_udp_tunnels_debugfs_create(struct nsim_dev *nsim_dev);
 int nsim_udp_tunnels_info_create(struct nsim_dev *nsim_dev,
 				 struct net_device *dev);
@@ -0,0 +1,499 @@
+// SPDX-License-Identifier: GPL-2.0
+/* Receive side traffic generator.
+ *
+ * Builds packets from a template inside the NAPI poll of each receive queue,
+ * as if they had just been DMAed into buffers of the queue's page pool, so
+ * that the stack can be benchmarked without a sender. The flows are spread
+ * over the queues with the RSS configuration, and with a rate set, packets
+ * arrive at the queues over time and overrun the rings if they are not
+ * polled in time.
+ */
+
+#include <linux/debugfs.h>
+#include <linux/etherdevice.h>
+#include <linux/ip.h>
+#include <linux/math64.h>
+#include <linux/netdevice.h>
+#include <linux/rtnetlink.h>
+#include <linux/slab.h>
+#include <linux/udp.h>
+#include <linux/unaligned.h>
+#include <net/checksum.h>
+#include <net/page_pool/helpers.h>
+
+#include "netdevsim.h"
+
+#define NSIM_RX_GEN_HEADROOM	(NET_SKB_PAD + NET_IP_ALIGN)
+#define NSIM_RX_GEN_MAX_LEN	\
+	(SKB_WITH_OVERHEAD(PAGE_SIZE) - NSIM_RX_GEN_HEADROOM)
+#define NSIM_RX_GEN_DEF_LEN	ETH_ZLEN
+
+/* Time at which the @n-th packet of the queue arrives */
+static u64 nsim_rx_gen_arrival(const struct nsim_rq_gen *gen, u64 n)
+{
+	return gen->start + mul_u64_u64_div_u64(n, NSEC_PER_SEC, gen->rate);
+}
+
+u64 nsim_rx_gen_next_ns(const struct nsim_rq *rq)
+{
+	struct netdevsim *ns = netdev_priv(rq->napi.dev);
+	u32 usecs = READ_ONCE(ns->ethtool.coalesce.rx_coalesce_usecs);
+	u32 frames = READ_ONCE(ns->ethtool.coalesce.rx_max_coalesced_frames);
+	const struct nsim_rq_gen *gen = &rq->gen;
+	u64 irq, last;
+
+	/* back to back generation only stops when buffers run out */
+	if (!gen->rate)
+		return ktime_get_ns() + (u64)(usecs ?: 1) * NSEC_PER_USEC;
+
+	irq = nsim_rx_gen_arrival(gen, gen->done + 1);
+	if (!usecs)
+		return irq;
+
+	irq += (u64)usecs * NSEC_PER_USEC;
+	if (frames) {
+		last = min(gen->done + frames, gen->total);
+		irq = min(irq, nsim_rx_gen_arrival(gen, last));
+	}
+	return irq;
+}
+
+static void nsim_rx_gen_fill(u8 *data, const struct nsim_rx_gen *cfg, u16 flow)
+{
+	u32 off = cfg->pkt_flow_offset;
+
+	memcpy(data, cfg->pkt, cfg->pkt_len);
+	if (off <= cfg->pkt_len - sizeof(__be16))
+		put_unaligned_be16(get_unaligned_be16(cfg->pkt + off) + flow,
+				   data + off);
+}
+
+static struct sk_buff *nsim_rx_gen_skb(struct nsim_rq *rq,
+				       const struct nsim_rx_gen *cfg,
+				       const struct nsim_rx_gen_flow *flow)
+{
+	unsigned int size;
+	struct sk_buff *skb;
+	void *va;
+
+	size = SKB_DATA_ALIGN(NSIM_RX_GEN_HEADROOM + cfg->pkt_len) +
+	       SKB_DATA_ALIGN(sizeof(struct skb_shared_info));
+	va = page_pool_dev_alloc_va(rq->page_pool, &size);
+	if (!va)
+		return NULL;
+
+	skb = napi_build_skb(va, size);
+	if (!skb) {
+		page_pool_free_va(rq->page_pool, va, true);
+		return NULL;
+	}
+	skb_mark_for_recycle(skb);
+	skb_reserve(skb, NSIM_RX_GEN_HEADROOM);
+	nsim_rx_gen_fill(skb_put(skb, cfg->pkt_len), cfg, flow->id);
+
+	skb->protocol = eth_type_trans(skb, rq->napi.dev);
+	skb->ip_summed = CHECKSUM_UNNECESSARY;
+	if (flow->hash_type != PKT_HASH_TYPE_NONE)
+		skb_set_hash(skb, flow->hash, flow->hash_type);
+
+	return skb;
+}
+
+int nsim_rx_gen_poll(struct nsim_rq *rq, int budget)
+{
+	struct netdevsim *ns = netdev_priv(rq->napi.dev);
+	u64 avail, bytes = 0, missed = 0;
+	struct nsim_rq_gen *gen = &rq->gen;
+	struct sk_buff *skb;
+	int i, n;
+
+	avail = gen->total - gen->done;
+	if (gen->rate) {
+		avail = mul_u64_u64_div_u64(ktime_get_ns() - gen->start,
+					    gen->rate, NSEC_PER_SEC);
+		avail = min(avail, gen->total) - gen->done;
+		if (avail > NSIM_RING_SIZE) {
+			missed = avail - NSIM_RING_SIZE;
+			gen->done += missed;
+			avail = NSIM_RING_SIZE;
+		}
+	}
+
+	n = min_t(u64, avail, budget);
+	for (i = 0; i < n; i++) {
+		skb = nsim_rx_gen_skb(rq, &ns->rx_gen, &gen->flows[gen->next]);
+		if (!skb)
+			break;
+
+		if (++gen->next == gen->nr_flows)
+			gen->next = 0;
+		skb_record_rx_queue(skb, rq - ns->rq);
+		bytes += skb->len;
+		napi_gro_receive(&rq->napi, skb);
+	}
+	gen->done += i;
+
+	u64_stats_update_begin(&rq->syncp);
+	rq->rx_packets += i;
+	rq->rx_bytes += bytes;
+	rq->rx_missed += missed;
+	u64_stats_update_end(&rq->syncp);
+
+	return i;
+}
+
+/* Called with all the NAPI instances of @ns disabled */
+void nsim_rx_gen_reset(struct netdevsim *ns)
+{
+	struct nsim_rx_gen *cfg = &ns->rx_gen;
+	int i;
+
+	for (i = 0; i < ns->netdev->num_rx_queues; i++)
+		memset(&ns->rq[i].gen, 0, sizeof(ns->rq[i].gen));
+
+	kfree(cfg->flow_map);
+	cfg->flow_map = NULL;
+	kfree(cfg->pkt);
+	cfg->pkt = NULL;
+	cfg->pkt_len = 0;
+}
+
+/* UDP over IPv4 to port 9 of 198.18.0.2, the source port being the flow */
+static u8 *nsim_rx_gen_default_pkt(struct netdevsim *ns, u32 *len)
+{
+	struct ethhdr *eth;
+	struct udphdr *uh;
+	struct iphdr *iph;
+	u8 *pkt;
+
+	pkt = kzalloc(NSIM_RX_GEN_DEF_LEN, GFP_KERNEL);
+	if (!pkt)
+		return NULL;
+
+	eth = (struct ethhdr *)pkt;
+	ether_addr_copy(eth->h_dest, ns->netdev->dev_addr);
+	eth_random_addr(eth->h_source);
+	eth->h_proto = htons(ETH_P_IP);
+
+	iph = (struct iphdr *)(eth + 1);
+	iph->version = 4;
+	iph->ihl = 5;
+	iph->tot_len = htons(NSIM_RX_GEN_DEF_LEN - ETH_HLEN);
+	iph->frag_off = htons(IP_DF);
+	iph->ttl = 64;
+	iph->protocol = IPPROTO_UDP;
+	iph->saddr = htonl(0xc6120001);
+	iph->daddr = htonl(0xc6120002);
+	iph->check = ip_fast_csum(iph, iph->ihl);
+
+	uh = (struct udphdr *)(iph + 1);
+	uh->source = htons(1024);
+	uh->dest = htons(9);
+	uh->len = htons(NSIM_RX_GEN_DEF_LEN - ETH_HLEN - sizeof(*iph));
+
+	*len = NSIM_RX_GEN_DEF_LEN;
+	return pkt;
+}
+
+/* Sorts the flows by the queue RSS steers them to, everything goes to the
+ * first queue with RSS disabled.
+ */
+static int nsim_rx_gen_map_flows(struct netdevsim *ns, u32 *per_queue)
+{
+	struct nsim_rx_gen *cfg = &ns->rx_gen;
+	struct net_device *dev = ns->netdev;
+	struct nsim_rx_gen_flow *flows;
+	u32 i, q, *queue, *pos;
+	enum pkt_hash_types type;
+	struct sk_buff *skb;
+	int err = -ENOMEM;
+
+	flows = kcalloc(cfg->flows, sizeof(*flows), GFP_KERNEL);
+	queue = kcalloc(cfg->flows, sizeof(*queue), GFP_KERNEL);
+	pos = kcalloc(dev->num_rx_queues, sizeof(*pos), GFP_KERNEL);
+	skb = alloc_skb(cfg->pkt_len, GFP_KERNEL);
+	cfg->flow_map = kcalloc(cfg->flows, sizeof(*cfg->flow_map), GFP_KERNEL);
+	if (!flows || !queue || !pos || !skb || !cfg->flow_map)
+		goto out;
+
+	skb_put(skb, cfg->pkt_len);
+	for (i = 0; i < cfg->flows; i++) {
+		flows[i].id = i;
+		if (!ns->ethtool.rss.enabled)
+			continue;
+
+		nsim_rx_gen_fill(skb->data, cfg, i);
+		skb->protocol = eth_type_trans(skb, dev);
+		flows[i].hash = nsim_rss_hash(ns, skb, &type);
+		flows[i].hash_type = type;
+		queue[i] = nsim_rss_queue(ns, flows[i].hash);
+		skb_push(skb, ETH_HLEN);
+	}
+
+	for (i = 0; i < cfg->flows; i++)
+		per_queue[queue[i]]++;
+	for (q = 0; q < dev->num_rx_queues; q++) {
+		if (q)
+			pos[q] = pos[q - 1] + per_queue[q - 1];
+		ns->rq[q].gen.flows = &cfg->flow_map[pos[q]];
+		ns->rq[q].gen.nr_flows = per_queue[q];
+	}
+	for (i = 0; i < cfg->flows; i++)
+		cfg->flow_map[pos[queue[i]]++] = flows[i];
+	err = 0;
+out:
+	kfree_skb(skb);
+	kfree(pos);
+	kfree(queue);
+	kfree(flows);
+	return err;
+}
+
+static void nsim_rx_gen_quiesce(struct netdevsim *ns)
+{
+	int i;
+
+	for (i = 0; i < ns->netdev->num_rx_queues; i++)
+		napi_disable(&ns->rq[i].napi);
+}
+
+static void nsim_rx_gen_resume(struct netdevsim *ns)
+{
+	int i;
+
+	for (i = 0; i < ns->netdev->num_rx_queues; i++)
+		napi_enable(&ns->rq[i].napi);
+
+	local_bh_disable();
+	for (i = 0; i < ns->netdev->num_rx_queues; i++)
+		if (nsim_rx_gen_active(&ns->rq[i]))
+			napi_schedule(&ns->rq[i].napi);
+	local_bh_enable();
+}
+
+/* Splits @count packets and the rate among the queues, in proportion to the
+ * flows each of them receives. Called under rtnl_lock().
+ */
+static int nsim_rx_gen_start(struct netdevsim *ns, u64 count)
+{
+	struct nsim_rx_gen *cfg = &ns->rx_gen;
+	struct net_device *dev = ns->netdev;
+	u32 i, q, rem, *per_queue;
+	u64 start, per_flow;
+	int err;
+
+	if (!netif_running(dev))
+		return count ? -ENETDOWN : 0;
+
+	nsim_rx_gen_quiesce(ns);
+	nsim_rx_gen_reset(ns);
+	if (!count) {
+		err = 0;
+		goto out_resume;
+	}
+
+	err = -EINVAL;
+	if (!cfg->flows || cfg->flows > U16_MAX + 1 ||
+	    (cfg->flows > 1 && cfg->flow_offset >
+	     (cfg->tmpl_len ?: NSIM_RX_GEN_DEF_LEN) - sizeof(__be16)))
+		goto out_resume;
+
+	err = -ENOMEM;
+	if (cfg->tmpl) {
+		cfg->pkt = kmemdup(cfg->tmpl, cfg->tmpl_len, GFP_KERNEL);
+		cfg->pkt_len = cfg->tmpl_len;
+	} else {
+		cfg->pkt = nsim_rx_gen_default_pkt(ns, &cfg->pkt_len);
+	}
+	if (!cfg->pkt)
+		goto out_reset;
+	cfg->pkt_flow_offset = cfg->flow_offset;
+
+	per_queue = kcalloc(dev->num_rx_queues, sizeof(*per_queue), GFP_KERNEL);
+	if (!per_queue)
+		goto out_reset;
+	err = nsim_rx_gen_map_flows(ns, per_queue);
+	if (err)
+		goto out_free;
+
+	per_flow = div_u64_rem(count, cfg->flows, &rem);
+	start = ktime_get_ns();
+	for (q = 0; q < dev->num_rx_queues; q++) {
+		struct nsim_rq_gen *gen = &ns->rq[q].gen;
+
+		if (!gen->nr_flows)
+			continue;
+
+		for (i = 0; i < gen->nr_flows; i++)
+			gen->total += per_flow + (gen->flows[i].id < rem);
+		if (cfg->rate_pps)
+			gen->rate = div_u64((u64)cfg->rate_pps * gen->nr_flows,
+					    cfg->flows) ?: 1;
+		gen->start = start;
+	}
+
+out_free:
+	kfree(per_queue);
+out_reset:
+	if (err)
+		nsim_rx_gen_reset(ns);
+out_resume:
+	nsim_rx_gen_resume(ns);
+	return err;
+}
+
+static ssize_t nsim_rx_gen_count_read(struct file *file, char __user *data,
+				      size_t count, loff_t *ppos)
+{
+	struct netdevsim *ns = file->private_data;
+	u64 left = 0;
+	char buf[24];
+	int i, len;
+
+	rtnl_lock();
+	for (i = 0; ns->rq && i < ns->netdev->num_rx_queues; i++)
+		left += READ_ONCE(ns->rq[i].gen.total) -
+			READ_ONCE(ns->rq[i].gen.done);
+	rtnl_unlock();
+
+	len = scnprintf(buf, sizeof(buf), "%llu\n", left);
+	return simple_read_from_buffer(data, count, ppos, buf, len);
+}
+
+static ssize_t nsim_rx_gen_count_write(struct file *file,
+				       const char __user *data,
+				       size_t count, loff_t *ppos)
+{
+	struct netdevsim *ns = file->private_data;
+	ssize_t ret;
+	u64 val;
+
+	ret = kstrtou64_from_user(data, count, 0, &val);
+	if (ret)
+		return ret;
+
+	rtnl_lock();
+	ret = nsim_rx_gen_start(ns, val) ?: count;
+	rtnl_unlock();
+
+	return ret;
+}
+
+static const struct file_operations nsim_rx_gen_count_fops = {
+	.open = simple_open,
+	.read = nsim_rx_gen_count_read,
+	.write = nsim_rx_gen_count_write,
+	.llseek = generic_file_llseek,
+	.owner = THIS_MODULE,
+};
+
+static ssize_t nsim_rx_gen_tmpl_read(struct file *file, char __user *data,
+				     size_t count, loff_t *ppos)
+{
+	struct netdevsim *ns = file->private_data;
+	struct nsim_rx_gen *cfg = &ns->rx_gen;
+	ssize_t ret;
+	size_t len;
+	char *buf;
+
+	rtnl_lock();
+	len = cfg->tmpl_len * 2 + 1;
+	buf = kmalloc(len, GFP_KERNEL);
+	if (!buf) {
+		rtnl_unlock();
+		return -ENOMEM;
+	}
+	bin2hex(buf, cfg->tmpl, cfg->tmpl_len);
+	buf[len - 1] = '\n';
+	rtnl_unlock();
+
+	ret = simple_read_from_buffer(data, count, ppos, buf, len);
+	kfree(buf);
+	return ret;
+}
+
+/* The template is written as a hex string of the whole frame, starting with
+ * the Ethernet header. An empty string reverts to the built-in UDP packet.
+ */
+static ssize_t nsim_rx_gen_tmpl_write(struct file *file,
+				      const char __user *data,
+				      size_t count, loff_t *ppos)
+{
+	struct netdevsim *ns = file->private_data;
+	struct nsim_rx_gen *cfg = &ns->rx_gen;
+	size_t len = count;
+	u8 *tmpl = NULL;
+	ssize_t ret;
+	char *buf;
+
+	if (*ppos != 0)
+		return -EINVAL;
+
+	buf = memdup_user(data, count);
+	if (IS_ERR(buf))
+		return PTR_ERR(buf);
+
+	if (len && buf[len - 1] == '\n')
+		len--;
+	ret = -EINVAL;
+	if (len % 2 || (len && (len / 2 < ETH_HLEN ||
+				len / 2 > NSIM_RX_GEN_MAX_LEN)))
+		goto free_buf;
+
+	if (len) {
+		tmpl = kmalloc(len / 2, GFP_KERNEL);
+		ret = -ENOMEM;
+		if (!tmpl)
+			goto free_buf;
+		ret = hex2bin(tmpl, buf, len / 2);
+		if (ret)
+			goto free_tmpl;
+	}
+
+	rtnl_lock();
+	kfree(cfg->tmpl);
+	cfg->tmpl = tmpl;
+	cfg->tmpl_len = len / 2;
+	rtnl_unlock();
+	kfree(buf);
+
+	return count;
+
+free_tmpl:
+	kfree(tmpl);
+free_buf:
+	kfree(buf);
+	return ret;
+}
+
+static const struct file_operations nsim_rx_gen_tmpl_fops = {
+	.open = simple_open,
+	.read = nsim_rx_gen_tmpl_read,
+	.write = nsim_rx_gen_tmpl_write,
+	.llseek = generic_file_llseek,
+	.owner = THIS_MODULE,
+};
+
+void nsim_rx_gen_init(struct netdevsim *ns)
+{
+	struct nsim_rx_gen *cfg = &ns->rx_gen;
+
+	cfg->flows = 1;
+	cfg->flow_offset = ETH_HLEN + sizeof(struct iphdr);
+
+	cfg->ddir = debugfs_create_dir("rx_gen", ns->nsim_dev_port->ddir);
+	debugfs_create_file("template", 0600, cfg->ddir, ns,
+			    &nsim_rx_gen_tmpl_fops);
+	debugfs_create_u32("flows", 0600, cfg->ddir, &cfg->flows);
+	debugfs_create_u32("flow_offset", 0600, cfg->ddir, &cfg->flow_offset);
+	debugfs_create_u32("rate_pps", 0600, cfg->ddir, &cfg->rate_pps);
+	debugfs_create_file("count", 0600, cfg->ddir, ns,
+			    &nsim_rx_gen_count_fops);
+}
+
+void nsim_rx_gen_exit(struct netdevsim *ns)
+{
+	debugfs_remove_recursive(ns->rx_gen.ddir);
+	kfree(ns->rx_gen.tmpl);
+	ns->rx_gen.tmpl = NULL;
+}
@@ -28,6 +28,7 @@
 #include <linux/net_tstamp.h>
 #include <linux/skbuff_ref.h>
 #include <net/page_pool/helpers.h>
+#include <net/xdp_sock_drv.h>
 
 #define DRV_NAME	"veth"
 #define DRV_VERSION	"1.0"
@@ -39,6 +40,11 @@
 #define VETH_XDP_TX_BULK_SIZE	16
 #define VETH_XDP_BATCH		16
 
+/* AF_XDP TX frames are copied into a page the peer can own, like XDP_TX */
+#define VETH_XSK_TX_MAX_LEN	(PAGE_SIZE - sizeof(struct xdp_frame) - \
+				 XDP_PACKET_HEADROOM - \
+				 SKB_DATA_ALIGN(sizeof(struct skb_shared_info)))
+
 struct veth_stats {
 	u64	rx_drops;
 	/* xdp */
@@ -50,6 +56,9 @@ struct veth_stats {
 	u64	xdp_tx_err;
 	u64	peer_tq_xdp_xmit;
 	u64	peer_tq_xdp_xmit_err;
+	/* AF_XDP zero-copy */
+	u64	xsk_xmit;
+	u64	xsk_xmit_err;
 };
 
 struct veth_rq_stats {
@@ -68,6 +77,8 @@ struct veth_rq {
 	struct ptr_ring		xdp_ring;
 	struct xdp_rxq_info	xdp_rxq;
 	struct page_pool	*page_pool;
+	struct xsk_buff_pool __rcu *xsk_pool;
+	struct xdp_rxq_info	xsk_rxq;
 };
 
 struct veth_priv {
@@ -102,6 +113,8 @@ static const struct veth_q_stat_desc veth_rq_stats_desc[] = {
 	{ "xdp_drops",		VETH_RQ_STAT(xdp_drops) },
 	{ "xdp_tx",		VETH_RQ_STAT(xdp_tx) },
 	{ "xdp_tx_errors",	VETH_RQ_STAT(xdp_tx_err) },
+	{ "xsk_xmit",		VETH_RQ_STAT(xsk_xmit) },
+	{ "xsk_xmit_errors",	VETH_RQ_STAT(xsk_xmit_err) },
 };
 
 #define VETH_RQ_STATS_LEN	ARRAY_SIZE(veth_rq_stats_desc)
@@ -870,8 +883,205 @@ static struct sk_buff *veth_xdp_rcv_skb(struct veth_rq *rq,
 	return NULL;
 }
 
-static int veth_xdp_rcv(struct veth_rq *rq, int budget,
-			struct veth_xdp_tx_bq *bq,
+static void veth_xsk_copy_frame(void *dst, struct xdp_frame *frame)
+{
+	struct skb_shared_info *sinfo;
+	int i;
+
+	memcpy(dst, frame->data, frame->len);
+	if (likely(!xdp_frame_has_frags(frame)))
+		return;
+
+	dst += frame->len;
+	sinfo = xdp_get_shared_info_from_frame(frame);
+	for (i = 0; i < sinfo->nr_frags; i++) {
+		const skb_frag_t *frag = &sinfo->frags[i];
+
+		memcpy(dst, skb_frag_address(frag), skb_frag_size(frag));
+		dst += skb_frag_size(frag);
+	}
+}
+
+/* Checksum state and VLAN tag of a peer skb, kept across the copy into
+ * UMEM. csum_start is relative to the start of the frame as the peer sent
+ * it.
+ */
+struct veth_xsk_state {
+	u8	ip_summed;
+	int	csum_start;
+	u16	csum_offset;
+	__be16	vlan_proto;
+	u16	vlan_tci;
+};
+
+static struct sk_buff *veth_xsk_build_skb(struct veth_rq *rq,
+					  struct xdp_buff *xdp,
+					  const struct veth_xsk_state *st,
+					  int moved)
+{
+	unsigned int totalsize = xdp->data_end - xdp->data_meta;
+	unsigned int metasize = xdp->data - xdp->data_meta;
+	struct sk_buff *skb;
+
+	skb = napi_alloc_skb(&rq->xdp_napi, totalsize);
+	if (unlikely(!skb))
+		goto out;
+
+	memcpy(__skb_put(skb, totalsize), xdp->data_meta, totalsize);
+	if (metasize) {
+		skb_metadata_set(skb, metasize);
+		__skb_pull(skb, metasize);
+	}
+
+	/* A locally generated packet may still have its checksum to be
+	 * filled in; follow it if the program moved the start of the frame.
+	 */
+	if (st->ip_summed == CHECKSUM_PARTIAL) {
+		int start = st->csum_start + moved;
+
+		if (start < 0 ||
+		    !skb_partial_csum_set(skb, start, st->csum_offset)) {
+			kfree_skb(skb);
+			skb = NULL;
+			goto out;
+		}
+	} else if (st->ip_summed == CHECKSUM_UNNECESSARY) {
+		skb->ip_summed = CHECKSUM_UNNECESSARY;
+	}
+
+	if (st->vlan_proto)
+		__vlan_hwaccel_put_tag(skb, st->vlan_proto, st->vlan_tci);
+
+	skb->protocol = eth_type_trans(skb, rq->dev);
+out:
+	xsk_buff_free(xdp);
+
+	return skb;
+}
+
+/* Whether a frame from the peer can take the zero-copy path; GSO and
+ * anything else larger than a UMEM frame go through the regular one.
+ */
+static bool veth_xsk_rcv_fits(struct xsk_buff_pool *pool, void *ptr)
+{
+	u32 max = xsk_pool_get_rx_frame_size(pool);
+	struct sk_buff *skb;
+
+	if (veth_is_xdp_frame(ptr))
+		return xdp_get_frame_len(veth_ptr_to_xdp(ptr)) <= max;
+
+	skb = ptr;
+	return !skb_is_gso(skb) &&
+	       skb->len + (skb->data - skb_mac_header(skb)) <= max;
+}
+
+/* With an AF_XDP pool bound to the queue, whatever the peer sends is copied
+ * once into a UMEM buffer, which is what the XDP program sees and what gets
+ * redirected to the socket without any further copy. XDP_PASS has to copy
+ * it back into an skb, like for hardware zero-copy drivers.
+ */
+static struct sk_buff *veth_xsk_rcv(struct veth_rq *rq,
+				    struct xsk_buff_pool *pool, void *ptr,
+				    struct veth_xdp_tx_bq *bq,
+				    struct veth_stats *stats)
+{
+	struct veth_xsk_state st = { .ip_summed = CHECKSUM_NONE };
+	struct xdp_frame *frame = NULL;
+	struct sk_buff *skb = NULL;
+	struct bpf_prog *xdp_prog;
+	struct xdp_buff *xdp;
+	void *orig_data;
+	u32 act, len;
+
+	XSK_CHECK_PRIV_TYPE(struct veth_xdp_buff);
+
+	if (veth_is_xdp_frame(ptr)) {
+		frame = veth_ptr_to_xdp(ptr);
+		len = xdp_get_frame_len(frame);
+	} else {
+		skb = ptr;
+		__skb_push(skb, skb->data - skb_mac_header(skb));
+		len = skb->len;
+		st.ip_summed = skb->ip_summed;
+		if (skb->ip_summed == CHECKSUM_PARTIAL) {
+			st.csum_start = skb_checksum_start_offset(skb);
+			st.csum_offset = skb->csum_offset;
+		}
+		if (skb_vlan_tag_present(skb)) {
+			st.vlan_proto = skb->vlan_proto;
+			st.vlan_tci = skb_vlan_tag_get(skb);
+		}
+	}
+	stats->xdp_bytes += len;
+
+	xdp = xsk_buff_alloc(pool);
+	if (unlikely(!xdp)) {
+		if (xsk_uses_need_wakeup(pool))
+			xsk_set_rx_need_wakeup(pool);
+		goto drop;
+	}
+	if (xsk_uses_need_wakeup(pool))
+		xsk_clear_rx_need_wakeup(pool);
+
+	if (frame) {
+		veth_xsk_copy_frame(xdp->data, frame);
+		xdp_return_frame(frame);
+	} else {
+		skb_copy_bits(skb, 0, xdp->data, len);
+	}
+	xdp->data_end = xdp->data + len;
+	orig_data = xdp->data;
+	/* for the metadata kfuncs */
+	((struct veth_xdp_buff *)xdp)->skb = skb;
+
+	xdp_prog = rcu_dereference(rq->xdp_prog);
+	act = xdp_prog ? bpf_prog_run_xdp(xdp_prog, xdp) : XDP_PASS;
+	consume_skb(skb);
+
+	switch (act) {
+	case XDP_PASS:
+		skb = veth_xsk_build_skb(rq, xdp, &st, orig_data - xdp->data);
+		if (unlikely(!skb))
+			stats->rx_drops++;
+		return skb;
+	case XDP_TX:
+		/* the UMEM buffer is copied into a page and released */
+		if (unlikely(veth_xdp_tx(rq, xdp, bq) < 0)) {
+			trace_xdp_exception(rq->dev, xdp_prog, act);
+			stats->rx_drops++;
+			goto err_xdp;
+		}
+		stats->xdp_tx++;
+		return NULL;
+	case XDP_REDIRECT:
+		if (xdp_do_redirect(rq->dev, xdp, xdp_prog)) {
+			stats->rx_drops++;
+			goto err_xdp;
+		}
+		stats->xdp_redirect++;
+		return NULL;
+	default:
+		bpf_warn_invalid_xdp_action(rq->dev, xdp_prog, act);
+		fallthrough;
+	case XDP_ABORTED:
+		trace_xdp_exception(rq->dev, xdp_prog, act);
+		fallthrough;
+	case XDP_DROP:
+		stats->xdp_drops++;
+		goto err_xdp;
+	}
+
+err_xdp:
+	xsk_buff_free(xdp);
+	return NULL;
+drop:
+	veth_ptr_free(ptr);
+	stats->rx_drops++;
+	return NULL;
+}
+
+static int veth_xdp_rcv(struct veth_rq *rq, struct xsk_buff_pool *pool,
+			int budget, struct veth_xdp_tx_bq *bq,
 			struct veth_stats *stats)
 {
 	int i, done = 0, n_xdpf = 0;
@@ -883,7 +1093,14 @@ static int veth_xdp_rcv(struct veth_rq *rq, int budget,
 		if (!ptr)
 			break;
 
-		if (veth_is_xdp_frame(ptr)) {
+		if (pool && veth_xsk_rcv_fits(pool, ptr)) {
+			/* AF_XDP zero-copy */
+			struct sk_buff *skb;
+
+			skb = veth_xsk_rcv(rq, pool, ptr, bq, stats);
+			if (skb)
+				napi_gro_receive(&rq->xdp_napi, skb);
+		} else if (veth_is_xdp_frame(ptr)) {
 			/* ndo_xdp_xmit */
 			struct xdp_frame *frame = veth_ptr_to_xdp(ptr);
 
@@ -928,18 +1145,129 @@ static int veth_xdp_rcv(struct veth_rq *rq, int budget,
 	return done;
 }
 
+/* Copy an AF_XDP TX descriptor into a page, laid out like an XDP_TX frame */
+static struct xdp_frame *veth_xsk_desc_to_frame(struct xsk_buff_pool *pool,
+						const struct xdp_desc *desc)
+{
+	struct xdp_frame *frame;
+	struct page *page;
+
+	if (unlikely(desc->len > VETH_XSK_TX_MAX_LEN))
+		return NULL;
+
+	page = dev_alloc_page();
+	if (unlikely(!page))
+		return NULL;
+
+	frame = page_address(page);
+	memset(frame, 0, sizeof(*frame));
+	frame->data = (void *)(frame + 1) + XDP_PACKET_HEADROOM;
+	frame->len = desc->len;
+	frame->headroom = XDP_PACKET_HEADROOM;
+	frame->frame_sz = PAGE_SIZE;
+	frame->mem.type = MEM_TYPE_PAGE_ORDER0;
+	memcpy(frame->data, xsk_buff_raw_get_data(pool, desc->addr), desc->len);
+
+	return frame;
+}
+
+/* The peer has no NAPI to take frames, hand it skbs instead */
+static int veth_xsk_xmit_skb(struct veth_rq *rq, struct xdp_frame **frames,
+			     int n)
+{
+	int i, sent = 0;
+
+	for (i = 0; i < n; i++) {
+		struct sk_buff *skb;
+
+		skb = xdp_build_skb_from_frame(frames[i], rq->dev);
+		if (unlikely(!skb)) {
+			xdp_return_frame(frames[i]);
+			continue;
+		}
+		__skb_push(skb, skb->data - skb_mac_header(skb));
+		skb_set_queue_mapping(skb, rq->xsk_rxq.queue_index);
+		if (veth_xmit(skb, rq->dev) == NETDEV_TX_OK)
+			sent++;
+	}
+
+	return sent;
+}
+
+/* Send the TX ring of the AF_XDP socket bound to @rq to the peer, as
+ * xdp_frames when the peer runs NAPI, so that no skb is built on the way.
+ */
+static int veth_xsk_xmit(struct veth_rq *rq, struct xsk_buff_pool *pool,
+			 int budget)
+{
+	struct xdp_frame *frames[VETH_XDP_TX_BULK_SIZE];
+	struct xdp_desc *descs = pool->tx_descs;
+	int i, j, n, sent, nb, done = 0;
+
+	nb = xsk_tx_peek_release_desc_batch(pool, budget);
+	for (i = 0; i < nb; i += VETH_XDP_TX_BULK_SIZE) {
+		int end = min(nb, i + VETH_XDP_TX_BULK_SIZE);
+
+		n = 0;
+		for (j = i; j < end; j++) {
+			struct xdp_frame *frame;
+
+			frame = veth_xsk_desc_to_frame(pool, &descs[j]);
+			if (frame)
+				frames[n++] = frame;
+		}
+		if (!n)
+			continue;
+
+		sent = veth_xdp_xmit(rq->dev, n, frames, XDP_XMIT_FLUSH, false);
+		if (sent < 0) {
+			sent = veth_xsk_xmit_skb(rq, frames, n);
+		} else {
+			for (j = sent; j < n; j++)
+				xdp_return_frame(frames[j]);
+		}
+		done += sent;
+	}
+
+	if (nb) {
+		/* the data was copied, the descriptors complete right away */
+		xsk_tx_completed(pool, nb);
+
+		u64_stats_update_begin(&rq->stats.syncp);
+		rq->stats.vs.xsk_xmit += done;
+		rq->stats.vs.xsk_xmit_err += nb - done;
+		u64_stats_update_end(&rq->stats.syncp);
+	}
+
+	if (xsk_uses_need_wakeup(pool)) {
+		if (nb < budget)
+			xsk_set_tx_need_wakeup(pool);
+		else
+			xsk_clear_tx_need_wakeup(pool);
+	}
+
+	return nb;
+}
+
 static int veth_poll(struct napi_struct *napi, int budget)
 {
 	struct veth_rq *rq =
 		container_of(napi, struct veth_rq, xdp_napi);
 	struct veth_stats stats = {};
+	struct xsk_buff_pool *pool;
 	struct veth_xdp_tx_bq bq;
 	int done;
 
 	bq.count = 0;
 
+	rcu_read_lock();
+	pool = rcu_dereference(rq->xsk_pool);
 	xdp_set_return_frame_no_direct();
-	done = veth_xdp_rcv(rq, budget, &bq, &stats);
+	done = veth_xdp_rcv(rq, pool, budget, &bq, &stats);
+	/* keep polling while the socket has more to send */
+	if (pool && veth_xsk_xmit(rq, pool, budget) >= budget)
+		done = budget;
+	rcu_read_unlock();
 
 	if (stats.xdp_redirect > 0)
 		xdp_do_flush();
@@ -1060,9 +1388,21 @@ static void veth_napi_del(struct net_device *dev)
 	veth_napi_del_range(dev, 0, dev->real_num_rx_queues);
 }
 
+static bool veth_xsk_bound(const struct net_device *dev)
+{
+	struct veth_priv *priv = netdev_priv(dev);
+	int i;
+
+	for (i = 0; i < dev->real_num_rx_queues; i++)
+		if (rcu_access_pointer(priv->rq[i].xsk_pool))
+			return true;
+	return false;
+}
+
+/* veth_fix_features() keeps GRO on while zero-copy sockets are bound */
 static bool veth_gro_requested(const struct net_device *dev)
 {
-	return !!(dev->wanted_features & NETIF_F_GRO);
+	return !!(dev->wanted_features & NETIF_F_GRO) || veth_xsk_bound(dev);
 }
 
 static int veth_enable_xdp_range(struct net_device *dev, int start, int end,
@@ -1250,6 +1590,9 @@ static void veth_set_xdp_features(struct net_device *dev)
 		if (priv_peer->_xdp_prog || veth_gro_requested(peer))
 			val |= NETDEV_XDP_ACT_NDO_XMIT |
 			       NETDEV_XDP_ACT_NDO_XMIT_SG;
+		/* zero-copy sockets are served from our own NAPI */
+		if (priv->_xdp_prog || veth_gro_requested(dev))
+			val |= NETDEV_XDP_ACT_XSK_ZEROCOPY;
 		xdp_set_features_flag(dev, val);
 	} else {
 		xdp_clear_features_flag(dev);
@@ -1466,6 +1809,10 @@ static netdev_features_t veth_fix_features(struct net_device *dev,
 			features &= ~NETIF_F_GSO_SOFTWARE;
 	}
 
+	/* zero-copy AF_XDP sockets need the NAPI that GRO keeps around */
+	if (veth_xsk_bound(dev))
+		features |= NETIF_F_GRO;
+
 	return features;
 }
 
@@ -1477,7 +1824,11 @@ static int veth_set_features(struct net_device *dev,
 	struct net_device *peer;
 	int err;
 
-	if (!(changed & NETIF_F_GRO) || !(dev->flags & IFF_UP) || priv->_xdp_prog)
+	if (!(changed & NETIF_F_GRO) || priv->_xdp_prog)
+		return 0;
+
+	veth_set_xdp_features(dev);
+	if (!(dev->flags & IFF_UP))
 		return 0;
 
 	peer = rtnl_dereference(priv->peer);
@@ -1593,6 +1944,8 @@ static int veth_xdp_set(struct net_device *dev, struct bpf_prog *prog,
 
 	if ((!!old_prog ^ !!prog) && peer)
 		netdev_update_features(peer);
+	if (!!old_prog ^ !!prog)
+		veth_set_xdp_features(dev);
 
 	return 0;
 err:
@@ -1601,11 +1954,118 @@ static int veth_xdp_set(struct net_device *dev, struct bpf_prog *prog,
 	return err;
 }
 
+static int veth_xsk_pool_enable(struct net_device *dev,
+				struct xsk_buff_pool *pool, u16 qid)
+{
+	struct veth_priv *priv = netdev_priv(dev);
+	struct veth_rq *rq;
+	int err;
+
+	if (qid >= dev->real_num_rx_queues || qid >= dev->real_num_tx_queues)
+		return -EINVAL;
+
+	/* RX and the TX wakeup both run from NAPI, which only exists with an
+	 * XDP program or GRO; without either the socket binds in copy mode.
+	 */
+	if (!priv->_xdp_prog && !veth_gro_requested(dev))
+		return -EOPNOTSUPP;
+
+	rq = &priv->rq[qid];
+	if (rtnl_dereference(rq->xsk_pool))
+		return -EBUSY;
+
+	/* buffers are only ever touched by the CPU, there is no DMA device */
+	err = xsk_pool_dma_map(pool, NULL, 0);
+	if (err)
+		return err;
+
+	err = xdp_rxq_info_reg(&rq->xsk_rxq, dev, qid, rq->xdp_napi.napi_id);
+	if (err < 0)
+		goto err_unmap;
+
+	err = xdp_rxq_info_reg_mem_model(&rq->xsk_rxq,
+					 MEM_TYPE_XSK_BUFF_POOL, NULL);
+	if (err < 0)
+		goto err_unreg;
+
+	xsk_pool_set_rxq_info(pool, &rq->xsk_rxq);
+	rcu_assign_pointer(rq->xsk_pool, pool);
+	/* forces GRO on, and with it the NAPI once XDP goes away */
+	netdev_update_features(dev);
+
+	return 0;
+err_unreg:
+	xdp_rxq_info_unreg(&rq->xsk_rxq);
+err_unmap:
+	xsk_pool_dma_unmap(pool, 0);
+	return err;
+}
+
+static int veth_xsk_pool_disable(struct net_device *dev, u16 qid)
+{
+	struct veth_priv *priv = netdev_priv(dev);
+	struct xsk_buff_pool *pool;
+	struct veth_rq *rq;
+
+	if (qid >= dev->num_rx_queues)
+		return -EINVAL;
+
+	rq = &priv->rq[qid];
+	pool = rtnl_dereference(rq->xsk_pool);
+	if (!pool)
+		return -EINVAL;
+
+	RCU_INIT_POINTER(rq->xsk_pool, NULL);
+	/* wait for veth_poll() to stop using the pool */
+	synchronize_net();
+
+	xdp_rxq_info_unreg(&rq->xsk_rxq);
+	xsk_pool_dma_unmap(pool, 0);
+	/* drops the NAPI if GRO was only on for zero-copy sockets */
+	netdev_update_features(dev);
+
+	return 0;
+}
+
+static int veth_xsk_pool_setup(struct net_device *dev,
+			       struct xsk_buff_pool *pool, u16 qid)
+{
+	return pool ? veth_xsk_pool_enable(dev, pool, qid) :
+		      veth_xsk_pool_disable(dev, qid);
+}
+
+static int veth_xsk_wakeup(struct net_device *dev, u32 qid, u32 flags)
+{
+	struct veth_priv *priv = netdev_priv(dev);
+	struct veth_rq *rq;
+
+	if (!netif_running(dev))
+		return -ENETDOWN;
+
+	if (qid >= dev->real_num_rx_queues)
+		return -EINVAL;
+
+	rq = &priv->rq[qid];
+	/* NAPI runs as long as an XDP program is attached or GRO is on */
+	if (!rcu_access_pointer(rq->xsk_pool) || !rcu_access_pointer(rq->napi))
+		return -ENXIO;
+
+	/* marks NAPI missed if it is running, so the TX ring is seen */
+	local_bh_disable();
+	napi_schedule(&rq->xdp_napi);
+	local_bh_enable();
+
+	return 0;
+}
+
 static int veth_xdp(struct net_device *dev, struct netdev_bpf *xdp)
 {
 	switch (xdp->command) {
 	case XDP_SETUP_PROG:
 		return veth_xdp_set(dev, xdp->prog, xdp->extack);
+	case XDP_SETUP_XSK_POOL:
+		return veth_xsk_pool_setup(dev, xdp->xsk.pool,
+					   xdp->xsk.queue_id);
 	default:
 		return -EINVAL;
 	}
@@ -1673,6 +2133,7 @@ static const struct net_device_ops veth_netdev_ops = {
 	.ndo_set_rx_headroom	= veth_set_rx_headroom,
 	.ndo_bpf		= veth_xdp,
 	.ndo_xdp_xmit		= veth_ndo_xdp_xmit,
+	.ndo_xsk_wakeup		= veth_xsk_wakeup,
 	.ndo_get_peer_dev	= veth_peer_dev,
 };
 
@@ -50,7 +50,9 @@ enum limits {
 	MAX_TIMER_HANDSHAKES = 90 / REKEY_TIMEOUT,
 	MAX_QUEUED_INCOMING_HANDSHAKES = 4096, /* TODO: replace this with DQL */
 	MAX_STAGED_PACKETS = 128,
-	MAX_QUEUED_PACKETS = 1024 /* TODO: replace this with DQL */
+	MAX_QUEUED_PACKETS = 1024, /* TODO: replace this with DQL */
+	MAX_CRYPT_BATCH = 16,
+	MAX_GSO_SEGMENTS = 64
 };
 
 enum message_type {
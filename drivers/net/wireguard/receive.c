@@ -239,13 +239,8 @@ static void keep_key_fresh(struct wg_peer *peer)
 	}
 }
 
-static bool decrypt_packet(struct sk_buff *skb, struct noise_keypair *keypair)
+static bool keypair_can_decrypt(struct noise_keypair *keypair)
 {
-	struct scatterlist sg[MAX_SKB_FRAGS + 8];
-	struct sk_buff *trailer;
-	unsigned int offset;
-	int num_frags;
-
 	if (unlikely(!keypair))
 		return false;
 
@@ -255,6 +250,15 @@ static bool decrypt_packet(struct sk_buff *skb, struct noise_keypair *keypair)
 		WRITE_ONCE(keypair->receiving.is_valid, false);
 		return false;
 	}
+	return true;
+}
+
+static bool decrypt_packet(struct sk_buff *skb, struct noise_keypair *keypair)
+{
+	struct scatterlist sg[MAX_SKB_FRAGS + 8];
+	struct sk_buff *trailer;
+	unsigned int offset;
+	int num_frags;
 
 	PACKET_CB(skb)->nonce =
 		le64_to_cpu(((struct message_data *)skb->data)->counter);
@@ -494,13 +498,29 @@ void wg_packet_decrypt_worker(struct work_struct *work)
 {
 	struct crypt_queue *queue = container_of(work, struct multicore_worker,
 						 work)->ptr;
-	struct sk_buff *skb;
+	struct sk_buff *skbs[MAX_CRYPT_BATCH];
+	struct noise_keypair *keypair;
+	enum packet_state state;
+	bool usable;
+	int i, n;
 
-	while ((skb = ptr_ring_consume_bh(&queue->ring)) != NULL) {
-		enum packet_state state =
-			likely(decrypt_packet(skb, PACKET_CB(skb)->keypair)) ?
-				PACKET_STATE_CRYPTED : PACKET_STATE_DEAD;
-		wg_queue_enqueue_per_peer_rx(skb, state);
+	/* Packets are taken off the ring a batch at a time, and the keypair
+	 * is only checked again when it changes from one packet to the next,
+	 * which for a busy peer is rarely.
+	 */
+	while ((n = ptr_ring_consume_batched_bh(&queue->ring, (void **)skbs,
+						ARRAY_SIZE(skbs))) > 0) {
+		keypair = NULL;
+		usable = false;
+		for (i = 0; i < n; ++i) {
+			if (PACKET_CB(skbs[i])->keypair != keypair) {
+				keypair = PACKET_CB(skbs[i])->keypair;
+				usable = keypair_can_decrypt(keypair);
+			}
+			state = likely(usable && decrypt_packet(skbs[i], keypair)) ?
+					PACKET_STATE_CRYPTED : PACKET_STATE_DEAD;
+			wg_queue_enqueue_per_peer_rx(skbs[i], state);
+		}
 		if (need_resched())
 			cond_resched();
 	}
@@ -248,6 +248,9 @@ static void wg_packet_create_data_done(struct wg_peer *peer, struct sk_buff *fir
 	wg_timers_any_authenticated_packet_sent(peer);
 	skb_list_walk_safe(first, skb, next) {
 		is_keepalive = skb->len == message_data_len(0);
+		/* The segments of a GSO packet leave as one UDP GSO packet */
+		if (next && !is_keepalive)
+			skb = wg_socket_coalesce_skbs(skb, &next);
 		if (likely(!wg_socket_send_skb_to_peer(peer, skb,
 				PACKET_CB(skb)->ds) && !is_keepalive))
 			data_sent = true;
@@ -288,21 +291,25 @@ void wg_packet_encrypt_worker(struct work_struct *work)
 {
 	struct crypt_queue *queue = container_of(work, struct multicore_worker,
 						 work)->ptr;
-	struct sk_buff *first, *skb, *next;
-
-	while ((first = ptr_ring_consume_bh(&queue->ring)) != NULL) {
-		enum packet_state state = PACKET_STATE_CRYPTED;
-
-		skb_list_walk_safe(first, skb, next) {
-			if (likely(encrypt_packet(skb,
-					PACKET_CB(first)->keypair))) {
-				wg_reset_packet(skb, true);
-			} else {
-				state = PACKET_STATE_DEAD;
-				break;
+	struct sk_buff *firsts[MAX_CRYPT_BATCH], *skb, *next;
+	enum packet_state state;
+	int i, n;
+
+	while ((n = ptr_ring_consume_batched_bh(&queue->ring, (void **)firsts,
+						ARRAY_SIZE(firsts))) > 0) {
+		for (i = 0; i < n; ++i) {
+			state = PACKET_STATE_CRYPTED;
+			skb_list_walk_safe(firsts[i], skb, next) {
+				if (likely(encrypt_packet(skb,
+						PACKET_CB(firsts[i])->keypair))) {
+					wg_reset_packet(skb, true);
+				} else {
+					state = PACKET_STATE_DEAD;
+					break;
+				}
 			}
+			wg_queue_enqueue_per_peer_tx(firsts[i], state);
 		}
-		wg_queue_enqueue_per_peer_tx(first, state);
 		if (need_resched())
 			cond_resched();
 	}
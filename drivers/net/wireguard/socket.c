@@ -186,6 +186,57 @@ int wg_socket_send_skb_to_peer(struct wg_peer *peer, struct sk_buff *skb, u8 ds)
 	return ret;
 }
 
+/* Chains a run of equally sized encrypted packets, starting at @skb and going
+ * on with @next, onto the frag_list of @skb, making it one UDP GSO packet,
+ * which the device, or the stack on its behalf, splits again into the original
+ * datagrams without copying their payload. Only the last packet of the run may
+ * be shorter, like the last segment of any GSO packet. If there is such a run,
+ * @next is moved past it; otherwise @skb is left as is.
+ */
+struct sk_buff *wg_socket_coalesce_skbs(struct sk_buff *skb,
+					struct sk_buff **next)
+{
+	unsigned int seg_len = skb->len, len = skb->len, segs = 1;
+	struct sk_buff *last = skb, *cur;
+
+	if (skb_has_frag_list(skb))
+		return skb;
+	for (cur = *next; cur && segs < MAX_GSO_SEGMENTS; cur = cur->next) {
+		if (cur->len > seg_len || PACKET_CB(cur)->ds != PACKET_CB(skb)->ds ||
+		    skb_has_frag_list(cur) ||
+		    len + cur->len > GSO_LEGACY_MAX_SIZE - SKB_HEADER_LEN)
+			break;
+		len += cur->len;
+		last = cur;
+		++segs;
+		if (cur->len < seg_len)
+			break;
+	}
+	if (segs < 2)
+		return skb;
+
+	*next = last->next;
+	last->next = NULL;
+	skb_shinfo(skb)->frag_list = skb->next;
+	skb_mark_not_on_list(skb);
+	/* The chained packets keep their own truesize and owner, so that each
+	 * is uncharged on its own when the head frees them.
+	 */
+	skb->data_len += len - skb->len;
+	skb->len = len;
+
+	skb_shinfo(skb)->gso_size = seg_len;
+	skb_shinfo(skb)->gso_type = SKB_GSO_UDP_L4;
+	skb_shinfo(skb)->gso_segs = segs;
+	/* The UDP header goes right in front of the data, and its checksum
+	 * is filled in for each segment once the packet is split.
+	 */
+	skb->ip_summed = CHECKSUM_PARTIAL;
+	skb->csum_start = skb_headroom(skb) - sizeof(struct udphdr);
+	skb->csum_offset = offsetof(struct udphdr, check);
+	return skb;
+}
+
 int wg_socket_send_buffer_to_peer(struct wg_peer *peer, void *buffer,
 				  size_t len, u8 ds)
 {
@@ -344,6 +395,11 @@ static void set_sock_opts(struct socket *sock)
 	sock->sk->sk_allocation = GFP_ATOMIC;
 	sock->sk->sk_sndbuf = INT_MAX;
 	sk_set_memalloc(sock->sk);
+	/* Let GRO merge the datagrams of a peer. They are split again before
+	 * reaching wg_receive(), as the socket does not accept GSO packets,
+	 * but only after going through the IP and UDP layers once.
+	 */
+	udp_set_bit(GRO_ENABLED, sock->sk);
 }
 
 int wg_socket_init(struct wg_device *wg, u16 port)
@@ -89,12 +89,17 @@ struct z_erofs_stream_dctx {
 	u8 *kin, *kout;			/* buffer mapped pointers */
 	void *bounce;			/* bounce buffer for inplace I/Os */
 	bool bounced;			/* is the bounce buffer used now? */
+	bool doubled;			/* any encoded data copied aside? */
 };
 
 int z_erofs_stream_switch_bufs(struct z_erofs_stream_dctx *dctx, void **dst,
 			       void **src, struct page **pgpl);
 int z_erofs_fixup_insize(struct z_erofs_decompress_req *rq, const char *padbuf,
 			 unsigned int padbufsize);
+int z_erofs_lz4_decompress_neon(const u8 *src, u8 *dst,
+				unsigned int inputsize, unsigned int outputsize,
+				unsigned int *inpos, unsigned int *outpos,
+				unsigned int chunk);
 int __init z_erofs_init_decompressor(void);
 void z_erofs_exit_decompressor(void);
 #endif
@@ -6,6 +6,10 @@
  */
 #include "compress.h"
 #include <linux/lz4.h>
+#ifdef CONFIG_EROFS_FS_ZIP_LZ4_NEON
+#include <asm/neon.h>
+#include <asm/simd.h>
+#endif
 
 #ifndef LZ4_DISTANCE_MAX	/* history window size */
 #define LZ4_DISTANCE_MAX 65535	/* set to maximum value by default */
@@ -121,25 +125,57 @@ static int z_erofs_lz4_prepare_dstpages(struct z_erofs_lz4_decompress_ctx *ctx,
 	return kaddr ? 1 : 0;
 }
 
+/*
+ * In-place I/O pages are expected at the tail of the decompressed pages.
+ * The other encoded pages (e.g. cached ones) can join them by being copied
+ * into the decompressed pages at their place, if those are file pages only
+ * used by this pcluster and don't keep any encoded data themselves.  It is
+ * much cheaper than copying all encoded data to a per-CPU buffer.
+ */
+static bool z_erofs_lz4_inplace_layout(struct z_erofs_lz4_decompress_ctx *ctx)
+{
+	struct z_erofs_decompress_req *rq = ctx->rq;
+	unsigned int i, j, no, first;
+	struct page *page;
+
+	if (ctx->inpages > ctx->outpages)
+		return false;
+	first = ctx->outpages - ctx->inpages;
+	for (i = 0; i < ctx->inpages; ++i) {
+		no = first + i;
+		page = rq->out[no];
+		if (page == rq->in[i])
+			continue;
+		/* the head and tail pages can be shared with other pclusters */
+		if (!page || z_erofs_is_shortlived_page(page) ||
+		    no == ctx->outpages - 1 || (!no && rq->pageofs_out))
+			return false;
+		for (j = 0; j < ctx->inpages; ++j)
+			if (page == rq->in[j])
+				return false;
+	}
+
+	for (i = 0; i < ctx->inpages; ++i)
+		if (rq->out[first + i] != rq->in[i])
+			copy_highpage(rq->out[first + i], rq->in[i]);
+	return true;
+}
+
 static void *z_erofs_lz4_handle_overlap(struct z_erofs_lz4_decompress_ctx *ctx,
 			void *inpage, void *out, unsigned int *inputmargin,
 			int *maptype, bool may_inplace)
 {
 	struct z_erofs_decompress_req *rq = ctx->rq;
-	unsigned int omargin, total, i;
+	unsigned int omargin, total;
 	struct page **in;
 	void *src, *tmp;
 
 	if (rq->inplace_io) {
 		omargin = PAGE_ALIGN(ctx->oend) - ctx->oend;
 		if (rq->partial_decoding || !may_inplace ||
-		    omargin < LZ4_DECOMPRESS_INPLACE_MARGIN(rq->inputsize))
+		    omargin < LZ4_DECOMPRESS_INPLACE_MARGIN(rq->inputsize) ||
+		    !z_erofs_lz4_inplace_layout(ctx))
 			goto docopy;
-
-		for (i = 0; i < ctx->inpages; ++i)
-			if (rq->out[ctx->outpages - ctx->inpages + i] !=
-			    rq->in[i])
-				goto docopy;
 		kunmap_local(inpage);
 		*maptype = 3;
 		return out + ((ctx->outpages - ctx->inpages) << PAGE_SHIFT);
@@ -158,6 +194,7 @@ static void *z_erofs_lz4_handle_overlap(struct z_erofs_lz4_decompress_ctx *ctx,
 
 docopy:
 	/* Or copy compressed data which can be overlapped to per-CPU buffer */
+	atomic64_inc(&EROFS_SB(rq->sb)->dstats.bounced_pclusters);
 	in = rq->in;
 	src = z_erofs_get_gbuf(ctx->inpages);
 	if (!src) {
@@ -204,6 +241,32 @@ int z_erofs_fixup_insize(struct z_erofs_decompress_req *rq, const char *padbuf,
 	return 0;
 }
 
+#ifdef CONFIG_EROFS_FS_ZIP_LZ4_NEON
+/* output decoded per NEON section, which runs with preemption disabled */
+#define Z_EROFS_LZ4_NEON_CHUNK	(32 * 1024)
+
+static int z_erofs_lz4_decompress_fast(const u8 *src, u8 *dst,
+				       unsigned int inputsize,
+				       unsigned int outputsize)
+{
+	unsigned int inpos = 0, outpos = 0;
+	int ret;
+
+	if (!cpu_has_neon() || !may_use_simd())
+		return LZ4_decompress_safe(src, dst, inputsize, outputsize);
+	do {
+		kernel_neon_begin();
+		ret = z_erofs_lz4_decompress_neon(src, dst, inputsize,
+				outputsize, &inpos, &outpos,
+				Z_EROFS_LZ4_NEON_CHUNK);
+		kernel_neon_end();
+	} while (ret > 0);
+	return ret ?: outpos;
+}
+#else
+#define z_erofs_lz4_decompress_fast	LZ4_decompress_safe
+#endif
+
 static int z_erofs_lz4_decompress_mem(struct z_erofs_lz4_decompress_ctx *ctx,
 				      u8 *dst)
 {
@@ -241,9 +304,12 @@ static int z_erofs_lz4_decompress_mem(struct z_erofs_lz4_decompress_ctx *ctx,
 	if (rq->partial_decoding || !support_0padding)
 		ret = LZ4_decompress_safe_partial(src + inputmargin, out,
 				rq->inputsize, rq->outputsize, rq->outputsize);
-	else
+	else if (maptype == 3)	/* wildcopies must fit the in-place margin */
 		ret = LZ4_decompress_safe(src + inputmargin, out,
 					  rq->inputsize, rq->outputsize);
+	else
+		ret = z_erofs_lz4_decompress_fast(src + inputmargin, out,
+					rq->inputsize, rq->outputsize);
 
 	if (ret != rq->outputsize) {
 		erofs_err(rq->sb, "failed to decompress %d in[%u, %u] out[%u]",
@@ -371,6 +437,15 @@ static int z_erofs_transform_plain(struct z_erofs_decompress_req *rq,
 	return 0;
 }
 
+/* account pclusters which needed any encoded data copied aside */
+static void z_erofs_stream_doubled(struct z_erofs_stream_dctx *dctx)
+{
+	if (dctx->doubled)
+		return;
+	dctx->doubled = true;
+	atomic64_inc(&EROFS_SB(dctx->rq->sb)->dstats.bounced_pclusters);
+}
+
 int z_erofs_stream_switch_bufs(struct z_erofs_stream_dctx *dctx, void **dst,
 			       void **src, struct page **pgpl)
 {
@@ -439,6 +514,7 @@ int z_erofs_stream_switch_bufs(struct z_erofs_stream_dctx *dctx, void **dst,
 		memcpy(dctx->bounce, *src, dctx->inbuf_sz);
 		*src = dctx->bounce;
 		dctx->bounced = true;
+		z_erofs_stream_doubled(dctx);
 	}
 
 	for (j = dctx->ni + 1; j < dctx->inpages; ++j) {
@@ -450,6 +526,7 @@ int z_erofs_stream_switch_bufs(struct z_erofs_stream_dctx *dctx, void **dst,
 		set_page_private(tmppage, Z_EROFS_SHORTLIVED_PAGE);
 		copy_highpage(tmppage, rq->in[j]);
 		rq->in[j] = tmppage;
+		z_erofs_stream_doubled(dctx);
 	}
 	return 0;
 }
@@ -0,0 +1,132 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * LZ4 block decoder using 16-byte NEON copies for literals and matches.
+ *
+ * Must be called between kernel_neon_begin() and kernel_neon_end(), with
+ * non-overlapping input and output buffers: in-place decompression relies
+ * on the exact wildcopy behaviour of the generic decoder.  It stops after
+ * each chunk of output so that the caller can leave the NEON section in
+ * between, rather than keeping preemption off for a whole pcluster.
+ */
+#include <linux/errno.h>
+#include <linux/string.h>
+#include <linux/unaligned.h>
+#include <asm/neon-intrinsics.h>
+
+#include "compress.h"
+
+#define LZ4_MINMATCH		4
+#define LZ4_COPYCHUNK		16
+
+/* copy @len bytes in 16-byte chunks, may write up to 15 bytes past the end */
+static __always_inline void lz4_wildcopy16(u8 *dst, const u8 *src,
+					   unsigned int len)
+{
+	u8 *const end = dst + len;
+
+	do {
+		vst1q_u8(dst, vld1q_u8(src));
+		dst += LZ4_COPYCHUNK;
+		src += LZ4_COPYCHUNK;
+	} while (dst < end);
+}
+
+/* same for matches with an offset of 8 to 15 bytes */
+static __always_inline void lz4_wildcopy8(u8 *dst, const u8 *src,
+					  unsigned int len)
+{
+	u8 *const end = dst + len;
+
+	do {
+		vst1_u8(dst, vld1_u8(src));
+		dst += 8;
+		src += 8;
+	} while (dst < end);
+}
+
+static __always_inline bool lz4_read_length(const u8 **ip, const u8 *iend,
+					    unsigned int *len)
+{
+	unsigned int s;
+
+	do {
+		if (*ip >= iend)
+			return false;
+		s = *(*ip)++;
+		*len += s;
+	} while (s == 255);
+	return true;
+}
+
+/*
+ * Decode the sequences from *@inpos of @src to *@outpos of @dst until at
+ * least @chunk more bytes are written or the input ends, and update both
+ * positions.  Returns 1 if there is input left, 0 if not, or an error.
+ */
+int z_erofs_lz4_decompress_neon(const u8 *src, u8 *dst,
+				unsigned int inputsize, unsigned int outputsize,
+				unsigned int *inpos, unsigned int *outpos,
+				unsigned int chunk)
+{
+	const u8 *ip = src + *inpos, *const iend = src + inputsize;
+	u8 *op = dst + *outpos, *const oend = dst + outputsize;
+	u8 *const ostop = op + min(chunk, outputsize - *outpos);
+	unsigned int token, len, offset;
+	const u8 *match;
+
+	while (ip < iend) {
+		/* with the output full, only decode on to catch trailing input */
+		if (op >= ostop && op < oend)
+			break;
+		token = *ip++;
+
+		/* literals */
+		len = token >> 4;
+		if (len == 15 && !lz4_read_length(&ip, iend, &len))
+			return -EFSCORRUPTED;
+		if (len > iend - ip || len > oend - op)
+			return -EFSCORRUPTED;
+		if (likely(iend - ip >= len + LZ4_COPYCHUNK &&
+			   oend - op >= len + LZ4_COPYCHUNK))
+			lz4_wildcopy16(op, ip, len);
+		else
+			memcpy(op, ip, len);
+		ip += len;
+		op += len;
+
+		/* the last sequence only has literals */
+		if (ip == iend)
+			break;
+
+		/* match */
+		if (iend - ip < 2)
+			return -EFSCORRUPTED;
+		offset = get_unaligned_le16(ip);
+		ip += 2;
+		if (!offset || offset > op - dst)
+			return -EFSCORRUPTED;
+		match = op - offset;
+
+		len = token & 15;
+		if (len == 15 && !lz4_read_length(&ip, iend, &len))
+			return -EFSCORRUPTED;
+		len += LZ4_MINMATCH;
+		if (len > oend - op)
+			return -EFSCORRUPTED;
+
+		if (oend - op >= len + LZ4_COPYCHUNK && offset >= 8) {
+			if (offset >= LZ4_COPYCHUNK)
+				lz4_wildcopy16(op, match, len);
+			else
+				lz4_wildcopy8(op, match, len);
+			op += len;
+		} else {
+			/* overlapping short offsets repeat a pattern */
+			while (len--)
+				*op++ = *match++;
+		}
+	}
+	*inpos = ip - src;
+	*outpos = op - dst;
+	return ip < iend;
+}
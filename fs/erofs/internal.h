@@ -64,9 +64,32 @@ struct erofs_mount_opts {
 	unsigned int sync_decompress;
 	/* threshold for decompression synchronously */
 	unsigned int max_sync_decompress_pages;
+	/* workers decompressing the pclusters of one read (0, 1 - serial) */
+	unsigned int max_decompress_workers;
+	/* pclusters a worker takes at a time when fanning out */
+	unsigned int min_decompress_batch;
 	unsigned int mount_opt;
 };
 
+/* upper limit of max_decompress_workers */
+#define EROFS_MAX_DECOMPRESS_WORKERS	32
+
+/* decompression statistics, exported in sysfs */
+struct erofs_decompress_stats {
+	atomic64_t decompressed_pclusters;
+	atomic64_t decompressed_bytes;
+	/* time spent decompressing, summed over all workers */
+	atomic64_t decompress_time_ns;
+	/* reads handed over to a background worker, and their queueing delay */
+	atomic64_t queued_decompressions;
+	atomic64_t queue_delay_ns;
+	/* reads fanned out, and helper works which took part */
+	atomic64_t fanout_decompressions;
+	atomic64_t fanout_workers;
+	/* pclusters whose in-place I/O data had to be copied aside */
+	atomic64_t bounced_pclusters;
+};
+
 struct erofs_dev_context {
 	struct idr tree;
 	struct rw_semaphore rwsem;
@@ -124,6 +147,7 @@ struct erofs_sb_info {
 	struct inode *managed_cache;
 
 	struct erofs_sb_lz4_info lz4;
+	struct erofs_decompress_stats dstats;
 #endif	/* CONFIG_EROFS_FS_ZIP */
 	struct inode *packed_inode;
 	struct erofs_dev_context *devs;
@@ -13,11 +13,13 @@ enum {
 	attr_drop_caches,
 	attr_pointer_ui,
 	attr_pointer_bool,
+	attr_pointer_atomic64,
 };
 
 enum {
 	struct_erofs_sb_info,
 	struct_erofs_mount_opts,
+	struct_erofs_decompress_stats,
 };
 
 struct erofs_attr {
@@ -54,17 +56,40 @@ static struct erofs_attr erofs_attr_##_name = {			\
 #define EROFS_ATTR_RW_BOOL(_name, _struct)	\
 	EROFS_ATTR_RW(_name, pointer_bool, _struct)
 
+#define EROFS_RO_ATTR_ATOMIC64(_name, _struct)	\
+	EROFS_RO_ATTR(_name, pointer_atomic64, _struct)
+
 #define ATTR_LIST(name) (&erofs_attr_##name.attr)
 
 #ifdef CONFIG_EROFS_FS_ZIP
 EROFS_ATTR_RW_UI(sync_decompress, erofs_mount_opts);
+EROFS_ATTR_RW_UI(max_decompress_workers, erofs_mount_opts);
+EROFS_ATTR_RW_UI(min_decompress_batch, erofs_mount_opts);
 EROFS_ATTR_FUNC(drop_caches, 0200);
+EROFS_RO_ATTR_ATOMIC64(decompressed_pclusters, erofs_decompress_stats);
+EROFS_RO_ATTR_ATOMIC64(decompressed_bytes, erofs_decompress_stats);
+EROFS_RO_ATTR_ATOMIC64(decompress_time_ns, erofs_decompress_stats);
+EROFS_RO_ATTR_ATOMIC64(queued_decompressions, erofs_decompress_stats);
+EROFS_RO_ATTR_ATOMIC64(queue_delay_ns, erofs_decompress_stats);
+EROFS_RO_ATTR_ATOMIC64(fanout_decompressions, erofs_decompress_stats);
+EROFS_RO_ATTR_ATOMIC64(fanout_workers, erofs_decompress_stats);
+EROFS_RO_ATTR_ATOMIC64(bounced_pclusters, erofs_decompress_stats);
 #endif
 
 static struct attribute *erofs_attrs[] = {
 #ifdef CONFIG_EROFS_FS_ZIP
 	ATTR_LIST(sync_decompress),
+	ATTR_LIST(max_decompress_workers),
+	ATTR_LIST(min_decompress_batch),
 	ATTR_LIST(drop_caches),
+	ATTR_LIST(decompressed_pclusters),
+	ATTR_LIST(decompressed_bytes),
+	ATTR_LIST(decompress_time_ns),
+	ATTR_LIST(queued_decompressions),
+	ATTR_LIST(queue_delay_ns),
+	ATTR_LIST(fanout_decompressions),
+	ATTR_LIST(fanout_workers),
+	ATTR_LIST(bounced_pclusters),
 #endif
 	NULL,
 };
@@ -104,6 +129,10 @@ static unsigned char *__struct_ptr(struct erofs_sb_info *sbi,
 		return (unsigned char *)sbi + offset;
 	if (struct_type == struct_erofs_mount_opts)
 		return (unsigned char *)&sbi->opt + offset;
+#ifdef CONFIG_EROFS_FS_ZIP
+	if (struct_type == struct_erofs_decompress_stats)
+		return (unsigned char *)&sbi->dstats + offset;
+#endif
 	return NULL;
 }
 
@@ -126,6 +155,11 @@ static ssize_t erofs_attr_show(struct kobject *kobj,
 		if (!ptr)
 			return 0;
 		return sysfs_emit(buf, "%d\n", *(bool *)ptr);
+	case attr_pointer_atomic64:
+		if (!ptr)
+			return 0;
+		return sysfs_emit(buf, "%lld\n",
+				  atomic64_read((atomic64_t *)ptr));
 	}
 	return 0;
 }
@@ -153,6 +187,11 @@ static ssize_t erofs_attr_store(struct kobject *kobj, struct attribute *attr,
 		if (!strcmp(a->attr.name, "sync_decompress") &&
 		    (t > EROFS_SYNC_DECOMPRESS_FORCE_OFF))
 			return -EINVAL;
+		if (!strcmp(a->attr.name, "max_decompress_workers") &&
+		    t > EROFS_MAX_DECOMPRESS_WORKERS)
+			return -EINVAL;
+		if (!strcmp(a->attr.name, "min_decompress_batch") && !t)
+			return -EINVAL;
 #endif
 		*(unsigned int *)ptr = t;
 		return len;
@@ -88,6 +88,11 @@ struct z_erofs_pcluster {
 	/* L: whether extra buffer allocations are best-effort */
 	bool besteffort;
 
+	/* L: whether its last page, shared with the next pcluster in the
+	 * chain, may be used for in-place I/O or as a bvpage
+	 */
+	bool tailshared;
+
 	/* A: compressed bvecs (can be cached or inplaced pages) */
 	struct z_erofs_bvec compressed_bvecs[];
 };
@@ -106,6 +111,8 @@ struct z_erofs_decompressqueue {
 		struct work_struct work;
 		struct kthread_work kthread_work;
 	} u;
+	/* when the queue was handed over to a background worker */
+	u64 queued_ns;
 	bool eio, sync;
 };
 
@@ -1085,6 +1092,9 @@ static int z_erofs_scan_folio(struct z_erofs_decompress_frontend *f,
 				.end = end - pgs, }), excl);
 			if (err)
 				break;
+			/* the rest of the page went to the previous pcluster */
+			if (excl && split > 1)
+				f->pcl->tailshared = true;
 
 			erofs_onlinefolio_split(folio);
 			if (f->pcl->pageofs_out != (map->m_la & ~PAGE_MASK))
@@ -1390,6 +1400,7 @@ static int z_erofs_decompress_pcluster(struct z_erofs_decompress_backend *be,
 	pcl->partial = true;
 	pcl->multibases = false;
 	pcl->besteffort = false;
+	pcl->tailshared = false;
 	pcl->bvset.nextpage = NULL;
 	pcl->vcnt = 0;
 
@@ -1404,6 +1415,182 @@ static int z_erofs_decompress_pcluster(struct z_erofs_decompress_backend *be,
 	return err;
 }
 
+/* decompress up to @nr pclusters of the chain starting at @owned */
+static int z_erofs_decompress_chain(struct z_erofs_decompress_backend *be,
+				    z_erofs_next_pcluster_t owned,
+				    unsigned int nr, int err)
+{
+	struct erofs_decompress_stats *st = &EROFS_SB(be->sb)->dstats;
+	u64 start = ktime_get_ns(), bytes = 0;
+	unsigned int done;
+
+	for (done = 0; done < nr && owned != Z_EROFS_PCLUSTER_TAIL; ++done) {
+		DBG_BUGON(owned == Z_EROFS_PCLUSTER_NIL);
+
+		be->pcl = container_of(owned, struct z_erofs_pcluster, next);
+		owned = READ_ONCE(be->pcl->next);
+
+		bytes += be->pcl->length;
+		err = z_erofs_decompress_pcluster(be, err) ?: err;
+	}
+	atomic64_add(done, &st->decompressed_pclusters);
+	atomic64_add(bytes, &st->decompressed_bytes);
+	atomic64_add(ktime_get_ns() - start, &st->decompress_time_ns);
+	return err;
+}
+
+/*
+ * Fan-out decompression: the pclusters of one queue are handed out in
+ * batches from a shared cursor to helper works on the unbound workqueue,
+ * with the caller taking part as well.  Helpers which haven't started by
+ * the time the cursor runs dry are cancelled rather than waited for, so
+ * that a worker never blocks on work queued behind it.
+ */
+struct z_erofs_fanout_helper {
+	struct work_struct work;
+	struct z_erofs_decompress_fanout *fo;
+};
+
+struct z_erofs_decompress_fanout {
+	struct super_block *sb;
+	spinlock_t lock;
+	z_erofs_next_pcluster_t cursor;
+	unsigned int batch;
+	bool eio;
+
+	atomic_t running;
+	struct completion done;
+	int err;
+
+	unsigned int nr_helpers;
+	struct z_erofs_fanout_helper helpers[];
+};
+
+/*
+ * Take the next batch of pclusters off the cursor.  A pcluster which may use
+ * the page it shares with the next one in the chain for in-place I/O or as a
+ * bvpage has to be decompressed before that one overwrites the rest of the
+ * page, so the two are never split between batches.
+ */
+static unsigned int z_erofs_fanout_take(struct z_erofs_decompress_fanout *fo,
+					z_erofs_next_pcluster_t *head)
+{
+	struct z_erofs_pcluster *pcl;
+	z_erofs_next_pcluster_t owned;
+	unsigned int nr = 0;
+
+	spin_lock(&fo->lock);
+	owned = *head = fo->cursor;
+	while (owned != Z_EROFS_PCLUSTER_TAIL) {
+		pcl = container_of(owned, struct z_erofs_pcluster, next);
+		owned = READ_ONCE(pcl->next);
+		if (++nr >= fo->batch && !pcl->tailshared)
+			break;
+	}
+	fo->cursor = owned;
+	spin_unlock(&fo->lock);
+	return nr;
+}
+
+static void z_erofs_fanout_run(struct z_erofs_decompress_fanout *fo,
+			       struct z_erofs_decompress_backend *be)
+{
+	z_erofs_next_pcluster_t head;
+	int err = fo->eio ? -EIO : 0;
+	unsigned int nr;
+
+	while ((nr = z_erofs_fanout_take(fo, &head)))
+		err = z_erofs_decompress_chain(be, head, nr, err);
+	if (err)
+		cmpxchg(&fo->err, 0, err);
+}
+
+static void z_erofs_fanout_work(struct work_struct *work)
+{
+	struct z_erofs_fanout_helper *h =
+		container_of(work, struct z_erofs_fanout_helper, work);
+	struct z_erofs_decompress_fanout *fo = h->fo;
+	struct page *pagepool = NULL;
+	struct z_erofs_decompress_backend be = {
+		.sb = fo->sb,
+		.pagepool = &pagepool,
+		.decompressed_secondary_bvecs =
+			LIST_HEAD_INIT(be.decompressed_secondary_bvecs),
+	};
+
+	atomic64_inc(&EROFS_SB(fo->sb)->dstats.fanout_workers);
+	z_erofs_fanout_run(fo, &be);
+	erofs_release_pages(&pagepool);
+	if (atomic_dec_and_test(&fo->running))
+		complete(&fo->done);
+}
+
+/* how many helpers to fan @io out to, 0 to decompress it serially */
+static unsigned int
+z_erofs_fanout_helpers(const struct z_erofs_decompressqueue *io)
+{
+	struct erofs_sb_info *const sbi = EROFS_SB(io->sb);
+	unsigned int workers = READ_ONCE(sbi->opt.max_decompress_workers);
+	unsigned int batch = max(READ_ONCE(sbi->opt.min_decompress_batch), 1U);
+	z_erofs_next_pcluster_t owned = io->head;
+	unsigned int nr = 0;
+
+	workers = min(workers, num_online_cpus());
+	if (workers <= 1)
+		return 0;
+	/* no point in counting further than what the workers can take */
+	while (owned != Z_EROFS_PCLUSTER_TAIL && nr < workers * batch) {
+		owned = READ_ONCE(container_of(owned, struct z_erofs_pcluster,
+					       next)->next);
+		++nr;
+	}
+	return min(DIV_ROUND_UP(nr, batch), workers) - 1;
+}
+
+/* returns false if @io has to be decompressed serially instead */
+static bool z_erofs_decompress_fanout(const struct z_erofs_decompressqueue *io,
+				      struct z_erofs_decompress_backend *be,
+				      int *err)
+{
+	struct erofs_sb_info *const sbi = EROFS_SB(io->sb);
+	unsigned int i, nr_helpers = z_erofs_fanout_helpers(io), cancelled = 0;
+	struct z_erofs_decompress_fanout *fo;
+
+	if (!nr_helpers)
+		return false;
+	fo = kmalloc(struct_size(fo, helpers, nr_helpers),
+		     GFP_KERNEL | __GFP_NOWARN);
+	if (!fo)
+		return false;
+
+	fo->sb = io->sb;
+	spin_lock_init(&fo->lock);
+	fo->cursor = io->head;
+	fo->batch = max(READ_ONCE(sbi->opt.min_decompress_batch), 1U);
+	fo->eio = io->eio;
+	atomic_set(&fo->running, nr_helpers + 1);
+	init_completion(&fo->done);
+	fo->err = 0;
+	fo->nr_helpers = nr_helpers;
+	for (i = 0; i < nr_helpers; ++i) {
+		fo->helpers[i].fo = fo;
+		INIT_WORK(&fo->helpers[i].work, z_erofs_fanout_work);
+		queue_work(z_erofs_workqueue, &fo->helpers[i].work);
+	}
+	atomic64_inc(&sbi->dstats.fanout_decompressions);
+
+	z_erofs_fanout_run(fo, be);
+
+	for (i = 0; i < nr_helpers; ++i)
+		if (cancel_work(&fo->helpers[i].work))
+			++cancelled;
+	if (!atomic_sub_and_test(cancelled + 1, &fo->running))
+		wait_for_completion(&fo->done);
+	*err = fo->err;
+	kfree(fo);
+	return true;
+}
+
 static int z_erofs_decompress_queue(const struct z_erofs_decompressqueue *io,
 				    struct page **pagepool)
 {
@@ -1413,18 +1600,11 @@ static int z_erofs_decompress_queue(const struct z_erofs_decompressqueue *io,
 		.decompressed_secondary_bvecs =
 			LIST_HEAD_INIT(be.decompressed_secondary_bvecs),
 	};
-	z_erofs_next_pcluster_t owned = io->head;
 	int err = io->eio ? -EIO : 0;
 
-	while (owned != Z_EROFS_PCLUSTER_TAIL) {
-		DBG_BUGON(owned == Z_EROFS_PCLUSTER_NIL);
-
-		be.pcl = container_of(owned, struct z_erofs_pcluster, next);
-		owned = READ_ONCE(be.pcl->next);
-
-		err = z_erofs_decompress_pcluster(&be, err) ?: err;
-	}
-	return err;
+	if (z_erofs_decompress_fanout(io, &be, &err))
+		return err;
+	return z_erofs_decompress_chain(&be, io->head, UINT_MAX, err);
 }
 
 static void z_erofs_decompressqueue_work(struct work_struct *work)
@@ -1434,6 +1614,13 @@ static void z_erofs_decompressqueue_work(struct work_struct *work)
 	struct page *pagepool = NULL;
 
 	DBG_BUGON(bgq->head == Z_EROFS_PCLUSTER_TAIL);
+	if (bgq->queued_ns) {
+		struct erofs_decompress_stats *st = &EROFS_SB(bgq->sb)->dstats;
+
+		atomic64_inc(&st->queued_decompressions);
+		atomic64_add(ktime_get_ns() - bgq->queued_ns,
+			     &st->queue_delay_ns);
+	}
 	z_erofs_decompress_queue(bgq, &pagepool);
 	erofs_release_pages(&pagepool);
 	kvfree(bgq);
@@ -1465,6 +1652,7 @@ static void z_erofs_decompress_kickoff(struct z_erofs_decompressqueue *io,
 #ifdef CONFIG_EROFS_FS_PCPU_KTHREAD
 		struct kthread_worker *worker;
 
+		io->queued_ns = ktime_get_ns();
 		rcu_read_lock();
 		worker = rcu_dereference(
 				z_erofs_pcpu_workers[raw_smp_processor_id()]);
@@ -1476,6 +1664,7 @@ static void z_erofs_decompress_kickoff(struct z_erofs_decompressqueue *io,
 		}
 		rcu_read_unlock();
 #else
+		io->queued_ns = ktime_get_ns();
 		queue_work(z_erofs_workqueue, &io->u.work);
 #endif
 		/* enable sync decompression for readahead */
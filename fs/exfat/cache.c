@@ -13,14 +13,31 @@
 #include <linux/slab.h>
 #include <linux/unaligned.h>
 #include <linux/buffer_head.h>
+#include <linux/list_lru.h>
+#include <linux/rbtree.h>
+#include <linux/shrinker.h>
 
 #include "exfat_raw.h"
 #include "exfat_fs.h"
 
-#define EXFAT_MAX_CACHE		16
+/*
+ * Each inode maps file clusters to disk clusters with a tree of contiguous
+ * fragments of its cluster chain, filled in as the chain gets walked.  The
+ * fragments of all inodes are on one LRU, bounded by exfat_cache_max and
+ * trimmed by a shrinker under memory pressure.
+ */
+
+/* The fragments of all inodes may use up to 1/256 of RAM */
+#define EXFAT_CACHE_RAM_SHIFT		8
+#define EXFAT_CACHE_MIN			1024
+/* Fragments reclaimed at once when over exfat_cache_max */
+#define EXFAT_CACHE_RECLAIM_BATCH	32
 
 struct exfat_cache {
-	struct list_head cache_list;
+	struct rb_node cache_node;	/* in exfat_inode_info.cache_tree */
+	struct list_head cache_lru;	/* in exfat_cache_lru */
+	struct exfat_inode_info *ei;
+	bool referenced;	/* looked up since the last LRU walk */
 	unsigned int nr_contig;	/* number of contiguous clusters */
 	unsigned int fcluster;	/* cluster number in the file. */
 	unsigned int dcluster;	/* cluster number on disk. */
@@ -34,50 +51,141 @@ struct exfat_cache_id {
 };
 
 static struct kmem_cache *exfat_cachep;
+static struct list_lru exfat_cache_lru;
+static struct shrinker *exfat_cache_shrinker;
+static unsigned long exfat_cache_max;
+
+static inline struct exfat_cache *exfat_cache_alloc(void)
+{
+	return kmem_cache_alloc(exfat_cachep, GFP_NOFS);
+}
+
+static inline void exfat_cache_free(struct exfat_cache *cache)
+{
+	WARN_ON(!list_empty(&cache->cache_lru));
+	kmem_cache_free(exfat_cachep, cache);
+}
+
+/*
+ * Called with the LRU lock held, which nests inside cache_lock, hence the
+ * trylock.  A fragment can't be freed while it is on the LRU, so cache->ei
+ * is still valid.
+ */
+static enum lru_status exfat_cache_isolate(struct list_head *item,
+		struct list_lru_one *lru, void *arg)
+{
+	struct exfat_cache *cache =
+		list_entry(item, struct exfat_cache, cache_lru);
+	struct exfat_inode_info *ei = cache->ei;
+	struct list_head *dispose = arg;
+
+	if (!spin_trylock(&ei->cache_lock))
+		return LRU_SKIP;
+
+	if (cache->referenced) {
+		cache->referenced = false;
+		spin_unlock(&ei->cache_lock);
+		return LRU_ROTATE;
+	}
+
+	rb_erase(&cache->cache_node, &ei->cache_tree);
+	ei->nr_caches--;
+	list_lru_isolate_move(lru, item, dispose);
+	spin_unlock(&ei->cache_lock);
+	return LRU_REMOVED;
+}
+
+static void exfat_cache_dispose(struct list_head *dispose)
+{
+	struct exfat_cache *cache, *tmp;
+
+	list_for_each_entry_safe(cache, tmp, dispose, cache_lru) {
+		list_del_init(&cache->cache_lru);
+		exfat_cache_free(cache);
+	}
+}
 
-static void exfat_cache_init_once(void *c)
+static unsigned long exfat_cache_count(struct shrinker *shrink,
+		struct shrink_control *sc)
 {
-	struct exfat_cache *cache = (struct exfat_cache *)c;
+	return list_lru_shrink_count(&exfat_cache_lru, sc);
+}
+
+static unsigned long exfat_cache_scan(struct shrinker *shrink,
+		struct shrink_control *sc)
+{
+	LIST_HEAD(dispose);
+	unsigned long freed;
 
-	INIT_LIST_HEAD(&cache->cache_list);
+	freed = list_lru_shrink_walk(&exfat_cache_lru, sc,
+			exfat_cache_isolate, &dispose);
+	exfat_cache_dispose(&dispose);
+	return freed;
 }
 
 int exfat_cache_init(void)
 {
+	int err;
+
 	exfat_cachep = kmem_cache_create("exfat_cache",
 				sizeof(struct exfat_cache),
-				0, SLAB_RECLAIM_ACCOUNT,
-				exfat_cache_init_once);
+				0, SLAB_RECLAIM_ACCOUNT, NULL);
 	if (!exfat_cachep)
 		return -ENOMEM;
+
+	err = list_lru_init(&exfat_cache_lru);
+	if (err)
+		goto destroy_cachep;
+
+	exfat_cache_shrinker = shrinker_alloc(SHRINKER_NUMA_AWARE,
+					      "exfat-cache");
+	if (!exfat_cache_shrinker) {
+		err = -ENOMEM;
+		goto destroy_lru;
+	}
+	exfat_cache_shrinker->count_objects = exfat_cache_count;
+	exfat_cache_shrinker->scan_objects = exfat_cache_scan;
+	shrinker_register(exfat_cache_shrinker);
+
+	exfat_cache_max = max_t(unsigned long, EXFAT_CACHE_MIN,
+			(totalram_pages() << (PAGE_SHIFT - EXFAT_CACHE_RAM_SHIFT)) /
+			sizeof(struct exfat_cache));
 	return 0;
+
+destroy_lru:
+	list_lru_destroy(&exfat_cache_lru);
+destroy_cachep:
+	kmem_cache_destroy(exfat_cachep);
+	exfat_cachep = NULL;
+	return err;
 }
 
 void exfat_cache_shutdown(void)
 {
 	if (!exfat_cachep)
 		return;
+	shrinker_free(exfat_cache_shrinker);
+	list_lru_destroy(&exfat_cache_lru);
 	kmem_cache_destroy(exfat_cachep);
 }
 
-static inline struct exfat_cache *exfat_cache_alloc(void)
-{
-	return kmem_cache_alloc(exfat_cachep, GFP_NOFS);
-}
-
-static inline void exfat_cache_free(struct exfat_cache *cache)
-{
-	WARN_ON(!list_empty(&cache->cache_list));
-	kmem_cache_free(exfat_cachep, cache);
-}
-
-static inline void exfat_cache_update_lru(struct inode *inode,
-		struct exfat_cache *cache)
+/* Find the fragment of "fclus", or the nearest one before it. */
+static struct exfat_cache *exfat_cache_floor(struct exfat_inode_info *ei,
+		unsigned int fclus)
 {
-	struct exfat_inode_info *ei = EXFAT_I(inode);
-
-	if (ei->cache_lru.next != &cache->cache_list)
-		list_move(&cache->cache_list, &ei->cache_lru);
+	struct rb_node *node = ei->cache_tree.rb_node;
+	struct exfat_cache *p, *floor = NULL;
+
+	while (node) {
+		p = rb_entry(node, struct exfat_cache, cache_node);
+		if (p->fcluster <= fclus) {
+			floor = p;
+			node = node->rb_right;
+		} else {
+			node = node->rb_left;
+		}
+	}
+	return floor;
 }
 
 static unsigned int exfat_cache_lookup(struct inode *inode,
@@ -85,25 +193,14 @@ static unsigned int exfat_cache_lookup(struct inode *inode,
 		unsigned int *cached_fclus, unsigned int *cached_dclus)
 {
 	struct exfat_inode_info *ei = EXFAT_I(inode);
-	static struct exfat_cache nohit = { .fcluster = 0, };
-	struct exfat_cache *hit = &nohit, *p;
+	struct exfat_cache *hit;
 	unsigned int offset = EXFAT_EOF_CLUSTER;
 
-	spin_lock(&ei->cache_lru_lock);
-	list_for_each_entry(p, &ei->cache_lru, cache_list) {
-		/* Find the cache of "fclus" or nearest cache. */
-		if (p->fcluster <= fclus && hit->fcluster < p->fcluster) {
-			hit = p;
-			if (hit->fcluster + hit->nr_contig < fclus) {
-				offset = hit->nr_contig;
-			} else {
-				offset = fclus - hit->fcluster;
-				break;
-			}
-		}
-	}
-	if (hit != &nohit) {
-		exfat_cache_update_lru(inode, hit);
+	spin_lock(&ei->cache_lock);
+	hit = exfat_cache_floor(ei, fclus);
+	if (hit) {
+		offset = min(fclus - hit->fcluster, hit->nr_contig);
+		hit->referenced = true;
 
 		cid->id = ei->cache_valid_id;
 		cid->nr_contig = hit->nr_contig;
@@ -112,96 +209,115 @@ static unsigned int exfat_cache_lookup(struct inode *inode,
 		*cached_fclus = cid->fcluster + offset;
 		*cached_dclus = cid->dcluster + offset;
 	}
-	spin_unlock(&ei->cache_lru_lock);
+	spin_unlock(&ei->cache_lock);
 
 	return offset;
 }
 
+/*
+ * Extend the fragment "new" starts in or right after, if "new" continues
+ * it on disk.
+ */
 static struct exfat_cache *exfat_cache_merge(struct inode *inode,
 		struct exfat_cache_id *new)
 {
 	struct exfat_inode_info *ei = EXFAT_I(inode);
 	struct exfat_cache *p;
+	unsigned int end;
 
-	list_for_each_entry(p, &ei->cache_lru, cache_list) {
-		/* Find the same part as "new" in cluster-chain. */
-		if (p->fcluster == new->fcluster) {
-			if (new->nr_contig > p->nr_contig)
-				p->nr_contig = new->nr_contig;
-			return p;
-		}
+	p = exfat_cache_floor(ei, new->fcluster);
+	if (!p || p->fcluster + p->nr_contig + 1 < new->fcluster ||
+	    p->dcluster + (new->fcluster - p->fcluster) != new->dcluster)
+		return NULL;
+
+	end = new->fcluster + new->nr_contig;
+	if (end > p->fcluster + p->nr_contig)
+		p->nr_contig = end - p->fcluster;
+	return p;
+}
+
+static void exfat_cache_insert(struct exfat_inode_info *ei,
+		struct exfat_cache *cache)
+{
+	struct rb_node **link = &ei->cache_tree.rb_node, *parent = NULL;
+	struct exfat_cache *p;
+
+	while (*link) {
+		parent = *link;
+		p = rb_entry(parent, struct exfat_cache, cache_node);
+		if (cache->fcluster < p->fcluster)
+			link = &parent->rb_left;
+		else
+			link = &parent->rb_right;
 	}
-	return NULL;
+	rb_link_node(&cache->cache_node, parent, link);
+	rb_insert_color(&cache->cache_node, &ei->cache_tree);
+	ei->nr_caches++;
 }
 
 static void exfat_cache_add(struct inode *inode,
 		struct exfat_cache_id *new)
 {
 	struct exfat_inode_info *ei = EXFAT_I(inode);
-	struct exfat_cache *cache, *tmp;
+	struct exfat_cache *cache;
+	LIST_HEAD(dispose);
 
 	if (new->fcluster == EXFAT_EOF_CLUSTER) /* dummy cache */
 		return;
 
-	spin_lock(&ei->cache_lru_lock);
+	spin_lock(&ei->cache_lock);
 	if (new->id != EXFAT_CACHE_VALID &&
 	    new->id != ei->cache_valid_id)
 		goto unlock;	/* this cache was invalidated */
-
 	cache = exfat_cache_merge(inode, new);
-	if (cache == NULL) {
-		if (ei->nr_caches < EXFAT_MAX_CACHE) {
-			ei->nr_caches++;
-			spin_unlock(&ei->cache_lru_lock);
-
-			tmp = exfat_cache_alloc();
-			if (!tmp) {
-				spin_lock(&ei->cache_lru_lock);
-				ei->nr_caches--;
-				spin_unlock(&ei->cache_lru_lock);
-				return;
-			}
-
-			spin_lock(&ei->cache_lru_lock);
-			cache = exfat_cache_merge(inode, new);
-			if (cache != NULL) {
-				ei->nr_caches--;
-				exfat_cache_free(tmp);
-				goto out_update_lru;
-			}
-			cache = tmp;
-		} else {
-			struct list_head *p = ei->cache_lru.prev;
+	spin_unlock(&ei->cache_lock);
+	if (cache)
+		return;
 
-			cache = list_entry(p,
-					struct exfat_cache, cache_list);
-		}
-		cache->fcluster = new->fcluster;
-		cache->dcluster = new->dcluster;
-		cache->nr_contig = new->nr_contig;
+	cache = exfat_cache_alloc();
+	if (!cache)
+		return;
+	INIT_LIST_HEAD(&cache->cache_lru);
+	cache->ei = ei;
+	cache->referenced = false;
+	cache->fcluster = new->fcluster;
+	cache->dcluster = new->dcluster;
+	cache->nr_contig = new->nr_contig;
+
+	spin_lock(&ei->cache_lock);
+	if ((new->id != EXFAT_CACHE_VALID &&
+	     new->id != ei->cache_valid_id) ||
+	    exfat_cache_merge(inode, new)) {
+		spin_unlock(&ei->cache_lock);
+		exfat_cache_free(cache);
+		return;
+	}
+	exfat_cache_insert(ei, cache);
+	list_lru_add_obj(&exfat_cache_lru, &cache->cache_lru);
+	spin_unlock(&ei->cache_lock);
+
+	if (list_lru_count(&exfat_cache_lru) > exfat_cache_max) {
+		list_lru_walk(&exfat_cache_lru, exfat_cache_isolate, &dispose,
+			      EXFAT_CACHE_RECLAIM_BATCH);
+		exfat_cache_dispose(&dispose);
 	}
-out_update_lru:
-	exfat_cache_update_lru(inode, cache);
+	return;
 unlock:
-	spin_unlock(&ei->cache_lru_lock);
+	spin_unlock(&ei->cache_lock);
 }
 
-/*
- * Cache invalidation occurs rarely, thus the LRU chain is not updated. It
- * fixes itself after a while.
- */
 static void __exfat_cache_inval_inode(struct inode *inode)
 {
 	struct exfat_inode_info *ei = EXFAT_I(inode);
-	struct exfat_cache *cache;
+	struct exfat_cache *cache, *tmp;
 
-	while (!list_empty(&ei->cache_lru)) {
-		cache = list_entry(ei->cache_lru.next,
-				   struct exfat_cache, cache_list);
-		list_del_init(&cache->cache_list);
-		ei->nr_caches--;
+	rbtree_postorder_for_each_entry_safe(cache, tmp, &ei->cache_tree,
+					     cache_node) {
+		list_lru_del_obj(&exfat_cache_lru, &cache->cache_lru);
 		exfat_cache_free(cache);
 	}
+	ei->cache_tree = RB_ROOT;
+	ei->nr_caches = 0;
 	/* Update. The copy of caches before this id is discarded. */
 	ei->cache_valid_id++;
 	if (ei->cache_valid_id == EXFAT_CACHE_VALID)
@@ -212,9 +328,9 @@ void exfat_cache_inval_inode(struct inode *inode)
 {
 	struct exfat_inode_info *ei = EXFAT_I(inode);
 
-	spin_lock(&ei->cache_lru_lock);
+	spin_lock(&ei->cache_lock);
 	__exfat_cache_inval_inode(inode);
-	spin_unlock(&ei->cache_lru_lock);
+	spin_unlock(&ei->cache_lock);
 }
 
 static inline int cache_contiguous(struct exfat_cache_id *cid,
@@ -305,8 +421,12 @@ int exfat_get_cluster(struct inode *inode, unsigned int cluster,
 			break;
 		}
 
-		if (!cache_contiguous(&cid, *dclus))
+		/* cache every fragment crossed, not just the last one */
+		if (!cache_contiguous(&cid, *dclus)) {
+			cid.nr_contig--;
+			exfat_cache_add(inode, &cid);
 			cache_init(&cid, *fclus, *dclus);
+		}
 	}
 
 	exfat_cache_add(inode, &cid);
@@ -313,9 +313,10 @@ struct exfat_inode_info {
 	/* hint for first empty entry */
 	struct exfat_hint_femp hint_femp;
 
-	spinlock_t cache_lru_lock;
-	struct list_head cache_lru;
-	int nr_caches;
+	/* cluster chain fragments, see cache.c */
+	spinlock_t cache_lock;
+	struct rb_root cache_tree;
+	unsigned int nr_caches;
 	/* for avoiding the race between alloc and free */
 	unsigned int cache_valid_id;
 
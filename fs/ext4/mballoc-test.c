@@ -5,6 +5,7 @@
 
 #include <kunit/test.h>
 #include <kunit/static_stub.h>
+#include <linux/kthread.h>
 #include <linux/random.h>
 
 #include "ext4.h"
@@ -933,6 +934,223 @@ static void test_mb_mark_used_cost(struct kunit *test)
 	ext4_mb_unload_buddy(&e4b);
 }
 
+#define MBT_ARENA_LOOPS		20000
+#define MBT_ARENA_EXTENT	8
+#define MBT_ARENA_SLOTS		4
+
+struct mbt_arena_worker {
+	struct ext4_buddy *e4b;
+	ext4_grpblk_t base;
+	struct completion done;
+};
+
+/* allocate and free small extents in one group, as small-file creation does */
+static int mbt_arena_worker_fn(void *data)
+{
+	struct mbt_arena_worker *w = data;
+	struct ext4_buddy *e4b = w->e4b;
+	struct super_block *sb = e4b->bd_sb;
+	struct ext4_free_extent ex = {
+		.fe_group = e4b->bd_group,
+		.fe_len = MBT_ARENA_EXTENT,
+	};
+	int i;
+
+	for (i = 0; i < MBT_ARENA_LOOPS; i++) {
+		ex.fe_start = w->base + (i % MBT_ARENA_SLOTS) * MBT_ARENA_EXTENT;
+
+		ext4_lock_group(sb, ex.fe_group);
+		mb_mark_used(e4b, &ex);
+		ext4_unlock_group(sb, ex.fe_group);
+
+		ext4_lock_group(sb, ex.fe_group);
+		mb_free_blocks(NULL, e4b, ex.fe_start, ex.fe_len);
+		ext4_unlock_group(sb, ex.fe_group);
+	}
+	complete(&w->done);
+	return 0;
+}
+
+/*
+ * Run one worker on each of the first @nr online CPUs, all in
+ * TEST_GOAL_GROUP or each in the initial arena group of its CPU.  Workers
+ * use disjoint ranges, so CPUs sharing an arena group are fine.
+ */
+static unsigned long mbt_arena_run(struct kunit *test, struct ext4_buddy *e4b,
+				   bool percpu, int nr)
+{
+	struct super_block *sb = (struct super_block *)test->priv;
+	struct mbt_arena_worker *workers;
+	struct task_struct *task;
+	unsigned long start;
+	int cpu, i = 0, err = 0;
+
+	workers = kunit_kcalloc(test, nr, sizeof(*workers), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, workers);
+
+	start = jiffies;
+	for_each_online_cpu(cpu) {
+		struct mbt_arena_worker *w = &workers[i];
+
+		if (i == nr)
+			break;
+		w->e4b = &e4b[percpu ? ext4_mb_arena_group(sb, cpu) :
+				       TEST_GOAL_GROUP];
+		w->base = (i + 1) * MBT_ARENA_SLOTS * MBT_ARENA_EXTENT;
+		init_completion(&w->done);
+		task = kthread_run_on_cpu(mbt_arena_worker_fn, w, cpu,
+					  "mbt_arena/%u");
+		if (IS_ERR(task)) {
+			err = PTR_ERR(task);
+			break;
+		}
+		i++;
+	}
+	/* the workers use kunit memory, so they must be done before failing */
+	for (i--; i >= 0; i--)
+		wait_for_completion(&workers[i].done);
+	KUNIT_ASSERT_EQ(test, err, 0);
+
+	return jiffies - start;
+}
+
+static void test_mb_arena_scaling(struct kunit *test)
+{
+	struct super_block *sb = (struct super_block *)test->priv;
+	ext4_group_t i, ngroups = ext4_get_groups_count(sb);
+	unsigned long shared, percpu;
+	struct ext4_buddy *e4b;
+	int *free;
+	int nr, ret;
+
+	/* buddy cache assumes that each page contains at least one block */
+	if (sb->s_blocksize > PAGE_SIZE)
+		kunit_skip(test, "blocksize exceeds pagesize");
+
+	/* the first CPUs start out in distinct groups */
+	for (i = 1; i < min(ngroups, num_possible_cpus()); i++)
+		KUNIT_EXPECT_GT(test, ext4_mb_arena_group(sb, i),
+				ext4_mb_arena_group(sb, i - 1));
+
+	e4b = kunit_kcalloc(test, ngroups, sizeof(*e4b), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, e4b);
+	free = kunit_kcalloc(test, ngroups, sizeof(*free), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, free);
+
+	for (i = 0; i < ngroups; i++) {
+		ret = ext4_mb_load_buddy(sb, i, &e4b[i]);
+		KUNIT_ASSERT_EQ(test, ret, 0);
+		free[i] = e4b[i].bd_info->bb_free;
+	}
+
+	nr = min_t(int, num_online_cpus(), ngroups);
+	shared = mbt_arena_run(test, e4b, false, nr);
+	percpu = mbt_arena_run(test, e4b, true, nr);
+	kunit_info(test, "%d CPUs: one group %lu jiffies, per-CPU groups %lu jiffies\n",
+		   nr, shared, percpu);
+
+	for (i = 0; i < ngroups; i++) {
+		KUNIT_EXPECT_EQ(test, e4b[i].bd_info->bb_free, free[i]);
+		ext4_mb_unload_buddy(&e4b[i]);
+	}
+}
+
+static void test_mb_arena_prealloc(struct kunit *test)
+{
+	struct super_block *sb = (struct super_block *)test->priv;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	ext4_group_t goal, group, ngroups = ext4_get_groups_count(sb);
+	struct ext4_allocation_context ac = {};
+	struct ext4_locality_group *lg;
+	struct ext4_inode_info *ei;
+	struct ext4_buddy e4b;
+	int free, order, ret;
+
+	/* buddy cache assumes that each page contains at least one block */
+	if (sb->s_blocksize > PAGE_SIZE)
+		kunit_skip(test, "blocksize exceeds pagesize");
+
+	ei = kunit_kzalloc(test, sizeof(*ei), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, ei);
+	ei->vfs_inode.i_sb = sb;
+	ei->vfs_inode.i_mode = S_IFREG;
+
+	lg = per_cpu_ptr(sbi->s_locality_groups, 0);
+	goal = (lg->lg_group + 1) % ngroups;
+	ac.ac_sb = sb;
+	ac.ac_inode = &ei->vfs_inode;
+	ac.ac_lg = lg;
+
+	/* locality group requests only go to lg_group with extents */
+	sbi->s_mb_percpu_arenas = 1;
+	ac.ac_g_ex.fe_group = goal;
+	ac.ac_g_ex.fe_start = 1;
+	ext4_mb_normalize_group_request(&ac);
+	KUNIT_EXPECT_EQ(test, ac.ac_g_ex.fe_group, goal);
+	KUNIT_EXPECT_EQ(test, ac.ac_g_ex.fe_start, 1);
+	KUNIT_EXPECT_EQ(test, ac.ac_g_ex.fe_len, sbi->s_mb_group_prealloc);
+
+	ext4_set_inode_flag(&ei->vfs_inode, EXT4_INODE_EXTENTS);
+	ext4_mb_normalize_group_request(&ac);
+	KUNIT_EXPECT_EQ(test, ac.ac_g_ex.fe_group, lg->lg_group);
+	KUNIT_EXPECT_EQ(test, ac.ac_g_ex.fe_start, 0);
+
+	sbi->s_mb_percpu_arenas = 0;
+	ac.ac_g_ex.fe_group = goal;
+	ac.ac_g_ex.fe_start = 1;
+	ext4_mb_normalize_group_request(&ac);
+	KUNIT_EXPECT_EQ(test, ac.ac_g_ex.fe_group, goal);
+	KUNIT_EXPECT_EQ(test, ac.ac_g_ex.fe_start, 1);
+
+	/* a prealloc space found elsewhere moves lg_group along */
+	ret = ext4_mb_load_buddy(sb, goal, &e4b);
+	KUNIT_ASSERT_EQ(test, ret, 0);
+	free = e4b.bd_info->bb_free;
+
+	ac.ac_b_ex.fe_group = goal;
+	ac.ac_b_ex.fe_start = EXT4_CLUSTERS_PER_GROUP(sb) / 2;
+	ac.ac_b_ex.fe_len = sbi->s_mb_group_prealloc;
+	ac.ac_o_ex.fe_len = 1;
+	ac.ac_status = AC_STATUS_FOUND;
+	ext4_lock_group(sb, goal);
+	mb_mark_used(&e4b, &ac.ac_b_ex);
+	ext4_unlock_group(sb, goal);
+
+	ret = ext4_mb_pa_alloc(&ac);
+	if (ret) {
+		ext4_mb_unload_buddy(&e4b);
+		KUNIT_FAIL(test, "pa alloc failed: %d", ret);
+		return;
+	}
+	ext4_mb_new_group_pa(&ac);
+	KUNIT_EXPECT_EQ(test, lg->lg_group, goal);
+	group = ac.ac_b_ex.fe_group;
+	ext4_mb_release_context(&ac);
+
+	/* a locality group that just allocated keeps its prealloc space */
+	WRITE_ONCE(lg->lg_last_alloc, jiffies);
+	ext4_mb_trim_arenas(sb);
+	for (order = 0; order < PREALLOC_TB_SIZE; order++)
+		if (!list_empty(&lg->lg_prealloc_list[order]))
+			break;
+	KUNIT_EXPECT_LT(test, order, PREALLOC_TB_SIZE);
+
+	/* an idle one gives it back, all but the cluster it handed out */
+	WRITE_ONCE(lg->lg_last_alloc, jiffies - MB_ARENA_IDLE_TIME - 1);
+	ext4_mb_trim_arenas(sb);
+	for (order = 0; order < PREALLOC_TB_SIZE; order++)
+		KUNIT_EXPECT_TRUE(test, list_empty(&lg->lg_prealloc_list[order]));
+	KUNIT_EXPECT_EQ(test, e4b.bd_info->bb_free, free - 1);
+
+	ext4_lock_group(sb, group);
+	mb_free_blocks(NULL, &e4b, ac.ac_b_ex.fe_start, 1);
+	ext4_unlock_group(sb, group);
+	KUNIT_EXPECT_EQ(test, e4b.bd_info->bb_free, free);
+	ext4_mb_unload_buddy(&e4b);
+	/* the discarded prealloc space is freed by RCU */
+	rcu_barrier();
+}
+
 static const struct mbt_ext4_block_layout mbt_test_layouts[] = {
 	{
 		.blocksize_bits = 10,
@@ -977,6 +1195,9 @@ static struct kunit_case mbt_test_cases[] = {
 	KUNIT_CASE_PARAM(test_mark_diskspace_used, mbt_layouts_gen_params),
 	KUNIT_CASE_PARAM_ATTR(test_mb_mark_used_cost, mbt_layouts_gen_params,
 			      { .speed = KUNIT_SPEED_SLOW }),
+	KUNIT_CASE_PARAM(test_mb_arena_prealloc, mbt_layouts_gen_params),
+	KUNIT_CASE_PARAM_ATTR(test_mb_arena_scaling, mbt_layouts_gen_params,
+			      { .speed = KUNIT_SPEED_SLOW }),
 	{}
 };
 
@@ -85,6 +85,15 @@
  * The reason for having a per cpu locality group is to reduce the contention
  * between CPUs. It is possible to get scheduled at this point.
  *
+ * With mb_percpu_arenas, each locality group also takes its new prealloc
+ * spaces from a block group of its own (lg_group), initially spread over the
+ * filesystem by CPU number, so that CPUs creating small files concurrently
+ * don't serialize on one group lock when marking blocks used. lg_group
+ * follows the group the last prealloc space was found in once the initial
+ * one fills up. Prealloc spaces of locality groups that have been idle for
+ * MB_ARENA_IDLE_TIME are returned to the buddy on sync. It is only on by
+ * default for non-rotational devices, where spreading costs no seeks.
+ *
  * The locality group prealloc space is used looking at whether we have
  * enough free space (pa_free) within the prealloc space.
  *
@@ -3588,6 +3597,20 @@ static void ext4_discard_work(struct work_struct *work)
 		ext4_mb_unload_buddy(&e4b);
 }
 
+/*
+ * Initial lg_group of @cpu's locality group: CPUs are spread evenly over the
+ * block groups, so that the first possible CPUs get distinct groups.
+ */
+static ext4_group_t ext4_mb_arena_group(struct super_block *sb,
+					unsigned int cpu)
+{
+	ext4_group_t ngroups = ext4_get_groups_count(sb);
+	ext4_group_t stride = max_t(ext4_group_t,
+				    ngroups / num_possible_cpus(), 1);
+
+	return ((u64)cpu * stride) % ngroups;
+}
+
 int ext4_mb_init(struct super_block *sb)
 {
 	struct ext4_sb_info *sbi = EXT4_SB(sb);
@@ -3723,12 +3746,16 @@ int ext4_mb_init(struct super_block *sb)
 		for (j = 0; j < PREALLOC_TB_SIZE; j++)
 			INIT_LIST_HEAD(&lg->lg_prealloc_list[j]);
 		spin_lock_init(&lg->lg_prealloc_lock);
+		lg->lg_group = ext4_mb_arena_group(sb, i);
 	}
 
-	if (bdev_nonrot(sb->s_bdev))
+	if (bdev_nonrot(sb->s_bdev)) {
 		sbi->s_mb_max_linear_groups = 0;
-	else
+		sbi->s_mb_percpu_arenas = MB_DEFAULT_PERCPU_ARENAS;
+	} else {
 		sbi->s_mb_max_linear_groups = MB_DEFAULT_LINEAR_LIMIT;
+		sbi->s_mb_percpu_arenas = 0;
+	}
 	/* init file for buddy data */
 	ret = ext4_mb_init_backend(sb);
 	if (ret != 0)
@@ -4217,7 +4244,14 @@ static void ext4_mb_normalize_group_request(struct ext4_allocation_context *ac)
 
 	BUG_ON(lg == NULL);
 	ac->ac_g_ex.fe_len = EXT4_SB(sb)->s_mb_group_prealloc;
-	mb_debug(sb, "goal %u blocks for locality group\n", ac->ac_g_ex.fe_len);
+	/* s_blockfile_groups restricts where non-extent files can go */
+	if (EXT4_SB(sb)->s_mb_percpu_arenas &&
+	    ext4_test_inode_flag(ac->ac_inode, EXT4_INODE_EXTENTS)) {
+		ac->ac_g_ex.fe_group = lg->lg_group;
+		ac->ac_g_ex.fe_start = 0;
+	}
+	mb_debug(sb, "goal %u blocks @ group %u for locality group\n",
+		 ac->ac_g_ex.fe_len, ac->ac_g_ex.fe_group);
 }
 
 /*
@@ -5295,6 +5329,8 @@ ext4_mb_new_group_pa(struct ext4_allocation_context *ac)
 
 	pa->pa_node_lock.lg_lock = &lg->lg_prealloc_lock;
 	pa->pa_inode = NULL;
+	/* serialized by lg_mutex */
+	lg->lg_group = ac->ac_b_ex.fe_group;
 
 	list_add(&pa->pa_group_list, &grp->bb_prealloc_list);
 
@@ -5784,6 +5820,7 @@ static void ext4_mb_group_or_file(struct ext4_allocation_context *ac)
 
 	/* serialize all allocations in the group */
 	mutex_lock(&ac->ac_lg->lg_mutex);
+	WRITE_ONCE(ac->ac_lg->lg_last_alloc, jiffies);
 }
 
 static noinline_for_stack void
@@ -5913,6 +5950,40 @@ ext4_mb_discard_lg_preallocations(struct super_block *sb,
 	}
 }
 
+/*
+ * Return the prealloc spaces of locality groups that haven't allocated for
+ * MB_ARENA_IDLE_TIME to the buddy, so that the space an idle CPU reserved
+ * becomes available to the other ones.  Called on sync; ENOSPC is already
+ * handled by ext4_mb_discard_preallocations().
+ */
+void ext4_mb_trim_arenas(struct super_block *sb)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_locality_group *lg;
+	int cpu, order;
+
+	if (!sbi->s_locality_groups)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		lg = per_cpu_ptr(sbi->s_locality_groups, cpu);
+		if (time_before(jiffies, READ_ONCE(lg->lg_last_alloc) +
+					 MB_ARENA_IDLE_TIME))
+			continue;
+		/* not idle after all */
+		if (!mutex_trylock(&lg->lg_mutex))
+			continue;
+		for (order = 0; order < PREALLOC_TB_SIZE; order++) {
+			if (list_empty(&lg->lg_prealloc_list[order]))
+				continue;
+			/* large enough a count to discard them all */
+			ext4_mb_discard_lg_preallocations(sb, lg, order,
+							  INT_MAX);
+		}
+		mutex_unlock(&lg->lg_mutex);
+	}
+}
+
 /*
  * We have incremented pa_count. So it cannot be freed at this
  * point. Also we hold lg_mutex. So no parallel allocation is
@@ -73,6 +73,19 @@
  */
 #define MB_DEFAULT_GROUP_PREALLOC	512
 
+/*
+ * By default on non-rotational devices, each CPU's locality group carves its
+ * preallocations out of its own block group, so that concurrent small-file
+ * allocations on different CPUs don't contend on the same group lock.
+ */
+#define MB_DEFAULT_PERCPU_ARENAS	1
+
+/*
+ * Locality group preallocations not used for that long are returned to the
+ * buddy on the next sync.
+ */
+#define MB_ARENA_IDLE_TIME		(5 * HZ)
+
 /*
  * Number of groups to search linearly before performing group scanning
  * optimization.
@@ -168,6 +181,10 @@ struct ext4_locality_group {
 	/* list of preallocations */
 	struct list_head	lg_prealloc_list[PREALLOC_TB_SIZE];
 	spinlock_t		lg_prealloc_lock;
+	/* group new preallocations are taken from, see mb_percpu_arenas */
+	ext4_group_t		lg_group;
+	/* jiffies of the last allocation, for ext4_mb_trim_arenas() */
+	unsigned long		lg_last_alloc;
 };
 
 struct ext4_allocation_context {
@@ -18,10 +18,12 @@
 #include "f2fs.h"
 #include "node.h"
 #include "segment.h"
+#include "iostat.h"
 #include <trace/events/f2fs.h>
 
 static struct kmem_cache *cic_entry_slab;
 static struct kmem_cache *dic_entry_slab;
+static struct kmem_cache *cwork_entry_slab;
 
 static void *page_array_alloc(struct inode *inode, int nr)
 {
@@ -1494,15 +1496,14 @@ void f2fs_compress_write_end_io(struct bio *bio, struct page *page)
 	kmem_cache_free(cic_entry_slab, cic);
 }
 
-static int f2fs_write_raw_pages(struct compress_ctx *cc,
-					int *submitted_p,
-					struct writeback_control *wbc,
-					enum iostat_type io_type)
+/*
+ * Leave the locked cluster dirty and unlocked before writing it uncompressed,
+ * returns its compressed block count.
+ */
+static int f2fs_unlock_raw_pages(struct compress_ctx *cc,
+					struct writeback_control *wbc)
 {
-	struct address_space *mapping = cc->inode->i_mapping;
-	struct f2fs_sb_info *sbi = F2FS_M_SB(mapping);
-	int submitted, compr_blocks, i;
-	int ret = 0;
+	int compr_blocks, i;
 
 	compr_blocks = f2fs_compressed_blocks(cc);
 
@@ -1513,9 +1514,19 @@ static int f2fs_write_raw_pages(struct compress_ctx *cc,
 		redirty_page_for_writepage(wbc, cc->rpages[i]);
 		unlock_page(cc->rpages[i]);
 	}
+	return compr_blocks;
+}
 
-	if (compr_blocks < 0)
-		return compr_blocks;
+static int __f2fs_write_raw_pages(struct compress_ctx *cc,
+					int compr_blocks,
+					int *submitted_p,
+					struct writeback_control *wbc,
+					enum iostat_type io_type)
+{
+	struct address_space *mapping = cc->inode->i_mapping;
+	struct f2fs_sb_info *sbi = F2FS_M_SB(mapping);
+	int submitted, i;
+	int ret = 0;
 
 	/* overwrite compressed cluster w/ normal cluster */
 	if (compr_blocks > 0)
@@ -1579,7 +1590,31 @@ static int f2fs_write_raw_pages(struct compress_ctx *cc,
 	return ret;
 }
 
-int f2fs_write_multi_pages(struct compress_ctx *cc,
+static int f2fs_write_raw_pages(struct compress_ctx *cc,
+					int *submitted_p,
+					struct writeback_control *wbc,
+					enum iostat_type io_type)
+{
+	int compr_blocks = f2fs_unlock_raw_pages(cc, wbc);
+
+	if (compr_blocks < 0)
+		return compr_blocks;
+	return __f2fs_write_raw_pages(cc, compr_blocks, submitted_p,
+							wbc, io_type);
+}
+
+static int f2fs_compress_cluster(struct compress_ctx *cc)
+{
+	u64 start = ktime_get_ns();
+	int ret;
+
+	ret = f2fs_compress_pages(cc);
+	f2fs_update_compress_iostat(F2FS_I_SB(cc->inode),
+			COMPRESS_CLUSTER_TIME, ktime_get_ns() - start);
+	return ret;
+}
+
+static int __f2fs_write_multi_pages(struct compress_ctx *cc,
 					int *submitted,
 					struct writeback_control *wbc,
 					enum iostat_type io_type)
@@ -1588,7 +1623,7 @@ int f2fs_write_multi_pages(struct compress_ctx *cc,
 
 	*submitted = 0;
 	if (cluster_may_compress(cc)) {
-		err = f2fs_compress_pages(cc);
+		err = f2fs_compress_cluster(cc);
 		if (err == -EAGAIN) {
 			add_compr_block_stat(cc->inode, cc->cluster_size);
 			goto write;
@@ -1613,6 +1648,239 @@ int f2fs_write_multi_pages(struct compress_ctx *cc,
 	return err;
 }
 
+/* A full cluster compressed by the workers on behalf of writeback */
+struct compress_work {
+	struct compress_ctx cc;		/* owns the locked cluster pages */
+	struct f2fs_sb_info *sbi;
+	struct work_struct work;
+	struct completion done;		/* f2fs_compress_pages() returned */
+	struct list_head list;		/* entry in compress_wb_ctx */
+	int err;			/* result of f2fs_compress_pages() */
+	int compr_blocks;		/* compressed blocks, on raw_works */
+};
+
+static void f2fs_compress_work_fn(struct work_struct *work)
+{
+	struct compress_work *cw = container_of(work,
+					struct compress_work, work);
+
+	cw->err = f2fs_compress_cluster(&cw->cc);
+	complete(&cw->done);
+}
+
+static bool cluster_may_compress_async(struct compress_ctx *cc)
+{
+	struct f2fs_sb_info *sbi = F2FS_I_SB(cc->inode);
+
+	/* quota files block on node_write, see f2fs_write_compressed_pages */
+	return sbi->compress_wq && READ_ONCE(sbi->max_compress_inflight) &&
+		!IS_NOQUOTA(cc->inode);
+}
+
+void f2fs_init_compress_wb_ctx(struct compress_wb_ctx *wctx)
+{
+	INIT_LIST_HEAD(&wctx->works);
+	INIT_LIST_HEAD(&wctx->raw_works);
+	wctx->nr_works = 0;
+}
+
+/*
+ * Write out a cluster whose compression completed.  The compressed write
+ * only trylocks cp_rwsem.  A cluster falling back to the raw write is just
+ * unlocked here and queued on raw_works: writing it may block on cp_rwsem
+ * or run foreground GC, which must not happen while later clusters of the
+ * pass are still locked.
+ */
+static int f2fs_write_compress_work(struct compress_wb_ctx *wctx,
+					struct compress_work *cw,
+					int *submitted,
+					struct writeback_control *wbc,
+					enum iostat_type io_type)
+{
+	struct compress_ctx *cc = &cw->cc;
+	int err = cw->err;
+
+	*submitted = 0;
+	if (err == -EAGAIN) {
+		add_compr_block_stat(cc->inode, cc->cluster_size);
+	} else if (err) {
+		f2fs_put_rpages_wbc(cc, wbc, true, 1);
+		f2fs_destroy_compress_ctx(cc, false);
+		goto free_work;
+	} else {
+		err = f2fs_write_compressed_pages(cc, submitted, wbc, io_type);
+		if (!err)
+			goto free_work;
+		f2fs_bug_on(cw->sbi, err != -EAGAIN);
+	}
+
+	f2fs_bug_on(cw->sbi, *submitted);
+	cw->compr_blocks = f2fs_unlock_raw_pages(cc, wbc);
+	list_add_tail(&cw->list, &wctx->raw_works);
+	return 0;
+
+free_work:
+	kmem_cache_free(cwork_entry_slab, cw);
+	return err;
+}
+
+/*
+ * Write out the clusters of @wctx in order, as their compression completes.
+ * Waits for at most @nr_wait clusters still being compressed, pass UINT_MAX
+ * to drain @wctx.  Returns the first error.
+ */
+int f2fs_flush_compress_works(struct compress_wb_ctx *wctx,
+					unsigned int nr_wait,
+					int *submitted,
+					struct writeback_control *wbc,
+					enum iostat_type io_type)
+{
+	struct compress_work *cw, *tmp;
+	struct f2fs_sb_info *sbi;
+	int nr, err, ret = 0;
+	u64 start;
+
+	*submitted = 0;
+	while (!list_empty(&wctx->works)) {
+		cw = list_first_entry(&wctx->works, struct compress_work, list);
+		sbi = cw->sbi;
+
+		if (!completion_done(&cw->done)) {
+			if (!nr_wait)
+				break;
+			nr_wait--;
+			start = ktime_get_ns();
+			wait_for_completion(&cw->done);
+			f2fs_update_compress_iostat(sbi, COMPRESS_WAIT_TIME,
+						ktime_get_ns() - start);
+		}
+
+		list_del(&cw->list);
+		wctx->nr_works--;
+		atomic_dec(&sbi->compress_inflight);
+
+		err = f2fs_write_compress_work(wctx, cw, &nr, wbc, io_type);
+		*submitted += nr;
+		if (err && !ret)
+			ret = err;
+	}
+
+	if (wctx->nr_works)
+		return ret;
+
+	/* no cluster of this pass is locked anymore */
+	list_for_each_entry_safe(cw, tmp, &wctx->raw_works, list) {
+		list_del(&cw->list);
+
+		err = cw->compr_blocks;
+		nr = 0;
+		if (err >= 0)
+			err = __f2fs_write_raw_pages(&cw->cc, cw->compr_blocks,
+							&nr, wbc, io_type);
+		f2fs_put_rpages_wbc(&cw->cc, wbc, false, 0);
+		f2fs_destroy_compress_ctx(&cw->cc, false);
+		kmem_cache_free(cwork_entry_slab, cw);
+
+		*submitted += nr;
+		if (err && !ret)
+			ret = err;
+	}
+	return ret;
+}
+
+/*
+ * Hand a full cluster to the compression workers and write out the clusters
+ * of @wctx that are done.  Once max_compress_inflight clusters are queued on
+ * the filesystem, wait for our oldest one; with none queued, drain @wctx and
+ * leave @cc to be compressed inline.
+ */
+static int f2fs_queue_compress_work(struct compress_ctx *cc,
+					struct compress_wb_ctx *wctx,
+					bool *queued,
+					int *submitted,
+					struct writeback_control *wbc,
+					enum iostat_type io_type)
+{
+	struct f2fs_sb_info *sbi = F2FS_I_SB(cc->inode);
+	struct compress_work *cw;
+	int nr, err, ret = 0;
+
+	*queued = false;
+	*submitted = 0;
+	while (atomic_inc_return(&sbi->compress_inflight) >
+				READ_ONCE(sbi->max_compress_inflight)) {
+		atomic_dec(&sbi->compress_inflight);
+		if (!wctx->nr_works)
+			goto drain;
+
+		err = f2fs_flush_compress_works(wctx, 1, &nr, wbc, io_type);
+		*submitted += nr;
+		if (err && !ret)
+			ret = err;
+	}
+
+	cw = f2fs_kmem_cache_alloc(cwork_entry_slab, GFP_NOFS, false, sbi);
+	if (!cw) {
+		atomic_dec(&sbi->compress_inflight);
+		goto drain;
+	}
+
+	cw->cc = *cc;
+	cw->sbi = sbi;
+	init_completion(&cw->done);
+	INIT_WORK(&cw->work, f2fs_compress_work_fn);
+	list_add_tail(&cw->list, &wctx->works);
+	wctx->nr_works++;
+	queue_work(sbi->compress_wq, &cw->work);
+
+	/* the cluster pages belong to the work now */
+	cc->rpages = NULL;
+	cc->nr_rpages = 0;
+	cc->cluster_idx = NULL_CLUSTER;
+	*queued = true;
+
+	err = f2fs_flush_compress_works(wctx, 0, &nr, wbc, io_type);
+	goto out;
+drain:
+	err = f2fs_flush_compress_works(wctx, UINT_MAX, &nr, wbc, io_type);
+out:
+	*submitted += nr;
+	return ret ?: err;
+}
+
+/*
+ * With @wctx, full clusters are compressed by the workers and written out
+ * by later calls; everything else is written inline once @wctx is drained.
+ */
+int f2fs_write_multi_pages(struct compress_ctx *cc,
+					struct compress_wb_ctx *wctx,
+					int *submitted,
+					struct writeback_control *wbc,
+					enum iostat_type io_type)
+{
+	bool queued = false;
+	int flushed = 0;
+	int err, ret = 0;
+
+	*submitted = 0;
+	if (wctx) {
+		if (cluster_may_compress(cc) && cluster_may_compress_async(cc))
+			ret = f2fs_queue_compress_work(cc, wctx, &queued,
+						&flushed, wbc, io_type);
+		else
+			ret = f2fs_flush_compress_works(wctx, UINT_MAX,
+						&flushed, wbc, io_type);
+		if (queued) {
+			*submitted = flushed;
+			return ret;
+		}
+	}
+
+	err = __f2fs_write_multi_pages(cc, submitted, wbc, io_type);
+	*submitted += flushed;
+	return ret ?: err;
+}
+
 static inline bool allow_memalloc_for_decomp(struct f2fs_sb_info *sbi,
 		bool pre_alloc)
 {
@@ -2042,6 +2310,32 @@ void f2fs_destroy_compress_inode(struct f2fs_sb_info *sbi)
 	sbi->compress_inode = NULL;
 }
 
+int f2fs_init_compress_wq(struct f2fs_sb_info *sbi)
+{
+	atomic_set(&sbi->compress_inflight, 0);
+
+	if (!f2fs_sb_has_compression(sbi))
+		return 0;
+
+	sbi->compress_wq = alloc_workqueue("f2fs_compress_wq",
+					WQ_UNBOUND | WQ_MEM_RECLAIM,
+					num_online_cpus());
+	if (!sbi->compress_wq)
+		return -ENOMEM;
+
+	/* a single cpu gains nothing from handing clusters over */
+	if (num_online_cpus() > 1)
+		sbi->max_compress_inflight =
+			DEF_COMPRESS_INFLIGHT_PER_CPU * num_online_cpus();
+	return 0;
+}
+
+void f2fs_destroy_compress_wq(struct f2fs_sb_info *sbi)
+{
+	if (sbi->compress_wq)
+		destroy_workqueue(sbi->compress_wq);
+}
+
 int f2fs_init_page_array_cache(struct f2fs_sb_info *sbi)
 {
 	dev_t dev = sbi->sb->s_bdev->bd_dev;
@@ -2075,7 +2369,13 @@ int __init f2fs_init_compress_cache(void)
 					sizeof(struct decompress_io_ctx));
 	if (!dic_entry_slab)
 		goto free_cic;
+	cwork_entry_slab = f2fs_kmem_cache_create("f2fs_cwork_entry",
+					sizeof(struct compress_work));
+	if (!cwork_entry_slab)
+		goto free_dic;
 	return 0;
+free_dic:
+	kmem_cache_destroy(dic_entry_slab);
 free_cic:
 	kmem_cache_destroy(cic_entry_slab);
 	return -ENOMEM;
@@ -2083,6 +2383,7 @@ int __init f2fs_init_compress_cache(void)
 
 void f2fs_destroy_compress_cache(void)
 {
+	kmem_cache_destroy(cwork_entry_slab);
 	kmem_cache_destroy(dic_entry_slab);
 	kmem_cache_destroy(cic_entry_slab);
 }
@@ -2990,6 +2990,7 @@ static int f2fs_write_cache_pages(struct address_space *mapping,
 		.rlen = PAGE_SIZE * F2FS_I(inode)->i_cluster_size,
 		.private = NULL,
 	};
+	struct compress_wb_ctx wctx;
 #endif
 	int nr_folios, p, idx;
 	int nr_pages;
@@ -3010,6 +3011,7 @@ static int f2fs_write_cache_pages(struct address_space *mapping,
 				cc.log_cluster_size, GFP_NOFS | __GFP_NOFAIL);
 		max_pages = 1 << cc.log_cluster_size;
 	}
+	f2fs_init_compress_wb_ctx(&wctx);
 #endif
 
 	folio_batch_init(&fbatch);
@@ -3089,7 +3091,8 @@ static int f2fs_write_cache_pages(struct address_space *mapping,
 				if (!f2fs_cluster_can_merge_page(&cc,
 								folio->index)) {
 					ret = f2fs_write_multi_pages(&cc,
-						&submitted, wbc, io_type);
+						&wctx, &submitted, wbc,
+						io_type);
 					if (!ret)
 						need_readd = true;
 					goto result;
@@ -3105,6 +3108,21 @@ static int f2fs_write_cache_pages(struct address_space *mapping,
 					pages, i, nr_pages, true))
 					goto lock_folio;
 
+				/*
+				 * preparing the overwrite may block on
+				 * cp_rwsem, don't keep queued clusters locked
+				 */
+				ret2 = f2fs_flush_compress_works(&wctx,
+						UINT_MAX, &submitted, wbc,
+						io_type);
+				nwritten += submitted;
+				wbc->nr_to_write -= submitted;
+				if (ret2) {
+					ret = ret2;
+					done = 1;
+					break;
+				}
+
 				ret2 = f2fs_prepare_compress_overwrite(
 							inode, &pagep,
 							folio->index, &fsdata);
@@ -3211,7 +3229,8 @@ static int f2fs_write_cache_pages(struct address_space *mapping,
 #ifdef CONFIG_F2FS_FS_COMPRESSION
 	/* flush remained pages in compress cluster */
 	if (f2fs_compressed_file(inode) && !f2fs_cluster_is_empty(&cc)) {
-		ret = f2fs_write_multi_pages(&cc, &submitted, wbc, io_type);
+		ret = f2fs_write_multi_pages(&cc, &wctx, &submitted,
+							wbc, io_type);
 		nwritten += submitted;
 		wbc->nr_to_write -= submitted;
 		if (ret) {
@@ -3219,8 +3238,20 @@ static int f2fs_write_cache_pages(struct address_space *mapping,
 			retry = 0;
 		}
 	}
-	if (f2fs_compressed_file(inode))
+	if (f2fs_compressed_file(inode)) {
+		/* nothing of this pass is left to a checkpoint or a retry */
+		int ret2 = f2fs_flush_compress_works(&wctx, UINT_MAX,
+						&submitted, wbc, io_type);
+
+		nwritten += submitted;
+		wbc->nr_to_write -= submitted;
+		if (ret2 && !ret) {
+			ret = ret2;
+			done = 1;
+			retry = 0;
+		}
 		f2fs_destroy_compress_ctx(&cc, false);
+	}
 #endif
 	if (retry) {
 		index = 0;
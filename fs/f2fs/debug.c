@@ -59,6 +59,25 @@ void f2fs_update_sit_info(struct f2fs_sb_info *sbi)
 		si->avg_vblocks = 0;
 }
 
+/* called under gc_lock at the end of each f2fs_gc() */
+void f2fs_update_gc_latency(struct f2fs_sb_info *sbi, int gc_type,
+				u64 time_ns, unsigned int blks)
+{
+	struct f2fs_stat_info *si = F2FS_STAT(sbi);
+	unsigned int ms = div_u64(time_ns, NSEC_PER_MSEC);
+	unsigned int bucket = 0;
+
+	if (ms)
+		bucket = min_t(unsigned int, ilog2(ms) + 1,
+					NR_GC_LAT_BUCKETS - 1);
+
+	si->gc_lat_hist[gc_type][bucket]++;
+	si->gc_time_ns[gc_type] += time_ns;
+	si->gc_moved_blks[gc_type] += blks;
+	if (ms > si->gc_peak_lat[gc_type])
+		si->gc_peak_lat[gc_type] = ms;
+}
+
 #ifdef CONFIG_DEBUG_FS
 static void update_multidevice_stats(struct f2fs_sb_info *sbi)
 {
@@ -434,6 +453,20 @@ static const char *ipu_mode_names[F2FS_IPU_MAX] = {
 	[F2FS_IPU_HONOR_OPU_WRITE]	= "HONOR_OPU_WRITE",
 };
 
+static const char *gc_lat_names[NR_GC_LAT_BUCKETS] = {
+	"<1", "1", "2", "4", "8", "16", "32", "64", "128", "256", "512",
+	">=1024",
+};
+
+static unsigned long long gc_bytes_per_sec(struct f2fs_stat_info *si,
+						int gc_type)
+{
+	if (!si->gc_time_ns[gc_type])
+		return 0;
+	return mul_u64_u64_div_u64(si->gc_moved_blks[gc_type] * F2FS_BLKSIZE,
+				NSEC_PER_SEC, si->gc_time_ns[gc_type]);
+}
+
 static int stat_show(struct seq_file *s, void *v)
 {
 	struct f2fs_stat_info *si;
@@ -647,6 +680,20 @@ static int stat_show(struct seq_file *s, void *v)
 				si->bg_node_blks);
 		seq_printf(s, "BG skip : IO: %u, Other: %u\n",
 				si->io_skip_bggc, si->other_skip_bggc);
+		seq_printf(s, "%-20s", "GC latency (ms) :");
+		for (i = 0; i < NR_GC_LAT_BUCKETS; i++)
+			seq_printf(s, " %6s", gc_lat_names[i]);
+		seq_putc(s, '\n');
+		for (j = BG_GC; j <= FG_GC; j++) {
+			seq_printf(s, "  - %s : peak %6u", j == BG_GC ? "BG" : "FG",
+					si->gc_peak_lat[j]);
+			for (i = 0; i < NR_GC_LAT_BUCKETS; i++)
+				seq_printf(s, " %6u", si->gc_lat_hist[j][i]);
+			seq_putc(s, '\n');
+		}
+		seq_printf(s, "GC migrated : BG: %llu bytes/s, FG: %llu bytes/s\n",
+				gc_bytes_per_sec(si, BG_GC),
+				gc_bytes_per_sec(si, FG_GC));
 		seq_puts(s, "\nExtent Cache (Read):\n");
 		seq_printf(s, "  - Hit Count: L1-1:%llu L1-2:%llu L2:%llu\n",
 				si->hit_largest, si->hit_cached[EX_READ],
@@ -1205,6 +1205,12 @@ enum iostat_type {
 	NR_IO_TYPE,
 };
 
+enum iostat_compress_type {
+	COMPRESS_CLUSTER_TIME,		/* time spent compressing clusters */
+	COMPRESS_WAIT_TIME,		/* writeback waiting for compression workers */
+	NR_COMPRESS_TIME_TYPE,
+};
+
 struct f2fs_io_info {
 	struct f2fs_sb_info *sbi;	/* f2fs_sb_info pointer */
 	nid_t ino;		/* inode number */
@@ -1461,6 +1467,10 @@ enum compress_flag {
 #define	COMPRESS_WATERMARK			20
 #define	COMPRESS_PERCENT			20
 
+/* clusters in flight to the compression workers, per online cpu */
+#define DEF_COMPRESS_INFLIGHT_PER_CPU		2
+#define MAX_COMPRESS_INFLIGHT			1024
+
 #define COMPRESS_DATA_RESERVED_SIZE		4
 struct compress_data {
 	__le32 clen;			/* compressed data size */
@@ -1496,6 +1506,13 @@ struct compress_ctx {
 	void *private2;			/* extra payload buffer */
 };
 
+/* clusters handed to the compression workers by one writeback pass */
+struct compress_wb_ctx {
+	struct list_head works;		/* being compressed, in cluster order */
+	struct list_head raw_works;	/* unlocked, to be written uncompressed */
+	unsigned int nr_works;		/* entries in works */
+};
+
 /* compress context for write IO path */
 struct compress_io_ctx {
 	u32 magic;			/* magic number to indicate page is compressed */
@@ -1818,6 +1835,11 @@ struct f2fs_sb_info {
 	unsigned int compress_percent;		/* cache page percentage */
 	unsigned int compress_watermark;	/* cache page watermark */
 	atomic_t compress_page_hit;		/* cache hit count */
+
+	/* For asynchronous compression in writeback */
+	struct workqueue_struct *compress_wq;	/* compression workers */
+	atomic_t compress_inflight;		/* clusters queued to workers */
+	unsigned int max_compress_inflight;	/* 0 compresses in writeback */
 #endif
 
 #ifdef CONFIG_F2FS_IOSTAT
@@ -1829,6 +1851,8 @@ struct f2fs_sb_info {
 	bool iostat_enable;
 	unsigned long iostat_next_period;
 	unsigned int iostat_period_ms;
+	unsigned long long compress_time_ns[NR_COMPRESS_TIME_TYPE];
+	unsigned long long compress_time_count[NR_COMPRESS_TIME_TYPE];
 
 	/* For io latency related statistics info in one iostat period */
 	spinlock_t iostat_lat_lock;
@@ -3957,6 +3981,8 @@ struct f2fs_dev_stats {
 	unsigned int devstats[2][DEVSTAT_MAX];		/* 0: segs, 1: secs */
 };
 
+#define NR_GC_LAT_BUCKETS	12
+
 struct f2fs_stat_info {
 	struct list_head stat_list;
 	struct f2fs_sb_info *sbi;
@@ -4006,6 +4032,11 @@ struct f2fs_stat_info {
 	int gc_call_count[MAX_CALL_TYPE];
 	int gc_segs[2][2];
 	int gc_secs[2][2];
+	/* f2fs_gc() latency in log2 buckets of ms, by BG_GC/FG_GC */
+	unsigned int gc_lat_hist[2][NR_GC_LAT_BUCKETS];
+	unsigned int gc_peak_lat[2];
+	unsigned long long gc_time_ns[2];
+	unsigned long long gc_moved_blks[2];
 	int tot_blks, data_blks, node_blks;
 	int bg_data_blks, bg_node_blks;
 	int curseg[NR_CURSEG_TYPE];
@@ -4124,6 +4155,9 @@ static inline struct f2fs_stat_info *F2FS_STAT(struct f2fs_sb_info *sbi)
 
 #define stat_inc_tot_blk_count(si, blks)				\
 	((si)->tot_blks += (blks))
+#define stat_get_gc_blk_count(sbi)	(F2FS_STAT(sbi)->tot_blks)
+#define stat_update_gc_latency(sbi, gc_type, time_ns, blks)		\
+		f2fs_update_gc_latency(sbi, gc_type, time_ns, blks)
 
 #define stat_inc_data_blk_count(sbi, blks, gc_type)			\
 	do {								\
@@ -4146,6 +4180,8 @@ void f2fs_destroy_stats(struct f2fs_sb_info *sbi);
 void __init f2fs_create_root_stats(void);
 void f2fs_destroy_root_stats(void);
 void f2fs_update_sit_info(struct f2fs_sb_info *sbi);
+void f2fs_update_gc_latency(struct f2fs_sb_info *sbi, int gc_type,
+				u64 time_ns, unsigned int blks);
 #else
 #define stat_inc_cp_call_count(sbi, foreground)		do { } while (0)
 #define stat_inc_cp_count(sbi)				do { } while (0)
@@ -4180,6 +4216,8 @@ void f2fs_update_sit_info(struct f2fs_sb_info *sbi);
 #define stat_inc_gc_sec_count(sbi, type, gc_type)	do { } while (0)
 #define stat_inc_gc_seg_count(sbi, type, gc_type)	do { } while (0)
 #define stat_inc_tot_blk_count(si, blks)		do { } while (0)
+#define stat_get_gc_blk_count(sbi)			0
+#define stat_update_gc_latency(sbi, gc_type, time_ns, blks)	do { } while (0)
 #define stat_inc_data_blk_count(sbi, blks, gc_type)	do { } while (0)
 #define stat_inc_node_blk_count(sbi, blks, gc_type)	do { } while (0)
 
@@ -4359,6 +4397,13 @@ bool f2fs_all_cluster_page_ready(struct compress_ctx *cc, struct page **pages,
 bool f2fs_sanity_check_cluster(struct dnode_of_data *dn);
 void f2fs_compress_ctx_add_page(struct compress_ctx *cc, struct folio *folio);
 int f2fs_write_multi_pages(struct compress_ctx *cc,
+						struct compress_wb_ctx *wctx,
+						int *submitted,
+						struct writeback_control *wbc,
+						enum iostat_type io_type);
+void f2fs_init_compress_wb_ctx(struct compress_wb_ctx *wctx);
+int f2fs_flush_compress_works(struct compress_wb_ctx *wctx,
+						unsigned int nr_wait,
 						int *submitted,
 						struct writeback_control *wbc,
 						enum iostat_type io_type);
@@ -4379,6 +4424,8 @@ unsigned int f2fs_cluster_blocks_are_contiguous(struct dnode_of_data *dn,
 int f2fs_init_compress_ctx(struct compress_ctx *cc);
 void f2fs_destroy_compress_ctx(struct compress_ctx *cc, bool reuse);
 void f2fs_init_compress_info(struct f2fs_sb_info *sbi);
+int f2fs_init_compress_wq(struct f2fs_sb_info *sbi);
+void f2fs_destroy_compress_wq(struct f2fs_sb_info *sbi);
 int f2fs_init_compress_inode(struct f2fs_sb_info *sbi);
 void f2fs_destroy_compress_inode(struct f2fs_sb_info *sbi);
 int f2fs_init_page_array_cache(struct f2fs_sb_info *sbi);
@@ -4435,6 +4482,8 @@ static inline void f2fs_put_page_dic(struct page *page, bool in_task)
 static inline unsigned int f2fs_cluster_blocks_are_contiguous(
 			struct dnode_of_data *dn, unsigned int ofs_in_node) { return 0; }
 static inline bool f2fs_sanity_check_cluster(struct dnode_of_data *dn) { return false; }
+static inline int f2fs_init_compress_wq(struct f2fs_sb_info *sbi) { return 0; }
+static inline void f2fs_destroy_compress_wq(struct f2fs_sb_info *sbi) { }
 static inline int f2fs_init_compress_inode(struct f2fs_sb_info *sbi) { return 0; }
 static inline void f2fs_destroy_compress_inode(struct f2fs_sb_info *sbi) { }
 static inline int f2fs_init_page_array_cache(struct f2fs_sb_info *sbi) { return 0; }
@@ -759,6 +759,99 @@ static int f2fs_gc_pinned_control(struct inode *inode, int gc_type,
 	return -EAGAIN;
 }
 
+static bool is_victim_candidate(struct f2fs_sb_info *sbi,
+			struct victim_sel_policy *p, int gc_type,
+			unsigned int segno)
+{
+	struct dirty_seglist_info *dirty_i = DIRTY_I(sbi);
+	unsigned int secno = GET_SEC_FROM_SEG(sbi, segno);
+
+#ifdef CONFIG_F2FS_CHECK_FS
+	/*
+	 * skip selecting the invalid segno (that is failed due to block
+	 * validity check failure during GC) to avoid endless GC loop in
+	 * such cases.
+	 */
+	if (test_bit(segno, SIT_I(sbi)->invalid_segmap))
+		return false;
+#endif
+
+	if (sec_usage_check(sbi, secno))
+		return false;
+
+	/* Don't touch checkpointed data */
+	if (unlikely(is_sbi_flag_set(sbi, SBI_CP_DISABLED))) {
+		if (p->alloc_mode == LFS) {
+			/*
+			 * LFS is set to find source section during GC.
+			 * The victim should have no checkpointed data.
+			 */
+			if (get_ckpt_valid_blocks(sbi, segno, true))
+				return false;
+		} else {
+			/*
+			 * SSR | AT_SSR are set to find target segment
+			 * for writes which can be full by checkpointed
+			 * and newly written blocks.
+			 */
+			if (!f2fs_segment_has_free_slot(sbi, segno))
+				return false;
+		}
+	}
+
+	if (gc_type == BG_GC && test_bit(secno, dirty_i->victim_secmap))
+		return false;
+
+	if (gc_type == FG_GC && f2fs_section_is_pinned(dirty_i, secno))
+		return false;
+
+	return true;
+}
+
+static bool use_victim_index(struct f2fs_sb_info *sbi,
+			struct victim_sel_policy *p)
+{
+	if (!SIT_I(sbi)->vindex.entries || f2fs_need_rand_seg(sbi))
+		return false;
+	return p->alloc_mode == LFS &&
+		(p->gc_mode == GC_GREEDY || p->gc_mode == GC_CB);
+}
+
+/*
+ * Visit dirty sections from the fewest valid blocks up.  Greedy stops after
+ * the first bucket holding a candidate, cost-benefit evaluates the emptiest
+ * max_search sections.
+ */
+static void lookup_victim_by_index(struct f2fs_sb_info *sbi,
+			struct victim_sel_policy *p, int gc_type)
+{
+	struct victim_index *vi = &SIT_I(sbi)->vindex;
+	struct victim_index_entry *ve;
+	unsigned int bucket, segno, nsearched = 0;
+	unsigned long cost;
+
+	for_each_set_bit(bucket, vi->bucket_map, vi->nr_buckets) {
+		list_for_each_entry(ve, &vi->buckets[bucket], list) {
+			segno = GET_SEG_FROM_SEC(sbi, ve - vi->entries);
+
+			if (test_bit(segno / p->ofs_unit, p->dirty_bitmap) &&
+			    is_victim_candidate(sbi, p, gc_type, segno)) {
+				cost = get_gc_cost(sbi, segno, p);
+				if (p->min_cost > cost) {
+					p->min_segno = segno;
+					p->min_cost = cost;
+				}
+			}
+
+			if (++nsearched >= p->max_search)
+				return;
+		}
+
+		if (p->gc_mode == GC_GREEDY && p->min_segno != NULL_SEGNO)
+			return;
+	}
+}
+
 /*
  * This function is called from two paths.
  * One is garbage collection and the other is SSR segment selection.
@@ -840,6 +933,11 @@ int f2fs_get_victim(struct f2fs_sb_info *sbi, unsigned int *result,
 			goto got_it;
 	}
 
+	if (!is_atgc && use_victim_index(sbi, &p)) {
+		lookup_victim_by_index(sbi, &p, gc_type);
+		goto lookup_done;
+	}
+
 	while (1) {
 		unsigned long cost, *dirty_bitmap;
 		unsigned int unit_no, segno;
@@ -863,45 +961,7 @@ int f2fs_get_victim(struct f2fs_sb_info *sbi, unsigned int *result,
 		p.offset = segno + p.ofs_unit;
 		nsearched++;
 
-#ifdef CONFIG_F2FS_CHECK_FS
-		/*
-		 * skip selecting the invalid segno (that is failed due to block
-		 * validity check failure during GC) to avoid endless GC loop in
-		 * such cases.
-		 */
-		if (test_bit(segno, sm->invalid_segmap))
-			goto next;
-#endif
-
-		secno = GET_SEC_FROM_SEG(sbi, segno);
-
-		if (sec_usage_check(sbi, secno))
-			goto next;
-
-		/* Don't touch checkpointed data */
-		if (unlikely(is_sbi_flag_set(sbi, SBI_CP_DISABLED))) {
-			if (p.alloc_mode == LFS) {
-				/*
-				 * LFS is set to find source section during GC.
-				 * The victim should have no checkpointed data.
-				 */
-				if (get_ckpt_valid_blocks(sbi, segno, true))
-					goto next;
-			} else {
-				/*
-				 * SSR | AT_SSR are set to find target segment
-				 * for writes which can be full by checkpointed
-				 * and newly written blocks.
-				 */
-				if (!f2fs_segment_has_free_slot(sbi, segno))
-					goto next;
-			}
-		}
-
-		if (gc_type == BG_GC && test_bit(secno, dirty_i->victim_secmap))
-			goto next;
-
-		if (gc_type == FG_GC && f2fs_section_is_pinned(dirty_i, secno))
+		if (!is_victim_candidate(sbi, &p, gc_type, segno))
 			goto next;
 
 		if (is_atgc) {
@@ -928,6 +988,7 @@ int f2fs_get_victim(struct f2fs_sb_info *sbi, unsigned int *result,
 		}
 	}
 
+lookup_done:
 	/* get victim for GC_AT/AT_SSR */
 	if (is_atgc) {
 		lookup_victim_by_age(sbi, &p);
@@ -1022,12 +1083,12 @@ static int check_valid_map(struct f2fs_sb_info *sbi,
  * ignore that.
  */
 static int gc_node_segment(struct f2fs_sb_info *sbi,
-		struct f2fs_summary *sum, unsigned int segno, int gc_type)
+		struct f2fs_summary *sum, unsigned int segno, int gc_type,
+		int phase, int last_phase)
 {
 	struct f2fs_summary *entry;
 	block_t start_addr;
 	int off;
-	int phase = 0;
 	bool fggc = (gc_type == FG_GC);
 	int submitted = 0;
 	unsigned int usable_blks_in_seg = f2fs_usable_blks_in_seg(sbi, segno);
@@ -1091,10 +1152,10 @@ static int gc_node_segment(struct f2fs_sb_info *sbi,
 		stat_inc_node_blk_count(sbi, 1, gc_type);
 	}
 
-	if (++phase < 3)
+	if (++phase <= last_phase)
 		goto next_step;
 
-	if (fggc)
+	if (fggc && last_phase == 2)
 		atomic_dec(&sbi->wb_sync_req[NODE]);
 	return submitted;
 }
@@ -1523,13 +1584,12 @@ static int move_data_page(struct inode *inode, block_t bidx, int gc_type,
  */
 static int gc_data_segment(struct f2fs_sb_info *sbi, struct f2fs_summary *sum,
 		struct gc_inode_list *gc_list, unsigned int segno, int gc_type,
-		bool force_migrate)
+		bool force_migrate, int phase, int last_phase)
 {
 	struct super_block *sb = sbi->sb;
 	struct f2fs_summary *entry;
 	block_t start_addr;
 	int off;
-	int phase = 0;
 	int submitted = 0;
 	unsigned int usable_blks_in_seg = f2fs_usable_blks_in_seg(sbi, segno);
 
@@ -1691,12 +1751,63 @@ static int gc_data_segment(struct f2fs_sb_info *sbi, struct f2fs_summary *sum,
 		}
 	}
 
-	if (++phase < 5)
+	if (++phase <= last_phase)
 		goto next_step;
 
 	return submitted;
 }
 
+/*
+ * Run the phases of gc_node_segment() and gc_data_segment() which only read
+ * ahead, NAT, node and inode blocks and the data itself, over a run of
+ * segments, so that their reads are all in flight before any block of the
+ * run is moved, instead of one segment at a time.
+ */
+static void gc_ra_window(struct f2fs_sb_info *sbi, unsigned int start_segno,
+				unsigned int end_segno, unsigned char type,
+				struct gc_inode_list *gc_list, int gc_type,
+				bool force_migrate, int migrated)
+{
+	struct f2fs_summary_block *sum;
+	struct page *sum_page;
+	unsigned int segno;
+
+	for (segno = start_segno; segno < end_segno; segno++) {
+		if (get_valid_blocks(sbi, segno, false) == 0)
+			continue;
+		/* the same segments do_garbage_collect() will skip */
+		if (gc_type == BG_GC && __is_large_section(sbi) &&
+				migrated >= sbi->migration_granularity)
+			break;
+		if (unlikely(f2fs_cp_error(sbi)))
+			break;
+
+		sum_page = find_get_page(META_MAPPING(sbi),
+					GET_SUM_BLOCK(sbi, segno));
+		if (!sum_page)
+			continue;
+		if (!PageUptodate(sum_page)) {
+			f2fs_put_page(sum_page, 0);
+			continue;
+		}
+
+		sum = page_address(sum_page);
+		if (type != GET_SUM_TYPE((&sum->footer))) {
+			f2fs_put_page(sum_page, 0);
+			continue;
+		}
+
+		if (type == SUM_TYPE_NODE)
+			gc_node_segment(sbi, sum->entries, segno, gc_type,
+					0, 1);
+		else
+			gc_data_segment(sbi, sum->entries, gc_list, segno,
+					gc_type, force_migrate, 0, 3);
+		f2fs_put_page(sum_page, 0);
+		migrated++;
+	}
+}
+
 static int __get_victim(struct f2fs_sb_info *sbi, unsigned int *victim,
 			int gc_type, bool one_time)
 {
@@ -1726,6 +1837,7 @@ static int do_garbage_collect(struct f2fs_sb_info *sbi,
 						SUM_TYPE_DATA : SUM_TYPE_NODE;
 	unsigned char data_type = (type == SUM_TYPE_DATA) ? DATA : NODE;
 	int submitted = 0;
+	unsigned int ra_end_segno = start_segno;
 
 	if (__is_large_section(sbi)) {
 		sec_end_segno = rounddown(end_segno, SEGS_PER_SEC(sbi));
@@ -1785,6 +1897,12 @@ static int do_garbage_collect(struct f2fs_sb_info *sbi,
 	blk_start_plug(&plug);
 
 	for (segno = start_segno; segno < end_segno; segno++) {
+		if (segno == ra_end_segno) {
+			ra_end_segno = min(segno + GC_RA_WINDOW_SEGS,
+					   end_segno);
+			gc_ra_window(sbi, segno, ra_end_segno, type, gc_list,
+					gc_type, force_migrate, migrated);
+		}
 
 		/* find segment summary of victim */
 		sum_page = find_get_page(META_MAPPING(sbi),
@@ -1817,11 +1935,11 @@ static int do_garbage_collect(struct f2fs_sb_info *sbi,
 		 */
 		if (type == SUM_TYPE_NODE)
 			submitted += gc_node_segment(sbi, sum->entries, segno,
-								gc_type);
+							gc_type, 2, 2);
 		else
 			submitted += gc_data_segment(sbi, sum->entries, gc_list,
 							segno, gc_type,
-							force_migrate);
+							force_migrate, 4, 4);
 
 		stat_inc_gc_seg_count(sbi, data_type, gc_type);
 		sbi->gc_reclaimed_segs[sbi->gc_mode]++;
@@ -1864,6 +1982,8 @@ int f2fs_gc(struct f2fs_sb_info *sbi, struct f2fs_gc_control *gc_control)
 	};
 	unsigned int skipped_round = 0, round = 0;
 	unsigned int upper_secs;
+	unsigned int start_blks = stat_get_gc_blk_count(sbi);
+	u64 start_time = ktime_get_ns();
 
 	trace_f2fs_gc_begin(sbi->sb, gc_type, gc_control->no_bg_gc,
 				gc_control->nr_free_secs,
@@ -1996,6 +2116,9 @@ int f2fs_gc(struct f2fs_sb_info *sbi, struct f2fs_gc_control *gc_control)
 				reserved_segments(sbi),
 				prefree_segments(sbi));
 
+	stat_update_gc_latency(sbi, gc_type, ktime_get_ns() - start_time,
+				stat_get_gc_blk_count(sbi) - start_blks);
+
 	f2fs_up_write(&sbi->gc_lock);
 
 	put_gc_inode(&gc_list);
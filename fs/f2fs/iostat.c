@@ -30,6 +30,16 @@ static inline unsigned long long iostat_get_avg_bytes(struct f2fs_sb_info *sbi,
 			sbi->iostat_count[type],			\
 			iostat_get_avg_bytes(sbi, type))
 
+#define IOSTAT_TIME_SHOW(name, type)					\
+	seq_printf(seq, "%-23s %-16llu %-16llu %-16llu\n",		\
+			name":", div_u64(sbi->compress_time_ns[type],	\
+				NSEC_PER_USEC),				\
+			sbi->compress_time_count[type],			\
+			sbi->compress_time_count[type] ?		\
+			div64_u64(sbi->compress_time_ns[type],		\
+				sbi->compress_time_count[type] *	\
+				NSEC_PER_USEC) : 0)
+
 int __maybe_unused iostat_info_seq_show(struct seq_file *seq, void *offset)
 {
 	struct super_block *sb = seq->private;
@@ -82,6 +92,15 @@ int __maybe_unused iostat_info_seq_show(struct seq_file *seq, void *offset)
 	IOSTAT_INFO_SHOW("fs flush", FS_FLUSH_IO);
 	IOSTAT_INFO_SHOW("fs zone reset", FS_ZONE_RESET_IO);
 
+#ifdef CONFIG_F2FS_FS_COMPRESSION
+	/* print time spent on compressed writeback */
+	seq_puts(seq, "[COMPRESS]\n");
+	seq_printf(seq, "\t\t\t%-16s %-16s %-16s\n",
+				"time_us", "count", "avg_us");
+	IOSTAT_TIME_SHOW("cluster compress", COMPRESS_CLUSTER_TIME);
+	IOSTAT_TIME_SHOW("writeback wait", COMPRESS_WAIT_TIME);
+#endif
+
 	return 0;
 }
 
@@ -151,6 +170,10 @@ void f2fs_reset_iostat(struct f2fs_sb_info *sbi)
 		sbi->iostat_bytes[i] = 0;
 		sbi->prev_iostat_bytes[i] = 0;
 	}
+	for (i = 0; i < NR_COMPRESS_TIME_TYPE; i++) {
+		sbi->compress_time_ns[i] = 0;
+		sbi->compress_time_count[i] = 0;
+	}
 	spin_unlock_irq(&sbi->iostat_lock);
 
 	spin_lock_irq(&sbi->iostat_lat_lock);
@@ -209,6 +232,20 @@ void f2fs_update_iostat(struct f2fs_sb_info *sbi, struct inode *inode,
 	f2fs_record_iostat(sbi);
 }
 
+void f2fs_update_compress_iostat(struct f2fs_sb_info *sbi,
+			enum iostat_compress_type type, u64 time_ns)
+{
+	unsigned long flags;
+
+	if (!sbi->iostat_enable)
+		return;
+
+	spin_lock_irqsave(&sbi->iostat_lock, flags);
+	sbi->compress_time_ns[type] += time_ns;
+	sbi->compress_time_count[type]++;
+	spin_unlock_irqrestore(&sbi->iostat_lock, flags);
+}
+
 static inline void __update_iostat_latency(struct bio_iostat_ctx *iostat_ctx,
 				enum iostat_lat_type lat_type)
 {
@@ -2426,6 +2426,36 @@ static void update_segment_mtime(struct f2fs_sb_info *sbi, block_t blkaddr,
 		SIT_I(sbi)->max_mtime = ctime;
 }
 
+/* rebucket the section of @segno after its valid block count changed */
+static void update_victim_index(struct f2fs_sb_info *sbi, unsigned int segno)
+{
+	struct victim_index *vi = &SIT_I(sbi)->vindex;
+	unsigned int vblocks = get_valid_blocks(sbi, segno, true);
+	struct victim_index_entry *ve;
+	unsigned int bucket = vi->nr_buckets;
+
+	if (!vi->entries)
+		return;
+
+	ve = &vi->entries[GET_SEC_FROM_SEG(sbi, segno)];
+	if (vblocks && vblocks < CAP_BLKS_PER_SEC(sbi))
+		bucket = vblocks >> vi->shift;
+
+	if (!list_empty(&ve->list)) {
+		if (ve->bucket == bucket)
+			return;
+		list_del_init(&ve->list);
+		if (list_empty(&vi->buckets[ve->bucket]))
+			clear_bit(ve->bucket, vi->bucket_map);
+	}
+
+	ve->bucket = bucket;
+	if (bucket == vi->nr_buckets)
+		return;
+	list_add_tail(&ve->list, &vi->buckets[bucket]);
+	set_bit(bucket, vi->bucket_map);
+}
+
 static void update_sit_entry(struct f2fs_sb_info *sbi, block_t blkaddr, int del)
 {
 	struct seg_entry *se;
@@ -2526,6 +2556,8 @@ static void update_sit_entry(struct f2fs_sb_info *sbi, block_t blkaddr, int del)
 
 	if (__is_large_section(sbi))
 		get_sec_entry(sbi, segno)->valid_blocks += del;
+
+	update_victim_index(sbi, segno);
 }
 
 void f2fs_invalidate_blocks(struct f2fs_sb_info *sbi, block_t addr)
@@ -5096,6 +5128,40 @@ static int build_dirty_segmap(struct f2fs_sb_info *sbi)
 	return init_victim_secmap(sbi);
 }
 
+static int build_victim_index(struct f2fs_sb_info *sbi)
+{
+	struct victim_index *vi = &SIT_I(sbi)->vindex;
+	struct victim_index_entry *entries;
+	unsigned int secno, i;
+
+	while ((BLKS_PER_SEC(sbi) >> vi->shift) > VICTIM_INDEX_MAX_BUCKETS)
+		vi->shift++;
+	vi->nr_buckets = (BLKS_PER_SEC(sbi) >> vi->shift) + 1;
+
+	vi->buckets = f2fs_kvmalloc(sbi, array_size(vi->nr_buckets,
+				sizeof(struct list_head)), GFP_KERNEL);
+	if (!vi->buckets)
+		return -ENOMEM;
+	vi->bucket_map = f2fs_kvzalloc(sbi, f2fs_bitmap_size(vi->nr_buckets),
+								GFP_KERNEL);
+	if (!vi->bucket_map)
+		return -ENOMEM;
+	entries = f2fs_kvmalloc(sbi, array_size(MAIN_SECS(sbi),
+				sizeof(struct victim_index_entry)), GFP_KERNEL);
+	if (!entries)
+		return -ENOMEM;
+
+	for (i = 0; i < vi->nr_buckets; i++)
+		INIT_LIST_HEAD(&vi->buckets[i]);
+	for (secno = 0; secno < MAIN_SECS(sbi); secno++)
+		INIT_LIST_HEAD(&entries[secno].list);
+
+	vi->entries = entries;
+	for (secno = 0; secno < MAIN_SECS(sbi); secno++)
+		update_victim_index(sbi, GET_SEG_FROM_SEC(sbi, secno));
+	return 0;
+}
+
 static int sanity_check_curseg(struct f2fs_sb_info *sbi)
 {
 	int i;
@@ -5599,6 +5665,10 @@ int f2fs_build_segment_manager(struct f2fs_sb_info *sbi)
 	if (err)
 		return err;
 
+	err = build_victim_index(sbi);
+	if (err)
+		return err;
+
 	err = sanity_check_curseg(sbi);
 	if (err)
 		return err;
@@ -5690,6 +5760,9 @@ static void destroy_sit_info(struct f2fs_sb_info *sbi)
 	kvfree(sit_i->sentries);
 	kvfree(sit_i->sec_entries);
 	kvfree(sit_i->dirty_sentries_bitmap);
+	kvfree(sit_i->vindex.entries);
+	kvfree(sit_i->vindex.buckets);
+	kvfree(sit_i->vindex.bucket_map);
 
 	SM_I(sbi)->sit_info = NULL;
 	kvfree(sit_i->sit_bitmap);
@@ -219,6 +219,26 @@ struct revoke_entry {
 	pgoff_t index;
 };
 
+/*
+ * Sections holding both valid and invalid blocks, bucketed by valid block
+ * count, so that victim selection visits the emptiest sections first
+ * instead of scanning the dirty bitmaps.  Protected by sentry_lock.
+ */
+#define VICTIM_INDEX_MAX_BUCKETS	1024
+
+struct victim_index_entry {
+	struct list_head list;		/* in buckets[bucket] */
+	unsigned int bucket;
+};
+
+struct victim_index {
+	struct victim_index_entry *entries;	/* one per section */
+	struct list_head *buckets;	/* valid blocks >> shift */
+	unsigned long *bucket_map;	/* non-empty buckets */
+	unsigned int nr_buckets;
+	unsigned int shift;
+};
+
 struct sit_info {
 	block_t sit_base_addr;		/* start block address of SIT area */
 	block_t sit_blocks;		/* # of blocks used by SIT area */
@@ -250,6 +270,8 @@ struct sit_info {
 	unsigned long long dirty_max_mtime;	/* rerange candidates in GC_AT */
 
 	unsigned int last_victim[MAX_GC_POLICY]; /* last victim segment # */
+
+	struct victim_index vindex;		/* dirty sections by vblocks */
 };
 
 struct free_segmap_info {
@@ -672,6 +672,13 @@ static ssize_t __sbi_store(struct f2fs_attr *a,
 		*ui = t;
 		return count;
 	}
+
+	if (!strcmp(a->attr.name, "max_compress_inflight")) {
+		if (t > MAX_COMPRESS_INFLIGHT)
+			return -EINVAL;
+		*ui = t;
+		return count;
+	}
 #endif
 
 	if (!strcmp(a->attr.name, "atgc_candidate_ratio")) {
@@ -1049,6 +1056,7 @@ F2FS_SBI_GENERAL_RW_ATTR(compr_saved_block);
 F2FS_SBI_GENERAL_RW_ATTR(compr_new_inode);
 F2FS_SBI_GENERAL_RW_ATTR(compress_percent);
 F2FS_SBI_GENERAL_RW_ATTR(compress_watermark);
+F2FS_SBI_GENERAL_RW_ATTR(max_compress_inflight);
 #endif
 /* atomic write */
 F2FS_SBI_GENERAL_RO_ATTR(current_atomic_write);
@@ -1232,6 +1240,7 @@ static struct attribute *f2fs_attrs[] = {
 	ATTR_LIST(compr_new_inode),
 	ATTR_LIST(compress_percent),
 	ATTR_LIST(compress_watermark),
+	ATTR_LIST(max_compress_inflight),
 #endif
 	/* For ATGC */
 	ATTR_LIST(atgc_candidate_ratio),
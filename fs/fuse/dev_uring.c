@@ -0,0 +1,772 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * FUSE: Filesystem in Userspace
+ *
+ * io_uring transport for /dev/fuse
+ *
+ * With read() and write() on /dev/fuse all requests of a connection go
+ * through the single pending list of fuse_iqueue, serialized on fiq->lock.
+ * Here the server instead registers buffers on per-CPU queues, each with an
+ * io_uring command that stays pending until there is a request for it.  A
+ * request issued on a CPU is copied into a buffer of that CPU's queue, and
+ * the command is completed.  The server writes the reply into the same
+ * buffer and sends it with FUSE_URING_CMD_COMMIT_AND_FETCH, which then waits
+ * for the next request of the queue.  Requests and replies have the same
+ * layout in the buffer as with read() and write().
+ *
+ * Request IDs are reserved from the connection in batches, so queueing a
+ * request only takes the lock of the local queue.
+ *
+ * /dev/fuse stays in use, and the server has to keep reading it: for
+ * requests issued on CPUs without a registered queue, for FORGET, INTERRUPT
+ * and notify replies, and for requests of queues whose commands were
+ * canceled.
+ */
+
+#include "dev_uring_i.h"
+#include "fuse_i.h"
+#include "fuse_dev_i.h"
+
+#include <linux/io_uring/cmd.h>
+#include <linux/moduleparam.h>
+#include <linux/uio.h>
+
+static bool __read_mostly enable_uring;
+module_param(enable_uring, bool, 0644);
+MODULE_PARM_DESC(enable_uring,
+		 "Enable userspace communication through io_uring");
+
+/* Number of request IDs a queue reserves at a time */
+#define FUSE_URING_UNIQUE_BATCH	256
+
+struct fuse_uring_pdu {
+	struct fuse_ring_ent *ent;
+};
+
+bool fuse_uring_enabled(void)
+{
+	return enable_uring;
+}
+
+static struct fuse_ring_ent *uring_cmd_to_ring_ent(struct io_uring_cmd *cmd)
+{
+	return io_uring_cmd_to_pdu(cmd, struct fuse_uring_pdu)->ent;
+}
+
+static void uring_cmd_set_ring_ent(struct io_uring_cmd *cmd,
+				   struct fuse_ring_ent *ent)
+{
+	io_uring_cmd_to_pdu(cmd, struct fuse_uring_pdu)->ent = ent;
+}
+
+static u64 fuse_uring_get_unique(struct fuse_ring_queue *queue)
+{
+	u64 unique;
+
+	if (queue->reqctr == queue->reqctr_end) {
+		queue->reqctr = fuse_get_unique_batch(&queue->ring->fc->iq,
+						      FUSE_URING_UNIQUE_BATCH);
+		queue->reqctr_end = queue->reqctr +
+			FUSE_URING_UNIQUE_BATCH * FUSE_REQ_ID_STEP;
+	}
+	unique = queue->reqctr;
+	queue->reqctr += FUSE_REQ_ID_STEP;
+
+	return unique;
+}
+
+static struct fuse_req *fuse_uring_find_req(struct fuse_ring_queue *queue,
+					    u64 unique)
+{
+	unsigned int hash = fuse_req_hash(unique);
+	struct fuse_req *req;
+
+	list_for_each_entry(req, &queue->processing[hash], list) {
+		if (req->in.h.unique == unique)
+			return req;
+	}
+	return NULL;
+}
+
+/* Hand @req to @ent, called with queue->lock held */
+static void fuse_uring_ent_assign(struct fuse_ring_ent *ent,
+				  struct fuse_req *req)
+{
+	clear_bit(FR_PENDING, &req->flags);
+	req->ring_entry = ent;
+	ent->fuse_req = req;
+	ent->state = FRRS_FUSE_REQ;
+	list_move_tail(&ent->list, &ent->queue->ent_w_req_queue);
+}
+
+/*
+ * Let @ent wait for a request, or hand it the first queued one.  Called with
+ * queue->lock held, returns true if @ent got a request to dispatch.
+ */
+static bool fuse_uring_ent_ready(struct fuse_ring_ent *ent)
+{
+	struct fuse_ring_queue *queue = ent->queue;
+	struct fuse_req *req;
+
+	queue->stopped = false;
+	req = list_first_entry_or_null(&queue->fuse_req_queue, struct fuse_req,
+				       list);
+	if (req) {
+		list_del_init(&req->list);
+		fuse_uring_ent_assign(ent, req);
+		return true;
+	}
+	ent->state = FRRS_AVAILABLE;
+	list_move(&ent->list, &queue->ent_avail_queue);
+	return false;
+}
+
+/* Called with queue->lock held, complete with fuse_uring_ent_done() */
+static void fuse_uring_ent_teardown(struct fuse_ring_ent *ent)
+{
+	ent->state = FRRS_TEARDOWN;
+	list_del_init(&ent->list);
+}
+
+static void fuse_uring_ent_done(struct fuse_ring_ent *ent, int err,
+				unsigned int issue_flags)
+{
+	io_uring_cmd_done(ent->cmd, err, 0, issue_flags);
+	kfree(ent);
+}
+
+static int fuse_uring_copy_to_ring(struct fuse_ring_ent *ent,
+				   struct fuse_req *req)
+{
+	struct fuse_args *args = req->args;
+	struct fuse_copy_state cs;
+	struct iov_iter iter;
+	int err;
+
+	err = import_ubuf(ITER_DEST, ent->buf, req->in.h.len, &iter);
+	if (err)
+		return err;
+
+	fuse_copy_init(&cs, 1, &iter);
+	cs.req = req;
+	err = fuse_copy_one(&cs, &req->in.h, sizeof(req->in.h));
+	if (!err)
+		err = fuse_copy_args(&cs, args->in_numargs, args->in_pages,
+				     (struct fuse_arg *) args->in_args, 0);
+	fuse_copy_finish(&cs);
+
+	return err;
+}
+
+static int fuse_uring_copy_from_ring(struct fuse_ring_ent *ent,
+				     struct fuse_req *req)
+{
+	struct fuse_copy_state cs;
+	struct fuse_out_header oh;
+	struct iov_iter iter;
+	int err;
+
+	if (copy_from_user(&oh, ent->buf, sizeof(oh)))
+		return -EFAULT;
+
+	if (oh.len < sizeof(oh) || oh.len > ent->buf_len ||
+	    oh.unique != req->in.h.unique ||
+	    oh.error <= -512 || oh.error > 0)
+		return -EINVAL;
+
+	req->out.h = oh;
+	if (oh.error)
+		return oh.len != sizeof(oh) ? -EINVAL : 0;
+
+	err = import_ubuf(ITER_SOURCE, ent->buf + sizeof(oh),
+			  oh.len - sizeof(oh), &iter);
+	if (err)
+		return err;
+
+	fuse_copy_init(&cs, 0, &iter);
+	cs.req = req;
+	err = fuse_copy_out_args(&cs, req->args, oh.len);
+	fuse_copy_finish(&cs);
+
+	return err;
+}
+
+/*
+ * Copy the request of @ent into its buffer and complete the command.  Runs
+ * in the context of the server task, either from task work or while the
+ * server issues a command.
+ */
+static void fuse_uring_dispatch(struct fuse_ring_ent *ent,
+				unsigned int issue_flags)
+{
+	struct fuse_ring_queue *queue = ent->queue;
+	struct fuse_iqueue *fiq = &queue->ring->fc->iq;
+	struct fuse_req *req;
+	LIST_HEAD(reqs);
+	LIST_HEAD(to_end);
+	unsigned int len;
+	int err;
+
+restart:
+	spin_lock(&queue->lock);
+	req = ent->fuse_req;
+	ent->fuse_req = NULL;
+	/* No request means it was ended by fuse_uring_abort() */
+	if (!req || !queue->connected) {
+		err = -ENOTCONN;
+		goto out_teardown;
+	}
+	if (issue_flags & IO_URING_F_TASK_DEAD) {
+		/* The server thread is gone, send the request through /dev/fuse */
+		clear_bit(FR_URING, &req->flags);
+		list_add(&req->list, &reqs);
+		fuse_dev_queue_pending_list(fiq, &reqs, &to_end);
+		err = -ECANCELED;
+		goto out_teardown;
+	}
+
+	len = req->in.h.len;
+	if (len > ent->buf_len) {
+		spin_unlock(&queue->lock);
+		req->out.h.error = -EIO;
+		/* SETXATTR is special, since it may contain too large data */
+		if (req->args->opcode == FUSE_SETXATTR)
+			req->out.h.error = -E2BIG;
+		fuse_request_end(req);
+
+		spin_lock(&queue->lock);
+		if (!queue->connected) {
+			err = -ENOTCONN;
+			goto out_teardown;
+		}
+		if (fuse_uring_ent_ready(ent)) {
+			spin_unlock(&queue->lock);
+			goto restart;
+		}
+		spin_unlock(&queue->lock);
+		return;
+	}
+	list_add(&req->list, &queue->io);
+	spin_unlock(&queue->lock);
+
+	err = fuse_uring_copy_to_ring(ent, req);
+
+	spin_lock(&queue->lock);
+	clear_bit(FR_LOCKED, &req->flags);
+	if (!queue->connected || err) {
+		if (!queue->connected)
+			err = -ENOTCONN;
+		else
+			req->out.h.error = -EIO;
+		if (!test_bit(FR_PRIVATE, &req->flags))
+			list_del_init(&req->list);
+		fuse_uring_ent_teardown(ent);
+		spin_unlock(&queue->lock);
+		fuse_request_end(req);
+		fuse_uring_ent_done(ent, err, issue_flags);
+		return;
+	}
+	list_move_tail(&req->list,
+		       &queue->processing[fuse_req_hash(req->in.h.unique)]);
+	__fuse_get_request(req);
+	set_bit(FR_SENT, &req->flags);
+	ent->state = FRRS_USERSPACE;
+	list_move_tail(&ent->list, &queue->ent_in_userspace);
+	spin_unlock(&queue->lock);
+	/* matches barrier in request_wait_answer() */
+	smp_mb__after_atomic();
+	if (test_bit(FR_INTERRUPTED, &req->flags))
+		fuse_queue_interrupt(req);
+	fuse_put_request(req);
+
+	io_uring_cmd_done(ent->cmd, len, 0, issue_flags);
+	return;
+
+out_teardown:
+	fuse_uring_ent_teardown(ent);
+	spin_unlock(&queue->lock);
+	fuse_dev_end_requests(&to_end);
+	fuse_uring_ent_done(ent, err, issue_flags);
+}
+
+static void fuse_uring_send_in_task(struct io_uring_cmd *cmd,
+				    unsigned int issue_flags)
+{
+	fuse_uring_dispatch(uring_cmd_to_ring_ent(cmd), issue_flags);
+}
+
+static void fuse_uring_teardown_in_task(struct io_uring_cmd *cmd,
+					unsigned int issue_flags)
+{
+	fuse_uring_ent_done(uring_cmd_to_ring_ent(cmd), -ENOTCONN, issue_flags);
+}
+
+/*
+ * Queue a request on the io_uring queue of the current CPU.  Returns false
+ * if the request has to go through /dev/fuse instead.
+ */
+bool fuse_uring_queue_req(struct fuse_conn *fc, struct fuse_req *req)
+{
+	struct fuse_ring *ring = smp_load_acquire(&fc->ring);
+	struct io_uring_cmd *cmd = NULL;
+	struct fuse_ring_queue *queue;
+	struct fuse_ring_ent *ent;
+
+	/* Requests without reply include notify replies with their own ID */
+	if (!ring || !test_bit(FR_ISREPLY, &req->flags))
+		return false;
+
+	queue = READ_ONCE(ring->queues[raw_smp_processor_id()]);
+	if (!queue)
+		return false;
+
+	spin_lock(&queue->lock);
+	if (!queue->connected || queue->stopped) {
+		spin_unlock(&queue->lock);
+		return false;
+	}
+	req->in.h.unique = fuse_uring_get_unique(queue);
+	req->ring_queue = queue;
+	set_bit(FR_URING, &req->flags);
+
+	ent = list_first_entry_or_null(&queue->ent_avail_queue,
+				       struct fuse_ring_ent, list);
+	if (ent) {
+		fuse_uring_ent_assign(ent, req);
+		cmd = ent->cmd;
+	} else {
+		list_add_tail(&req->list, &queue->fuse_req_queue);
+	}
+	spin_unlock(&queue->lock);
+
+	if (cmd)
+		io_uring_cmd_complete_in_task(cmd, fuse_uring_send_in_task);
+
+	return true;
+}
+
+bool fuse_uring_remove_pending_req(struct fuse_req *req)
+{
+	struct fuse_ring_queue *queue = req->ring_queue;
+	spinlock_t *lock = &queue->lock;
+	bool removed;
+
+	spin_lock(lock);
+	/* Requests given back to /dev/fuse have FR_URING cleared */
+	if (!test_bit(FR_URING, &req->flags)) {
+		spin_unlock(lock);
+		lock = &queue->ring->fc->iq.lock;
+		spin_lock(lock);
+	}
+	removed = fuse_remove_pending_req(req);
+	spin_unlock(lock);
+
+	return removed;
+}
+
+/* Look up a request handed to the server, with a reference */
+struct fuse_req *fuse_uring_request_find(struct fuse_conn *fc, u64 unique)
+{
+	struct fuse_ring *ring = smp_load_acquire(&fc->ring);
+	unsigned int qid;
+
+	if (!ring)
+		return NULL;
+
+	for (qid = 0; qid < ring->nr_queues; qid++) {
+		struct fuse_ring_queue *queue = READ_ONCE(ring->queues[qid]);
+		struct fuse_req *req = NULL;
+
+		if (!queue)
+			continue;
+
+		spin_lock(&queue->lock);
+		if (queue->connected)
+			req = fuse_uring_find_req(queue, unique);
+		if (req)
+			__fuse_get_request(req);
+		spin_unlock(&queue->lock);
+		if (req)
+			return req;
+	}
+	return NULL;
+}
+
+static struct fuse_ring *fuse_uring_create(struct fuse_conn *fc)
+{
+	struct fuse_ring *ring;
+
+	ring = smp_load_acquire(&fc->ring);
+	if (ring)
+		return ring;
+
+	ring = kzalloc(struct_size(ring, queues, nr_cpu_ids), GFP_KERNEL_ACCOUNT);
+	if (!ring)
+		return ERR_PTR(-ENOMEM);
+
+	ring->fc = fc;
+	ring->nr_queues = nr_cpu_ids;
+	/* Same as the minimum read() buffer */
+	ring->min_buf_len = max_t(size_t, FUSE_MIN_READ_BUFFER,
+				  sizeof(struct fuse_in_header) +
+				  sizeof(struct fuse_write_in) +
+				  fc->max_write);
+
+	spin_lock(&fc->lock);
+	if (!fc->connected) {
+		spin_unlock(&fc->lock);
+		kfree(ring);
+		return ERR_PTR(-ENOTCONN);
+	}
+	if (fc->ring) {
+		kfree(ring);
+		ring = fc->ring;
+	} else {
+		smp_store_release(&fc->ring, ring);
+	}
+	spin_unlock(&fc->lock);
+
+	return ring;
+}
+
+static struct fuse_ring_queue *fuse_uring_create_queue(struct fuse_ring *ring,
+						       unsigned int qid)
+{
+	struct fuse_conn *fc = ring->fc;
+	struct fuse_ring_queue *queue, *old;
+	struct list_head *processing;
+	unsigned int i;
+
+	queue = READ_ONCE(ring->queues[qid]);
+	if (queue)
+		return queue;
+
+	queue = kzalloc(sizeof(*queue), GFP_KERNEL_ACCOUNT);
+	processing = kcalloc(FUSE_PQ_HASH_SIZE, sizeof(struct list_head),
+			     GFP_KERNEL_ACCOUNT);
+	if (!queue || !processing) {
+		kfree(queue);
+		kfree(processing);
+		return ERR_PTR(-ENOMEM);
+	}
+
+	queue->ring = ring;
+	queue->qid = qid;
+	spin_lock_init(&queue->lock);
+	queue->connected = true;
+	INIT_LIST_HEAD(&queue->ent_avail_queue);
+	INIT_LIST_HEAD(&queue->ent_w_req_queue);
+	INIT_LIST_HEAD(&queue->ent_in_userspace);
+	INIT_LIST_HEAD(&queue->fuse_req_queue);
+	INIT_LIST_HEAD(&queue->io);
+	for (i = 0; i < FUSE_PQ_HASH_SIZE; i++)
+		INIT_LIST_HEAD(&processing[i]);
+	queue->processing = processing;
+
+	/* fuse_abort_conn() walks the queues under fc->lock */
+	spin_lock(&fc->lock);
+	old = ring->queues[qid];
+	if (!fc->connected || old) {
+		spin_unlock(&fc->lock);
+		kfree(processing);
+		kfree(queue);
+		return old ?: ERR_PTR(-ENOTCONN);
+	}
+	smp_store_release(&ring->queues[qid], queue);
+	spin_unlock(&fc->lock);
+
+	return queue;
+}
+
+static int fuse_uring_register(struct io_uring_cmd *cmd,
+			       unsigned int issue_flags, struct fuse_conn *fc,
+			       const struct fuse_uring_cmd_req *cmd_req)
+{
+	void __user *buf = u64_to_user_ptr(READ_ONCE(cmd->sqe->addr));
+	unsigned int buf_len = READ_ONCE(cmd->sqe->len);
+	struct fuse_ring_queue *queue;
+	struct fuse_ring_ent *ent;
+	struct fuse_ring *ring;
+	bool assigned;
+
+	ring = fuse_uring_create(fc);
+	if (IS_ERR(ring))
+		return PTR_ERR(ring);
+
+	if (cmd_req->qid >= ring->nr_queues || buf_len < ring->min_buf_len)
+		return -EINVAL;
+
+	if (!access_ok(buf, buf_len))
+		return -EFAULT;
+
+	queue = fuse_uring_create_queue(ring, cmd_req->qid);
+	if (IS_ERR(queue))
+		return PTR_ERR(queue);
+
+	ent = kzalloc(sizeof(*ent), GFP_KERNEL_ACCOUNT);
+	if (!ent)
+		return -ENOMEM;
+
+	ent->buf = buf;
+	ent->buf_len = buf_len;
+	ent->queue = queue;
+	ent->cmd = cmd;
+	INIT_LIST_HEAD(&ent->list);
+	uring_cmd_set_ring_ent(cmd, ent);
+	io_uring_cmd_mark_cancelable(cmd, issue_flags);
+
+	spin_lock(&queue->lock);
+	if (!queue->connected) {
+		spin_unlock(&queue->lock);
+		fuse_uring_ent_done(ent, -ENOTCONN, issue_flags);
+		return -EIOCBQUEUED;
+	}
+	assigned = fuse_uring_ent_ready(ent);
+	spin_unlock(&queue->lock);
+
+	if (assigned)
+		fuse_uring_dispatch(ent, issue_flags);
+
+	return -EIOCBQUEUED;
+}
+
+static int fuse_uring_commit_fetch(struct io_uring_cmd *cmd,
+				   unsigned int issue_flags,
+				   struct fuse_conn *fc,
+				   const struct fuse_uring_cmd_req *cmd_req)
+{
+	struct fuse_ring *ring = smp_load_acquire(&fc->ring);
+	struct fuse_ring_queue *queue;
+	struct fuse_ring_ent *ent;
+	struct fuse_req *req;
+	bool assigned;
+	int err;
+
+	if (!ring || cmd_req->qid >= ring->nr_queues)
+		return -EINVAL;
+
+	queue = READ_ONCE(ring->queues[cmd_req->qid]);
+	if (!queue)
+		return -EINVAL;
+
+	spin_lock(&queue->lock);
+	req = NULL;
+	if (queue->connected)
+		req = fuse_uring_find_req(queue, cmd_req->commit_id);
+	if (!req) {
+		spin_unlock(&queue->lock);
+		return -ENOENT;
+	}
+	ent = req->ring_entry;
+	clear_bit(FR_SENT, &req->flags);
+	list_move(&req->list, &queue->io);
+	set_bit(FR_LOCKED, &req->flags);
+	ent->cmd = cmd;
+	uring_cmd_set_ring_ent(cmd, ent);
+	spin_unlock(&queue->lock);
+
+	err = fuse_uring_copy_from_ring(ent, req);
+
+	spin_lock(&queue->lock);
+	clear_bit(FR_LOCKED, &req->flags);
+	if (!queue->connected)
+		err = -ENOENT;
+	else if (err)
+		req->out.h.error = -EIO;
+	if (!test_bit(FR_PRIVATE, &req->flags))
+		list_del_init(&req->list);
+	spin_unlock(&queue->lock);
+
+	fuse_request_end(req);
+
+	/* Fetch the next request, unless the reply was bad */
+	io_uring_cmd_mark_cancelable(cmd, issue_flags);
+
+	spin_lock(&queue->lock);
+	if (err || !queue->connected) {
+		fuse_uring_ent_teardown(ent);
+		spin_unlock(&queue->lock);
+		fuse_uring_ent_done(ent, err ?: -ENOTCONN, issue_flags);
+		return -EIOCBQUEUED;
+	}
+	assigned = fuse_uring_ent_ready(ent);
+	spin_unlock(&queue->lock);
+
+	if (assigned)
+		fuse_uring_dispatch(ent, issue_flags);
+
+	return -EIOCBQUEUED;
+}
+
+/*
+ * The io_uring instance of the command goes away.  Entries that wait for a
+ * request are released, and the queue falls back to /dev/fuse until the
+ * server registers or commits again.
+ */
+static void fuse_uring_cancel(struct io_uring_cmd *cmd,
+			      unsigned int issue_flags)
+{
+	struct fuse_ring_ent *ent = uring_cmd_to_ring_ent(cmd);
+	struct fuse_ring_queue *queue = ent->queue;
+	struct fuse_req *req;
+	LIST_HEAD(to_end);
+	bool teardown = false;
+
+	spin_lock(&queue->lock);
+	if (ent->state == FRRS_AVAILABLE) {
+		fuse_uring_ent_teardown(ent);
+		teardown = true;
+		queue->stopped = true;
+		list_for_each_entry(req, &queue->fuse_req_queue, list)
+			clear_bit(FR_URING, &req->flags);
+		fuse_dev_queue_pending_list(&queue->ring->fc->iq,
+					    &queue->fuse_req_queue, &to_end);
+	}
+	spin_unlock(&queue->lock);
+
+	fuse_dev_end_requests(&to_end);
+	if (teardown)
+		fuse_uring_ent_done(ent, -ENOTCONN, issue_flags);
+}
+
+int fuse_uring_cmd(struct io_uring_cmd *cmd, unsigned int issue_flags)
+{
+	const struct fuse_uring_cmd_req *sqe_req;
+	struct fuse_uring_cmd_req cmd_req;
+	struct fuse_dev *fud;
+	struct fuse_conn *fc;
+
+	if (unlikely(issue_flags & IO_URING_F_CANCEL)) {
+		fuse_uring_cancel(cmd, issue_flags);
+		return 0;
+	}
+
+	if (!enable_uring)
+		return -EOPNOTSUPP;
+
+	fud = fuse_get_dev(cmd->file);
+	if (!fud)
+		return -EPERM;
+	fc = fud->fc;
+
+	/* Only once FUSE_INIT negotiated FUSE_OVER_IO_URING */
+	if (!fc->io_uring)
+		return -EOPNOTSUPP;
+
+	sqe_req = io_uring_sqe_cmd(cmd->sqe);
+	cmd_req.commit_id = READ_ONCE(sqe_req->commit_id);
+	cmd_req.qid = READ_ONCE(sqe_req->qid);
+	cmd_req.flags = READ_ONCE(sqe_req->flags);
+	if (cmd_req.flags)
+		return -EINVAL;
+
+	switch (cmd->cmd_op) {
+	case FUSE_URING_CMD_REGISTER:
+		return fuse_uring_register(cmd, issue_flags, fc, &cmd_req);
+
+	case FUSE_URING_CMD_COMMIT_AND_FETCH:
+		return fuse_uring_commit_fetch(cmd, issue_flags, fc, &cmd_req);
+
+	default:
+		return -EINVAL;
+	}
+}
+
+static void fuse_uring_abort_queue(struct fuse_ring_queue *queue,
+				   struct list_head *to_end)
+{
+	struct fuse_ring_ent *ent, *next_ent;
+	struct fuse_req *req, *next;
+	unsigned int i;
+
+	spin_lock(&queue->lock);
+	queue->connected = false;
+
+	list_for_each_entry(req, &queue->fuse_req_queue, list)
+		clear_bit(FR_PENDING, &req->flags);
+	list_splice_tail_init(&queue->fuse_req_queue, to_end);
+
+	/* Requests not yet picked up by fuse_uring_dispatch() */
+	list_for_each_entry(ent, &queue->ent_w_req_queue, list) {
+		if (ent->fuse_req) {
+			list_add_tail(&ent->fuse_req->list, to_end);
+			ent->fuse_req = NULL;
+		}
+	}
+
+	list_for_each_entry_safe(req, next, &queue->io, list) {
+		req->out.h.error = -ECONNABORTED;
+		spin_lock(&req->waitq.lock);
+		set_bit(FR_ABORTED, &req->flags);
+		if (!test_bit(FR_LOCKED, &req->flags)) {
+			set_bit(FR_PRIVATE, &req->flags);
+			__fuse_get_request(req);
+			list_move(&req->list, to_end);
+		}
+		spin_unlock(&req->waitq.lock);
+	}
+	for (i = 0; i < FUSE_PQ_HASH_SIZE; i++)
+		list_splice_tail_init(&queue->processing[i], to_end);
+
+	/* Commands can only be completed from the server's task context */
+	list_for_each_entry_safe(ent, next_ent, &queue->ent_avail_queue, list) {
+		fuse_uring_ent_teardown(ent);
+		io_uring_cmd_complete_in_task(ent->cmd,
+					      fuse_uring_teardown_in_task);
+	}
+	spin_unlock(&queue->lock);
+}
+
+/*
+ * Called from fuse_abort_conn() with fc->lock held.  The requests on the
+ * queues are moved to @to_end, and the commands waiting for requests are
+ * completed.
+ */
+void fuse_uring_abort(struct fuse_conn *fc, struct list_head *to_end)
+{
+	struct fuse_ring *ring = fc->ring;
+	unsigned int qid;
+
+	if (!ring)
+		return;
+
+	for (qid = 0; qid < ring->nr_queues; qid++) {
+		struct fuse_ring_queue *queue = ring->queues[qid];
+
+		if (queue)
+			fuse_uring_abort_queue(queue, to_end);
+	}
+}
+
+void fuse_uring_destruct(struct fuse_conn *fc)
+{
+	struct fuse_ring *ring = fc->ring;
+	unsigned int qid;
+
+	if (!ring)
+		return;
+
+	for (qid = 0; qid < ring->nr_queues; qid++) {
+		struct fuse_ring_queue *queue = ring->queues[qid];
+		struct fuse_ring_ent *ent, *next;
+
+		if (!queue)
+			continue;
+
+		/* Pending commands hold a reference to the connection */
+		WARN_ON(!list_empty(&queue->ent_avail_queue));
+		WARN_ON(!list_empty(&queue->ent_w_req_queue));
+		WARN_ON(!list_empty(&queue->fuse_req_queue));
+
+		/* Entries of requests that were aborted while in userspace */
+		list_for_each_entry_safe(ent, next, &queue->ent_in_userspace,
+					 list) {
+			list_del(&ent->list);
+			kfree(ent);
+		}
+		kfree(queue->processing);
+		kfree(queue);
+	}
+	kfree(ring);
+	fc->ring = NULL;
+}
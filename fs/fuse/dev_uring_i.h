@@ -0,0 +1,126 @@
+/* SPDX-License-Identifier: GPL-2.0
+ *
+ * FUSE: Filesystem in Userspace
+ *
+ * io_uring transport for /dev/fuse
+ */
+#ifndef _FS_FUSE_DEV_URING_I_H
+#define _FS_FUSE_DEV_URING_I_H
+
+#include "fuse_i.h"
+
+#ifdef CONFIG_FUSE_IO_URING
+
+enum fuse_ring_ent_state {
+	/* Waiting for a request, on ent_avail_queue */
+	FRRS_AVAILABLE,
+	/* Has a request to copy to the server in task work, on ent_w_req_queue */
+	FRRS_FUSE_REQ,
+	/* The server is handling a request, on ent_in_userspace */
+	FRRS_USERSPACE,
+	/* On no list, freed once its command is completed */
+	FRRS_TEARDOWN,
+};
+
+/* A buffer registered by the server, with its pending io_uring command */
+struct fuse_ring_ent {
+	/* Userspace buffer for one request and its reply */
+	void __user *buf;
+	unsigned int buf_len;
+
+	struct fuse_ring_queue *queue;
+
+	/* Protected by queue->lock */
+	struct list_head list;
+	enum fuse_ring_ent_state state;
+	struct io_uring_cmd *cmd;
+	/* The request to be copied in FRRS_FUSE_REQ state */
+	struct fuse_req *fuse_req;
+};
+
+struct fuse_ring_queue {
+	struct fuse_ring *ring;
+	unsigned int qid;
+
+	/* Protects everything below */
+	spinlock_t lock;
+
+	/* Aborted, no more requests are accepted or replies looked up */
+	bool connected;
+
+	/* The commands were canceled, requests go to /dev/fuse until more arrive */
+	bool stopped;
+
+	struct list_head ent_avail_queue;
+	struct list_head ent_w_req_queue;
+	struct list_head ent_in_userspace;
+
+	/* Requests waiting for an available entry */
+	struct list_head fuse_req_queue;
+
+	/* Request IDs reserved from fiq->reqctr, [reqctr, reqctr_end) */
+	u64 reqctr;
+	u64 reqctr_end;
+
+	/* Hash table of requests handed to the server */
+	struct list_head *processing;
+
+	/* Requests being copied to or from the server */
+	struct list_head io;
+};
+
+struct fuse_ring {
+	struct fuse_conn *fc;
+
+	/* Smallest buffer the server may register */
+	size_t min_buf_len;
+
+	/* One queue per possible CPU, allocated on first registration */
+	unsigned int nr_queues;
+	struct fuse_ring_queue *queues[] __counted_by(nr_queues);
+};
+
+bool fuse_uring_enabled(void);
+int fuse_uring_cmd(struct io_uring_cmd *cmd, unsigned int issue_flags);
+bool fuse_uring_queue_req(struct fuse_conn *fc, struct fuse_req *req);
+bool fuse_uring_remove_pending_req(struct fuse_req *req);
+struct fuse_req *fuse_uring_request_find(struct fuse_conn *fc, u64 unique);
+void fuse_uring_abort(struct fuse_conn *fc, struct list_head *to_end);
+void fuse_uring_destruct(struct fuse_conn *fc);
+
+#else /* CONFIG_FUSE_IO_URING */
+
+static inline bool fuse_uring_enabled(void)
+{
+	return false;
+}
+
+static inline bool fuse_uring_queue_req(struct fuse_conn *fc,
+					struct fuse_req *req)
+{
+	return false;
+}
+
+static inline bool fuse_uring_remove_pending_req(struct fuse_req *req)
+{
+	return false;
+}
+
+static inline struct fuse_req *fuse_uring_request_find(struct fuse_conn *fc,
+						       u64 unique)
+{
+	return NULL;
+}
+
+static inline void fuse_uring_abort(struct fuse_conn *fc,
+				    struct list_head *to_end)
+{
+}
+
+static inline void fuse_uring_destruct(struct fuse_conn *fc)
+{
+}
+
+#endif /* CONFIG_FUSE_IO_URING */
+
+#endif /* _FS_FUSE_DEV_URING_I_H */
@@ -1191,6 +1191,70 @@ static void fuse_statx_to_attr(struct fuse_statx *sx, struct fuse_attr *attr)
 	attr->blksize = sx->blksize;
 }
 
+static void fuse_kstat_to_attr(struct fuse_conn *fc, const struct kstat *stat,
+			       struct fuse_attr *attr)
+{
+	memset(attr, 0, sizeof(*attr));
+	attr->size = stat->size;
+	attr->blocks = stat->blocks;
+	attr->atime = stat->atime.tv_sec;
+	attr->mtime = stat->mtime.tv_sec;
+	attr->ctime = stat->ctime.tv_sec;
+	attr->atimensec = stat->atime.tv_nsec;
+	attr->mtimensec = stat->mtime.tv_nsec;
+	attr->ctimensec = stat->ctime.tv_nsec;
+	attr->mode = stat->mode;
+	attr->nlink = stat->nlink;
+	attr->uid = from_kuid(fc->user_ns, stat->uid);
+	attr->gid = from_kgid(fc->user_ns, stat->gid);
+	attr->rdev = new_encode_dev(stat->rdev);
+	attr->blksize = stat->blksize;
+}
+
+/*
+ * Take the attributes from the backing file of the inode, if it has one.
+ *
+ * They are not cached, so the backing file is looked at every time.  Returns
+ * -EOPNOTSUPP if the server has to be asked instead.
+ */
+static int fuse_passthrough_do_getattr(struct mnt_idmap *idmap,
+				       struct inode *inode, struct kstat *stat,
+				       u32 request_mask)
+{
+	struct fuse_inode *fi = get_fuse_inode(inode);
+	struct fuse_conn *fc = get_fuse_conn(inode);
+	u64 attr_version = fuse_get_attr_version(fc);
+	struct fuse_attr attr;
+	struct kstat bstat;
+	int err;
+
+	if (!IS_ENABLED(CONFIG_FUSE_PASSTHROUGH) || !fc->passthrough_meta)
+		return -EOPNOTSUPP;
+
+	err = fuse_passthrough_getattr(inode, &bstat, request_mask);
+	if (err)
+		return err;
+
+	fuse_kstat_to_attr(fc, &bstat, &attr);
+	attr.ino = fi->orig_ino;
+	if (fuse_invalid_attr(&attr) || inode_wrong_type(inode, attr.mode)) {
+		fuse_make_bad(inode);
+		return -EIO;
+	}
+
+	fuse_change_attributes(inode, &attr, NULL, 0, attr_version);
+	if (stat) {
+		stat->result_mask = STATX_BASIC_STATS;
+		if (bstat.result_mask & request_mask & STATX_BTIME) {
+			stat->btime = bstat.btime;
+			stat->result_mask |= STATX_BTIME;
+		}
+		fuse_fillattr(idmap, inode, &attr, stat);
+	}
+
+	return 0;
+}
+
 static int fuse_do_statx(struct mnt_idmap *idmap, struct inode *inode,
 			 struct file *file, struct kstat *stat)
 {
@@ -1203,6 +1267,11 @@ static int fuse_do_statx(struct mnt_idmap *idmap, struct inode *inode,
 	u64 attr_version = fuse_get_attr_version(fm->fc);
 	FUSE_ARGS(args);
 
+	err = fuse_passthrough_do_getattr(idmap, inode, stat,
+					  STATX_BASIC_STATS | STATX_BTIME);
+	if (err != -EOPNOTSUPP)
+		return err;
+
 	memset(&inarg, 0, sizeof(inarg));
 	memset(&outarg, 0, sizeof(outarg));
 	/* Directories have separate file-handle space */
@@ -1262,6 +1331,10 @@ static int fuse_do_getattr(struct mnt_idmap *idmap, struct inode *inode,
 	FUSE_ARGS(args);
 	u64 attr_version;
 
+	err = fuse_passthrough_do_getattr(idmap, inode, stat, STATX_BASIC_STATS);
+	if (err != -EOPNOTSUPP)
+		return err;
+
 	attr_version = fuse_get_attr_version(fm->fc);
 
 	memset(&inarg, 0, sizeof(inarg));
@@ -1661,6 +1734,7 @@ static const char *fuse_get_link(struct dentry *dentry, struct inode *inode,
 static int fuse_dir_open(struct inode *inode, struct file *file)
 {
 	struct fuse_mount *fm = get_fuse_mount(inode);
+	struct fuse_conn *fc = fm->fc;
 	int err;
 
 	if (fuse_is_bad(inode))
@@ -1679,6 +1753,22 @@ static int fuse_dir_open(struct inode *inode, struct file *file)
 		 * directories for backward compatibility, though it's unlikely
 		 * to be useful.
 		 */
+		/*
+		 * FOPEN_PASSTHROUGH used to be ignored for directories, so only
+		 * honor it if the server asked for FUSE_PASSTHROUGH_META.
+		 */
+		if (IS_ENABLED(CONFIG_FUSE_PASSTHROUGH) && fc->passthrough_meta &&
+		    (ff->open_flags & FOPEN_PASSTHROUGH)) {
+			err = fuse_passthrough_opendir(inode, file);
+			if (err) {
+				pr_debug("failed to open directory for passthrough (err=%i).\n",
+					 err);
+				fuse_file_release(inode, ff, file->f_flags, NULL,
+						  true);
+				return -EIO;
+			}
+		}
+
 		if (ff->open_flags & (FOPEN_STREAM | FOPEN_NONSEEKABLE))
 			nonseekable_open(inode, file);
 		if (!(ff->open_flags & FOPEN_KEEP_CACHE))
@@ -192,6 +192,9 @@ struct fuse_inode {
 #ifdef CONFIG_FUSE_PASSTHROUGH
 	/** Reference to backing file in passthrough mode */
 	struct fuse_backing *fb;
+
+	/** Reference to backing file for attributes, set by the server */
+	struct fuse_backing *attr_fb;
 #endif
 };
 
@@ -378,6 +381,7 @@ struct fuse_io_priv {
  * FR_FINISHED:		request is finished
  * FR_PRIVATE:		request is on private list
  * FR_ASYNC:		request is asynchronous
+ * FR_URING:		request is queued on an io_uring queue
  */
 enum fuse_req_flag {
 	FR_ISREPLY,
@@ -392,6 +396,7 @@ enum fuse_req_flag {
 	FR_FINISHED,
 	FR_PRIVATE,
 	FR_ASYNC,
+	FR_URING,
 };
 
 /**
@@ -438,6 +443,12 @@ struct fuse_req {
 
 	/** fuse_mount this request belongs to */
 	struct fuse_mount *fm;
+
+#ifdef CONFIG_FUSE_IO_URING
+	/** io_uring queue and entry the request was handed to */
+	struct fuse_ring_queue *ring_queue;
+	struct fuse_ring_ent *ring_entry;
+#endif
 };
 
 struct fuse_iqueue;
@@ -860,9 +871,15 @@ struct fuse_conn {
 	/** Passthrough support for read/write IO */
 	unsigned int passthrough:1;
 
+	/** Passthrough support for readdir and getattr */
+	unsigned int passthrough_meta:1;
+
 	/* Use pages instead of pointer for kernel I/O */
 	unsigned int use_pages_for_kvec_io:1;
 
+	/** Requests may be fetched through io_uring */
+	unsigned int io_uring:1;
+
 	/** Maximum stack depth for passthrough backing files */
 	int max_stack_depth;
 
@@ -923,6 +940,11 @@ struct fuse_conn {
 	/** IDR for backing files ids */
 	struct idr backing_files_map;
 #endif
+
+#ifdef CONFIG_FUSE_IO_URING
+	/** io_uring queues, set up when the server registers the first one */
+	struct fuse_ring *ring;
+#endif
 };
 
 /*
@@ -1452,6 +1474,25 @@ static inline struct fuse_backing *fuse_inode_backing_set(struct fuse_inode *fi,
 #endif
 }
 
+static inline struct fuse_backing *fuse_inode_attr_backing(struct fuse_inode *fi)
+{
+#ifdef CONFIG_FUSE_PASSTHROUGH
+	return READ_ONCE(fi->attr_fb);
+#else
+	return NULL;
+#endif
+}
+
+static inline struct fuse_backing *fuse_inode_attr_backing_set(struct fuse_inode *fi,
+							       struct fuse_backing *fb)
+{
+#ifdef CONFIG_FUSE_PASSTHROUGH
+	return xchg(&fi->attr_fb, fb);
+#else
+	return NULL;
+#endif
+}
+
 #ifdef CONFIG_FUSE_PASSTHROUGH
 struct fuse_backing *fuse_backing_get(struct fuse_backing *fb);
 void fuse_backing_put(struct fuse_backing *fb);
@@ -1471,6 +1512,8 @@ void fuse_backing_files_init(struct fuse_conn *fc);
 void fuse_backing_files_free(struct fuse_conn *fc);
 int fuse_backing_open(struct fuse_conn *fc, struct fuse_backing_map *map);
 int fuse_backing_close(struct fuse_conn *fc, int backing_id);
+int fuse_backing_attach(struct fuse_conn *fc,
+			struct fuse_backing_attach *attach);
 
 struct fuse_backing *fuse_passthrough_open(struct file *file,
 					   struct inode *inode,
@@ -1495,6 +1538,10 @@ ssize_t fuse_passthrough_splice_write(struct pipe_inode_info *pipe,
 				      struct file *out, loff_t *ppos,
 				      size_t len, unsigned int flags);
 ssize_t fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma);
+int fuse_passthrough_opendir(struct inode *inode, struct file *file);
+int fuse_passthrough_readdir(struct file *file, struct dir_context *ctx);
+int fuse_passthrough_getattr(struct inode *inode, struct kstat *stat,
+			     u32 request_mask);
 
 #ifdef CONFIG_SYSCTL
 extern int fuse_sysctl_register(void);
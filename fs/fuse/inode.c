@@ -6,6 +6,7 @@
   See the file COPYING.
 */
 
+#include "dev_uring_i.h"
 #include "fuse_i.h"
 
 #include <linux/pagemap.h>
@@ -113,8 +114,10 @@ static struct inode *fuse_alloc_inode(struct super_block *sb)
 	if (IS_ENABLED(CONFIG_FUSE_DAX) && !fuse_dax_inode_alloc(sb, fi))
 		goto out_free_forget;
 
-	if (IS_ENABLED(CONFIG_FUSE_PASSTHROUGH))
+	if (IS_ENABLED(CONFIG_FUSE_PASSTHROUGH)) {
 		fuse_inode_backing_set(fi, NULL);
+		fuse_inode_attr_backing_set(fi, NULL);
+	}
 
 	return &fi->inode;
 
@@ -134,8 +137,10 @@ static void fuse_free_inode(struct inode *inode)
 #ifdef CONFIG_FUSE_DAX
 	kfree(fi->dax);
 #endif
-	if (IS_ENABLED(CONFIG_FUSE_PASSTHROUGH))
+	if (IS_ENABLED(CONFIG_FUSE_PASSTHROUGH)) {
 		fuse_backing_put(fuse_inode_backing(fi));
+		fuse_backing_put(fuse_inode_attr_backing(fi));
+	}
 
 	kmem_cache_free(fuse_inode_cachep, fi);
 }
@@ -1014,6 +1019,7 @@ void fuse_conn_put(struct fuse_conn *fc)
 		}
 		if (IS_ENABLED(CONFIG_FUSE_PASSTHROUGH))
 			fuse_backing_files_free(fc);
+		fuse_uring_destruct(fc);
 		call_rcu(&fc->rcu, delayed_release);
 	}
 }
@@ -1378,7 +1384,12 @@ static void process_init_reply(struct fuse_mount *fm, struct fuse_args *args,
 				fc->passthrough = 1;
 				fc->max_stack_depth = arg->max_stack_depth;
 				fm->sb->s_stack_depth = arg->max_stack_depth;
+				if (flags & FUSE_PASSTHROUGH_META)
+					fc->passthrough_meta = 1;
 			}
+			if ((flags & FUSE_OVER_IO_URING) &&
+			    fuse_uring_enabled())
+				fc->io_uring = 1;
 			if (flags & FUSE_NO_EXPORT_SUPPORT)
 				fm->sb->s_export_op = &fuse_export_fid_operations;
 			if (flags & FUSE_ALLOW_IDMAP) {
@@ -1444,7 +1455,9 @@ void fuse_send_init(struct fuse_mount *fm)
 	if (fm->fc->auto_submounts)
 		flags |= FUSE_SUBMOUNTS;
 	if (IS_ENABLED(CONFIG_FUSE_PASSTHROUGH))
-		flags |= FUSE_PASSTHROUGH;
+		flags |= FUSE_PASSTHROUGH | FUSE_PASSTHROUGH_META;
+	if (fuse_uring_enabled())
+		flags |= FUSE_OVER_IO_URING;
 
 	ia->in.flags = flags;
 	ia->in.flags2 = flags >> 32;
@@ -324,6 +324,12 @@ struct fuse_backing *fuse_passthrough_open(struct file *file,
 	if (!fb)
 		goto out;
 
+	err = -EINVAL;
+	if (inode_wrong_type(inode, file_inode(fb->file)->i_mode)) {
+		fuse_backing_put(fb);
+		goto out;
+	}
+
 	/* Allocate backing file per fuse file to store fuse path */
 	backing_file = backing_file_open(&file->f_path, file->f_flags,
 					 &fb->file->f_path, fb->cred);
@@ -353,3 +359,167 @@ void fuse_passthrough_release(struct fuse_file *ff, struct fuse_backing *fb)
 	put_cred(ff->cred);
 	ff->cred = NULL;
 }
+
+/*
+ * Setup readdir passthrough to a backing directory.
+ *
+ * Unlike for regular files, the backing directory is not stored in the fuse
+ * inode, the backing file of the open directory holds its own reference.
+ */
+int fuse_passthrough_opendir(struct inode *inode, struct file *file)
+{
+	struct fuse_file *ff = file->private_data;
+	struct fuse_conn *fc = get_fuse_conn(inode);
+	struct fuse_backing *fb;
+
+	if (!fc->passthrough_meta || !ff->args)
+		return -EINVAL;
+
+	fb = fuse_passthrough_open(file, inode,
+				   ff->args->open_outarg.backing_id);
+	if (IS_ERR(fb))
+		return PTR_ERR(fb);
+
+	fuse_backing_put(fb);
+	return 0;
+}
+
+int fuse_passthrough_readdir(struct file *file, struct dir_context *ctx)
+{
+	struct fuse_file *ff = file->private_data;
+	struct file *backing_file = fuse_file_passthrough(ff);
+	const struct cred *old_cred;
+	int err = 0;
+
+	pr_debug("%s: backing_file=0x%p, pos=%lld\n", __func__,
+		 backing_file, ctx->pos);
+
+	old_cred = override_creds(ff->cred);
+	/* Follow seeks on the fuse directory, iterate_dir() starts at f_pos */
+	if (ctx->pos != backing_file->f_pos) {
+		loff_t pos = vfs_llseek(backing_file, ctx->pos, SEEK_SET);
+
+		if (pos < 0)
+			err = pos;
+	}
+	if (!err)
+		err = iterate_dir(backing_file, ctx);
+	revert_creds(old_cred);
+
+	fuse_invalidate_atime(file_inode(file));
+
+	return err;
+}
+
+/*
+ * Backing file to take the attributes of @fi from: the one attached by the
+ * server, or else the one of files open in passthrough mode.
+ */
+static struct fuse_backing *fuse_attr_backing_get(struct fuse_inode *fi)
+{
+	struct fuse_backing *fb;
+
+	rcu_read_lock();
+	fb = fuse_inode_attr_backing(fi) ?: fuse_inode_backing(fi);
+	fb = fuse_backing_get(fb);
+	rcu_read_unlock();
+
+	return fb;
+}
+
+/*
+ * Get the attributes of @inode from its backing file.
+ *
+ * Returns -EOPNOTSUPP if there is no backing file for the attributes and the
+ * server has to be asked instead.
+ */
+int fuse_passthrough_getattr(struct inode *inode, struct kstat *stat,
+			     u32 request_mask)
+{
+	struct fuse_conn *fc = get_fuse_conn(inode);
+	const struct cred *old_cred;
+	struct fuse_backing *fb;
+	int err;
+
+	if (!fc->passthrough_meta)
+		return -EOPNOTSUPP;
+
+	fb = fuse_attr_backing_get(get_fuse_inode(inode));
+	if (!fb)
+		return -EOPNOTSUPP;
+
+	old_cred = override_creds(fb->cred);
+	err = vfs_getattr(&fb->file->f_path, stat, request_mask,
+			  AT_STATX_SYNC_AS_STAT);
+	revert_creds(old_cred);
+
+	pr_debug("%s: fb=0x%p, err=%i\n", __func__, fb, err);
+	fuse_backing_put(fb);
+
+	return err;
+}
+
+int fuse_backing_attach(struct fuse_conn *fc,
+			struct fuse_backing_attach *attach)
+{
+	struct fuse_backing *fb = NULL, *oldfb;
+	struct fuse_inode *fi;
+	struct inode *inode;
+	int err;
+
+	pr_debug("%s: nodeid=%llu backing_id=%d\n", __func__,
+		 attach->nodeid, attach->backing_id);
+
+	/* TODO: relax CAP_SYS_ADMIN once backing files are visible to lsof */
+	err = -EPERM;
+	if (!fc->passthrough_meta || !capable(CAP_SYS_ADMIN))
+		goto out;
+
+	err = -EINVAL;
+	if (attach->flags || attach->backing_id < 0)
+		goto out;
+
+	if (attach->backing_id) {
+		rcu_read_lock();
+		fb = idr_find(&fc->backing_files_map, attach->backing_id);
+		fb = fuse_backing_get(fb);
+		rcu_read_unlock();
+
+		err = -ENOENT;
+		if (!fb)
+			goto out;
+	}
+
+	down_read(&fc->killsb);
+	inode = fuse_ilookup(fc, attach->nodeid, NULL);
+	err = -ENOENT;
+	if (!inode)
+		goto out_unlock;
+
+	err = -EINVAL;
+	if (fb && inode_wrong_type(inode, file_inode(fb->file)->i_mode))
+		goto out_iput;
+
+	/*
+	 * Attributes cached from the old mapping, or being fetched with it, must
+	 * not be used anymore.
+	 */
+	fi = get_fuse_inode(inode);
+	spin_lock(&fi->lock);
+	oldfb = fuse_inode_attr_backing_set(fi, fb);
+	fi->attr_version = atomic64_inc_return(&fc->attr_version);
+	spin_unlock(&fi->lock);
+	fuse_invalidate_attr(inode);
+
+	fb = oldfb;
+	err = 0;
+out_iput:
+	iput(inode);
+out_unlock:
+	up_read(&fc->killsb);
+	fuse_backing_put(fb);
+out:
+	pr_debug("%s: err=%i\n", __func__, err);
+
+	return err;
+}
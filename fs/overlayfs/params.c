@@ -59,6 +59,7 @@ enum ovl_opt {
 	Opt_metacopy,
 	Opt_verity,
 	Opt_volatile,
+	Opt_readdir_xattr,
 };
 
 static const struct constant_table ovl_parameter_bool[] = {
@@ -155,6 +156,7 @@ const struct fs_parameter_spec ovl_parameter_spec[] = {
 	fsparam_enum("metacopy",            Opt_metacopy, ovl_parameter_bool),
 	fsparam_enum("verity",              Opt_verity, ovl_parameter_verity),
 	fsparam_flag("volatile",            Opt_volatile),
+	fsparam_flag("readdir_xattr",       Opt_readdir_xattr),
 	{}
 };
 
@@ -662,6 +664,9 @@ static int ovl_parse_param(struct fs_context *fc, struct fs_parameter *param)
 	case Opt_userxattr:
 		config->userxattr = true;
 		break;
+	case Opt_readdir_xattr:
+		config->readdir_xattr = true;
+		break;
 	default:
 		pr_err("unrecognized mount option \"%s\" or missing value\n",
 		       param->key);
@@ -841,6 +846,11 @@ int ovl_fs_params_verify(const struct ovl_fs_context *ctx,
 		config->ovl_volatile = false;
 	}
 
+	if (!config->upperdir && config->readdir_xattr) {
+		pr_info("option \"readdir_xattr\" is meaningless in a non-upper mount, ignoring it.\n");
+		config->readdir_xattr = false;
+	}
+
 	if (!config->upperdir && config->uuid == OVL_UUID_ON) {
 		pr_info("option \"uuid=on\" requires an upper fs, falling back to uuid=null.\n");
 		config->uuid = OVL_UUID_NULL;
@@ -1068,6 +1078,8 @@ int ovl_show_options(struct seq_file *m, struct dentry *dentry)
 		seq_puts(m, ",volatile");
 	if (ofs->config.userxattr)
 		seq_puts(m, ",userxattr");
+	if (ofs->config.readdir_xattr)
+		seq_puts(m, ",readdir_xattr");
 	if (ofs->config.verity_mode != ovl_verity_mode_def())
 		seq_printf(m, ",verity=%s",
 			   ovl_verity_mode(&ofs->config));
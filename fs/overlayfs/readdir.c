@@ -13,6 +13,8 @@
 #include <linux/security.h>
 #include <linux/cred.h>
 #include <linux/ratelimit.h>
+#include <linux/list_lru.h>
+#include <linux/siphash.h>
 #include "overlayfs.h"
 
 struct ovl_cache_entry {
@@ -34,8 +36,18 @@ struct ovl_dir_cache {
 	u64 version;
 	struct list_head entries;
 	struct rb_root root;
+	/* Entries are in this single allocation, instead of one per entry */
+	void *packed;
+	/* Set while the merged cache is unused and on ovl_dir_cache_lru */
+	struct inode *inode;
+	struct list_head lru;
+	struct list_head dispose;
 };
 
+/* Unused merged dir caches, kept until the dir changes or memory is short */
+static struct list_lru ovl_dir_cache_lru;
+static struct shrinker *ovl_dir_cache_shrinker;
+
 struct ovl_readdir_data {
 	struct dir_context ctx;
 	struct dentry *dentry;
@@ -142,17 +154,11 @@ static bool ovl_calc_d_ino(struct ovl_readdir_data *rdd,
 	return false;
 }
 
-static struct ovl_cache_entry *ovl_cache_entry_new(struct ovl_readdir_data *rdd,
-						   const char *name, int len,
-						   u64 ino, unsigned int d_type)
+static void ovl_cache_entry_init(struct ovl_readdir_data *rdd,
+				 struct ovl_cache_entry *p,
+				 const char *name, int len,
+				 u64 ino, unsigned int d_type)
 {
-	struct ovl_cache_entry *p;
-	size_t size = offsetof(struct ovl_cache_entry, name[len + 1]);
-
-	p = kmalloc(size, GFP_KERNEL);
-	if (!p)
-		return NULL;
-
 	memcpy(p->name, name, len);
 	p->name[len] = '\0';
 	p->len = len;
@@ -171,6 +177,18 @@ static struct ovl_cache_entry *ovl_cache_entry_new(struct ovl_readdir_data *rdd,
 		p->next_maybe_whiteout = rdd->first_maybe_whiteout;
 		rdd->first_maybe_whiteout = p;
 	}
+}
+
+static struct ovl_cache_entry *ovl_cache_entry_new(struct ovl_readdir_data *rdd,
+						   const char *name, int len,
+						   u64 ino, unsigned int d_type)
+{
+	struct ovl_cache_entry *p;
+	size_t size = offsetof(struct ovl_cache_entry, name[len + 1]);
+
+	p = kmalloc(size, GFP_KERNEL);
+	if (p)
+		ovl_cache_entry_init(rdd, p, name, len, ino, d_type);
 	return p;
 }
 
@@ -229,14 +247,119 @@ void ovl_cache_free(struct list_head *list)
 	INIT_LIST_HEAD(list);
 }
 
-void ovl_dir_cache_free(struct inode *inode)
+static size_t ovl_cache_entry_size(int len)
 {
-	struct ovl_dir_cache *cache = ovl_dir_cache(inode);
+	return ALIGN(offsetof(struct ovl_cache_entry, name[len + 1]),
+		     __alignof__(struct ovl_cache_entry));
+}
 
-	if (cache) {
+static void ovl_dir_cache_destroy(struct ovl_dir_cache *cache)
+{
+	if (cache->packed)
+		kvfree(cache->packed);
+	else
 		ovl_cache_free(&cache->entries);
-		kfree(cache);
+	kfree(cache);
+}
+
+/*
+ * Move the entries of an unused cache into a single allocation.  This saves
+ * the slab rounding of each entry, and the cache does not pin partially used
+ * slabs while it is kept around.  The rbtree is only needed while merging
+ * layers, so it is dropped.
+ */
+static void ovl_cache_pack(struct ovl_dir_cache *cache)
+{
+	struct ovl_cache_entry *p, *q;
+	LIST_HEAD(list);
+	size_t size = 0;
+	void *buf;
+
+	if (cache->packed)
+		return;
+
+	list_for_each_entry(p, &cache->entries, l_node)
+		size += ovl_cache_entry_size(p->len);
+	buf = kvmalloc(size ?: 1, GFP_KERNEL);
+	if (!buf)
+		return;
+
+	q = buf;
+	list_for_each_entry(p, &cache->entries, l_node) {
+		memcpy(q, p, offsetof(struct ovl_cache_entry, name[p->len + 1]));
+		list_add_tail(&q->l_node, &list);
+		q = (void *)q + ovl_cache_entry_size(p->len);
 	}
+	ovl_cache_free(&cache->entries);
+	list_splice(&list, &cache->entries);
+	cache->packed = buf;
+	cache->root = RB_ROOT;
+}
+
+/*
+ * Called with the LRU lock held, which nests inside the inode lock, hence the
+ * trylock.  ovl_destroy_inode() has to take the LRU lock to remove the cache,
+ * so the inode can't go away under us.  Once the cache is off the LRU, it
+ * belongs to the shrinker.
+ */
+static enum lru_status ovl_dir_cache_isolate(struct list_head *item,
+		struct list_lru_one *lru, void *arg)
+{
+	struct ovl_dir_cache *cache =
+		list_entry(item, struct ovl_dir_cache, lru);
+	struct inode *inode = cache->inode;
+	struct list_head *dispose = arg;
+
+	if (!inode_trylock(inode))
+		return LRU_SKIP;
+
+	/* The inode may be freed as soon as its cache pointer is cleared */
+	rcu_read_lock();
+	ovl_set_dir_cache(inode, NULL);
+	list_lru_isolate(lru, item);
+	list_add(&cache->dispose, dispose);
+	inode_unlock(inode);
+	rcu_read_unlock();
+	return LRU_REMOVED;
+}
+
+static unsigned long ovl_dir_cache_count(struct shrinker *shrink,
+		struct shrink_control *sc)
+{
+	return list_lru_shrink_count(&ovl_dir_cache_lru, sc);
+}
+
+static unsigned long ovl_dir_cache_scan(struct shrinker *shrink,
+		struct shrink_control *sc)
+{
+	struct ovl_dir_cache *cache, *tmp;
+	LIST_HEAD(dispose);
+	unsigned long freed;
+
+	freed = list_lru_shrink_walk(&ovl_dir_cache_lru, sc,
+			ovl_dir_cache_isolate, &dispose);
+	list_for_each_entry_safe(cache, tmp, &dispose, dispose)
+		ovl_dir_cache_destroy(cache);
+	return freed;
+}
+
+/* Take an unused cache off the LRU, returns false if the shrinker has it */
+static bool ovl_dir_cache_unretain(struct ovl_dir_cache *cache)
+{
+	if (!list_lru_del_obj(&ovl_dir_cache_lru, &cache->lru))
+		return false;
+	cache->inode = NULL;
+	return true;
+}
+
+/* Called with the inode lock held, or when the inode is being destroyed */
+void ovl_dir_cache_free(struct inode *inode)
+{
+	struct ovl_dir_cache *cache = ovl_dir_cache(inode);
+
+	if (!cache || (cache->inode && !ovl_dir_cache_unretain(cache)))
+		return;
+	ovl_dir_cache_destroy(cache);
 }
 
 static void ovl_cache_put(struct ovl_dir_file *od, struct inode *inode)
@@ -245,13 +368,46 @@ static void ovl_cache_put(struct ovl_dir_file *od, struct inode *inode)
 
 	WARN_ON(cache->refcount <= 0);
 	cache->refcount--;
-	if (!cache->refcount) {
-		if (ovl_dir_cache(inode) == cache)
-			ovl_set_dir_cache(inode, NULL);
+	if (cache->refcount)
+		return;
+
+	if (ovl_dir_cache(inode) == cache) {
+		/* Keep the cache for the next open, unless the dir changed */
+		if (ovl_inode_version_get(inode) == cache->version) {
+			ovl_cache_pack(cache);
+			cache->inode = inode;
+			list_lru_add_obj(&ovl_dir_cache_lru, &cache->lru);
+			return;
+		}
+		ovl_set_dir_cache(inode, NULL);
+	}
+	ovl_dir_cache_destroy(cache);
+}
 
-		ovl_cache_free(&cache->entries);
-		kfree(cache);
+int __init ovl_dir_cache_init(void)
+{
+	int err;
+
+	err = list_lru_init(&ovl_dir_cache_lru);
+	if (err)
+		return err;
+
+	ovl_dir_cache_shrinker = shrinker_alloc(SHRINKER_NUMA_AWARE,
+						"ovl-dir-cache");
+	if (!ovl_dir_cache_shrinker) {
+		list_lru_destroy(&ovl_dir_cache_lru);
+		return -ENOMEM;
 	}
+	ovl_dir_cache_shrinker->count_objects = ovl_dir_cache_count;
+	ovl_dir_cache_shrinker->scan_objects = ovl_dir_cache_scan;
+	shrinker_register(ovl_dir_cache_shrinker);
+	return 0;
+}
+
+void ovl_dir_cache_exit(void)
+{
+	shrinker_free(ovl_dir_cache_shrinker);
+	list_lru_destroy(&ovl_dir_cache_lru);
 }
 
 static bool ovl_fill_merge(struct dir_context *ctx, const char *name,
@@ -397,18 +553,250 @@ static void ovl_seek_cursor(struct ovl_dir_file *od, loff_t pos)
 	od->cursor = p;
 }
 
+/*
+ * The merged entries of a dir with an upper dir may be stored in the
+ * "readdir" xattr of the upper dir, so that they need not be read from all
+ * layers again after a remount.  The xattr is only used if the fingerprint of
+ * the dirs in all layers still matches.
+ */
+#define OVL_READDIR_XATTR_VERSION	1
+
+struct ovl_readdir_xattr {
+	u8 version;
+	u8 pad[3];
+	__le32 nr;
+	__le64 fingerprint;
+	u8 entries[];
+} __packed;
+
+#define OVL_READDIR_XATTR_UPPER		BIT(0)
+#define OVL_READDIR_XATTR_WHITEOUT	BIT(1)
+#define OVL_READDIR_XATTR_XWHITEOUT	BIT(2)
+
+struct ovl_readdir_xattr_entry {
+	__le64 ino;
+	u8 type;
+	u8 flags;
+	u8 len;
+	char name[];
+} __packed;
+
+/* Not a secret, the fingerprint only needs to change with the layers */
+static const siphash_key_t ovl_dir_fingerprint_key;
+
+static bool ovl_dir_cache_persist(struct dentry *dentry)
+{
+	struct ovl_fs *ofs = OVL_FS(dentry->d_sb);
+
+	return ofs->config.readdir_xattr && !ofs->noxattr &&
+	       ovl_dentry_upper(dentry);
+}
+
+/*
+ * Hash inode number, mtime and size of the dir in all layers.  Changes within
+ * the timestamp granularity can't be told apart, so a dir that was changed
+ * in the last couple of seconds gets no fingerprint.
+ */
+static int ovl_dir_fingerprint(struct dentry *dentry, u64 *fingerprint)
+{
+	time64_t recent = ktime_get_real_seconds() - 2;
+	const struct ovl_layer *layer;
+	struct path realpath;
+	struct kstat stat;
+	int idx, next, err;
+	u64 fp = 0;
+
+	for (idx = 0; idx != -1; idx = next) {
+		next = ovl_path_next(idx, dentry, &realpath, &layer);
+		err = vfs_getattr(&realpath, &stat,
+				  STATX_INO | STATX_MTIME | STATX_SIZE, 0);
+		if (err)
+			return err;
+		if (stat.mtime.tv_sec >= recent)
+			return -EAGAIN;
+		fp = siphash_4u64(fp ^ layer->idx, stat.ino,
+				  timespec64_to_ns(&stat.mtime), stat.size,
+				  &ovl_dir_fingerprint_key);
+	}
+	*fingerprint = fp;
+	return 0;
+}
+
+static int ovl_dir_cache_load(struct dentry *dentry,
+			      struct ovl_dir_cache *cache, u64 fingerprint)
+{
+	struct ovl_fs *ofs = OVL_FS(dentry->d_sb);
+	struct dentry *upper = ovl_dentry_upper(dentry);
+	struct ovl_readdir_data rdd = { .dentry = dentry };
+	struct ovl_readdir_xattr_entry *re;
+	struct ovl_readdir_xattr *rx;
+	struct ovl_cache_entry *p;
+	size_t off, size = 0;
+	ssize_t res;
+	u32 i, nr;
+	void *buf;
+
+	res = ovl_getxattr_upper(ofs, upper, OVL_XATTR_READDIR, NULL, 0);
+	if (res < 0)
+		return res;
+	if (res < sizeof(*rx))
+		return -EINVAL;
+
+	rx = kvmalloc(res, GFP_KERNEL);
+	if (!rx)
+		return -ENOMEM;
+	res = ovl_getxattr_upper(ofs, upper, OVL_XATTR_READDIR, rx, res);
+	if (res < (ssize_t)sizeof(*rx))
+		goto invalid;
+	if (rx->version != OVL_READDIR_XATTR_VERSION ||
+	    le64_to_cpu(rx->fingerprint) != fingerprint) {
+		res = -ESTALE;
+		goto out;
+	}
+
+	nr = le32_to_cpu(rx->nr);
+	for (i = 0, off = sizeof(*rx); i < nr; i++) {
+		re = (void *)rx + off;
+		if (off + sizeof(*re) > res || off + sizeof(*re) + re->len > res)
+			goto invalid;
+		if (!re->len || re->type > DT_WHT ||
+		    memchr(re->name, '/', re->len) ||
+		    memchr(re->name, '\0', re->len))
+			goto invalid;
+		/* "." and ".." can only be the dir and its parent */
+		if (is_dot_dotdot(re->name, re->len) &&
+		    (re->type != DT_DIR ||
+		     (re->flags & OVL_READDIR_XATTR_WHITEOUT)))
+			goto invalid;
+		size += ovl_cache_entry_size(re->len);
+		off += sizeof(*re) + re->len;
+	}
+	if (off != res)
+		goto invalid;
+
+	buf = kvmalloc(size ?: 1, GFP_KERNEL);
+	if (!buf) {
+		res = -ENOMEM;
+		goto out;
+	}
+
+	p = buf;
+	for (i = 0, off = sizeof(*rx); i < nr; i++) {
+		struct rb_node **newp = &cache->root.rb_node;
+		struct rb_node *parent = NULL;
+
+		re = (void *)rx + off;
+		/* a merged dir lists every name once */
+		if (ovl_cache_entry_find_link(re->name, re->len, &newp,
+					      &parent)) {
+			INIT_LIST_HEAD(&cache->entries);
+			cache->root = RB_ROOT;
+			kvfree(buf);
+			goto invalid;
+		}
+		rdd.is_upper = re->flags & OVL_READDIR_XATTR_UPPER;
+		rdd.in_xwhiteouts_dir = re->flags & OVL_READDIR_XATTR_XWHITEOUT;
+		ovl_cache_entry_init(&rdd, p, re->name, re->len,
+				     le64_to_cpu(re->ino), re->type);
+		p->is_whiteout = re->flags & OVL_READDIR_XATTR_WHITEOUT;
+		list_add_tail(&p->l_node, &cache->entries);
+		rb_link_node(&p->node, parent, newp);
+		rb_insert_color(&p->node, &cache->root);
+		p = (void *)p + ovl_cache_entry_size(re->len);
+		off += sizeof(*re) + re->len;
+	}
+	cache->packed = buf;
+	res = 0;
+out:
+	kvfree(rx);
+	return res;
+
+invalid:
+	pr_warn_ratelimited("invalid readdir xattr (%pd2)\n", upper);
+	res = -EINVAL;
+	goto out;
+}
+
+/* Storing the entries is best effort, the dir is readable without them */
+static void ovl_dir_cache_store(struct dentry *dentry,
+				struct ovl_dir_cache *cache, u64 fingerprint)
+{
+	struct ovl_fs *ofs = OVL_FS(dentry->d_sb);
+	struct ovl_readdir_xattr_entry *re;
+	struct ovl_readdir_xattr *rx;
+	struct ovl_cache_entry *p;
+	size_t size = sizeof(*rx);
+	u32 nr = 0;
+
+	list_for_each_entry(p, &cache->entries, l_node) {
+		if (p->len > U8_MAX)
+			return;
+		size += sizeof(*re) + p->len;
+		nr++;
+	}
+	if (size > XATTR_SIZE_MAX)
+		return;
+
+	rx = kvmalloc(size, GFP_KERNEL);
+	if (!rx)
+		return;
+	rx->version = OVL_READDIR_XATTR_VERSION;
+	memset(rx->pad, 0, sizeof(rx->pad));
+	rx->nr = cpu_to_le32(nr);
+	rx->fingerprint = cpu_to_le64(fingerprint);
+
+	re = (void *)rx->entries;
+	list_for_each_entry(p, &cache->entries, l_node) {
+		re->ino = cpu_to_le64(p->real_ino);
+		re->type = p->type;
+		re->flags = 0;
+		if (p->is_upper)
+			re->flags |= OVL_READDIR_XATTR_UPPER;
+		if (p->is_whiteout)
+			re->flags |= OVL_READDIR_XATTR_WHITEOUT;
+		if (p->check_xwhiteout)
+			re->flags |= OVL_READDIR_XATTR_XWHITEOUT;
+		re->len = p->len;
+		memcpy(re->name, p->name, p->len);
+		re = (void *)re + sizeof(*re) + p->len;
+	}
+
+	/*
+	 * We hold the dir inode lock, so don't wait for a frozen upper fs,
+	 * the entries are stored again on the next open.
+	 */
+	if (!ovl_get_write_access(dentry)) {
+		if (ovl_start_write_trylock(dentry)) {
+			ovl_setxattr(ofs, ovl_dentry_upper(dentry),
+				     OVL_XATTR_READDIR, rx, size);
+			ovl_end_write(dentry);
+		}
+		ovl_put_write_access(dentry);
+	}
+	kvfree(rx);
+}
+
 static struct ovl_dir_cache *ovl_cache_get(struct dentry *dentry)
 {
 	int res;
 	struct ovl_dir_cache *cache;
 	struct inode *inode = d_inode(dentry);
+	u64 fingerprint;
+	bool persist;
 
 	cache = ovl_dir_cache(inode);
 	if (cache && ovl_inode_version_get(inode) == cache->version) {
-		WARN_ON(!cache->refcount);
+		/* Can't fail, the shrinker needs the inode lock we hold */
+		if (cache->inode)
+			ovl_dir_cache_unretain(cache);
+		else
+			WARN_ON(!cache->refcount);
 		cache->refcount++;
 		return cache;
 	}
+	/* A stale cache still in use is freed on its last release */
+	if (cache && cache->inode)
+		ovl_dir_cache_free(inode);
 	ovl_set_dir_cache(d_inode(dentry), NULL);
 
 	cache = kzalloc(sizeof(struct ovl_dir_cache), GFP_KERNEL);
@@ -419,11 +807,18 @@ static struct ovl_dir_cache *ovl_cache_get(struct dentry *dentry)
 	INIT_LIST_HEAD(&cache->entries);
 	cache->root = RB_ROOT;
 
-	res = ovl_dir_read_merged(dentry, &cache->entries, &cache->root);
-	if (res) {
-		ovl_cache_free(&cache->entries);
-		kfree(cache);
-		return ERR_PTR(res);
+	persist = ovl_dir_cache_persist(dentry) &&
+		  !ovl_dir_fingerprint(dentry, &fingerprint);
+	if (!persist || ovl_dir_cache_load(dentry, cache, fingerprint)) {
+		res = ovl_dir_read_merged(dentry, &cache->entries,
+					  &cache->root);
+		if (res) {
+			ovl_cache_free(&cache->entries);
+			kfree(cache);
+			return ERR_PTR(res);
+		}
+		if (persist)
+			ovl_dir_cache_store(dentry, cache, fingerprint);
 	}
 
 	cache->version = ovl_inode_version_get(inode);
@@ -1502,10 +1502,16 @@ static int __init ovl_init(void)
 	if (ovl_inode_cachep == NULL)
 		return -ENOMEM;
 
+	err = ovl_dir_cache_init();
+	if (err)
+		goto out_destroy_cachep;
+
 	err = register_filesystem(&ovl_fs_type);
 	if (!err)
 		return 0;
 
+	ovl_dir_cache_exit();
+out_destroy_cachep:
 	kmem_cache_destroy(ovl_inode_cachep);
 
 	return err;
@@ -1514,6 +1520,7 @@ static int __init ovl_init(void)
 static void __exit ovl_exit(void)
 {
 	unregister_filesystem(&ovl_fs_type);
+	ovl_dir_cache_exit();
 
 	/*
 	 * Make sure all delayed rcu free inodes are flushed before we
@@ -19,6 +19,10 @@
  * To avoid out of memory and fragmentation issues with vmalloc the cache
  * uses sequences of kmalloced PAGE_SIZE buffers.
  *
+ * Entries are found through a hash table which is looked up under RCU, so
+ * that readers of blocks already in the cache don't contend on the cache
+ * lock, which only serialises filling and evicting entries.
+ *
  * It should be noted that the cache is not used for file datablocks, these
  * are decompressed and cached in the page-cache in the normal way.  The
  * cache is only used to temporarily cache fragment and metadata blocks
@@ -39,126 +43,168 @@
 #include <linux/spinlock.h>
 #include <linux/wait.h>
 #include <linux/pagemap.h>
+#include <linux/hash.h>
+#include <linux/log2.h>
+#include <linux/rculist.h>
+#include <linux/percpu_counter.h>
 
 #include "squashfs_fs.h"
 #include "squashfs_fs_sb.h"
 #include "squashfs.h"
 #include "page_actor.h"
 
+static struct hlist_head *squashfs_cache_bucket(struct squashfs_cache *cache,
+	u64 block)
+{
+	return &cache->hash[hash_64(block, cache->hash_bits)];
+}
+
+
 /*
- * Look-up block in cache, and increment usage count.  If not in cache, read
- * and decompress it from disk.
+ * Look-up block in the hash table, and increment usage count.  This runs
+ * without cache->lock.  The refcount of an entry being recycled is -1, so
+ * a reference can't be taken on it, and the block is checked again once
+ * the reference is held, since the entry can have been recycled after it
+ * was found.  A miss here is not definitive, the caller retries under
+ * cache->lock.
  */
-struct squashfs_cache_entry *squashfs_cache_get(struct super_block *sb,
-	struct squashfs_cache *cache, u64 block, int length)
+static struct squashfs_cache_entry *squashfs_cache_lookup(
+	struct squashfs_cache *cache, u64 block)
 {
-	int i, n;
 	struct squashfs_cache_entry *entry;
 
-	spin_lock(&cache->lock);
-
-	while (1) {
-		for (i = cache->curr_blk, n = 0; n < cache->entries; n++) {
-			if (cache->entry[i].block == block) {
-				cache->curr_blk = i;
-				break;
-			}
-			i = (i + 1) % cache->entries;
+	rcu_read_lock();
+	hlist_for_each_entry_rcu(entry, squashfs_cache_bucket(cache, block),
+			hash) {
+		if (READ_ONCE(entry->block) != block)
+			continue;
+		if (!atomic_inc_unless_negative(&entry->refcount))
+			break;
+		if (READ_ONCE(entry->block) == block) {
+			rcu_read_unlock();
+			return entry;
 		}
+		squashfs_cache_put(entry);
+		break;
+	}
+	rcu_read_unlock();
+	return NULL;
+}
 
-		if (n == cache->entries) {
-			/*
-			 * Block not in cache, if all cache entries are used
-			 * go to sleep waiting for one to become available.
-			 */
-			if (cache->unused == 0) {
-				cache->num_waiters++;
-				spin_unlock(&cache->lock);
-				wait_event(cache->wait_queue, cache->unused);
-				spin_lock(&cache->lock);
-				cache->num_waiters--;
-				continue;
-			}
 
-			/*
-			 * At least one unused cache entry.  A simple
-			 * round-robin strategy is used to choose the entry to
-			 * be evicted from the cache.
-			 */
-			i = cache->next_blk;
-			for (n = 0; n < cache->entries; n++) {
-				if (cache->entry[i].refcount == 0)
-					break;
-				i = (i + 1) % cache->entries;
-			}
+static bool squashfs_cache_unused(struct squashfs_cache *cache)
+{
+	int i;
 
-			cache->next_blk = (i + 1) % cache->entries;
-			entry = &cache->entry[i];
-
-			/*
-			 * Initialise chosen cache entry, and fill it in from
-			 * disk.
-			 */
-			cache->unused--;
-			entry->block = block;
-			entry->refcount = 1;
-			entry->pending = 1;
-			entry->num_waiters = 0;
-			entry->error = 0;
-			spin_unlock(&cache->lock);
+	for (i = 0; i < cache->entries; i++)
+		if (atomic_read(&cache->entry[i].refcount) == 0)
+			return true;
+	return false;
+}
 
-			entry->length = squashfs_read_data(sb, block, length,
-				&entry->next_index, entry->actor);
 
-			spin_lock(&cache->lock);
+/*
+ * Claim an unused entry for recycling, called with cache->lock held.  A
+ * simple round-robin strategy is used to choose the entry to be evicted.
+ */
+static struct squashfs_cache_entry *squashfs_cache_evict(
+	struct squashfs_cache *cache)
+{
+	int i = cache->next_blk, n;
 
-			if (entry->length < 0)
-				entry->error = entry->length;
+	for (n = 0; n < cache->entries; n++) {
+		if (atomic_cmpxchg(&cache->entry[i].refcount, 0, -1) == 0) {
+			cache->next_blk = (i + 1) % cache->entries;
+			return &cache->entry[i];
+		}
+		i = (i + 1) % cache->entries;
+	}
+	return NULL;
+}
 
-			entry->pending = 0;
 
-			/*
-			 * While filling this entry one or more other processes
-			 * have looked it up in the cache, and have slept
-			 * waiting for it to become available.
-			 */
-			if (entry->num_waiters) {
-				spin_unlock(&cache->lock);
-				wake_up_all(&entry->wait_queue);
-			} else
-				spin_unlock(&cache->lock);
+/*
+ * Look-up block in cache, and increment usage count.  If not in cache, read
+ * and decompress it from disk.
+ */
+struct squashfs_cache_entry *squashfs_cache_get(struct super_block *sb,
+	struct squashfs_cache *cache, u64 block, int length)
+{
+	struct squashfs_cache_entry *entry;
+
+	entry = squashfs_cache_lookup(cache, block);
+	if (entry)
+		goto hit;
 
-			goto out;
+	spin_lock(&cache->lock);
+
+	while (1) {
+		entry = squashfs_cache_lookup(cache, block);
+		if (entry) {
+			spin_unlock(&cache->lock);
+			goto hit;
 		}
 
-		/*
-		 * Block already in cache.  Increment refcount so it doesn't
-		 * get reused until we're finished with it, if it was
-		 * previously unused there's one less cache entry available
-		 * for reuse.
-		 */
-		entry = &cache->entry[i];
-		if (entry->refcount == 0)
-			cache->unused--;
-		entry->refcount++;
+		entry = squashfs_cache_evict(cache);
+		if (entry)
+			break;
 
 		/*
-		 * If the entry is currently being filled in by another process
-		 * go to sleep waiting for it to become available.
+		 * Block not in cache, and all cache entries are used, go to
+		 * sleep waiting for one to become available.
 		 */
-		if (entry->pending) {
-			entry->num_waiters++;
-			spin_unlock(&cache->lock);
-			wait_event(entry->wait_queue, !entry->pending);
-		} else
-			spin_unlock(&cache->lock);
-
-		goto out;
+		atomic_inc(&cache->num_waiters);
+		/* pairs with atomic_dec_and_test() in squashfs_cache_put() */
+		smp_mb__after_atomic();
+		spin_unlock(&cache->lock);
+		wait_event(cache->wait_queue, squashfs_cache_unused(cache));
+		spin_lock(&cache->lock);
+		atomic_dec(&cache->num_waiters);
 	}
 
+	/*
+	 * Initialise chosen cache entry, rehash it, and fill it in from
+	 * disk.  Lockless lookups can see the new block before the entry
+	 * is published by setting its refcount.
+	 */
+	if (!hlist_unhashed(&entry->hash))
+		hlist_del_rcu(&entry->hash);
+	WRITE_ONCE(entry->block, block);
+	entry->pending = 1;
+	entry->error = 0;
+	hlist_add_head_rcu(&entry->hash, squashfs_cache_bucket(cache, block));
+	atomic_set_release(&entry->refcount, 1);
+	spin_unlock(&cache->lock);
+
+	percpu_counter_inc(&cache->misses);
+	entry->length = squashfs_read_data(sb, block, length,
+		&entry->next_index, entry->actor);
+	if (entry->length < 0)
+		entry->error = entry->length;
+
+	/*
+	 * While filling this entry one or more other processes may have
+	 * looked it up in the cache, and have slept waiting for it to become
+	 * available.
+	 */
+	smp_store_release(&entry->pending, 0);
+	if (wq_has_sleeper(&entry->wait_queue))
+		wake_up_all(&entry->wait_queue);
+	goto out;
+
+hit:
+	percpu_counter_inc(&cache->hits);
+
+	/*
+	 * If the entry is currently being filled in by another process
+	 * go to sleep waiting for it to become available.
+	 */
+	wait_event(entry->wait_queue, !smp_load_acquire(&entry->pending));
+
 out:
 	TRACE("Got %s %d, start block %lld, refcount %d, error %d\n",
-		cache->name, i, entry->block, entry->refcount, entry->error);
+		cache->name, (int)(entry - cache->entry), entry->block,
+		atomic_read(&entry->refcount), entry->error);
 
 	if (entry->error)
 		ERROR("Unable to read %s cache entry [%llx]\n", cache->name,
@@ -174,21 +220,14 @@ void squashfs_cache_put(struct squashfs_cache_entry *entry)
 {
 	struct squashfs_cache *cache = entry->cache;
 
-	spin_lock(&cache->lock);
-	entry->refcount--;
-	if (entry->refcount == 0) {
-		cache->unused++;
-		/*
-		 * If there's any processes waiting for a block to become
-		 * available, wake one up.
-		 */
-		if (cache->num_waiters) {
-			spin_unlock(&cache->lock);
-			wake_up(&cache->wait_queue);
-			return;
-		}
-	}
-	spin_unlock(&cache->lock);
+	/*
+	 * If there's any processes waiting for a block to become available,
+	 * wake one up.  atomic_dec_and_test() orders the refcount update
+	 * before reading num_waiters.
+	 */
+	if (atomic_dec_and_test(&entry->refcount) &&
+	    atomic_read(&cache->num_waiters))
+		wake_up(&cache->wait_queue);
 }
 
 /*
@@ -201,7 +240,7 @@ void squashfs_cache_delete(struct squashfs_cache *cache)
 	if (cache == NULL)
 		return;
 
-	for (i = 0; i < cache->entries; i++) {
+	for (i = 0; cache->entry && i < cache->entries; i++) {
 		if (cache->entry[i].data) {
 			for (j = 0; j < cache->pages; j++)
 				kfree(cache->entry[i].data[j]);
@@ -210,6 +249,9 @@ void squashfs_cache_delete(struct squashfs_cache *cache)
 		kfree(cache->entry[i].actor);
 	}
 
+	percpu_counter_destroy(&cache->hits);
+	percpu_counter_destroy(&cache->misses);
+	kfree(cache->hash);
 	kfree(cache->entry);
 	kfree(cache);
 }
@@ -237,15 +279,24 @@ struct squashfs_cache *squashfs_cache_init(char *name, int entries,
 		goto cleanup;
 	}
 
-	cache->curr_blk = 0;
+	/* About two buckets per entry */
+	cache->hash_bits = ilog2(roundup_pow_of_two(entries)) + 1;
+	cache->hash = kcalloc(1 << cache->hash_bits, sizeof(*cache->hash),
+		GFP_KERNEL);
+	if (cache->hash == NULL ||
+	    percpu_counter_init(&cache->hits, 0, GFP_KERNEL) ||
+	    percpu_counter_init(&cache->misses, 0, GFP_KERNEL)) {
+		ERROR("Failed to allocate %s cache\n", name);
+		goto cleanup;
+	}
+
 	cache->next_blk = 0;
-	cache->unused = entries;
 	cache->entries = entries;
 	cache->block_size = block_size;
 	cache->pages = block_size >> PAGE_SHIFT;
 	cache->pages = cache->pages ? cache->pages : 1;
 	cache->name = name;
-	cache->num_waiters = 0;
+	atomic_set(&cache->num_waiters, 0);
 	spin_lock_init(&cache->lock);
 	init_waitqueue_head(&cache->wait_queue);
 
@@ -253,6 +304,7 @@ struct squashfs_cache *squashfs_cache_init(char *name, int entries,
 		struct squashfs_cache_entry *entry = &cache->entry[i];
 
 		init_waitqueue_head(&cache->entry[i].wait_queue);
+		INIT_HLIST_NODE(&entry->hash);
 		entry->cache = cache;
 		entry->block = SQUASHFS_INVALID_BLK;
 		entry->data = kcalloc(cache->pages, sizeof(void *), GFP_KERNEL);
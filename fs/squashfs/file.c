@@ -34,6 +34,7 @@
 #include <linux/string.h>
 #include <linux/pagemap.h>
 #include <linux/mutex.h>
+#include <linux/workqueue.h>
 
 #include "squashfs_fs.h"
 #include "squashfs_fs_sb.h"
@@ -563,6 +564,102 @@ static int squashfs_readahead_fragment(struct page **page,
 	return 1;
 }
 
+/*
+ * Read and decompress one datablock of a readahead window into its pages,
+ * and release them.  Returns false if the page actor couldn't be allocated.
+ */
+static bool squashfs_readahead_block(struct super_block *sb,
+	struct page **pages, unsigned int nr_pages, u64 block, int bsize,
+	unsigned int expected, loff_t start, bool last_block)
+{
+	struct squashfs_sb_info *msblk = sb->s_fs_info;
+	struct squashfs_page_actor *actor;
+	struct page *last_page;
+	int i, res;
+
+	actor = squashfs_page_actor_init_special(msblk, pages, nr_pages,
+						expected, start);
+	if (!actor)
+		goto out;
+
+	res = squashfs_read_data(sb, block, bsize, NULL, actor);
+
+	last_page = squashfs_page_actor_free(actor);
+
+	if (res == expected && !IS_ERR(last_page)) {
+		int bytes;
+
+		/* Last page (if present) may have trailing bytes not filled */
+		bytes = res % PAGE_SIZE;
+		if (last_block && bytes && last_page)
+			memzero_page(last_page, bytes,
+				     PAGE_SIZE - bytes);
+
+		for (i = 0; i < nr_pages; i++) {
+			flush_dcache_page(pages[i]);
+			SetPageUptodate(pages[i]);
+		}
+	}
+
+out:
+	for (i = 0; i < nr_pages; i++) {
+		unlock_page(pages[i]);
+		put_page(pages[i]);
+	}
+	return actor != NULL;
+}
+
+/*
+ * With more than one decompressor, the datablocks of a readahead window
+ * are decompressed concurrently: all but the last are handed to workers,
+ * which release their pages once done, as bio completion would.  The
+ * locked pages keep the inode, and so the superblock, alive until then.
+ */
+struct squashfs_readahead_work {
+	struct work_struct	work;
+	struct super_block	*sb;
+	u64			block;
+	int			bsize;
+	unsigned int		expected;
+	loff_t			start;
+	bool			last_block;
+	unsigned int		nr_pages;
+	struct page		*pages[];
+};
+
+static void squashfs_readahead_work(struct work_struct *work)
+{
+	struct squashfs_readahead_work *ra =
+		container_of(work, struct squashfs_readahead_work, work);
+
+	squashfs_readahead_block(ra->sb, ra->pages, ra->nr_pages, ra->block,
+		ra->bsize, ra->expected, ra->start, ra->last_block);
+	kfree(ra);
+}
+
+static bool squashfs_readahead_queue(struct super_block *sb,
+	struct page **pages, unsigned int nr_pages, u64 block, int bsize,
+	unsigned int expected, loff_t start, bool last_block)
+{
+	struct squashfs_readahead_work *ra;
+
+	ra = kmalloc(struct_size(ra, pages, nr_pages), GFP_NOFS | __GFP_NOWARN);
+	if (!ra)
+		return false;
+
+	INIT_WORK(&ra->work, squashfs_readahead_work);
+	ra->sb = sb;
+	ra->block = block;
+	ra->bsize = bsize;
+	ra->expected = expected;
+	ra->start = start;
+	ra->last_block = last_block;
+	ra->nr_pages = nr_pages;
+	memcpy(ra->pages, pages, nr_pages * sizeof(*pages));
+	queue_work(system_unbound_wq, &ra->work);
+	return true;
+}
+
 static void squashfs_readahead(struct readahead_control *ractl)
 {
 	struct inode *inode = ractl->mapping->host;
@@ -571,14 +668,17 @@ static void squashfs_readahead(struct readahead_control *ractl)
 	unsigned short shift = msblk->block_log - PAGE_SHIFT;
 	loff_t start = readahead_pos(ractl) & ~mask;
 	size_t len = readahead_length(ractl) + readahead_pos(ractl) - start;
-	struct squashfs_page_actor *actor;
 	unsigned int nr_pages = 0;
 	struct page **pages;
 	int i;
 	loff_t file_end = i_size_read(inode) >> msblk->block_log;
 	unsigned int max_pages = 1UL << shift;
+	bool parallel = msblk->max_thread_num > 1;
+	loff_t last_index;
 
 	readahead_expand(ractl, start, (len | mask) + 1);
+	last_index = (readahead_pos(ractl) + readahead_length(ractl) - 1) >>
+		     msblk->block_log;
 
 	pages = kmalloc_array(max_pages, sizeof(void *), GFP_KERNEL);
 	if (!pages)
@@ -588,9 +688,10 @@ static void squashfs_readahead(struct readahead_control *ractl)
 		int res, bsize;
 		u64 block = 0;
 		unsigned int expected;
-		struct page *last_page;
+		loff_t index = start >> msblk->block_log;
+		bool queued;
 
-		expected = start >> msblk->block_log == file_end ?
+		expected = index == file_end ?
 			   (i_size_read(inode) & (msblk->block_size - 1)) :
 			    msblk->block_size;
 
@@ -603,7 +704,7 @@ static void squashfs_readahead(struct readahead_control *ractl)
 		if (readahead_pos(ractl) >= i_size_read(inode))
 			goto skip_pages;
 
-		if (start >> msblk->block_log == file_end &&
+		if (index == file_end &&
 				squashfs_i(inode)->fragment_block != SQUASHFS_INVALID_BLK) {
 			res = squashfs_readahead_fragment(pages, nr_pages,
 							  expected, start);
@@ -612,38 +713,17 @@ static void squashfs_readahead(struct readahead_control *ractl)
 			continue;
 		}
 
-		bsize = read_blocklist(inode, start >> msblk->block_log, &block);
+		bsize = read_blocklist(inode, index, &block);
 		if (bsize == 0)
 			goto skip_pages;
 
-		actor = squashfs_page_actor_init_special(msblk, pages, nr_pages,
-							expected, start);
-		if (!actor)
-			goto skip_pages;
-
-		res = squashfs_read_data(inode->i_sb, block, bsize, NULL, actor);
-
-		last_page = squashfs_page_actor_free(actor);
-
-		if (res == expected && !IS_ERR(last_page)) {
-			int bytes;
-
-			/* Last page (if present) may have trailing bytes not filled */
-			bytes = res % PAGE_SIZE;
-			if (start >> msblk->block_log == file_end && bytes && last_page)
-				memzero_page(last_page, bytes,
-					     PAGE_SIZE - bytes);
-
-			for (i = 0; i < nr_pages; i++) {
-				flush_dcache_page(pages[i]);
-				SetPageUptodate(pages[i]);
-			}
-		}
-
-		for (i = 0; i < nr_pages; i++) {
-			unlock_page(pages[i]);
-			put_page(pages[i]);
-		}
+		queued = parallel && index < last_index &&
+			 squashfs_readahead_queue(inode->i_sb, pages, nr_pages,
+					block, bsize, expected, start, false);
+		if (!queued && !squashfs_readahead_block(inode->i_sb, pages,
+					nr_pages, block, bsize, expected, start,
+					index == file_end))
+			break;
 
 		start += readahead_batch_length(ractl);
 	}
@@ -203,6 +203,10 @@ static inline int squashfs_block_size(__le32 raw)
 
 /* cached data constants for filesystem */
 #define SQUASHFS_CACHED_BLKS		8
+/* upper limit of the cache_entries mount option */
+#define SQUASHFS_MAX_CACHED_BLKS	1024
+/* the fragment cache only grows past its default up to this many bytes */
+#define SQUASHFS_MAX_FRAGMENT_CACHE	(64 << 20)
 
 /* meta index cache */
 #define SQUASHFS_META_INDEXES	(SQUASHFS_METADATA_SIZE / sizeof(unsigned int))
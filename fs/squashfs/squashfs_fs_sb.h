@@ -10,31 +10,36 @@
  * squashfs_fs_sb.h
  */
 
+#include <linux/percpu_counter.h>
+
 #include "squashfs_fs.h"
 
 struct squashfs_cache {
 	char			*name;
 	int			entries;
-	int			curr_blk;
 	int			next_blk;
-	int			num_waiters;
-	int			unused;
+	atomic_t		num_waiters;
 	int			block_size;
 	int			pages;
+	unsigned int		hash_bits;
 	spinlock_t		lock;
 	wait_queue_head_t	wait_queue;
+	struct hlist_head	*hash;
 	struct squashfs_cache_entry *entry;
+	struct percpu_counter	hits;
+	struct percpu_counter	misses;
 };
 
 struct squashfs_cache_entry {
 	u64			block;
 	int			length;
-	int			refcount;
+	/* -1 while the entry is being recycled */
+	atomic_t		refcount;
 	u64			next_index;
 	int			pending;
 	int			error;
-	int			num_waiters;
 	wait_queue_head_t	wait_queue;
+	struct hlist_node	hash;
 	struct squashfs_cache	*cache;
 	void			**data;
 	struct squashfs_page_actor	*actor;
@@ -69,5 +74,6 @@ struct squashfs_sb_info {
 	bool					panic_on_errors;
 	const struct squashfs_decompressor_thread_ops *thread_ops;
 	int					max_thread_num;
+	int					cache_entries;
 };
 #endif
@@ -48,12 +48,14 @@ enum Opt_errors {
 enum squashfs_param {
 	Opt_errors,
 	Opt_threads,
+	Opt_cache_entries,
 };
 
 struct squashfs_mount_opts {
 	enum Opt_errors errors;
 	const struct squashfs_decompressor_thread_ops *thread_ops;
 	int thread_num;
+	int cache_entries;
 };
 
 static const struct constant_table squashfs_param_errors[] = {
@@ -65,6 +67,7 @@ static const struct constant_table squashfs_param_errors[] = {
 static const struct fs_parameter_spec squashfs_fs_parameters[] = {
 	fsparam_enum("errors", Opt_errors, squashfs_param_errors),
 	fsparam_string("threads", Opt_threads),
+	fsparam_u32("cache_entries", Opt_cache_entries),
 	{}
 };
 
@@ -142,6 +145,13 @@ static int squashfs_parse_param(struct fs_context *fc, struct fs_parameter *para
 		if (squashfs_parse_param_threads(param->string, opts) != 0)
 			return -EINVAL;
 		break;
+	case Opt_cache_entries:
+		if (result.uint_32 == 0 ||
+		    result.uint_32 > SQUASHFS_MAX_CACHED_BLKS)
+			return invalfc(fc, "cache_entries must be 1-%d",
+				       SQUASHFS_MAX_CACHED_BLKS);
+		opts->cache_entries = result.uint_32;
+		break;
 	default:
 		return -EINVAL;
 	}
@@ -186,6 +196,7 @@ static int squashfs_fill_super(struct super_block *sb, struct fs_context *fc)
 	long long root_inode;
 	unsigned short flags;
 	unsigned int fragments;
+	int fragment_entries;
 	u64 lookup_table_start, xattr_id_table_start, next_table;
 	int err;
 
@@ -198,6 +209,7 @@ static int squashfs_fill_super(struct super_block *sb, struct fs_context *fc)
 	}
 	msblk = sb->s_fs_info;
 	msblk->thread_ops = opts->thread_ops;
+	msblk->cache_entries = opts->cache_entries;
 
 	msblk->panic_on_errors = (opts->errors == Opt_errors_panic);
 
@@ -317,7 +329,8 @@ static int squashfs_fill_super(struct super_block *sb, struct fs_context *fc)
 	err = -ENOMEM;
 
 	msblk->block_cache = squashfs_cache_init("metadata",
-			SQUASHFS_CACHED_BLKS, SQUASHFS_METADATA_SIZE);
+			msblk->cache_entries ?: SQUASHFS_CACHED_BLKS,
+			SQUASHFS_METADATA_SIZE);
 	if (msblk->block_cache == NULL)
 		goto failed_mount;
 
@@ -404,8 +417,18 @@ static int squashfs_fill_super(struct super_block *sb, struct fs_context *fc)
 	if (fragments == 0)
 		goto check_directory_table;
 
+	/*
+	 * Fragment entries are a whole block each, up to 1 MiB, so
+	 * cache_entries is bounded by their total size here.
+	 */
+	fragment_entries = SQUASHFS_CACHED_FRAGMENTS;
+	if (msblk->cache_entries)
+		fragment_entries = min_t(int, msblk->cache_entries,
+			max_t(int, SQUASHFS_CACHED_FRAGMENTS,
+			      SQUASHFS_MAX_FRAGMENT_CACHE / msblk->block_size));
+
 	msblk->fragment_cache = squashfs_cache_init("fragment",
-		SQUASHFS_CACHED_FRAGMENTS, msblk->block_size);
+		fragment_entries, msblk->block_size);
 	if (msblk->fragment_cache == NULL) {
 		err = -ENOMEM;
 		goto failed_mount;
@@ -521,6 +544,9 @@ static int squashfs_show_options(struct seq_file *s, struct dentry *root)
 	else
 		seq_puts(s, ",errors=continue");
 
+	if (msblk->cache_entries)
+		seq_printf(s, ",cache_entries=%d", msblk->cache_entries);
+
 #ifdef CONFIG_SQUASHFS_CHOICE_DECOMP_BY_MOUNT
 	if (msblk->thread_ops == &squashfs_decompressor_single) {
 		seq_puts(s, ",threads=single");
@@ -537,6 +563,29 @@ static int squashfs_show_options(struct seq_file *s, struct dentry *root)
 	return 0;
 }
 
+static void squashfs_show_cache_stats(struct seq_file *s,
+	struct squashfs_cache *cache)
+{
+	if (cache == NULL)
+		return;
+
+	seq_printf(s, "\n\t%s cache: entries %d hits %lld misses %lld",
+		   cache->name, cache->entries,
+		   percpu_counter_sum(&cache->hits),
+		   percpu_counter_sum(&cache->misses));
+}
+
+static int squashfs_show_stats(struct seq_file *s, struct dentry *root)
+{
+	struct squashfs_sb_info *msblk = root->d_sb->s_fs_info;
+
+	seq_puts(s, "statvers=1.0");
+	squashfs_show_cache_stats(s, msblk->block_cache);
+	squashfs_show_cache_stats(s, msblk->fragment_cache);
+	squashfs_show_cache_stats(s, msblk->read_page);
+	return 0;
+}
+
 static int squashfs_init_fs_context(struct fs_context *fc)
 {
 	struct squashfs_mount_opts *opts;
@@ -689,6 +738,7 @@ static const struct super_operations squashfs_super_ops = {
 	.statfs = squashfs_statfs,
 	.put_super = squashfs_put_super,
 	.show_options = squashfs_show_options,
+	.show_stats = squashfs_show_stats,
 };
 
 module_init(init_squashfs_fs);
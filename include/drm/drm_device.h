@@ -14,6 +14,7 @@ struct drm_master;
 struct drm_vblank_crtc;
 struct drm_vma_offset_manager;
 struct drm_vram_mm;
+struct drm_gem_shmem;
 struct drm_fb_helper;
 
 struct inode;
@@ -293,6 +294,9 @@ struct drm_device {
 	/** @vram_mm: VRAM MM memory manager */
 	struct drm_vram_mm *vram_mm;
 
+	/** @shmem_mm: shmem GEM memory shrinker */
+	struct drm_gem_shmem *shmem_mm;
+
 	/**
 	 * @switch_power_state:
 	 *
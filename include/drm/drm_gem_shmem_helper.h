@@ -3,6 +3,7 @@
 #ifndef __DRM_GEM_SHMEM_HELPER_H__
 #define __DRM_GEM_SHMEM_HELPER_H__
 
+#include <linux/atomic.h>
 #include <linux/fs.h>
 #include <linux/mm.h>
 #include <linux/mutex.h>
@@ -16,6 +17,71 @@ struct dma_buf_attachment;
 struct drm_mode_create_dumb;
 struct drm_printer;
 struct sg_table;
+struct shrinker;
+
+/**
+ * struct drm_gem_shmem - per-device memory shrinker of shmem GEM objects
+ *
+ * Set up by drmm_gem_shmem_init(). The objects of the device whose pages are
+ * resident are kept on one of the LRUs, depending on whether the pages can
+ * be reclaimed and how, so that the shrinker only walks the objects it can
+ * do something about.
+ */
+struct drm_gem_shmem {
+	/**
+	 * @shrinker: Shrinker registered for the device
+	 */
+	struct shrinker *shrinker;
+
+	/**
+	 * @lock: Protects the LRUs
+	 */
+	struct mutex lock;
+
+	/**
+	 * @lru_pinned: Objects whose pages can't be reclaimed
+	 */
+	struct drm_gem_lru lru_pinned;
+
+	/**
+	 * @lru_evictable: Objects whose pages can be swapped out
+	 */
+	struct drm_gem_lru lru_evictable;
+
+	/**
+	 * @lru_purgeable: Objects whose pages or swap can be dropped
+	 */
+	struct drm_gem_lru lru_purgeable;
+
+	/**
+	 * @lru_evicted: Objects whose pages were swapped out, until next use
+	 */
+	struct drm_gem_lru lru_evicted;
+
+	/**
+	 * @stats: Reclaim statistics, reported in debugfs
+	 */
+	struct {
+		/** @stats.purged: Objects purged */
+		atomic64_t purged;
+		/** @stats.purged_pages: Pages released by purging */
+		atomic64_t purged_pages;
+		/** @stats.evicted: Objects evicted */
+		atomic64_t evicted;
+		/** @stats.evicted_pages: Pages released by eviction */
+		atomic64_t evicted_pages;
+		/** @stats.swapped_in: Evicted objects brought back */
+		atomic64_t swapped_in;
+		/** @stats.scans: Calls into the shrinker scan */
+		atomic64_t scans;
+		/** @stats.scan_ns: Total time spent in the shrinker scan */
+		atomic64_t scan_ns;
+		/** @stats.scan_ns_max: Longest shrinker scan */
+		atomic64_t scan_ns_max;
+	} stats;
+};
+
+int drmm_gem_shmem_init(struct drm_device *dev);
 
 /**
  * struct drm_gem_shmem_object - GEM object backed by shmem
@@ -39,6 +105,14 @@ struct drm_gem_shmem_object {
 	 */
 	unsigned int pages_use_count;
 
+	/**
+	 * @pages_pin_count:
+	 *
+	 * Reference count on pinned pages. Pinned pages can't be evicted
+	 * by the shrinker.
+	 */
+	unsigned int pages_pin_count;
+
 	/**
 	 * @madv: State for madvise
 	 *
@@ -91,6 +165,12 @@ struct drm_gem_shmem_object {
 	 * @map_wc: map object write-combined (instead of using shmem defaults).
 	 */
 	bool map_wc : 1;
+
+	/**
+	 * @evicted: The pages were written out by the shrinker and have to be
+	 * brought back before use.
+	 */
+	bool evicted : 1;
 };
 
 #define to_drm_gem_shmem_obj(obj) \
@@ -119,14 +199,25 @@ int drm_gem_shmem_madvise(struct drm_gem_shmem_object *shmem, int madv);
 static inline bool drm_gem_shmem_is_purgeable(struct drm_gem_shmem_object *shmem)
 {
 	return (shmem->madv > 0) &&
-		!shmem->vmap_use_count && shmem->sgt &&
+		!shmem->vmap_use_count && (shmem->sgt || shmem->evicted) &&
 		!shmem->base.dma_buf && !shmem->base.import_attach;
 }
 
 void drm_gem_shmem_purge(struct drm_gem_shmem_object *shmem);
 
+static inline bool drm_gem_shmem_is_evictable(struct drm_gem_shmem_object *shmem)
+{
+	return shmem->base.funcs->evict && shmem->pages &&
+		(shmem->madv >= 0) &&
+		!shmem->pages_pin_count && !shmem->vmap_use_count &&
+		!shmem->base.dma_buf && !shmem->base.import_attach;
+}
+
+int drm_gem_shmem_evict_locked(struct drm_gem_shmem_object *shmem);
+
 struct sg_table *drm_gem_shmem_get_sg_table(struct drm_gem_shmem_object *shmem);
 struct sg_table *drm_gem_shmem_get_pages_sgt(struct drm_gem_shmem_object *shmem);
+struct sg_table *drm_gem_shmem_get_pages_sgt_locked(struct drm_gem_shmem_object *shmem);
 
 void drm_gem_shmem_print_info(const struct drm_gem_shmem_object *shmem,
 			      struct drm_printer *p, unsigned int indent);
@@ -266,6 +357,24 @@ static inline int drm_gem_shmem_object_mmap(struct drm_gem_object *obj, struct v
 	return drm_gem_shmem_mmap(shmem, vma);
 }
 
+/**
+ * drm_gem_shmem_object_evict - GEM object function for drm_gem_shmem_evict_locked()
+ * @obj: GEM object
+ *
+ * This function wraps drm_gem_shmem_evict_locked(). Drivers that employ the shmem
+ * helpers and have no mappings of their own to tear down can use it as their
+ * &drm_gem_object_funcs.evict handler.
+ *
+ * Returns:
+ * 0 on success or a negative error code on failure.
+ */
+static inline int drm_gem_shmem_object_evict(struct drm_gem_object *obj)
+{
+	struct drm_gem_shmem_object *shmem = to_drm_gem_shmem_obj(obj);
+
+	return drm_gem_shmem_evict_locked(shmem);
+}
+
 /*
  * Driver ops
  */
@@ -274,6 +383,8 @@ struct drm_gem_object *
 drm_gem_shmem_prime_import_sg_table(struct drm_device *dev,
 				    struct dma_buf_attachment *attach,
 				    struct sg_table *sgt);
+struct dma_buf *drm_gem_shmem_prime_export(struct drm_gem_object *obj,
+					   int flags);
 int drm_gem_shmem_dumb_create(struct drm_file *file, struct drm_device *dev,
 			      struct drm_mode_create_dumb *args);
 
@@ -530,10 +530,24 @@ struct cgroup {
 	/*
 	 * A singly-linked list of cgroup structures to be rstat flushed.
 	 * This is a scratch field to be used exclusively by
-	 * cgroup_rstat_flush_locked() and protected by cgroup_rstat_lock.
+	 * cgroup_rstat_flush_owned() and protected by the flush ownership of
+	 * the subtree being flushed.
 	 */
 	struct cgroup	*rstat_flush_next;
 
+	/*
+	 * rstat flush ownership, protected by cgroup_root->rstat_lock. See
+	 * __cgroup_rstat_lock().
+	 */
+	int		rstat_flush_busy;	/* owned subtrees at or below */
+	int		rstat_flush_waiters;	/* flushers waiting for this */
+	bool		rstat_flush_owned;	/* a flush owns this subtree */
+	u64		rstat_flush_seq;	/* seq of the owning flush */
+	u64		rstat_flushed_seq;	/* seq of the last completed flush */
+
+	/* serializes propagation from concurrently flushed child subtrees */
+	spinlock_t	rstat_prop_lock;
+
 	/* cgroup basic resource statistics */
 	struct cgroup_base_stat last_bstat;
 	struct cgroup_base_stat bstat;
@@ -600,6 +614,15 @@ struct cgroup_root {
 	/* Number of cgroups in the hierarchy, used only for /proc/cgroups */
 	atomic_t nr_cgrps;
 
+	/*
+	 * Protects the rstat flush ownership state of the cgroups in this
+	 * hierarchy. Flushers waiting for an overlapping flush to finish sleep
+	 * on @rstat_waitq. @rstat_flush_seq numbers flushes as they start.
+	 */
+	spinlock_t rstat_lock;
+	wait_queue_head_t rstat_waitq;
+	u64 rstat_flush_seq;
+
 	/* Hierarchy-specific flags */
 	unsigned int flags;
 
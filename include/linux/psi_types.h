@@ -163,6 +163,9 @@ struct psi_group {
 	struct psi_group *parent;
 	bool enabled;
 
+	/* Level in the cgroup hierarchy, 0 for the system group */
+	unsigned int depth;
+
 	/* Protects data used by the aggregator */
 	struct mutex avgs_lock;
 
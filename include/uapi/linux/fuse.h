@@ -220,6 +220,16 @@
  *
  *  7.41
  *  - add FUSE_ALLOW_IDMAP
+ *
+ *  7.42
+ *  - add FUSE_OVER_IO_URING and all other io-uring related flags and data
+ *    structures:
+ *    - struct fuse_uring_cmd_req
+ *    - FUSE_URING_CMD_REGISTER, FUSE_URING_CMD_COMMIT_AND_FETCH
+ *
+ *  7.43
+ *  - add FUSE_PASSTHROUGH_META init flag
+ *  - add FUSE_DEV_IOC_BACKING_ATTACH and struct fuse_backing_attach
  */
 
 #ifndef _LINUX_FUSE_H
@@ -255,7 +265,7 @@
 #define FUSE_KERNEL_VERSION 7
 
 /** Minor version number of this interface */
-#define FUSE_KERNEL_MINOR_VERSION 41
+#define FUSE_KERNEL_MINOR_VERSION 43
 
 /** The node ID of the root inode */
 #define FUSE_ROOT_ID 1
@@ -362,7 +372,8 @@ struct fuse_file_lock {
  * FOPEN_STREAM: the file is stream-like (no file position at all)
  * FOPEN_NOFLUSH: don't flush data cache on close (unless FUSE_WRITEBACK_CACHE)
  * FOPEN_PARALLEL_DIRECT_WRITES: Allow concurrent direct writes on the same inode
- * FOPEN_PASSTHROUGH: passthrough read/write io for this open file
+ * FOPEN_PASSTHROUGH: passthrough read/write io for this open file, or readdir
+ *		      for this open directory with FUSE_PASSTHROUGH_META
  */
 #define FOPEN_DIRECT_IO		(1 << 0)
 #define FOPEN_KEEP_CACHE	(1 << 1)
@@ -425,6 +436,10 @@ struct fuse_file_lock {
  * FUSE_HAS_RESEND: kernel supports resending pending requests, and the high bit
  *		    of the request ID indicates resend requests
  * FUSE_ALLOW_IDMAP: allow creation of idmapped mounts
+ * FUSE_OVER_IO_URING: Indicate that client supports io-uring
+ * FUSE_PASSTHROUGH_META: passthrough readdir for directories opened with
+ *			  FOPEN_PASSTHROUGH, and getattr for inodes with a
+ *			  backing file (requires FUSE_PASSTHROUGH)
  */
 #define FUSE_ASYNC_READ		(1 << 0)
 #define FUSE_POSIX_LOCKS	(1 << 1)
@@ -471,6 +486,8 @@ struct fuse_file_lock {
 /* Obsolete alias for FUSE_DIRECT_IO_ALLOW_MMAP */
 #define FUSE_DIRECT_IO_RELAX	FUSE_DIRECT_IO_ALLOW_MMAP
 #define FUSE_ALLOW_IDMAP	(1ULL << 40)
+#define FUSE_OVER_IO_URING	(1ULL << 41)
+#define FUSE_PASSTHROUGH_META	(1ULL << 42)
 
 /**
  * CUSE INIT request/reply flags
@@ -1099,12 +1116,24 @@ struct fuse_backing_map {
 	uint64_t	padding;
 };
 
+/*
+ * Take the attributes of an inode from a backing file.  A backing_id of 0
+ * detaches the inode from its backing file again.
+ */
+struct fuse_backing_attach {
+	uint64_t	nodeid;
+	int32_t		backing_id;
+	uint32_t	flags;
+};
+
 /* Device ioctls: */
 #define FUSE_DEV_IOC_MAGIC		229
 #define FUSE_DEV_IOC_CLONE		_IOR(FUSE_DEV_IOC_MAGIC, 0, uint32_t)
 #define FUSE_DEV_IOC_BACKING_OPEN	_IOW(FUSE_DEV_IOC_MAGIC, 1, \
 					     struct fuse_backing_map)
 #define FUSE_DEV_IOC_BACKING_CLOSE	_IOW(FUSE_DEV_IOC_MAGIC, 2, uint32_t)
+#define FUSE_DEV_IOC_BACKING_ATTACH	_IOW(FUSE_DEV_IOC_MAGIC, 3, \
+					     struct fuse_backing_attach)
 
 struct fuse_lseek_in {
 	uint64_t	fh;
@@ -1206,4 +1235,37 @@ struct fuse_supp_groups {
 	uint32_t	groups[];
 };
 
+/**
+ * enum fuse_uring_cmd - io_uring commands on /dev/fuse (sqe->cmd_op)
+ *
+ * @FUSE_URING_CMD_REGISTER: register a buffer on a queue and wait for a
+ *			     request
+ * @FUSE_URING_CMD_COMMIT_AND_FETCH: send the reply found in the buffer and
+ *				     wait for the next request
+ *
+ * The buffer is passed in sqe->addr and sqe->len, and has to hold at least
+ * as much as a read() on /dev/fuse.  Requests and replies use the same
+ * layout in the buffer as read() and write() on /dev/fuse, and cqe->res is
+ * the length of the request.
+ */
+enum fuse_uring_cmd {
+	FUSE_URING_CMD_INVALID = 0,
+	FUSE_URING_CMD_REGISTER = 1,
+	FUSE_URING_CMD_COMMIT_AND_FETCH = 2,
+};
+
+/**
+ * struct fuse_uring_cmd_req - command data in sqe->cmd
+ * @commit_id: unique ID of the request the reply is for, for
+ *	       FUSE_URING_CMD_COMMIT_AND_FETCH
+ * @qid: queue of the command, queues are per CPU
+ * @flags: must be zero
+ */
+struct fuse_uring_cmd_req {
+	uint64_t	commit_id;
+	uint16_t	qid;
+	uint16_t	flags;
+	uint32_t	padding;
+};
+
 #endif /* _LINUX_FUSE_H */
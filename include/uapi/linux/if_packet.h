@@ -60,6 +60,7 @@ struct sockaddr_ll {
 #define PACKET_FANOUT_DATA		22
 #define PACKET_IGNORE_OUTGOING		23
 #define PACKET_VNET_HDR_SZ		24
+#define PACKET_TX_BATCH			25
 
 #define PACKET_FANOUT_HASH		0
 #define PACKET_FANOUT_LB		1
@@ -2069,6 +2069,8 @@ void init_cgroup_root(struct cgroup_fs_context *ctx)
 
 	INIT_LIST_HEAD_RCU(&root->root_list);
 	atomic_set(&root->nr_cgrps, 1);
+	spin_lock_init(&root->rstat_lock);
+	init_waitqueue_head(&root->rstat_waitq);
 	cgrp->root = root;
 	init_cgroup_housekeeping(cgrp);
 
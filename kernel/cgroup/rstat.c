@@ -9,7 +9,6 @@
 
 #include <trace/events/cgroup.h>
 
-static DEFINE_SPINLOCK(cgroup_rstat_lock);
 static DEFINE_PER_CPU(raw_spinlock_t, cgroup_rstat_cpu_lock);
 
 static void cgroup_base_stat_flush(struct cgroup *cgrp, int cpu);
@@ -35,12 +34,13 @@ unsigned long _cgroup_rstat_cpu_lock(raw_spinlock_t *cpu_lock, int cpu,
 	bool contended;
 
 	/*
-	 * The _irqsave() is needed because cgroup_rstat_lock is
-	 * spinlock_t which is a sleeping lock on PREEMPT_RT. Acquiring
-	 * this lock with the _irq() suffix only disables interrupts on
-	 * a non-PREEMPT_RT kernel. The raw_spinlock_t below disables
-	 * interrupts on both configurations. The _irqsave() ensures
-	 * that interrupts are always disabled and later restored.
+	 * The _irqsave() is needed because the updated lists are modified
+	 * from cgroup_rstat_updated() which can be called with interrupts
+	 * either enabled or disabled, while flushers walk them with
+	 * interrupts enabled. The raw_spinlock_t below disables interrupts
+	 * on both PREEMPT_RT and non-PREEMPT_RT configurations. The
+	 * _irqsave() ensures that interrupts are always disabled and later
+	 * restored.
 	 */
 	contended = !raw_spin_trylock_irqsave(cpu_lock, flags);
 	if (contended) {
@@ -207,6 +207,16 @@ static struct cgroup *cgroup_rstat_updated_list(struct cgroup *root, int cpu)
 	struct cgroup *head = NULL, *parent, *child;
 	unsigned long flags;
 
+	/*
+	 * Skip CPUs on which nothing in the subtree was updated without
+	 * touching their cgroup_rstat_cpu_lock, so that concurrent flushes of
+	 * unrelated subtrees don't bounce the locks of every CPU. An update
+	 * racing with this test isn't guaranteed to be visible to the flush
+	 * anyway.
+	 */
+	if (!data_race(rstatc->updated_next))
+		return NULL;
+
 	flags = _cgroup_rstat_cpu_lock(cpu_lock, cpu, root, false);
 
 	/* Return NULL if this subtree is not on-list */
@@ -271,65 +281,186 @@ __weak noinline void bpf_rstat_flush(struct cgroup *cgrp,
 __bpf_hook_end();
 
 /*
- * Helper functions for locking cgroup_rstat_lock.
+ * rstat flush ownership.
+ *
+ * Flushing @cgrp's subtree writes the stats of every cgroup in the subtree and
+ * propagates @cgrp's stats into its parent. Instead of serializing all flushes
+ * of a hierarchy behind one lock, a flush takes exclusive ownership of the
+ * subtree it flushes. Flushes of disjoint subtrees, e.g. different containers
+ * reading their own stat files, run concurrently, including their per-CPU
+ * updated-tree walks. Only the propagation into the parent of the flushed
+ * subtree, which may be shared with concurrently flushed siblings, is
+ * serialized with the parent's ->rstat_prop_lock.
+ *
+ * A flush of @cgrp conflicts with flushes of its ancestors and descendants.
+ * The ownership state is kept in the cgroups and protected by the
+ * hierarchy's ->rstat_lock which is only held for the bookkeeping. Conflicting
+ * flushers sleep on the hierarchy's ->rstat_waitq. Waiting ancestors block new
+ * descendant flushes so that they can't be starved.
+ *
+ * Each flush is assigned a sequence number when it takes ownership and
+ * records it in its target cgroup on completion. A flusher which had to wait
+ * can skip its own walk if a flush of itself or an ancestor started after it
+ * arrived, as that flush has already collected every update that preceded the
+ * request.
+ */
+
+/* test whether a flush covering @cgrp started after @seq was sampled */
+static bool cgroup_rstat_flushed_since(struct cgroup *cgrp, u64 seq)
+{
+	for (; cgrp; cgrp = cgroup_parent(cgrp))
+		if (cgrp->rstat_flushed_seq > seq)
+			return true;
+	return false;
+}
+
+static bool cgroup_rstat_try_own(struct cgroup *cgrp)
+{
+	struct cgroup *pos;
+
+	lockdep_assert_held(&cgrp->root->rstat_lock);
+
+	/* @cgrp or one of its descendants is being flushed */
+	if (cgrp->rstat_flush_busy)
+		return false;
+
+	/* an ancestor is being flushed or waiting to be */
+	for (pos = cgroup_parent(cgrp); pos; pos = cgroup_parent(pos))
+		if (pos->rstat_flush_owned || pos->rstat_flush_waiters)
+			return false;
+
+	cgrp->rstat_flush_owned = true;
+	for (pos = cgrp; pos; pos = cgroup_parent(pos))
+		pos->rstat_flush_busy++;
+	return true;
+}
+
+/*
+ * Helper functions for acquiring and releasing rstat flush ownership.
  *
  * This makes it easier to diagnose locking issues and contention in
- * production environments.  The parameter @cpu_in_loop indicate lock
- * was released and re-taken when collection data from the CPUs. The
- * value -1 is used when obtaining the main lock else this is the CPU
- * number processed last.
+ * production environments. The cgroup_rstat_lock_contended tracepoint fires
+ * only when a flush has to wait for an overlapping flush.
+ *
+ * __cgroup_rstat_lock() returns %true if the caller must flush @cgrp's subtree
+ * and %false if a concurrent flush already did. On %true return or if @hold
+ * is set, @cgrp's subtree is owned by the caller and must be released with
+ * __cgroup_rstat_unlock().
  */
-static inline void __cgroup_rstat_lock(struct cgroup *cgrp, int cpu_in_loop)
-	__acquires(&cgroup_rstat_lock)
+static bool __cgroup_rstat_lock(struct cgroup *cgrp, bool hold)
 {
-	bool contended;
+	struct cgroup_root *root = cgrp->root;
+	bool contended = false, flushed = false, owned;
+	DEFINE_WAIT(wait);
+	u64 seq;
 
-	contended = !spin_trylock_irq(&cgroup_rstat_lock);
-	if (contended) {
-		trace_cgroup_rstat_lock_contended(cgrp, cpu_in_loop, contended);
-		spin_lock_irq(&cgroup_rstat_lock);
+	spin_lock(&root->rstat_lock);
+	seq = root->rstat_flush_seq;
+
+	while (true) {
+		if (contended && cgroup_rstat_flushed_since(cgrp, seq))
+			flushed = true;
+		if (flushed && !hold) {
+			owned = false;
+			break;
+		}
+		owned = cgroup_rstat_try_own(cgrp);
+		if (owned)
+			break;
+
+		if (!contended) {
+			trace_cgroup_rstat_lock_contended(cgrp, -1, true);
+			cgrp->rstat_flush_waiters++;
+			contended = true;
+		}
+
+		prepare_to_wait(&root->rstat_waitq, &wait, TASK_UNINTERRUPTIBLE);
+		spin_unlock(&root->rstat_lock);
+		schedule();
+		finish_wait(&root->rstat_waitq, &wait);
+		spin_lock(&root->rstat_lock);
 	}
-	trace_cgroup_rstat_locked(cgrp, cpu_in_loop, contended);
+
+	if (contended)
+		cgrp->rstat_flush_waiters--;
+	if (owned)
+		cgrp->rstat_flush_seq = flushed ? 0 : ++root->rstat_flush_seq;
+
+	spin_unlock(&root->rstat_lock);
+
+	/* our waiter count may have been holding back descendant flushes */
+	if (contended && wq_has_sleeper(&root->rstat_waitq))
+		wake_up_all(&root->rstat_waitq);
+
+	if (owned)
+		trace_cgroup_rstat_locked(cgrp, -1, contended);
+	return !flushed;
 }
 
-static inline void __cgroup_rstat_unlock(struct cgroup *cgrp, int cpu_in_loop)
-	__releases(&cgroup_rstat_lock)
+static void __cgroup_rstat_unlock(struct cgroup *cgrp)
 {
-	trace_cgroup_rstat_unlock(cgrp, cpu_in_loop, false);
-	spin_unlock_irq(&cgroup_rstat_lock);
+	struct cgroup_root *root = cgrp->root;
+	struct cgroup *pos;
+
+	trace_cgroup_rstat_unlock(cgrp, -1, false);
+
+	spin_lock(&root->rstat_lock);
+
+	WARN_ON_ONCE(!cgrp->rstat_flush_owned);
+	cgrp->rstat_flush_owned = false;
+	for (pos = cgrp; pos; pos = cgroup_parent(pos))
+		pos->rstat_flush_busy--;
+
+	if (cgrp->rstat_flush_seq)
+		cgrp->rstat_flushed_seq = cgrp->rstat_flush_seq;
+
+	spin_unlock(&root->rstat_lock);
+
+	if (wq_has_sleeper(&root->rstat_waitq))
+		wake_up_all(&root->rstat_waitq);
+}
+
+static void cgroup_rstat_flush_one(struct cgroup *pos, int cpu)
+{
+	struct cgroup_subsys_state *css;
+
+	cgroup_base_stat_flush(pos, cpu);
+	bpf_rstat_flush(pos, cgroup_parent(pos), cpu);
+
+	rcu_read_lock();
+	list_for_each_entry_rcu(css, &pos->rstat_css_list, rstat_css_node)
+		css->ss->css_rstat_flush(css, cpu);
+	rcu_read_unlock();
 }
 
 /* see cgroup_rstat_flush() */
-static void cgroup_rstat_flush_locked(struct cgroup *cgrp)
-	__releases(&cgroup_rstat_lock) __acquires(&cgroup_rstat_lock)
+static void cgroup_rstat_flush_owned(struct cgroup *cgrp)
 {
+	struct cgroup *parent = cgroup_parent(cgrp);
 	int cpu;
 
-	lockdep_assert_held(&cgroup_rstat_lock);
+	WARN_ON_ONCE(!cgrp->rstat_flush_owned);
 
 	for_each_possible_cpu(cpu) {
 		struct cgroup *pos = cgroup_rstat_updated_list(cgrp, cpu);
 
 		for (; pos; pos = pos->rstat_flush_next) {
-			struct cgroup_subsys_state *css;
-
-			cgroup_base_stat_flush(pos, cpu);
-			bpf_rstat_flush(pos, cgroup_parent(pos), cpu);
-
-			rcu_read_lock();
-			list_for_each_entry_rcu(css, &pos->rstat_css_list,
-						rstat_css_node)
-				css->ss->css_rstat_flush(css, cpu);
-			rcu_read_unlock();
+			/*
+			 * @cgrp propagates into @parent which isn't owned by
+			 * us and can be updated concurrently by flushes of
+			 * @cgrp's siblings.
+			 */
+			if (pos == cgrp && parent) {
+				spin_lock(&parent->rstat_prop_lock);
+				cgroup_rstat_flush_one(pos, cpu);
+				spin_unlock(&parent->rstat_prop_lock);
+			} else {
+				cgroup_rstat_flush_one(pos, cpu);
+			}
 		}
 
 		/* play nice and yield if necessary */
-		if (need_resched() || spin_needbreak(&cgroup_rstat_lock)) {
-			__cgroup_rstat_unlock(cgrp, cpu);
-			if (!cond_resched())
-				cpu_relax();
-			__cgroup_rstat_lock(cgrp, cpu);
-		}
+		cond_resched();
 	}
 }
 
@@ -344,32 +475,38 @@ static void cgroup_rstat_flush_locked(struct cgroup *cgrp)
  * This also gets all cgroups in the subtree including @cgrp off the
  * ->updated_children lists.
  *
+ * Flushes of disjoint subtrees may run concurrently. If a flush of @cgrp or
+ * one of its ancestors which started after this call completes in the
+ * meantime, @cgrp's subtree isn't walked again.
+ *
  * This function may block.
  */
 __bpf_kfunc void cgroup_rstat_flush(struct cgroup *cgrp)
 {
 	might_sleep();
 
-	__cgroup_rstat_lock(cgrp, -1);
-	cgroup_rstat_flush_locked(cgrp);
-	__cgroup_rstat_unlock(cgrp, -1);
+	if (!__cgroup_rstat_lock(cgrp, false))
+		return;
+	cgroup_rstat_flush_owned(cgrp);
+	__cgroup_rstat_unlock(cgrp);
 }
 
 /**
  * cgroup_rstat_flush_hold - flush stats in @cgrp's subtree and hold
  * @cgrp: target cgroup
  *
- * Flush stats in @cgrp's subtree and prevent further flushes.  Must be
- * paired with cgroup_rstat_flush_release().
+ * Flush stats in @cgrp's subtree and prevent further flushes of the subtree,
+ * its ancestors and its descendants.  Must be paired with
+ * cgroup_rstat_flush_release().
  *
  * This function may block.
  */
 void cgroup_rstat_flush_hold(struct cgroup *cgrp)
-	__acquires(&cgroup_rstat_lock)
 {
 	might_sleep();
-	__cgroup_rstat_lock(cgrp, -1);
-	cgroup_rstat_flush_locked(cgrp);
+
+	if (__cgroup_rstat_lock(cgrp, true))
+		cgroup_rstat_flush_owned(cgrp);
 }
 
 /**
@@ -377,9 +514,8 @@ void cgroup_rstat_flush_hold(struct cgroup *cgrp)
  * @cgrp: cgroup used by tracepoint
  */
 void cgroup_rstat_flush_release(struct cgroup *cgrp)
-	__releases(&cgroup_rstat_lock)
 {
-	__cgroup_rstat_unlock(cgrp, -1);
+	__cgroup_rstat_unlock(cgrp);
 }
 
 int cgroup_rstat_init(struct cgroup *cgrp)
@@ -393,6 +529,8 @@ int cgroup_rstat_init(struct cgroup *cgrp)
 			return -ENOMEM;
 	}
 
+	spin_lock_init(&cgrp->rstat_prop_lock);
+
 	/* ->updated_children list is self terminated */
 	for_each_possible_cpu(cpu) {
 		struct cgroup_rstat_cpu *rstatc = cgroup_rstat_cpu(cgrp, cpu);
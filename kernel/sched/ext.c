@@ -7349,6 +7349,56 @@ __bpf_kfunc void scx_bpf_cpuperf_set(s32 cpu, u32 perf)
 	}
 }
 
+/**
+ * scx_bpf_asym_cpucapacity - Test whether CPU capacities are asymmetric
+ *
+ * Return %true if the CPUs in the system don't all have the same capacity,
+ * e.g. on big.LITTLE systems. When %false, scx_bpf_cpuperf_cap() returns the
+ * same value for all CPUs and capacity-aware placement can be skipped.
+ */
+__bpf_kfunc bool scx_bpf_asym_cpucapacity(void)
+{
+#ifdef CONFIG_SMP
+	return sched_asym_cpucap_active();
+#else
+	return false;
+#endif
+}
+
+/**
+ * scx_bpf_cpu_cluster_id - Query the cluster ID of a CPU
+ * @cpu: CPU of interest
+ *
+ * Return the topology cluster ID of @cpu. CPUs sharing a cluster usually share
+ * the same micro-architecture, capacity and frequency domain. Returns -1 if
+ * the architecture doesn't describe clusters, -%EINVAL if @cpu is invalid.
+ */
+__bpf_kfunc s32 scx_bpf_cpu_cluster_id(s32 cpu)
+{
+	if (!ops_cpu_valid(cpu, NULL))
+		return -EINVAL;
+
+	return topology_cluster_id(cpu);
+}
+
+/**
+ * scx_bpf_get_cluster_cpumask - Get a referenced kptr to the cluster cpumask
+ * of a CPU
+ * @cpu: CPU of interest
+ *
+ * Return the cpumask of the CPUs in the same topology cluster as @cpu. If the
+ * architecture doesn't describe clusters, the mask only contains @cpu. If @cpu
+ * is invalid, an empty cpumask is returned. Must be released with
+ * scx_bpf_put_cpumask().
+ */
+__bpf_kfunc const struct cpumask *scx_bpf_get_cluster_cpumask(s32 cpu)
+{
+	if (!ops_cpu_valid(cpu, NULL))
+		return cpu_none_mask;
+
+	return topology_cluster_cpumask(cpu);
+}
+
 /**
  * scx_bpf_nr_cpu_ids - Return the number of possible CPU IDs
  *
@@ -7376,7 +7426,7 @@ __bpf_kfunc const struct cpumask *scx_bpf_get_online_cpumask(void)
 }
 
 /**
- * scx_bpf_put_cpumask - Release a possible/online cpumask
+ * scx_bpf_put_cpumask - Release a possible/online/cluster cpumask
  * @cpumask: cpumask to release
  */
 __bpf_kfunc void scx_bpf_put_cpumask(const struct cpumask *cpumask)
@@ -7605,9 +7655,12 @@ BTF_ID_FLAGS(func, scx_bpf_dump_bstr, KF_TRUSTED_ARGS)
 BTF_ID_FLAGS(func, scx_bpf_cpuperf_cap)
 BTF_ID_FLAGS(func, scx_bpf_cpuperf_cur)
 BTF_ID_FLAGS(func, scx_bpf_cpuperf_set)
+BTF_ID_FLAGS(func, scx_bpf_asym_cpucapacity)
+BTF_ID_FLAGS(func, scx_bpf_cpu_cluster_id)
 BTF_ID_FLAGS(func, scx_bpf_nr_cpu_ids)
 BTF_ID_FLAGS(func, scx_bpf_get_possible_cpumask, KF_ACQUIRE)
 BTF_ID_FLAGS(func, scx_bpf_get_online_cpumask, KF_ACQUIRE)
+BTF_ID_FLAGS(func, scx_bpf_get_cluster_cpumask, KF_ACQUIRE)
 BTF_ID_FLAGS(func, scx_bpf_put_cpumask, KF_RELEASE)
 BTF_ID_FLAGS(func, scx_bpf_get_idle_cpumask, KF_ACQUIRE)
 BTF_ID_FLAGS(func, scx_bpf_get_idle_smtmask, KF_ACQUIRE)
@@ -135,6 +135,19 @@
  * This gives us an approximation of pressure that is practical
  * cost-wise, yet way more sensitive and accurate than periodic
  * sampling of the aggregate task states would be.
+ *
+ *			Deferred aggregation
+ *
+ * Every task state change is accounted in all of the task's
+ * ancestor cgroups, which gets expensive with deep hierarchies and
+ * high context switch rates. With psi_defer_levels=N, the groups in
+ * the top N levels of the hierarchy (the system group being level 0)
+ * are not updated from the scheduler hot paths. Instead, the change
+ * is appended to a small per-cpu log, and the log is replayed into
+ * those groups, in order and with the original timestamps, when one
+ * of them is sampled, when a trigger needs them or when the log is
+ * full. Pressure is thus exactly what it would be with immediate
+ * aggregation, only folded in batches.
  */
 
 static int psi_bug __read_mostly;
@@ -172,6 +185,54 @@ struct psi_group psi_system = {
 	.pcpu = &system_group_pcpu,
 };
 
+/* Deferred aggregation of the upper levels of the hierarchy */
+static DEFINE_STATIC_KEY_FALSE(psi_defer_enabled);
+static unsigned int psi_defer_levels __read_mostly;
+
+static int __init setup_psi_defer_levels(char *str)
+{
+	return kstrtouint(str, 0, &psi_defer_levels) == 0;
+}
+__setup("psi_defer_levels=", setup_psi_defer_levels);
+
+#define PSI_DEFER_EVENTS	32
+
+/* psi_defer_event flags */
+#define PSI_DEFER_WAKE_CLOCK	(1 << 0)
+#define PSI_DEFER_MEMSTALL	(1 << 1)	/* cpu_curr() was in_memstall */
+#define PSI_DEFER_IRQ		(1 << 2)	/* IRQ time, not a task change */
+
+struct psi_defer_event {
+	/* Groups from @group up to, but excluding, @stop change */
+	struct psi_group *group;
+	struct psi_group *stop;
+	u64 now;
+	u32 irq;
+	u8 clear;
+	u8 set;
+	u8 flags;
+};
+
+struct psi_defer_cpu {
+	/* Nests inside the rq lock of the CPU */
+	raw_spinlock_t lock;
+	unsigned int nr;
+	struct psi_defer_event events[PSI_DEFER_EVENTS];
+};
+
+static DEFINE_PER_CPU(struct psi_defer_cpu, psi_defer_pcpu);
+
+/* RT polling triggers on deferred groups, which disable batching */
+static atomic_t psi_defer_rtpoll = ATOMIC_INIT(0);
+
+static inline bool psi_group_deferred(struct psi_group *group)
+{
+	return static_branch_unlikely(&psi_defer_enabled) &&
+		group->depth < psi_defer_levels;
+}
+
+static void psi_defer_drain(struct psi_defer_cpu *dc, int cpu);
+
 static void psi_avgs_work(struct work_struct *work);
 
 static void poll_timer_fn(struct timer_list *t);
@@ -216,6 +277,14 @@ void __init psi_init(void)
 
 	psi_period = jiffies_to_nsecs(PSI_FREQ);
 	group_init(&psi_system);
+
+	if (psi_defer_levels) {
+		int cpu;
+
+		for_each_possible_cpu(cpu)
+			raw_spin_lock_init(&per_cpu_ptr(&psi_defer_pcpu, cpu)->lock);
+		static_branch_enable(&psi_defer_enabled);
+	}
 }
 
 static u32 test_states(unsigned int *tasks, u32 state_mask)
@@ -253,6 +322,8 @@ static void get_recent_times(struct psi_group *group, int cpu,
 	struct psi_group_cpu *groupc = per_cpu_ptr(group->pcpu, cpu);
 	int current_cpu = raw_smp_processor_id();
 	unsigned int tasks[NR_PSI_TASK_COUNTS];
+	struct psi_defer_cpu *dc = NULL;
+	unsigned long flags;
 	u64 now, state_start;
 	enum psi_states s;
 	unsigned int seq;
@@ -260,6 +331,17 @@ static void get_recent_times(struct psi_group *group, int cpu,
 
 	*pchanged_states = 0;
 
+	/*
+	 * A deferred group is only current once the CPU's log has been
+	 * replayed. Keep the log locked while sampling so that no change
+	 * older than our @now can be logged behind our back.
+	 */
+	if (psi_group_deferred(group)) {
+		dc = per_cpu_ptr(&psi_defer_pcpu, cpu);
+		raw_spin_lock_irqsave(&dc->lock, flags);
+		psi_defer_drain(dc, cpu);
+	}
+
 	/* Snapshot a coherent view of the CPU state */
 	do {
 		seq = read_seqcount_begin(&groupc->seq);
@@ -271,6 +353,9 @@ static void get_recent_times(struct psi_group *group, int cpu,
 			memcpy(tasks, groupc->tasks, sizeof(groupc->tasks));
 	} while (read_seqcount_retry(&groupc->seq, seq));
 
+	if (dc)
+		raw_spin_unlock_irqrestore(&dc->lock, flags);
+
 	/* Calculate state time deltas against the previous snapshot */
 	for (s = 0; s < NR_PSI_STATES; s++) {
 		u32 delta;
@@ -768,29 +853,18 @@ static void record_times(struct psi_group_cpu *groupc, u64 now)
 		groupc->times[PSI_NONIDLE] += delta;
 }
 
-static void psi_group_change(struct psi_group *group, int cpu,
-			     unsigned int clear, unsigned int set,
-			     bool wake_clock)
+/*
+ * Apply a task state change to @group's @groupc at @now. Must be called
+ * inside @groupc's seqcount write section. Returns whether @group is
+ * enabled, i.e. whether its aggregators need to be kicked.
+ */
+static bool __psi_group_change(struct psi_group *group,
+			       struct psi_group_cpu *groupc, int cpu,
+			       unsigned int clear, unsigned int set, u64 now,
+			       bool memstall)
 {
-	struct psi_group_cpu *groupc;
 	unsigned int t, m;
 	u32 state_mask;
-	u64 now;
-
-	lockdep_assert_rq_held(cpu_rq(cpu));
-	groupc = per_cpu_ptr(group->pcpu, cpu);
-
-	/*
-	 * First we update the task counts according to the state
-	 * change requested through the @clear and @set bits.
-	 *
-	 * Then if the cgroup PSI stats accounting enabled, we
-	 * assess the aggregate resource states this CPU's tasks
-	 * have been in since the last change, and account any
-	 * SOME and FULL time these may have resulted in.
-	 */
-	write_seqcount_begin(&groupc->seq);
-	now = cpu_clock(cpu);
 
 	/*
 	 * Start with TSK_ONCPU, which doesn't have a corresponding
@@ -842,9 +916,7 @@ static void psi_group_change(struct psi_group *group, int cpu,
 			record_times(groupc, now);
 
 		groupc->state_mask = state_mask;
-
-		write_seqcount_end(&groupc->seq);
-		return;
+		return false;
 	}
 
 	state_mask = test_states(groupc->tasks, state_mask);
@@ -857,15 +929,18 @@ static void psi_group_change(struct psi_group *group, int cpu,
 	 * task in a cgroup is in_memstall, the corresponding groupc
 	 * on that cpu is in PSI_MEM_FULL state.
 	 */
-	if (unlikely((state_mask & PSI_ONCPU) && cpu_curr(cpu)->in_memstall))
+	if (unlikely((state_mask & PSI_ONCPU) && memstall))
 		state_mask |= (1 << PSI_MEM_FULL);
 
 	record_times(groupc, now);
 
 	groupc->state_mask = state_mask;
+	return true;
+}
 
-	write_seqcount_end(&groupc->seq);
-
+static void psi_group_change_notify(struct psi_group *group, u32 state_mask,
+				    bool wake_clock)
+{
 	if (state_mask & group->rtpoll_states)
 		psi_schedule_rtpoll_work(group, 1, false);
 
@@ -873,6 +948,169 @@ static void psi_group_change(struct psi_group *group, int cpu,
 		schedule_delayed_work(&group->avgs_work, PSI_FREQ);
 }
 
+static void psi_group_change(struct psi_group *group, int cpu,
+			     unsigned int clear, unsigned int set,
+			     bool wake_clock)
+{
+	struct psi_group_cpu *groupc;
+	bool enabled;
+	u64 now;
+
+	lockdep_assert_rq_held(cpu_rq(cpu));
+	groupc = per_cpu_ptr(group->pcpu, cpu);
+
+	/*
+	 * First we update the task counts according to the state
+	 * change requested through the @clear and @set bits.
+	 *
+	 * Then if the cgroup PSI stats accounting enabled, we
+	 * assess the aggregate resource states this CPU's tasks
+	 * have been in since the last change, and account any
+	 * SOME and FULL time these may have resulted in.
+	 */
+	write_seqcount_begin(&groupc->seq);
+	now = cpu_clock(cpu);
+	enabled = __psi_group_change(group, groupc, cpu, clear, set, now,
+				     cpu_curr(cpu)->in_memstall);
+	write_seqcount_end(&groupc->seq);
+
+	if (enabled)
+		psi_group_change_notify(group, groupc->state_mask, wake_clock);
+}
+
+#ifdef CONFIG_IRQ_TIME_ACCOUNTING
+static bool __psi_account_irqtime(struct psi_group *group,
+				  struct psi_group_cpu *groupc, u64 now,
+				  u32 delta)
+{
+	if (!group->enabled)
+		return false;
+
+	record_times(groupc, now);
+	groupc->times[PSI_IRQ_FULL] += delta;
+	return true;
+}
+
+static void psi_account_irqtime_notify(struct psi_group *group)
+{
+	if (group->rtpoll_states & (1 << PSI_IRQ_FULL))
+		psi_schedule_rtpoll_work(group, 1, false);
+}
+#endif
+
+/* Apply a logged change to the deferred groups it covers */
+static void psi_defer_replay(struct psi_defer_event *ev, int cpu)
+{
+	bool wake_clock = ev->flags & PSI_DEFER_WAKE_CLOCK;
+	struct psi_group *group;
+
+	for (group = ev->group; group != ev->stop; group = group->parent) {
+		struct psi_group_cpu *groupc = per_cpu_ptr(group->pcpu, cpu);
+		bool enabled;
+
+		write_seqcount_begin(&groupc->seq);
+#ifdef CONFIG_IRQ_TIME_ACCOUNTING
+		if (ev->flags & PSI_DEFER_IRQ) {
+			enabled = __psi_account_irqtime(group, groupc, ev->now,
+							ev->irq);
+			write_seqcount_end(&groupc->seq);
+			if (enabled)
+				psi_account_irqtime_notify(group);
+			continue;
+		}
+#endif
+		enabled = __psi_group_change(group, groupc, cpu, ev->clear,
+					     ev->set, ev->now,
+					     ev->flags & PSI_DEFER_MEMSTALL);
+		write_seqcount_end(&groupc->seq);
+
+		if (enabled)
+			psi_group_change_notify(group, groupc->state_mask,
+						wake_clock);
+	}
+}
+
+static void psi_defer_drain(struct psi_defer_cpu *dc, int cpu)
+{
+	unsigned int i;
+
+	lockdep_assert_held(&dc->lock);
+
+	for (i = 0; i < dc->nr; i++)
+		psi_defer_replay(&dc->events[i], cpu);
+	dc->nr = 0;
+}
+
+/*
+ * Log a change of the deferred groups from @group up to, but excluding,
+ * @stop on @cpu. The groups are brought up to date by psi_defer_drain().
+ */
+static void psi_defer_change(struct psi_group *group, struct psi_group *stop,
+			     int cpu, unsigned int clear, unsigned int set,
+			     u32 irq, unsigned int flags)
+{
+	struct psi_defer_cpu *dc = per_cpu_ptr(&psi_defer_pcpu, cpu);
+	struct psi_defer_event *ev;
+
+	lockdep_assert_rq_held(cpu_rq(cpu));
+
+	if (group == stop)
+		return;
+
+	if (cpu_curr(cpu)->in_memstall)
+		flags |= PSI_DEFER_MEMSTALL;
+
+	raw_spin_lock(&dc->lock);
+
+	ev = &dc->events[dc->nr++];
+	ev->group = group;
+	ev->stop = stop;
+	ev->now = cpu_clock(cpu);
+	ev->irq = irq;
+	ev->clear = clear;
+	ev->set = set;
+	ev->flags = flags;
+
+	/*
+	 * RT polling triggers need to hear about state changes right
+	 * away, so don't batch while any deferred group has them.
+	 */
+	if (dc->nr == PSI_DEFER_EVENTS || atomic_read(&psi_defer_rtpoll)) {
+		psi_defer_drain(dc, cpu);
+	} else if (dc->nr == 1 && (flags & PSI_DEFER_WAKE_CLOCK)) {
+		/*
+		 * The log is drained by the averaging work of the deferred
+		 * groups. Make sure it runs, as psi_group_change() would.
+		 */
+		for (; group != stop; group = group->parent)
+			if (group->enabled &&
+			    !delayed_work_pending(&group->avgs_work))
+				schedule_delayed_work(&group->avgs_work, PSI_FREQ);
+	}
+
+	raw_spin_unlock(&dc->lock);
+}
+
+/*
+ * Apply a change to the groups from @group up to, but excluding, @stop.
+ * Deferred groups are always the uppermost ones, so the first one found
+ * ends the walk.
+ */
+static void psi_group_change_path(struct psi_group *group,
+				  struct psi_group *stop, int cpu,
+				  unsigned int clear, unsigned int set,
+				  bool wake_clock)
+{
+	for (; group != stop; group = group->parent) {
+		if (psi_group_deferred(group)) {
+			psi_defer_change(group, stop, cpu, clear, set, 0,
+					 wake_clock ? PSI_DEFER_WAKE_CLOCK : 0);
+			return;
+		}
+		psi_group_change(group, cpu, clear, set, wake_clock);
+	}
+}
+
 static inline struct psi_group *task_psi_group(struct task_struct *task)
 {
 #ifdef CONFIG_CGROUPS
@@ -882,6 +1120,32 @@ static inline struct psi_group *task_psi_group(struct task_struct *task)
 	return &psi_system;
 }
 
+/*
+ * The state_mask of a deferred group may lag behind. Determine the first
+ * of @group and its ancestors that has TSK_ONCPU set on @prev's CPU from the
+ * hierarchy instead: those are @prev's groups.
+ */
+static struct psi_group *psi_common_ancestor(struct psi_group *group,
+					     struct task_struct *prev)
+{
+	struct psi_group *prev_group;
+
+	if (!prev->pid)
+		return NULL;
+
+	prev_group = task_psi_group(prev);
+	while (prev_group->depth > group->depth)
+		prev_group = prev_group->parent;
+	while (group->depth > prev_group->depth)
+		group = group->parent;
+	while (group != prev_group) {
+		group = group->parent;
+		prev_group = prev_group->parent;
+	}
+
+	return group;
+}
+
 static void psi_flags_change(struct task_struct *task, int clear, int set)
 {
 	if (((task->psi_flags & set) ||
@@ -900,17 +1164,13 @@ static void psi_flags_change(struct task_struct *task, int clear, int set)
 void psi_task_change(struct task_struct *task, int clear, int set)
 {
 	int cpu = task_cpu(task);
-	struct psi_group *group;
 
 	if (!task->pid)
 		return;
 
 	psi_flags_change(task, clear, set);
 
-	group = task_psi_group(task);
-	do {
-		psi_group_change(group, cpu, clear, set, true);
-	} while ((group = group->parent));
+	psi_group_change_path(task_psi_group(task), NULL, cpu, clear, set, true);
 }
 
 void psi_task_switch(struct task_struct *prev, struct task_struct *next,
@@ -928,6 +1188,14 @@ void psi_task_switch(struct task_struct *prev, struct task_struct *next,
 		 */
 		group = task_psi_group(next);
 		do {
+			if (psi_group_deferred(group)) {
+				common = psi_common_ancestor(group, prev);
+				psi_defer_change(group, common, cpu,
+						 0, TSK_ONCPU, 0,
+						 PSI_DEFER_WAKE_CLOCK);
+				break;
+			}
+
 			if (per_cpu_ptr(group->pcpu, cpu)->state_mask &
 			    PSI_ONCPU) {
 				common = group;
@@ -968,12 +1236,8 @@ void psi_task_switch(struct task_struct *prev, struct task_struct *next,
 
 		psi_flags_change(prev, clear, set);
 
-		group = task_psi_group(prev);
-		do {
-			if (group == common)
-				break;
-			psi_group_change(group, cpu, clear, set, wake_clock);
-		} while ((group = group->parent));
+		psi_group_change_path(task_psi_group(prev), common, cpu,
+				      clear, set, wake_clock);
 
 		/*
 		 * TSK_ONCPU is handled up to the common ancestor. If there are
@@ -983,8 +1247,8 @@ void psi_task_switch(struct task_struct *prev, struct task_struct *next,
 		 */
 		if ((prev->psi_flags ^ next->psi_flags) & ~TSK_ONCPU) {
 			clear &= ~TSK_ONCPU;
-			for (; group; group = group->parent)
-				psi_group_change(group, cpu, clear, set, wake_clock);
+			psi_group_change_path(common, NULL, cpu, clear, set,
+					      wake_clock);
 		}
 	}
 }
@@ -1016,23 +1280,23 @@ void psi_account_irqtime(struct rq *rq, struct task_struct *curr, struct task_st
 	rq->psi_irq_time = irq;
 
 	do {
-		u64 now;
+		bool enabled;
 
-		if (!group->enabled)
-			continue;
+		if (psi_group_deferred(group)) {
+			psi_defer_change(group, NULL, cpu, 0, 0, delta,
+					 PSI_DEFER_IRQ);
+			break;
+		}
 
 		groupc = per_cpu_ptr(group->pcpu, cpu);
 
 		write_seqcount_begin(&groupc->seq);
-		now = cpu_clock(cpu);
-
-		record_times(groupc, now);
-		groupc->times[PSI_IRQ_FULL] += delta;
-
+		enabled = __psi_account_irqtime(group, groupc, cpu_clock(cpu),
+						delta);
 		write_seqcount_end(&groupc->seq);
 
-		if (group->rtpoll_states & (1 << PSI_IRQ_FULL))
-			psi_schedule_rtpoll_work(group, 1, false);
+		if (enabled)
+			psi_account_irqtime_notify(group);
 	} while ((group = group->parent));
 }
 #endif
@@ -1116,6 +1380,7 @@ int psi_cgroup_alloc(struct cgroup *cgroup)
 	}
 	group_init(cgroup->psi);
 	cgroup->psi->parent = cgroup_psi(cgroup_parent(cgroup));
+	cgroup->psi->depth = cgroup->level;
 	return 0;
 }
 
@@ -1124,6 +1389,19 @@ void psi_cgroup_free(struct cgroup *cgroup)
 	if (!static_branch_likely(&psi_cgroups_enabled))
 		return;
 
+	/* Logged changes may still point to the group */
+	if (psi_group_deferred(cgroup->psi)) {
+		int cpu;
+
+		for_each_possible_cpu(cpu) {
+			struct psi_defer_cpu *dc = per_cpu_ptr(&psi_defer_pcpu, cpu);
+
+			raw_spin_lock_irq(&dc->lock);
+			psi_defer_drain(dc, cpu);
+			raw_spin_unlock_irq(&dc->lock);
+		}
+	}
+
 	cancel_delayed_work_sync(&cgroup->psi->avgs_work);
 	free_percpu(cgroup->psi->pcpu);
 	/* All triggers must be removed by now */
@@ -1225,7 +1503,11 @@ void psi_cgroup_restart(struct psi_group *group)
 		struct rq_flags rf;
 
 		rq_lock_irq(rq, &rf);
-		psi_group_change(group, cpu, 0, 0, true);
+		if (psi_group_deferred(group))
+			psi_defer_change(group, group->parent, cpu, 0, 0, 0,
+					 PSI_DEFER_WAKE_CLOCK);
+		else
+			psi_group_change(group, cpu, 0, 0, true);
 		rq_unlock_irq(rq, &rf);
 	}
 }
@@ -1365,6 +1647,8 @@ struct psi_trigger *psi_trigger_create(struct psi_group *group, char *buf,
 			div_u64(t->win.size, UPDATES_PER_WINDOW));
 		group->rtpoll_nr_triggers[t->state]++;
 		group->rtpoll_states |= (1 << t->state);
+		if (psi_group_deferred(group))
+			atomic_inc(&psi_defer_rtpoll);
 
 		mutex_unlock(&group->rtpoll_trigger_lock);
 	} else {
@@ -1416,6 +1700,8 @@ void psi_trigger_destroy(struct psi_trigger *t)
 
 			list_del(&t->node);
 			group->rtpoll_nr_triggers[t->state]--;
+			if (psi_group_deferred(group))
+				atomic_dec(&psi_defer_rtpoll);
 			if (!group->rtpoll_nr_triggers[t->state])
 				group->rtpoll_states &= ~(1 << t->state);
 			/*
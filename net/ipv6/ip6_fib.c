@@ -37,6 +37,8 @@
 #include <net/ip6_fib.h>
 #include <net/ip6_route.h>
 
+#include "ip6_fib_index.h"
+
 static struct kmem_cache *fib6_node_kmem __read_mostly;
 
 struct fib6_cleaner {
@@ -1262,6 +1264,8 @@ static int fib6_add_rt2node(struct fib6_node *fn, struct fib6_info *rt,
 		if (!(fn->fn_flags & RTN_RTINFO)) {
 			info->nl_net->ipv6.rt6_stats->fib_route_nodes++;
 			fn->fn_flags |= RTN_RTINFO;
+			fib6_idx_update(info->nl_net, rt->fib6_table,
+					&rt->fib6_dst, true);
 		}
 
 	} else {
@@ -1291,6 +1295,8 @@ static int fib6_add_rt2node(struct fib6_node *fn, struct fib6_info *rt,
 		if (!(fn->fn_flags & RTN_RTINFO)) {
 			info->nl_net->ipv6.rt6_stats->fib_route_nodes++;
 			fn->fn_flags |= RTN_RTINFO;
+			fib6_idx_update(info->nl_net, rt->fib6_table,
+					&rt->fib6_dst, true);
 		}
 		nsiblings = iter->fib6_nsiblings;
 		iter->fib6_node = NULL;
@@ -1988,6 +1994,7 @@ static void fib6_del_route(struct fib6_table *table, struct fib6_node *fn,
 		if (!(fn->fn_flags & RTN_TL_ROOT)) {
 			fn->fn_flags &= ~RTN_RTINFO;
 			net->ipv6.rt6_stats->fib_route_nodes--;
+			fib6_idx_update(net, table, &rt->fib6_dst, false);
 		}
 		fn = fib6_repair_tree(net, table, fn);
 	}
@@ -2479,6 +2486,7 @@ static void fib6_net_exit(struct net *net)
 
 		hlist_for_each_entry_safe(tb, tmp, head, tb6_hlist) {
 			hlist_del(&tb->tb6_hlist);
+			fib6_idx_table_free(net, tb);
 			fib6_free_table(tb);
 		}
 	}
@@ -2508,10 +2516,14 @@ int __init fib6_init(void)
 	if (!fib6_node_kmem)
 		goto out;
 
-	ret = register_pernet_subsys(&fib6_net_ops);
+	ret = fib6_idx_init();
 	if (ret)
 		goto out_kmem_cache_create;
 
+	ret = register_pernet_subsys(&fib6_net_ops);
+	if (ret)
+		goto out_idx_exit;
+
 	ret = rtnl_register_many(fib6_rtnl_msg_handlers);
 	if (ret)
 		goto out_unregister_subsys;
@@ -2522,6 +2534,8 @@ int __init fib6_init(void)
 
 out_unregister_subsys:
 	unregister_pernet_subsys(&fib6_net_ops);
+out_idx_exit:
+	fib6_idx_exit();
 out_kmem_cache_create:
 	kmem_cache_destroy(fib6_node_kmem);
 	goto out;
@@ -2530,6 +2544,7 @@ int __init fib6_init(void)
 void fib6_gc_cleanup(void)
 {
 	unregister_pernet_subsys(&fib6_net_ops);
+	fib6_idx_exit();
 	kmem_cache_destroy(fib6_node_kmem);
 }
 
@@ -0,0 +1,756 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ *	Linux INET6 implementation
+ *	Compressed multibit lookup index of the FIB
+ *
+ *	fib6_node_lookup() descends the radix tree of a table one branching
+ *	bit at a time, which for a full table means a long chain of dependent
+ *	loads per packet. Large tables get a read-mostly index, built from the
+ *	tree, which resolves a destination to the very fib6_node the tree
+ *	lookup would have returned in a handful of loads:
+ *
+ *	- the first 16 bits of the address pick one of 65536 top slots;
+ *	- below that, nodes consume 6 bits each. A node only stores the
+ *	  entries leading to a child, plus one result per run of equal
+ *	  results, located by counting bits in two 64 bit vectors.
+ *
+ *	The tree stays authoritative. Any slot of the index may be NULL, in
+ *	which case the lookup falls back to the tree. Route changes, which
+ *	run under tb6_lock, NULL the part of the index that covers the
+ *	changed prefix and leave it to a work item to rebuild it. The work
+ *	builds each top slot anew from the tree under RCU, without tb6_lock,
+ *	and only publishes it if no route change marked the slot dirty again
+ *	in the meantime. Readers only ever see complete nodes, replaced ones
+ *	are freed after a grace period.
+ *
+ *	The index ignores source addresses, it is not used while routes with
+ *	a source prefix exist in the namespace.
+ */
+
+#define pr_fmt(fmt) "IPv6: " fmt
+
+#include <linux/bitmap.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/sysctl.h>
+#include <linux/unaligned.h>
+#include <linux/workqueue.h>
+#include <linux/xarray.h>
+
+#include <net/ipv6.h>
+#include <net/net_namespace.h>
+#include <net/netns/generic.h>
+
+#include "ip6_fib_index.h"
+
+#define FIB6_IDX_TOP_BITS	16
+#define FIB6_IDX_SLOTS		(1U << FIB6_IDX_TOP_BITS)
+#define FIB6_IDX_STRIDE		6
+#define FIB6_IDX_FANOUT		(1U << FIB6_IDX_STRIDE)
+#define FIB6_IDX_MASK		(FIB6_IDX_FANOUT - 1)
+#define FIB6_IDX_LEVEL(depth)	(((depth) - FIB6_IDX_TOP_BITS) / FIB6_IDX_STRIDE)
+#define FIB6_IDX_LEVELS		(FIB6_IDX_LEVEL(128 - 1) + 1)
+
+/* Lets a batch of route changes go by before rebuilding */
+#define FIB6_IDX_DELAY		(HZ / 10)
+
+/* Slots hold either a struct fib6_node or a tagged struct fib6_idx_node */
+#define FIB6_IDX_NODE		1UL
+
+struct fib6_idx_node {
+	u64			vector;		/* entries with a slot */
+	u64			leafvec;	/* entries starting a run */
+	unsigned int		nr_slots;
+	struct rcu_head		rcu;
+	void __rcu		*entries[];	/* slots, then runs */
+};
+
+struct fib6_idx {
+	struct fib6_table	*table;
+	void __rcu * __rcu	*top;
+	unsigned long		*dirty;		/* top slots to rebuild */
+	void			*(*scratch)[FIB6_IDX_FANOUT];
+	struct delayed_work	work;
+	unsigned int		prefixes;
+	unsigned long		rebuilds;
+	unsigned long		failed;
+};
+
+struct fib6_idx_net {
+	struct xarray		tables;		/* struct fib6_idx by tb6_id */
+	int			min_prefixes;
+#ifdef CONFIG_SYSCTL
+	struct ctl_table_header	*sysctl_hdr;
+#endif
+};
+
+static unsigned int fib6_idx_net_id __read_mostly;
+
+/* The tree is read under tb6_lock, or under RCU while building */
+#define fib6_idx_deref(idx, p)						\
+	rcu_dereference_check(p, lockdep_is_held(&(idx)->table->tb6_lock))
+
+static bool fib6_idx_is_node(const void *e)
+{
+	return (unsigned long)e & FIB6_IDX_NODE;
+}
+
+static struct fib6_idx_node *fib6_idx_node(const void *e)
+{
+	return (struct fib6_idx_node *)((unsigned long)e & ~FIB6_IDX_NODE);
+}
+
+static void *fib6_idx_tag(struct fib6_idx_node *node)
+{
+	return (void *)((unsigned long)node | FIB6_IDX_NODE);
+}
+
+/* The stride at @depth. Depths are 16 + 6 * n, so a stride never spans
+ * both halves of the address; the last one reads two bits past its end
+ * as zero.
+ */
+static unsigned int fib6_idx_bits(u64 hi, u64 lo, unsigned int depth)
+{
+	unsigned int end = depth + FIB6_IDX_STRIDE;
+
+	if (end <= 64)
+		return (hi >> (64 - end)) & FIB6_IDX_MASK;
+	if (end <= 128)
+		return (lo >> (128 - end)) & FIB6_IDX_MASK;
+	return (lo << (end - 128)) & FIB6_IDX_MASK;
+}
+
+static unsigned int fib6_idx_stride(const struct in6_addr *addr,
+				    unsigned int depth)
+{
+	return fib6_idx_bits(get_unaligned_be64(&addr->s6_addr[0]),
+			     get_unaligned_be64(&addr->s6_addr[8]), depth);
+}
+
+/* @addr, with the stride at @depth set to @e and the bits after cleared */
+static void fib6_idx_entry_addr(struct in6_addr *sub,
+				const struct in6_addr *addr,
+				unsigned int depth, unsigned int e)
+{
+	u64 hi = get_unaligned_be64(&addr->s6_addr[0]);
+	u64 lo = get_unaligned_be64(&addr->s6_addr[8]);
+	unsigned int end = depth + FIB6_IDX_STRIDE;
+
+	if (end <= 64) {
+		hi = (hi & ~GENMASK_ULL(63 - depth, 0)) | ((u64)e << (64 - end));
+		lo = 0;
+	} else if (end <= 128) {
+		lo = (lo & ~GENMASK_ULL(127 - depth, 0)) | ((u64)e << (128 - end));
+	} else {
+		lo = (lo & ~GENMASK_ULL(127 - depth, 0)) | (e >> (end - 128));
+	}
+	put_unaligned_be64(hi, &sub->s6_addr[0]);
+	put_unaligned_be64(lo, &sub->s6_addr[8]);
+}
+
+/* called with rcu_read_lock() held, returns NULL to use the tree */
+struct fib6_node *fib6_idx_lookup(struct net *net, struct fib6_table *table,
+				  const struct in6_addr *daddr)
+{
+	struct fib6_idx_net *in = net_generic(net, fib6_idx_net_id);
+	void __rcu * const *top;
+	struct fib6_idx *idx;
+	unsigned int depth;
+	u64 hi, lo;
+	void *e;
+
+	if (!READ_ONCE(in->min_prefixes) || fib6_routes_require_src(net))
+		return NULL;
+
+	idx = xa_load(&in->tables, table->tb6_id);
+	if (!idx)
+		return NULL;
+	top = rcu_dereference(idx->top);
+	if (!top)
+		return NULL;
+
+	hi = get_unaligned_be64(&daddr->s6_addr[0]);
+	lo = get_unaligned_be64(&daddr->s6_addr[8]);
+	e = rcu_dereference(top[hi >> (64 - FIB6_IDX_TOP_BITS)]);
+
+	for (depth = FIB6_IDX_TOP_BITS; fib6_idx_is_node(e);
+	     depth += FIB6_IDX_STRIDE) {
+		struct fib6_idx_node *node = fib6_idx_node(e);
+		u64 bit = BIT_ULL(fib6_idx_bits(hi, lo, depth));
+
+		if (node->vector & bit)
+			e = rcu_dereference(node->entries[hweight64(node->vector &
+								    (bit - 1))]);
+		else
+			e = rcu_dereference(node->entries[node->nr_slots - 1 +
+				hweight64(node->leafvec & (bit | (bit - 1)))]);
+	}
+
+	return e;
+}
+
+/* Frees an index subtree that no reader can reach anymore */
+static void fib6_idx_free(void *e)
+{
+	struct fib6_idx_node *node;
+	unsigned int i;
+
+	if (!fib6_idx_is_node(e))
+		return;
+
+	node = fib6_idx_node(e);
+	for (i = 0; i < node->nr_slots; i++)
+		fib6_idx_free(rcu_dereference_raw(node->entries[i]));
+	kfree(node);
+}
+
+static void fib6_idx_free_rcu(struct rcu_head *head)
+{
+	fib6_idx_free(fib6_idx_tag(container_of(head, struct fib6_idx_node,
+						rcu)));
+}
+
+static void fib6_idx_clear(struct fib6_idx *idx, void __rcu **slot)
+{
+	void *e = fib6_idx_deref(idx, *slot);
+
+	RCU_INIT_POINTER(*slot, NULL);
+	if (fib6_idx_is_node(e))
+		call_rcu(&fib6_idx_node(e)->rcu, fib6_idx_free_rcu);
+}
+
+/* NULL for a node losing its last route, which marks its slot dirty */
+static const struct in6_addr *fib6_idx_key(struct fib6_idx *idx,
+					   struct fib6_node *fn)
+{
+	struct fib6_info *leaf = fib6_idx_deref(idx, fn->leaf);
+
+	return leaf ? &leaf->fib6_dst.addr : NULL;
+}
+
+/* The node of the tree matching @addr on its first @maxlen bits or less,
+ * as fib6_node_lookup() would find it without the longer prefixes.
+ */
+static struct fib6_node *fib6_idx_match(struct fib6_idx *idx,
+					const struct in6_addr *addr,
+					unsigned int maxlen)
+{
+	struct fib6_node *fn = &idx->table->tb6_root, *match = fn;
+	const struct in6_addr *key;
+
+	while (fn && fn->fn_bit <= maxlen &&
+	       (key = fib6_idx_key(idx, fn)) &&
+	       ipv6_prefix_equal(key, addr, fn->fn_bit)) {
+		if (fn->fn_flags & RTN_RTINFO)
+			match = fn;
+		if (fn->fn_bit >= 128)
+			break;
+		fn = addr_bit_set(addr, fn->fn_bit) ?
+		     fib6_idx_deref(idx, fn->right) :
+		     fib6_idx_deref(idx, fn->left);
+	}
+
+	return match;
+}
+
+/* The topmost node of the tree below @addr/@depth, NULL if there is none */
+static struct fib6_node *fib6_idx_range(struct fib6_idx *idx,
+					const struct in6_addr *addr,
+					unsigned int depth)
+{
+	struct fib6_node *fn = &idx->table->tb6_root;
+	const struct in6_addr *key;
+
+	for (;;) {
+		key = fib6_idx_key(idx, fn);
+		if (!key)
+			return NULL;
+		if (fn->fn_bit >= depth)
+			break;
+		if (!ipv6_prefix_equal(key, addr, fn->fn_bit))
+			return NULL;
+		fn = addr_bit_set(addr, fn->fn_bit) ?
+		     fib6_idx_deref(idx, fn->right) :
+		     fib6_idx_deref(idx, fn->left);
+		if (!fn)
+			return NULL;
+	}
+
+	return ipv6_prefix_equal(key, addr, depth) ? fn : NULL;
+}
+
+/* Pre-order walk of the tree below @top */
+static struct fib6_node *fib6_idx_next(struct fib6_idx *idx,
+				       struct fib6_node *top,
+				       struct fib6_node *fn, bool descend)
+{
+	struct fib6_node *pn, *next;
+
+	if (descend) {
+		next = fib6_idx_deref(idx, fn->left) ?:
+		       fib6_idx_deref(idx, fn->right);
+		if (next)
+			return next;
+	}
+
+	for (; fn != top; fn = pn) {
+		/* @fn may have been unlinked since, under RCU */
+		pn = fib6_idx_deref(idx, fn->parent);
+		if (!pn)
+			return NULL;
+		next = fib6_idx_deref(idx, pn->right);
+		if (next && next != fn)
+			return next;
+	}
+
+	return NULL;
+}
+
+/* Builds the index of @addr/@depth, where @def is the result for the
+ * addresses no prefix longer than @depth covers. Returns a result when
+ * there is no such prefix, NULL if memory ran out or the tree changed
+ * under the walk. Called under RCU, the result is unpublished until the
+ * caller checks that its slot wasn't dirtied again.
+ */
+static void *fib6_idx_build(struct fib6_idx *idx, const struct in6_addr *addr,
+			    unsigned int depth, struct fib6_node *def)
+{
+	void **res = idx->scratch[FIB6_IDX_LEVEL(depth)];
+	unsigned int end = depth + FIB6_IDX_STRIDE;
+	unsigned int e, i, nr_slots, nr_leaves = 0;
+	struct fib6_idx_node *node;
+	struct fib6_node *fn, *top;
+	u64 vector = 0, leafvec = 0;
+	struct in6_addr sub;
+	void *prev = NULL;
+
+	top = fib6_idx_range(idx, addr, depth);
+	if (!top)
+		return def;
+
+	for (e = 0; e < FIB6_IDX_FANOUT; e++)
+		res[e] = def;
+
+	/* Prefixes ending in this stride paint the entries they cover, in
+	 * pre-order so that longer ones win. Longer prefixes are left to a
+	 * child, their subtree is not walked here.
+	 */
+	fn = top;
+	do {
+		const struct in6_addr *key = fib6_idx_key(idx, fn);
+		bool descend = fn->fn_bit < end;
+
+		if (!key)
+			return NULL;
+
+		if (fn->fn_flags & RTN_RTINFO &&
+		    fn->fn_bit > depth && fn->fn_bit <= end) {
+			unsigned int span = 1U << (end - fn->fn_bit);
+
+			e = fib6_idx_stride(key, depth) & ~(span - 1);
+			for (i = e; i < e + span; i++)
+				res[i] = fn;
+		}
+		if (!descend &&
+		    (fn->fn_bit > end || rcu_access_pointer(fn->left) ||
+		     rcu_access_pointer(fn->right)))
+			vector |= BIT_ULL(fib6_idx_stride(key, depth));
+
+		fn = fib6_idx_next(idx, top, fn, descend);
+	} while (fn);
+
+	for (e = 0; e < FIB6_IDX_FANOUT; e++) {
+		if (!(vector & BIT_ULL(e)))
+			continue;
+
+		fib6_idx_entry_addr(&sub, addr, depth, e);
+		res[e] = fib6_idx_build(idx, &sub, end, res[e]);
+		if (res[e] && !fib6_idx_is_node(res[e]))
+			vector &= ~BIT_ULL(e);
+	}
+
+	nr_slots = hweight64(vector);
+	for (e = 0; e < FIB6_IDX_FANOUT; e++) {
+		if (vector & BIT_ULL(e))
+			continue;
+		if (!nr_leaves || res[e] != prev) {
+			leafvec |= BIT_ULL(e);
+			nr_leaves++;
+			prev = res[e];
+		}
+	}
+	if (!nr_slots && nr_leaves == 1)
+		return prev;
+
+	node = kmalloc(struct_size(node, entries, nr_slots + nr_leaves),
+		       GFP_NOWAIT | __GFP_NOWARN);
+	if (!node) {
+		for (e = 0; e < FIB6_IDX_FANOUT; e++)
+			if (vector & BIT_ULL(e))
+				fib6_idx_free(res[e]);
+		idx->failed++;
+		return NULL;
+	}
+
+	node->vector = vector;
+	node->leafvec = leafvec;
+	node->nr_slots = nr_slots;
+	i = 0;
+	for (e = 0; e < FIB6_IDX_FANOUT; e++)
+		if (vector & BIT_ULL(e))
+			RCU_INIT_POINTER(node->entries[i++], res[e]);
+	for (e = 0; e < FIB6_IDX_FANOUT; e++)
+		if (leafvec & BIT_ULL(e))
+			RCU_INIT_POINTER(node->entries[i++], res[e]);
+
+	return fib6_idx_tag(node);
+}
+
+/* Builds top slot @s anew and publishes it, unless a route change marked
+ * it dirty again while it was being built. The old slot stays in place if
+ * memory runs out: its cleared parts fall back to the tree.
+ */
+static void fib6_idx_rebuild(struct fib6_idx *idx, void __rcu **top,
+			     unsigned int s)
+{
+	struct fib6_table *table = idx->table;
+	struct in6_addr addr = {};
+	void *e;
+
+	spin_lock_bh(&table->tb6_lock);
+	__clear_bit(s, idx->dirty);
+	spin_unlock_bh(&table->tb6_lock);
+
+	put_unaligned_be16(s, &addr.s6_addr[0]);
+	rcu_read_lock();
+	e = fib6_idx_build(idx, &addr, FIB6_IDX_TOP_BITS,
+			   fib6_idx_match(idx, &addr, FIB6_IDX_TOP_BITS));
+	rcu_read_unlock();
+
+	spin_lock_bh(&table->tb6_lock);
+	if (e && !test_bit(s, idx->dirty)) {
+		fib6_idx_clear(idx, &top[s]);
+		rcu_assign_pointer(top[s], e);
+		idx->rebuilds++;
+		e = NULL;
+	}
+	spin_unlock_bh(&table->tb6_lock);
+
+	/* Never published, the work is queued again if it was outdated */
+	fib6_idx_free(e);
+}
+
+static void fib6_idx_work(struct work_struct *work)
+{
+	struct fib6_idx *idx = container_of(to_delayed_work(work),
+					    struct fib6_idx, work);
+	struct fib6_table *table = idx->table;
+	void __rcu **top;
+	unsigned int s;
+
+	top = rcu_dereference_protected(idx->top, true);
+	if (!top) {
+		/* Everything starts out falling back to the tree */
+		top = kvcalloc(FIB6_IDX_SLOTS, sizeof(*top), GFP_KERNEL);
+		idx->dirty = bitmap_zalloc(FIB6_IDX_SLOTS, GFP_KERNEL);
+		idx->scratch = kvmalloc_array(FIB6_IDX_LEVELS,
+					      sizeof(*idx->scratch),
+					      GFP_KERNEL);
+		if (!top || !idx->dirty || !idx->scratch) {
+			kvfree(top);
+			bitmap_free(idx->dirty);
+			kvfree(idx->scratch);
+			idx->dirty = NULL;
+			idx->scratch = NULL;
+			return;
+		}
+		bitmap_fill(idx->dirty, FIB6_IDX_SLOTS);
+
+		spin_lock_bh(&table->tb6_lock);
+		rcu_assign_pointer(idx->top, top);
+		spin_unlock_bh(&table->tb6_lock);
+	}
+
+	for_each_set_bit(s, idx->dirty, FIB6_IDX_SLOTS) {
+		fib6_idx_rebuild(idx, top, s);
+		cond_resched();
+	}
+}
+
+static struct fib6_idx *fib6_idx_create(struct fib6_idx_net *in,
+					struct fib6_table *table)
+{
+	struct fib6_idx *idx;
+
+	idx = kzalloc(sizeof(*idx), GFP_ATOMIC);
+	if (!idx)
+		return NULL;
+
+	idx->table = table;
+	INIT_DELAYED_WORK(&idx->work, fib6_idx_work);
+	if (xa_err(xa_store_bh(&in->tables, table->tb6_id, idx, GFP_ATOMIC))) {
+		kfree(idx);
+		return NULL;
+	}
+
+	return idx;
+}
+
+/* A node of @table got its first route for @key, or lost its last one.
+ * Need to own table->tb6_lock.
+ */
+void fib6_idx_update(struct net *net, struct fib6_table *table,
+		     const struct rt6key *key, bool add)
+{
+	struct fib6_idx_net *in = net_generic(net, fib6_idx_net_id);
+	unsigned int s, depth = FIB6_IDX_TOP_BITS;
+	struct fib6_idx *idx;
+	void __rcu **top;
+	void __rcu **slot;
+
+	idx = xa_load(&in->tables, table->tb6_id);
+	if (!idx) {
+		if (!add)
+			return;
+		idx = fib6_idx_create(in, table);
+		if (!idx)
+			return;
+	}
+	if (add)
+		idx->prefixes++;
+	else
+		idx->prefixes--;
+
+	top = fib6_idx_deref(idx, idx->top);
+	if (!top) {
+		if (add && READ_ONCE(in->min_prefixes) &&
+		    idx->prefixes >= READ_ONCE(in->min_prefixes))
+			queue_delayed_work(system_unbound_wq, &idx->work, 0);
+		return;
+	}
+
+	s = get_unaligned_be16(&key->addr.s6_addr[0]);
+	if (key->plen < FIB6_IDX_TOP_BITS) {
+		unsigned int span = 1U << (FIB6_IDX_TOP_BITS - key->plen);
+
+		for (s &= ~(span - 1); span--; s++) {
+			fib6_idx_clear(idx, &top[s]);
+			__set_bit(s, idx->dirty);
+		}
+		goto out;
+	}
+
+	/* Clear the slot of the deepest node the prefix ends in, or that
+	 * lacks a child for it.
+	 */
+	slot = &top[s];
+	for (;;) {
+		void *e = fib6_idx_deref(idx, *slot);
+		struct fib6_idx_node *node;
+		u64 bit;
+
+		if (!fib6_idx_is_node(e) ||
+		    key->plen <= depth + FIB6_IDX_STRIDE)
+			break;
+
+		node = fib6_idx_node(e);
+		bit = BIT_ULL(fib6_idx_stride(&key->addr, depth));
+		if (!(node->vector & bit))
+			break;
+
+		slot = &node->entries[hweight64(node->vector & (bit - 1))];
+		depth += FIB6_IDX_STRIDE;
+	}
+	fib6_idx_clear(idx, slot);
+	__set_bit(s, idx->dirty);
+out:
+	queue_delayed_work(system_unbound_wq, &idx->work, FIB6_IDX_DELAY);
+}
+
+static void fib6_idx_destroy(struct fib6_idx *idx)
+{
+	void __rcu **top = rcu_dereference_protected(idx->top, true);
+	unsigned int s;
+
+	if (top) {
+		for (s = 0; s < FIB6_IDX_SLOTS; s++)
+			fib6_idx_free(rcu_dereference_protected(top[s], true));
+		kvfree(top);
+	}
+	bitmap_free(idx->dirty);
+	kvfree(idx->scratch);
+	kfree(idx);
+}
+
+/* Called before @table is freed, with nothing able to change it anymore */
+void fib6_idx_table_free(struct net *net, struct fib6_table *table)
+{
+	struct fib6_idx_net *in = net_generic(net, fib6_idx_net_id);
+	struct fib6_idx *idx;
+
+	idx = xa_erase_bh(&in->tables, table->tb6_id);
+	if (!idx)
+		return;
+
+	cancel_delayed_work_sync(&idx->work);
+	fib6_idx_destroy(idx);
+}
+
+#ifdef CONFIG_PROC_FS
+static void fib6_idx_count(void *e, unsigned long *nodes, unsigned long *bytes)
+{
+	struct fib6_idx_node *node;
+	unsigned int i;
+
+	if (!fib6_idx_is_node(e))
+		return;
+
+	node = fib6_idx_node(e);
+	*nodes += 1;
+	*bytes += struct_size(node, entries,
+			      node->nr_slots + hweight64(node->leafvec));
+	for (i = 0; i < node->nr_slots; i++)
+		fib6_idx_count(rcu_dereference(node->entries[i]), nodes, bytes);
+}
+
+static int fib6_idx_seq_show(struct seq_file *seq, void *v)
+{
+	struct net *net = seq_file_single_net(seq);
+	struct fib6_idx_net *in = net_generic(net, fib6_idx_net_id);
+	struct fib6_idx *idx;
+	unsigned long id;
+
+	seq_printf(seq, "%-10s %10s %10s %12s %8s %10s %8s\n", "table",
+		   "prefixes", "nodes", "bytes", "pending", "rebuilds",
+		   "failed");
+
+	rcu_read_lock();
+	xa_for_each(&in->tables, id, idx) {
+		unsigned long nodes = 0, bytes = 0, pending = 0;
+		void __rcu **top = rcu_dereference(idx->top);
+		unsigned int s;
+
+		if (top) {
+			bytes = FIB6_IDX_SLOTS * sizeof(*top);
+			for (s = 0; s < FIB6_IDX_SLOTS; s++)
+				fib6_idx_count(rcu_dereference(top[s]), &nodes,
+					       &bytes);
+			pending = bitmap_weight(idx->dirty, FIB6_IDX_SLOTS);
+		}
+		seq_printf(seq, "%-10lu %10u %10lu %12lu %8lu %10lu %8lu\n",
+			   id, READ_ONCE(idx->prefixes), nodes, bytes, pending,
+			   READ_ONCE(idx->rebuilds), READ_ONCE(idx->failed));
+	}
+	rcu_read_unlock();
+
+	return 0;
+}
+#endif	/* CONFIG_PROC_FS */
+
+#ifdef CONFIG_SYSCTL
+static const struct ctl_table fib6_idx_sysctl_table[] = {
+	{
+		.procname	= "lookup_index",
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec_minmax,
+		.extra1		= SYSCTL_ZERO,
+	},
+};
+
+static int __net_init fib6_idx_sysctl_init(struct net *net,
+					   struct fib6_idx_net *in)
+{
+	struct ctl_table *table;
+
+	table = kmemdup(fib6_idx_sysctl_table, sizeof(fib6_idx_sysctl_table),
+			GFP_KERNEL);
+	if (!table)
+		return -ENOMEM;
+	table[0].data = &in->min_prefixes;
+
+	in->sysctl_hdr = register_net_sysctl_sz(net, "net/ipv6/route", table,
+						ARRAY_SIZE(fib6_idx_sysctl_table));
+	if (!in->sysctl_hdr) {
+		kfree(table);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+static void fib6_idx_sysctl_exit(struct fib6_idx_net *in)
+{
+	const struct ctl_table *table = in->sysctl_hdr->ctl_table_arg;
+
+	unregister_net_sysctl_table(in->sysctl_hdr);
+	kfree(table);
+}
+#else
+static int fib6_idx_sysctl_init(struct net *net, struct fib6_idx_net *in)
+{
+	return 0;
+}
+
+static void fib6_idx_sysctl_exit(struct fib6_idx_net *in)
+{
+}
+#endif	/* CONFIG_SYSCTL */
+
+static int __net_init fib6_idx_net_init(struct net *net)
+{
+	struct fib6_idx_net *in = net_generic(net, fib6_idx_net_id);
+	int err;
+
+	xa_init_flags(&in->tables, XA_FLAGS_LOCK_BH);
+	/* Below this many prefixes the tree is shallow enough */
+	in->min_prefixes = 1024;
+
+	err = fib6_idx_sysctl_init(net, in);
+	if (err)
+		return err;
+
+#ifdef CONFIG_PROC_FS
+	if (!proc_create_net_single("rt6_index", 0444, net->proc_net,
+				    fib6_idx_seq_show, NULL)) {
+		fib6_idx_sysctl_exit(in);
+		return -ENOMEM;
+	}
+#endif
+
+	return 0;
+}
+
+static void __net_exit fib6_idx_net_exit(struct net *net)
+{
+	struct fib6_idx_net *in = net_generic(net, fib6_idx_net_id);
+
+#ifdef CONFIG_PROC_FS
+	remove_proc_entry("rt6_index", net->proc_net);
+#endif
+	fib6_idx_sysctl_exit(in);
+	WARN_ON_ONCE(!xa_empty(&in->tables));
+	xa_destroy(&in->tables);
+}
+
+static struct pernet_operations fib6_idx_net_ops = {
+	.init = fib6_idx_net_init,
+	.exit = fib6_idx_net_exit,
+	.id = &fib6_idx_net_id,
+	.size = sizeof(struct fib6_idx_net),
+};
+
+/* Registered before the FIB, so that tables go away while it is around */
+int __init fib6_idx_init(void)
+{
+	BUILD_BUG_ON((64 - FIB6_IDX_TOP_BITS) % FIB6_IDX_STRIDE);
+
+	return register_pernet_subsys(&fib6_idx_net_ops);
+}
+
+void fib6_idx_exit(void)
+{
+	unregister_pernet_subsys(&fib6_idx_net_ops);
+	rcu_barrier();
+}
@@ -0,0 +1,31 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ *	Compressed multibit lookup index of the IPv6 FIB
+ *	Linux INET6 implementation
+ */
+
+#ifndef __ip6_fib_index_h
+#define __ip6_fib_index_h
+
+#include <net/ip6_fib.h>
+
+struct fib6_node *fib6_idx_lookup(struct net *net, struct fib6_table *table,
+				  const struct in6_addr *daddr);
+void fib6_idx_update(struct net *net, struct fib6_table *table,
+		     const struct rt6key *key, bool add);
+void fib6_idx_table_free(struct net *net, struct fib6_table *table);
+int fib6_idx_init(void);
+void fib6_idx_exit(void);
+
+/* called with rcu_read_lock() held */
+static inline struct fib6_node *
+fib6_table_node_lookup(struct net *net, struct fib6_table *table,
+		       const struct in6_addr *daddr,
+		       const struct in6_addr *saddr)
+{
+	struct fib6_node *fn = fib6_idx_lookup(net, table, daddr);
+
+	return fn ?: fib6_node_lookup(&table->tb6_root, daddr, saddr);
+}
+
+#endif
@@ -64,6 +64,8 @@
 #include <linux/uaccess.h>
 #include <linux/btf_ids.h>
 
+#include "ip6_fib_index.h"
+
 #ifdef CONFIG_SYSCTL
 #include <linux/sysctl.h>
 #endif
@@ -1225,7 +1227,7 @@ INDIRECT_CALLABLE_SCOPE struct rt6_info *ip6_pol_route_lookup(struct net *net,
 	struct rt6_info *rt;
 
 	rcu_read_lock();
-	fn = fib6_node_lookup(&table->tb6_root, &fl6->daddr, &fl6->saddr);
+	fn = fib6_table_node_lookup(net, table, &fl6->daddr, &fl6->saddr);
 restart:
 	res.f6i = rcu_dereference(fn->leaf);
 	if (!res.f6i)
@@ -2188,7 +2190,7 @@ int fib6_table_lookup(struct net *net, struct fib6_table *table, int oif,
 {
 	struct fib6_node *fn, *saved_fn;
 
-	fn = fib6_node_lookup(&table->tb6_root, &fl6->daddr, &fl6->saddr);
+	fn = fib6_table_node_lookup(net, table, &fl6->daddr, &fl6->saddr);
 	saved_fn = fn;
 
 redo_rt6_select:
@@ -3077,7 +3079,7 @@ INDIRECT_CALLABLE_SCOPE struct rt6_info *__ip6_route_redirect(struct net *net,
 	 */
 
 	rcu_read_lock();
-	fn = fib6_node_lookup(&table->tb6_root, &fl6->daddr, &fl6->saddr);
+	fn = fib6_table_node_lookup(net, table, &fl6->daddr, &fl6->saddr);
 restart:
 	for_each_fib6_node_rt_rcu(fn) {
 		res.f6i = rt;
@@ -10,8 +10,138 @@
 #define pr_fmt(fmt) "MPTCP: " fmt
 
 #include <linux/bpf.h>
+#include <linux/bpf_verifier.h>
+#include <linux/btf.h>
+#include <linux/btf_ids.h>
 #include "protocol.h"
 
+#ifdef CONFIG_BPF_JIT
+static const struct btf_type *mptcp_sock_type, *mptcp_subflow_type __read_mostly;
+
+static const struct bpf_func_proto *
+bpf_mptcp_sched_get_func_proto(enum bpf_func_id func_id,
+			       const struct bpf_prog *prog)
+{
+	return bpf_base_func_proto(func_id, prog);
+}
+
+/* Schedulers may only set the burst of the msk and the pacing estimate of
+ * the subflows, which mptcp_subflow_get_send() maintains as well.
+ */
+static int bpf_mptcp_sched_btf_struct_access(struct bpf_verifier_log *log,
+					     const struct bpf_reg_state *reg,
+					     int off, int size)
+{
+	const struct btf_type *t;
+
+	t = btf_type_by_id(reg->btf, reg->btf_id);
+	if (t == mptcp_sock_type) {
+		if (off >= offsetof(struct mptcp_sock, snd_burst) &&
+		    off + size <= offsetofend(struct mptcp_sock, snd_burst))
+			return SCALAR_VALUE;
+	} else if (t == mptcp_subflow_type) {
+		if (off >= offsetof(struct mptcp_subflow_context, avg_pacing_rate) &&
+		    off + size <= offsetofend(struct mptcp_subflow_context,
+					      avg_pacing_rate))
+			return SCALAR_VALUE;
+	}
+
+	bpf_log(log, "no write support at off %d\n", off);
+	return -EACCES;
+}
+
+static const struct bpf_verifier_ops bpf_mptcp_sched_verifier_ops = {
+	.get_func_proto		= bpf_mptcp_sched_get_func_proto,
+	.is_valid_access	= bpf_tracing_btf_ctx_access,
+	.btf_struct_access	= bpf_mptcp_sched_btf_struct_access,
+};
+
+static int bpf_mptcp_sched_reg(void *kdata, struct bpf_link *link)
+{
+	return mptcp_register_scheduler(kdata);
+}
+
+static void bpf_mptcp_sched_unreg(void *kdata, struct bpf_link *link)
+{
+	mptcp_unregister_scheduler(kdata);
+}
+
+static int bpf_mptcp_sched_check_member(const struct btf_type *t,
+					const struct btf_member *member,
+					const struct bpf_prog *prog)
+{
+	return 0;
+}
+
+static int bpf_mptcp_sched_init_member(const struct btf_type *t,
+				       const struct btf_member *member,
+				       void *kdata, const void *udata)
+{
+	const struct mptcp_sched_ops *usched = udata;
+	struct mptcp_sched_ops *sched = kdata;
+	u32 moff = __btf_member_bit_offset(t, member) / 8;
+
+	switch (moff) {
+	case offsetof(struct mptcp_sched_ops, name):
+		if (bpf_obj_name_cpy(sched->name, usched->name,
+				     sizeof(sched->name)) <= 0)
+			return -EINVAL;
+		return 1;
+	}
+
+	return 0;
+}
+
+static int bpf_mptcp_sched_init(struct btf *btf)
+{
+	s32 type_id;
+
+	type_id = btf_find_by_name_kind(btf, "mptcp_sock", BTF_KIND_STRUCT);
+	if (type_id < 0)
+		return -EINVAL;
+	mptcp_sock_type = btf_type_by_id(btf, type_id);
+
+	type_id = btf_find_by_name_kind(btf, "mptcp_subflow_context",
+					BTF_KIND_STRUCT);
+	if (type_id < 0)
+		return -EINVAL;
+	mptcp_subflow_type = btf_type_by_id(btf, type_id);
+
+	return 0;
+}
+
+static int __bpf_mptcp_sched_get_subflow(struct mptcp_sock *msk,
+					 struct mptcp_sched_data *data)
+{
+	return 0;
+}
+
+static void __bpf_mptcp_sched_init(struct mptcp_sock *msk)
+{
+}
+
+static void __bpf_mptcp_sched_release(struct mptcp_sock *msk)
+{
+}
+
+static struct mptcp_sched_ops __bpf_mptcp_sched_ops = {
+	.get_subflow	= __bpf_mptcp_sched_get_subflow,
+	.init		= __bpf_mptcp_sched_init,
+	.release	= __bpf_mptcp_sched_release,
+};
+
+static struct bpf_struct_ops bpf_mptcp_sched_ops = {
+	.verifier_ops	= &bpf_mptcp_sched_verifier_ops,
+	.reg		= bpf_mptcp_sched_reg,
+	.unreg		= bpf_mptcp_sched_unreg,
+	.check_member	= bpf_mptcp_sched_check_member,
+	.init_member	= bpf_mptcp_sched_init_member,
+	.init		= bpf_mptcp_sched_init,
+	.name		= "mptcp_sched_ops",
+	.cfi_stubs	= &__bpf_mptcp_sched_ops,
+};
+#endif /* CONFIG_BPF_JIT */
+
 struct mptcp_sock *bpf_mptcp_sock_from_subflow(struct sock *sk)
 {
 	if (sk && sk_fullsock(sk) && sk->sk_protocol == IPPROTO_TCP && sk_is_mptcp(sk))
@@ -20,6 +150,137 @@ struct mptcp_sock *bpf_mptcp_sock_from_subflow(struct sock *sk)
 	return NULL;
 }
 
+struct bpf_iter_mptcp_subflow {
+	__u64 __opaque[2];
+} __aligned(8);
+
+struct bpf_iter_mptcp_subflow_kern {
+	struct mptcp_sock *msk;
+	struct list_head *pos;
+} __aligned(8);
+
+__bpf_kfunc_start_defs();
+
+/* The subflow list is protected by the msk socket lock, which is held while
+ * the scheduler runs.
+ */
+__bpf_kfunc int
+bpf_iter_mptcp_subflow_new(struct bpf_iter_mptcp_subflow *it,
+			   struct mptcp_sock *msk)
+{
+	struct bpf_iter_mptcp_subflow_kern *kit = (void *)it;
+
+	BUILD_BUG_ON(sizeof(struct bpf_iter_mptcp_subflow_kern) >
+		     sizeof(struct bpf_iter_mptcp_subflow));
+	BUILD_BUG_ON(__alignof__(struct bpf_iter_mptcp_subflow_kern) !=
+		     __alignof__(struct bpf_iter_mptcp_subflow));
+
+	kit->msk = msk;
+	if (!msk)
+		return -EINVAL;
+
+	msk_owned_by_me(msk);
+	kit->pos = &msk->conn_list;
+	return 0;
+}
+
+__bpf_kfunc struct mptcp_subflow_context *
+bpf_iter_mptcp_subflow_next(struct bpf_iter_mptcp_subflow *it)
+{
+	struct bpf_iter_mptcp_subflow_kern *kit = (void *)it;
+
+	if (!kit->msk || list_is_last(kit->pos, &kit->msk->conn_list))
+		return NULL;
+
+	kit->pos = kit->pos->next;
+	return list_entry(kit->pos, struct mptcp_subflow_context, node);
+}
+
+__bpf_kfunc void
+bpf_iter_mptcp_subflow_destroy(struct bpf_iter_mptcp_subflow *it)
+{
+}
+
+__bpf_kfunc struct sock *
+bpf_mptcp_subflow_tcp_sock(struct mptcp_subflow_context *subflow)
+{
+	return subflow ? mptcp_subflow_tcp_sock(subflow) : NULL;
+}
+
+__bpf_kfunc u32 bpf_mptcp_subflow_srtt_us(struct mptcp_subflow_context *subflow)
+{
+	return tcp_sk(mptcp_subflow_tcp_sock(subflow))->srtt_us >> 3;
+}
+
+__bpf_kfunc bool
+bpf_mptcp_subflow_cwnd_full(struct mptcp_subflow_context *subflow)
+{
+	const struct tcp_sock *tp = tcp_sk(mptcp_subflow_tcp_sock(subflow));
+
+	return tcp_packets_in_flight(tp) >= tcp_snd_cwnd(tp);
+}
+
+__bpf_kfunc bool
+bpf_mptcp_subflow_memory_free(struct mptcp_subflow_context *subflow)
+{
+	return sk_stream_memory_free(mptcp_subflow_tcp_sock(subflow));
+}
+
+__bpf_kfunc bool
+bpf_mptcp_subflow_queues_empty(struct mptcp_subflow_context *subflow)
+{
+	return tcp_rtx_and_write_queues_empty(mptcp_subflow_tcp_sock(subflow));
+}
+
+__bpf_kfunc bool
+bpf_mptcp_subflow_is_backup(struct mptcp_subflow_context *subflow)
+{
+	return subflow->backup || subflow->request_bkup;
+}
+
+__bpf_kfunc int bpf_mptcp_send_burst(struct mptcp_sock *msk)
+{
+	return mptcp_send_burst(msk);
+}
+
+__bpf_kfunc_end_defs();
+
+BTF_KFUNCS_START(bpf_mptcp_sched_kfunc_ids)
+BTF_ID_FLAGS(func, bpf_iter_mptcp_subflow_new, KF_ITER_NEW | KF_TRUSTED_ARGS)
+BTF_ID_FLAGS(func, bpf_iter_mptcp_subflow_next, KF_ITER_NEXT | KF_RET_NULL)
+BTF_ID_FLAGS(func, bpf_iter_mptcp_subflow_destroy, KF_ITER_DESTROY)
+BTF_ID_FLAGS(func, bpf_mptcp_subflow_tcp_sock, KF_TRUSTED_ARGS | KF_RET_NULL)
+BTF_ID_FLAGS(func, bpf_mptcp_subflow_srtt_us, KF_TRUSTED_ARGS)
+BTF_ID_FLAGS(func, bpf_mptcp_subflow_cwnd_full, KF_TRUSTED_ARGS)
+BTF_ID_FLAGS(func, bpf_mptcp_subflow_memory_free, KF_TRUSTED_ARGS)
+BTF_ID_FLAGS(func, bpf_mptcp_subflow_queues_empty, KF_TRUSTED_ARGS)
+BTF_ID_FLAGS(func, bpf_mptcp_subflow_is_backup, KF_TRUSTED_ARGS)
+BTF_ID_FLAGS(func, bpf_mptcp_send_burst, KF_TRUSTED_ARGS)
+BTF_ID_FLAGS(func, mptcp_subflow_set_scheduled, KF_TRUSTED_ARGS)
+BTF_ID_FLAGS(func, mptcp_subflow_active, KF_TRUSTED_ARGS)
+BTF_ID_FLAGS(func, mptcp_set_timeout, KF_TRUSTED_ARGS)
+BTF_ID_FLAGS(func, mptcp_wnd_end, KF_TRUSTED_ARGS)
+BTF_KFUNCS_END(bpf_mptcp_sched_kfunc_ids)
+
+/* The kfuncs above assume the msk socket lock, so only schedulers get them */
+static int bpf_mptcp_sched_kfunc_filter(const struct bpf_prog *prog,
+					u32 kfunc_id)
+{
+	if (!btf_id_set8_contains(&bpf_mptcp_sched_kfunc_ids, kfunc_id))
+		return 0;
+#ifdef CONFIG_BPF_JIT
+	if (prog->aux->st_ops == &bpf_mptcp_sched_ops)
+		return 0;
+#endif
+	return -EACCES;
+}
+
+static const struct btf_kfunc_id_set bpf_mptcp_sched_kfunc_set = {
+	.owner	= THIS_MODULE,
+	.set	= &bpf_mptcp_sched_kfunc_ids,
+	.filter	= bpf_mptcp_sched_kfunc_filter,
+};
+
 BTF_SET8_START(bpf_mptcp_fmodret_ids)
 BTF_ID_FLAGS(func, update_socket_protocol)
 BTF_SET8_END(bpf_mptcp_fmodret_ids)
@@ -31,6 +292,15 @@ static const struct btf_kfunc_id_set bpf_mptcp_fmodret_set = {
 
 static int __init bpf_mptcp_kfunc_init(void)
 {
-	return register_btf_fmodret_id_set(&bpf_mptcp_fmodret_set);
+	int ret;
+
+	ret = register_btf_fmodret_id_set(&bpf_mptcp_fmodret_set);
+	ret = ret ?: register_btf_kfunc_id_set(BPF_PROG_TYPE_STRUCT_OPS,
+					       &bpf_mptcp_sched_kfunc_set);
+#ifdef CONFIG_BPF_JIT
+	ret = ret ?: register_bpf_struct_ops(&bpf_mptcp_sched_ops,
+					     mptcp_sched_ops);
+#endif
+	return ret;
 }
 late_initcall(bpf_mptcp_kfunc_init);
@@ -50,7 +50,7 @@ DEFINE_PER_CPU(struct mptcp_delegated_action, mptcp_delegated_actions);
 static struct net_device mptcp_napi_dev;
 
 /* Returns end sequence number of the receiver's advertised window */
-static u64 mptcp_wnd_end(const struct mptcp_sock *msk)
+u64 mptcp_wnd_end(const struct mptcp_sock *msk)
 {
 	return READ_ONCE(msk->wnd_end);
 }
@@ -490,7 +490,7 @@ static long mptcp_timeout_from_subflow(const struct mptcp_subflow_context *subfl
 	       inet_csk(ssk)->icsk_timeout - jiffies : 0;
 }
 
-static void mptcp_set_timeout(struct sock *sk)
+void mptcp_set_timeout(struct sock *sk)
 {
 	struct mptcp_subflow_context *subflow;
 	long tout = 0;
@@ -1388,6 +1388,12 @@ static int mptcp_sendmsg_frag(struct sock *sk, struct sock *ssk,
 					 sizeof(struct ipv6hdr) - \
 					 sizeof(struct frag_hdr))
 
+/* Returns how much the subflows picked by a scheduler may push at once */
+int mptcp_send_burst(const struct mptcp_sock *msk)
+{
+	return min_t(int, MPTCP_SEND_BURST_SIZE, mptcp_wnd_end(msk) - msk->snd_nxt);
+}
+
 struct subflow_send_info {
 	struct sock *ssk;
 	u64 linger_time;
@@ -1486,7 +1492,7 @@ struct sock *mptcp_subflow_get_send(struct mptcp_sock *msk)
 	if (!ssk || !sk_stream_memory_free(ssk))
 		return NULL;
 
-	burst = min_t(int, MPTCP_SEND_BURST_SIZE, mptcp_wnd_end(msk) - msk->snd_nxt);
+	burst = mptcp_send_burst(msk);
 	wmem = READ_ONCE(ssk->sk_wmem_queued);
 	if (!burst)
 		return ssk;
@@ -1585,6 +1591,93 @@ static int __subflow_push_pending(struct sock *sk, struct sock *ssk,
 	return err;
 }
 
+/* Sends on @ssk the data another subflow just pushed, starting @sent bytes
+ * into @dfrag, like a retransmission of it.
+ */
+static int __subflow_push_redundant(struct sock *sk, struct sock *ssk,
+				    struct mptcp_data_frag *dfrag, u16 sent,
+				    struct mptcp_sendmsg_info *info)
+{
+	struct mptcp_sock *msk = mptcp_sk(sk);
+	int ret, copied = 0;
+
+	list_for_each_entry_from(dfrag, &msk->rtx_queue, list) {
+		if (dfrag->already_sent <= sent)
+			break;
+
+		info->sent = sent;
+		info->limit = dfrag->already_sent;
+		while (info->sent < info->limit) {
+			ret = mptcp_sendmsg_frag(sk, ssk, dfrag, info);
+			if (ret <= 0)
+				return copied ? : ret;
+
+			info->sent += ret;
+			copied += ret;
+		}
+		sent = 0;
+	}
+	return copied;
+}
+
+/* Sends on @ssk what other subflows pushed while the scheduler picked it
+ * along with them, see mptcp_subflow_mark_redundant().
+ */
+static int __subflow_push_redundant_pending(struct sock *sk, struct sock *ssk,
+					    struct mptcp_sendmsg_info *info)
+{
+	struct mptcp_subflow_context *subflow = mptcp_subflow_ctx(ssk);
+	struct mptcp_sock *msk = mptcp_sk(sk);
+	struct mptcp_data_frag *dfrag;
+	u64 seq = subflow->redundant_seq;
+	int ret;
+
+	if (!subflow->redundant)
+		return 0;
+
+	list_for_each_entry(dfrag, &msk->rtx_queue, list) {
+		if (after64(dfrag->data_seq + dfrag->already_sent, seq))
+			break;
+	}
+	/* all of it acked or already sent here */
+	if (list_entry_is_head(dfrag, &msk->rtx_queue, list)) {
+		subflow->redundant = false;
+		return 0;
+	}
+
+	if (before64(seq, dfrag->data_seq))
+		seq = dfrag->data_seq;
+	ret = __subflow_push_redundant(sk, ssk, dfrag, seq - dfrag->data_seq,
+				       info);
+	if (ret > 0)
+		seq += ret;
+	subflow->redundant_seq = seq;
+	subflow->redundant = before64(seq, msk->snd_nxt);
+	return ret;
+}
+
+/* The data from @seq that @ssk just pushed has to go on every other active
+ * subflow too, when the scheduler picks several at once. Only used where the
+ * other subflows can't be locked right away; they catch up once delegated.
+ */
+static void mptcp_subflow_mark_redundant(struct mptcp_sock *msk,
+					 struct sock *ssk, u64 seq)
+{
+	struct mptcp_subflow_context *subflow;
+
+	mptcp_for_each_subflow(msk, subflow) {
+		if (mptcp_subflow_tcp_sock(subflow) == ssk ||
+		    !mptcp_subflow_active(subflow))
+			continue;
+
+		if (!subflow->redundant ||
+		    after64(subflow->redundant_seq, seq))
+			subflow->redundant_seq = seq;
+		subflow->redundant = true;
+		mptcp_subflow_delegate(subflow, MPTCP_DELEGATE_SEND);
+	}
+}
+
 void __mptcp_push_pending(struct sock *sk, unsigned int flags)
 {
 	struct sock *prev_ssk = NULL, *ssk = NULL;
@@ -1592,11 +1685,14 @@ void __mptcp_push_pending(struct sock *sk, unsigned int flags)
 	struct mptcp_sendmsg_info info = {
 				.flags = flags,
 	};
+	struct mptcp_subflow_context *subflow;
 	bool do_check_data_fin = false;
 	int push_count = 1;
 
 	while (mptcp_send_head(sk) && (push_count > 0)) {
-		struct mptcp_subflow_context *subflow;
+		struct mptcp_data_frag *head = mptcp_send_head(sk);
+		u16 head_sent = head->already_sent;
+		bool pushed = false;
 		int ret = 0;
 
 		if (mptcp_sched_get_send(msk))
@@ -1624,6 +1720,20 @@ void __mptcp_push_pending(struct sock *sk, unsigned int flags)
 					lock_sock(ssk);
 				}
 
+				/* Catch up with what was pushed on the others
+				 * while this one could not be locked.
+				 */
+				__subflow_push_redundant_pending(sk, ssk, &info);
+
+				/* Once a subflow made progress, the others picked
+				 * by the scheduler carry the same data.
+				 */
+				if (pushed) {
+					__subflow_push_redundant(sk, ssk, head,
+								 head_sent, &info);
+					continue;
+				}
+
 				push_count++;
 
 				ret = __subflow_push_pending(sk, ssk, &info);
@@ -1634,6 +1744,7 @@ void __mptcp_push_pending(struct sock *sk, unsigned int flags)
 						push_count--;
 					continue;
 				}
+				pushed = true;
 				do_check_data_fin = true;
 			}
 		}
@@ -1643,6 +1754,17 @@ void __mptcp_push_pending(struct sock *sk, unsigned int flags)
 	if (ssk)
 		mptcp_push_release(ssk, &info);
 
+	/* subflows delegated while the msk was owned, with no new data left */
+	mptcp_for_each_subflow(msk, subflow) {
+		if (!subflow->redundant)
+			continue;
+
+		ssk = mptcp_subflow_tcp_sock(subflow);
+		lock_sock(ssk);
+		__subflow_push_redundant_pending(sk, ssk, &info);
+		mptcp_push_release(ssk, &info);
+	}
+
 	/* ensure the rtx timer is running */
 	if (!mptcp_rtx_timer_pending(sk))
 		mptcp_reset_rtx_timer(sk);
@@ -1657,10 +1779,13 @@ static void __mptcp_subflow_push_pending(struct sock *sk, struct sock *ssk, bool
 		.data_lock_held = true,
 	};
 	bool keep_pushing = true;
+	u64 push_seq = msk->snd_nxt;
 	struct sock *xmit_ssk;
-	int copied = 0;
+	int copied;
 
 	info.flags = 0;
+	copied = max(__subflow_push_redundant_pending(sk, ssk, &info), 0);
+
 	while (mptcp_send_head(sk) && keep_pushing) {
 		struct mptcp_subflow_context *subflow = mptcp_subflow_ctx(ssk);
 		int ret = 0;
@@ -1702,6 +1827,13 @@ static void __mptcp_subflow_push_pending(struct sock *sk, struct sock *ssk, bool
 	}
 
 out:
+	/* With several subflows picked at once, what went out here, including
+	 * through the first chunk which skips the scheduler, goes on the
+	 * others as well.
+	 */
+	if (msk->sched_multi && msk->snd_nxt != push_seq)
+		mptcp_subflow_mark_redundant(msk, ssk, push_seq);
+
 	/* __mptcp_alloc_tx_skb could have released some wmem and we are
 	 * not going to flush it via release_sock()
 	 */
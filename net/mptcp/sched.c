@@ -36,6 +36,93 @@ static struct mptcp_sched_ops mptcp_sched_default = {
 	.owner		= THIS_MODULE,
 };
 
+/* Picks the subflow with the lowest smoothed RTT that still has room in its
+ * congestion window, so that the slower paths only carry what the faster
+ * ones can't take right now. Backup subflows are used only if no other
+ * subflow is active.
+ */
+static int mptcp_sched_minrtt_get_subflow(struct mptcp_sock *msk,
+					  struct mptcp_sched_data *data)
+{
+	struct mptcp_subflow_context *subflow, *pick[2] = {};
+	u32 srtt, min_srtt[2] = { U32_MAX, U32_MAX };
+	bool backup, active = false;
+	struct tcp_sock *tp;
+	struct sock *ssk;
+
+	if (data->reinject)
+		return mptcp_sched_default_get_subflow(msk, data);
+
+	mptcp_for_each_subflow(msk, subflow) {
+		backup = subflow->backup || subflow->request_bkup;
+		if (!mptcp_subflow_active(subflow))
+			continue;
+		active |= !backup;
+
+		ssk = mptcp_subflow_tcp_sock(subflow);
+		tp = tcp_sk(ssk);
+		if (!sk_stream_memory_free(ssk) ||
+		    tcp_packets_in_flight(tp) >= tcp_snd_cwnd(tp))
+			continue;
+
+		srtt = tp->srtt_us ? : U32_MAX - 1;
+		if (srtt < min_srtt[backup]) {
+			min_srtt[backup] = srtt;
+			pick[backup] = subflow;
+		}
+	}
+	mptcp_set_timeout((struct sock *)msk);
+
+	subflow = active ? pick[0] : pick[1];
+	if (!subflow)
+		return -EINVAL;
+
+	mptcp_subflow_set_scheduled(subflow, true);
+	msk->snd_burst = mptcp_send_burst(msk);
+	return 0;
+}
+
+static struct mptcp_sched_ops mptcp_sched_minrtt = {
+	.get_subflow	= mptcp_sched_minrtt_get_subflow,
+	.name		= "minrtt",
+	.owner		= THIS_MODULE,
+};
+
+/* Sends all data on every active subflow, trading bandwidth for the latency
+ * of the fastest path and for not waiting on losses of any single one.
+ */
+static int mptcp_sched_redundant_get_subflow(struct mptcp_sock *msk,
+					     struct mptcp_sched_data *data)
+{
+	struct mptcp_subflow_context *subflow;
+	bool picked = false;
+
+	if (data->reinject)
+		return mptcp_sched_default_get_subflow(msk, data);
+
+	mptcp_for_each_subflow(msk, subflow) {
+		if (!mptcp_subflow_active(subflow) ||
+		    !sk_stream_memory_free(mptcp_subflow_tcp_sock(subflow)))
+			continue;
+
+		mptcp_subflow_set_scheduled(subflow, true);
+		picked = true;
+	}
+	mptcp_set_timeout((struct sock *)msk);
+
+	if (!picked)
+		return -EINVAL;
+
+	msk->snd_burst = mptcp_send_burst(msk);
+	return 0;
+}
+
+static struct mptcp_sched_ops mptcp_sched_redundant = {
+	.get_subflow	= mptcp_sched_redundant_get_subflow,
+	.name		= "redundant",
+	.owner		= THIS_MODULE,
+};
+
 /* Must be called with rcu read lock held */
 struct mptcp_sched_ops *mptcp_sched_find(const char *name)
 {
@@ -90,7 +177,8 @@ int mptcp_register_scheduler(struct mptcp_sched_ops *sched)
 
 void mptcp_unregister_scheduler(struct mptcp_sched_ops *sched)
 {
-	if (sched == &mptcp_sched_default)
+	if (sched == &mptcp_sched_default || sched == &mptcp_sched_minrtt ||
+	    sched == &mptcp_sched_redundant)
 		return;
 
 	spin_lock(&mptcp_sched_list_lock);
@@ -101,6 +189,8 @@ void mptcp_unregister_scheduler(struct mptcp_sched_ops *sched)
 void mptcp_sched_init(void)
 {
 	mptcp_register_scheduler(&mptcp_sched_default);
+	mptcp_register_scheduler(&mptcp_sched_minrtt);
+	mptcp_register_scheduler(&mptcp_sched_redundant);
 }
 
 int mptcp_init_sched(struct mptcp_sock *msk,
@@ -145,6 +235,7 @@ int mptcp_sched_get_send(struct mptcp_sock *msk)
 {
 	struct mptcp_subflow_context *subflow;
 	struct mptcp_sched_data data;
+	int err, picked = 0;
 
 	msk_owned_by_me(msk);
 
@@ -165,9 +256,16 @@ int mptcp_sched_get_send(struct mptcp_sock *msk)
 	}
 
 	data.reinject = false;
-	if (msk->sched == &mptcp_sched_default || !msk->sched)
+	if (msk->sched == &mptcp_sched_default || !msk->sched) {
+		msk->sched_multi = 0;
 		return mptcp_sched_default_get_subflow(msk, &data);
-	return msk->sched->get_subflow(msk, &data);
+	}
+
+	err = msk->sched->get_subflow(msk, &data);
+	mptcp_for_each_subflow(msk, subflow)
+		picked += READ_ONCE(subflow->scheduled);
+	msk->sched_multi = picked > 1;
+	return err;
 }
 
 int mptcp_sched_get_retrans(struct mptcp_sock *msk)
@@ -95,6 +95,7 @@
 #include <linux/netfilter_netdev.h>
 
 #include "internal.h"
+#include "../core/dev.h"
 
 /*
    Assumptions:
@@ -231,6 +232,9 @@ struct packet_skb_cb {
 
 #define PACKET_SKB_CB(__skb)	((struct packet_skb_cb *)((__skb)->cb))
 
+/* Most TPACKET_V3 frames queued before they are handed to the device */
+#define PACKET_TX_BATCH_MAX	256
+
 #define GET_PBDQC_FROM_RB(x)	((struct tpacket_kbdq_core *)(&(x)->prb_bdqc))
 #define GET_PBLOCK_DESC(x, bid)	\
 	((struct tpacket_block_desc *)((x)->pkbdq[(bid)].buffer))
@@ -285,6 +289,88 @@ static int packet_xmit(const struct packet_sock *po, struct sk_buff *skb)
 	return dev_direct_xmit(skb, packet_pick_tx_queue(skb));
 }
 
+/* Sends the frames queued by tpacket_snd() in one pass: the tx queue is
+ * locked once and the driver is told more frames follow for all but the
+ * last one. Unlike dev_direct_xmit(), GSO frames the device cannot take
+ * are segmented rather than dropped.
+ *
+ * Returns -ENOBUFS if the tx queue stopped before all of them were sent,
+ * in which case the ones left are on @list again, in order.
+ */
+static int packet_xmit_batch(struct sk_buff_head *list)
+{
+	struct sk_buff *skb, *segs, *head = NULL, *tail = NULL;
+	struct net_device *dev;
+	struct netdev_queue *txq;
+	bool again = false;
+	u16 queue_index;
+
+	if (skb_queue_empty(list))
+		return 0;
+
+	dev = skb_peek(list)->dev;
+	if (unlikely(!netif_running(dev) || !netif_carrier_ok(dev))) {
+		while ((skb = __skb_dequeue(list))) {
+			dev_core_stats_tx_dropped_inc(dev);
+			kfree_skb(skb);
+		}
+		return -ENOBUFS;
+	}
+
+	queue_index = packet_pick_tx_queue(skb_peek(list));
+	while ((skb = __skb_dequeue(list))) {
+#ifdef CONFIG_NETFILTER_EGRESS
+		if (nf_hook_egress_active()) {
+			skb = nf_hook_direct_egress(skb);
+			if (!skb)
+				continue;
+		}
+#endif
+		skb_set_queue_mapping(skb, queue_index);
+		segs = validate_xmit_skb_list(skb, dev, &again);
+		if (!segs)
+			continue;
+
+		if (!head)
+			head = segs;
+		else
+			tail->next = segs;
+		for (tail = segs; tail->next; tail = tail->next)
+			;
+	}
+
+	txq = netdev_get_tx_queue(dev, queue_index);
+	local_bh_disable();
+	dev_xmit_recursion_inc();
+	HARD_TX_LOCK(dev, txq, smp_processor_id());
+	while (head && !netif_xmit_frozen_or_drv_stopped(txq)) {
+		skb = head;
+		head = skb->next;
+		skb_mark_not_on_list(skb);
+
+		if (!dev_xmit_complete(netdev_start_xmit(skb, dev, txq, !!head))) {
+			/* not taken by the driver, still ours */
+			skb->next = head;
+			head = skb;
+			break;
+		}
+	}
+	HARD_TX_UNLOCK(dev, txq);
+	dev_xmit_recursion_dec();
+	local_bh_enable();
+
+	if (likely(!head))
+		return 0;
+
+	while (head) {
+		skb = head;
+		head = skb->next;
+		skb_mark_not_on_list(skb);
+		__skb_queue_tail(list, skb);
+	}
+	return -ENOBUFS;
+}
+
 static struct net_device *packet_cached_dev_get(struct packet_sock *po)
 {
 	struct net_device *dev;
@@ -2767,9 +2853,50 @@ static int tpacket_parse_header(struct packet_sock *po, void *frame,
 	return tp_len;
 }
 
+/* Hands a batch to packet_xmit_batch(). The frames a stopped tx queue left
+ * over go back to TP_STATUS_SEND_REQUEST, with the ring head moved back
+ * over them, so that the next send picks them up again instead of losing
+ * them. That only works for the run of frames right before the head; what
+ * else is left over (segments of GSO frames, whose slots were released when
+ * they were segmented) is dropped.
+ */
+static int tpacket_snd_batch(struct packet_sock *po, struct sk_buff_head *batch)
+{
+	struct packet_ring_buffer *rb = &po->tx_ring;
+	struct sk_buff *skb, *tmp;
+	int err;
+
+	err = packet_xmit_batch(batch);
+	if (likely(!err))
+		return 0;
+
+	skb_queue_reverse_walk_safe(batch, skb, tmp) {
+		void *ph = packet_previous_frame(po, rb, TP_STATUS_SENDING);
+
+		if (skb->destructor != tpacket_destruct_skb ||
+		    skb_zcopy_get_nouarg(skb) != ph)
+			break;
+
+		__skb_unlink(skb, batch);
+		__packet_set_status(po, ph, TP_STATUS_SEND_REQUEST);
+		rb->head = rb->head ? rb->head - 1 : rb->frame_max;
+		packet_dec_pending(rb);
+		skb->destructor = sock_wfree;
+		consume_skb(skb);
+	}
+
+	while ((skb = __skb_dequeue(batch))) {
+		dev_core_stats_tx_dropped_inc(skb->dev);
+		kfree_skb(skb);
+	}
+	return err;
+}
+
 static int tpacket_snd(struct packet_sock *po, struct msghdr *msg)
 {
 	struct sk_buff *skb = NULL;
+	struct sk_buff_head batch;
+	unsigned int tx_batch = 0;
 	struct net_device *dev;
 	struct virtio_net_hdr *vnet_hdr = NULL;
 	struct sockcm_cookie sockc;
@@ -2787,6 +2914,7 @@ static int tpacket_snd(struct packet_sock *po, struct msghdr *msg)
 	int hlen, tlen, copylen = 0;
 	long timeo = 0;
 
+	__skb_queue_head_init(&batch);
 	mutex_lock(&po->pg_vec_lock);
 
 	/* packet_sendmsg() check on tx_ring.pg_vec was lockless,
@@ -2839,12 +2967,19 @@ static int tpacket_snd(struct packet_sock *po, struct msghdr *msg)
 	if ((size_max > dev->mtu + reserve + VLAN_HLEN) && !vnet_hdr_sz)
 		size_max = dev->mtu + reserve + VLAN_HLEN;
 
+	if (po->tp_version == TPACKET_V3 &&
+	    packet_sock_flag(po, PACKET_SOCK_QDISC_BYPASS))
+		tx_batch = READ_ONCE(po->tx_batch);
+
 	reinit_completion(&po->skb_completion);
 
 	do {
 		ph = packet_current_frame(po, &po->tx_ring,
 					  TP_STATUS_SEND_REQUEST);
 		if (unlikely(ph == NULL)) {
+			err = tpacket_snd_batch(po, &batch);
+			if (unlikely(err))
+				goto out_put;
 			if (need_wait && skb) {
 				timeo = sock_sndtimeo(&po->sk, msg->msg_flags & MSG_DONTWAIT);
 				timeo = wait_for_completion_interruptible_timeout(&po->skb_completion, timeo);
@@ -2878,6 +3013,13 @@ static int tpacket_snd(struct packet_sock *po, struct msghdr *msg)
 						    vnet_hdr->hdr_len);
 		}
 		copylen = max_t(int, copylen, dev->hard_header_len);
+		/* Queued frames hold on to sk_wmem_alloc until they are sent */
+		if (!skb_queue_empty(&batch) &&
+		    sk_wmem_alloc_get(&po->sk) >= READ_ONCE(po->sk.sk_sndbuf)) {
+			err = tpacket_snd_batch(po, &batch);
+			if (unlikely(err))
+				goto out_put;
+		}
 		skb = sock_alloc_send_skb(&po->sk,
 				hlen + tlen + sizeof(struct sockaddr_ll) +
 				(copylen - dev->hard_header_len),
@@ -2925,6 +3067,22 @@ static int tpacket_snd(struct packet_sock *po, struct msghdr *msg)
 		packet_inc_pending(&po->tx_ring);
 
 		status = TP_STATUS_SEND_REQUEST;
+		if (tx_batch > 1) {
+			/* Frames dropped on the way are handed back to user
+			 * space by tpacket_destruct_skb(), as with congestion.
+			 * The head is advanced first, tpacket_snd_batch() may
+			 * move it back over frames a stopped queue left.
+			 */
+			__skb_queue_tail(&batch, skb);
+			packet_increment_head(&po->tx_ring);
+			len_sum += tp_len;
+			if (skb_queue_len(&batch) >= tx_batch) {
+				err = tpacket_snd_batch(po, &batch);
+				if (unlikely(err))
+					goto out_put;
+			}
+			continue;
+		}
 		err = packet_xmit(po, skb);
 		if (unlikely(err != 0)) {
 			if (err > 0)
@@ -2959,6 +3117,8 @@ static int tpacket_snd(struct packet_sock *po, struct msghdr *msg)
 	__packet_set_status(po, ph, status);
 	kfree_skb(skb);
 out_put:
+	if (unlikely(tpacket_snd_batch(po, &batch)) && err >= 0)
+		err = -ENOBUFS;
 	dev_put(dev);
 out:
 	mutex_unlock(&po->pg_vec_lock);
@@ -4098,6 +4258,20 @@ packet_setsockopt(struct socket *sock, int level, int optname, sockptr_t optval,
 		packet_sock_flag_set(po, PACKET_SOCK_QDISC_BYPASS, val);
 		return 0;
 	}
+	case PACKET_TX_BATCH:
+	{
+		int val;
+
+		if (optlen != sizeof(val))
+			return -EINVAL;
+		if (copy_from_sockptr(&val, optval, sizeof(val)))
+			return -EFAULT;
+		if (val < 0 || val > PACKET_TX_BATCH_MAX)
+			return -EINVAL;
+
+		WRITE_ONCE(po->tx_batch, val);
+		return 0;
+	}
 	default:
 		return -ENOPROTOOPT;
 	}
@@ -4218,6 +4392,9 @@ static int packet_getsockopt(struct socket *sock, int level, int optname,
 	case PACKET_QDISC_BYPASS:
 		val = packet_sock_flag(po, PACKET_SOCK_QDISC_BYPASS);
 		break;
+	case PACKET_TX_BATCH:
+		val = READ_ONCE(po->tx_batch);
+		break;
 	default:
 		return -ENOPROTOOPT;
 	}
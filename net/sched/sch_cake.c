@@ -46,6 +46,13 @@
  * priority-based weight (high) or a bandwidth-based weight (low) is used for
  * that tin in the current pass.
  *
+ * On multiqueue devices, the cake_mq variant runs one instance per tx queue,
+ * so that the queues are served in parallel.  The instances charge their
+ * packets to a common shaper with atomic operations, and share the bulk flow
+ * counts of the hosts.  Each instance is given a share of the rate matching
+ * the fraction of the hosts' bulk flows it holds, so that hosts keep getting
+ * even shares of the link however their flows are spread across the queues.
+ *
  * This qdisc was inspired by Eric Dumazet's fq_codel code, which he kindly
  * granted us permission to leverage.
  */
@@ -63,6 +70,7 @@
 #include <linux/slab.h>
 #include <linux/vmalloc.h>
 #include <linux/reciprocal_div.h>
+#include <linux/refcount.h>
 #include <net/netlink.h>
 #include <linux/if_vlan.h>
 #include <net/gso.h>
@@ -80,6 +88,8 @@
 #define CAKE_QUEUES (1024)
 #define CAKE_FLOW_MASK 63
 #define CAKE_FLOW_NAT_FLAG 64
+#define CAKE_MQ_SYNC_NS (200 * NSEC_PER_USEC)
+#define CAKE_MQ_SLACK_NS (100 * NSEC_PER_USEC)
 
 /* struct cobalt_params - contains codel and blue parameters
  * @interval:	codel initial drop rate
@@ -147,12 +157,36 @@ struct cake_heap_entry {
 	u16 t:3, b:10;
 };
 
+/* bulk flow counts of a host over all the tx queues of a cake_mq.  The
+ * instances keep their hosts in set-associative slots of their own, so these
+ * are indexed by host hash instead, see cake_mq_srchost().
+ */
+struct cake_mq_host {
+	atomic_t srchost_bulk_flow_count;
+	atomic_t dsthost_bulk_flow_count;
+};
+
+struct cake_mq_shared {
+	refcount_t	refcnt;
+	unsigned int	nr_queues;
+
+	/* aggregate shaper, time_next = time_this + len * rate_ns */
+	atomic64_t	time_next_packet ____cacheline_aligned_in_smp;
+
+	struct cake_mq_host hosts[CAKE_MAX_TINS][CAKE_QUEUES]
+			____cacheline_aligned_in_smp;
+
+	/* weight of the bulk flows of each queue, see cake_mq_weight() */
+	u32		weights[];
+};
+
 struct cake_tin_data {
 	struct cake_flow flows[CAKE_QUEUES];
 	u32	backlogs[CAKE_QUEUES];
 	u32	tags[CAKE_QUEUES]; /* for set association */
 	u16	overflow_idx[CAKE_QUEUES];
 	struct cake_host hosts[CAKE_QUEUES]; /* for triple isolation */
+	struct cake_mq_host *mq_hosts; /* same, for all queues of a cake_mq */
 	u16	flow_quantum;
 
 	struct cobalt_params cparams;
@@ -254,6 +288,12 @@ struct cake_sched_data {
 	u16		max_adjlen;
 	u16		min_netlen;
 	u16		min_adjlen;
+
+	/* cake_mq: state shared with the instances of the other tx queues */
+	struct cake_mq_shared *mq;
+	u16		mq_idx;
+	u32		mq_share;	/* (all weights / ours) in 16.16 */
+	ktime_t		mq_next_sync;
 };
 
 enum {
@@ -627,13 +667,30 @@ static bool cake_ddst(int flow_mode)
 	return (flow_mode & CAKE_FLOW_DUAL_DST) == CAKE_FLOW_DUAL_DST;
 }
 
+/* The counts of a cake_mq are only changed along with the local ones, so
+ * that they always hold the sum of the local counts of all instances, for
+ * the hosts of the same hash.
+ */
+static atomic_t *cake_mq_srchost(const struct cake_tin_data *q, u32 host_hash)
+{
+	return &q->mq_hosts[host_hash % CAKE_QUEUES].srchost_bulk_flow_count;
+}
+
+static atomic_t *cake_mq_dsthost(const struct cake_tin_data *q, u32 host_hash)
+{
+	return &q->mq_hosts[host_hash % CAKE_QUEUES].dsthost_bulk_flow_count;
+}
+
 static void cake_dec_srchost_bulk_flow_count(struct cake_tin_data *q,
 					     struct cake_flow *flow,
 					     int flow_mode)
 {
 	if (likely(cake_dsrc(flow_mode) &&
-		   q->hosts[flow->srchost].srchost_bulk_flow_count))
+		   q->hosts[flow->srchost].srchost_bulk_flow_count)) {
 		q->hosts[flow->srchost].srchost_bulk_flow_count--;
+		if (q->mq_hosts)
+			atomic_dec(cake_mq_srchost(q, q->hosts[flow->srchost].srchost_tag));
+	}
 }
 
 static void cake_inc_srchost_bulk_flow_count(struct cake_tin_data *q,
@@ -641,8 +698,11 @@ static void cake_inc_srchost_bulk_flow_count(struct cake_tin_data *q,
 					     int flow_mode)
 {
 	if (likely(cake_dsrc(flow_mode) &&
-		   q->hosts[flow->srchost].srchost_bulk_flow_count < CAKE_QUEUES))
+		   q->hosts[flow->srchost].srchost_bulk_flow_count < CAKE_QUEUES)) {
 		q->hosts[flow->srchost].srchost_bulk_flow_count++;
+		if (q->mq_hosts)
+			atomic_inc(cake_mq_srchost(q, q->hosts[flow->srchost].srchost_tag));
+	}
 }
 
 static void cake_dec_dsthost_bulk_flow_count(struct cake_tin_data *q,
@@ -650,8 +710,11 @@ static void cake_dec_dsthost_bulk_flow_count(struct cake_tin_data *q,
 					     int flow_mode)
 {
 	if (likely(cake_ddst(flow_mode) &&
-		   q->hosts[flow->dsthost].dsthost_bulk_flow_count))
+		   q->hosts[flow->dsthost].dsthost_bulk_flow_count)) {
 		q->hosts[flow->dsthost].dsthost_bulk_flow_count--;
+		if (q->mq_hosts)
+			atomic_dec(cake_mq_dsthost(q, q->hosts[flow->dsthost].dsthost_tag));
+	}
 }
 
 static void cake_inc_dsthost_bulk_flow_count(struct cake_tin_data *q,
@@ -659,23 +722,76 @@ static void cake_inc_dsthost_bulk_flow_count(struct cake_tin_data *q,
 					     int flow_mode)
 {
 	if (likely(cake_ddst(flow_mode) &&
-		   q->hosts[flow->dsthost].dsthost_bulk_flow_count < CAKE_QUEUES))
+		   q->hosts[flow->dsthost].dsthost_bulk_flow_count < CAKE_QUEUES)) {
 		q->hosts[flow->dsthost].dsthost_bulk_flow_count++;
+		if (q->mq_hosts)
+			atomic_inc(cake_mq_dsthost(q, q->hosts[flow->dsthost].dsthost_tag));
+	}
 }
 
-static u16 cake_get_flow_quantum(struct cake_tin_data *q,
-				 struct cake_flow *flow,
-				 int flow_mode)
+/* A host slot is only taken over with bulk flows left when all the slots of
+ * its set are in use.  Its shared counts then move along to the new host.
+ */
+static void cake_set_srchost_tag(struct cake_tin_data *q, u32 host,
+				 u32 host_hash)
+{
+	u16 count = q->hosts[host].srchost_bulk_flow_count;
+
+	if (q->mq_hosts && count) {
+		atomic_sub(count, cake_mq_srchost(q, q->hosts[host].srchost_tag));
+		atomic_add(count, cake_mq_srchost(q, host_hash));
+	}
+	q->hosts[host].srchost_tag = host_hash;
+}
+
+static void cake_set_dsthost_tag(struct cake_tin_data *q, u32 host,
+				 u32 host_hash)
+{
+	u16 count = q->hosts[host].dsthost_bulk_flow_count;
+
+	if (q->mq_hosts && count) {
+		atomic_sub(count, cake_mq_dsthost(q, q->hosts[host].dsthost_tag));
+		atomic_add(count, cake_mq_dsthost(q, host_hash));
+	}
+	q->hosts[host].dsthost_tag = host_hash;
+}
+
+static u16 cake_srchost_load(const struct cake_tin_data *q, u16 host)
+{
+	if (q->mq_hosts)
+		return clamp(atomic_read(cake_mq_srchost(q, q->hosts[host].srchost_tag)),
+			     0, CAKE_QUEUES);
+	return q->hosts[host].srchost_bulk_flow_count;
+}
+
+static u16 cake_dsthost_load(const struct cake_tin_data *q, u16 host)
+{
+	if (q->mq_hosts)
+		return clamp(atomic_read(cake_mq_dsthost(q, q->hosts[host].dsthost_tag)),
+			     0, CAKE_QUEUES);
+	return q->hosts[host].dsthost_bulk_flow_count;
+}
+
+static u16 cake_host_load(const struct cake_tin_data *q,
+			  const struct cake_flow *flow,
+			  int flow_mode)
 {
 	u16 host_load = 1;
 
 	if (cake_dsrc(flow_mode))
-		host_load = max(host_load,
-				q->hosts[flow->srchost].srchost_bulk_flow_count);
+		host_load = max(host_load, cake_srchost_load(q, flow->srchost));
 
 	if (cake_ddst(flow_mode))
-		host_load = max(host_load,
-				q->hosts[flow->dsthost].dsthost_bulk_flow_count);
+		host_load = max(host_load, cake_dsthost_load(q, flow->dsthost));
+
+	return host_load;
+}
+
+static u16 cake_get_flow_quantum(struct cake_tin_data *q,
+				 struct cake_flow *flow,
+				 int flow_mode)
+{
+	u16 host_load = cake_host_load(q, flow, flow_mode);
 
 	/* The get_random_u16() is a way to apply dithering to avoid
 	 * accumulating roundoff errors
@@ -853,7 +969,7 @@ static u32 cake_hash(struct cake_tin_data *q, const struct sk_buff *skb,
 				if (!q->hosts[outer_hash + k].srchost_bulk_flow_count)
 					break;
 			}
-			q->hosts[outer_hash + k].srchost_tag = srchost_hash;
+			cake_set_srchost_tag(q, outer_hash + k, srchost_hash);
 found_src:
 			srchost_idx = outer_hash + k;
 			q->flows[reduced_hash].srchost = srchost_idx;
@@ -877,7 +993,7 @@ static u32 cake_hash(struct cake_tin_data *q, const struct sk_buff *skb,
 				if (!q->hosts[outer_hash + k].dsthost_bulk_flow_count)
 					break;
 			}
-			q->hosts[outer_hash + k].dsthost_tag = dsthost_hash;
+			cake_set_dsthost_tag(q, outer_hash + k, dsthost_hash);
 found_dst:
 			dsthost_idx = outer_hash + k;
 			q->flows[reduced_hash].dsthost = dsthost_idx;
@@ -1509,6 +1625,22 @@ static void cake_heapify_up(struct cake_sched_data *q, u16 i)
 	}
 }
 
+/* Charge a packet to the shaper common to all queues of a cake_mq.  Time
+ * lost to scheduling latency can be caught up, up to CAKE_MQ_SLACK_NS.
+ */
+static void cake_mq_advance_shaper(struct cake_mq_shared *mq, u64 dur,
+				   ktime_t now)
+{
+	s64 floor = ktime_to_ns(now) - CAKE_MQ_SLACK_NS;
+	s64 old = atomic64_read(&mq->time_next_packet);
+
+	do {
+		if (old < floor)
+			old = floor;
+	} while (!atomic64_try_cmpxchg(&mq->time_next_packet, &old,
+				       old + dur));
+}
+
 static int cake_advance_shaper(struct cake_sched_data *q,
 			       struct cake_tin_data *b,
 			       struct sk_buff *skb,
@@ -1522,7 +1654,16 @@ static int cake_advance_shaper(struct cake_sched_data *q,
 	if (q->rate_ns) {
 		u64 tin_dur = (len * b->tin_rate_ns) >> b->tin_rate_shft;
 		u64 global_dur = (len * q->rate_ns) >> q->rate_shft;
-		u64 failsafe_dur = global_dur + (global_dur >> 1);
+		u64 failsafe_dur;
+
+		/* the global shaper of a cake_mq instance runs at its
+		 * share of the rate
+		 */
+		if (q->mq) {
+			cake_mq_advance_shaper(q->mq, global_dur, now);
+			global_dur = mul_u64_u32_shr(global_dur, q->mq_share, 16);
+		}
+		failsafe_dur = global_dur + (global_dur >> 1);
 
 		if (ktime_before(b->time_next_packet, now))
 			b->time_next_packet = ktime_add_ns(b->time_next_packet,
@@ -1968,6 +2109,68 @@ static void cake_clear_tin(struct Qdisc *sch, u16 tin)
 			kfree_skb(skb);
 }
 
+/* Weight of the bulk flows of a cake_mq instance.  Each flow counts for its
+ * fraction of the bulk flows of its host over all queues, so the weights of
+ * all instances add up to the number of hosts with bulk flows.
+ */
+static u32 cake_mq_weight(struct cake_sched_data *q)
+{
+	struct cake_flow *flow;
+	u32 weight = 0;
+	int i;
+
+	for (i = 0; i < q->tin_cnt; i++) {
+		struct cake_tin_data *b = &q->tins[i];
+
+		if (!b->bulk_flow_count)
+			continue;
+
+		list_for_each_entry(flow, &b->old_flows, flowchain)
+			if (flow->set == CAKE_SET_BULK)
+				weight += quantum_div[cake_host_load(b, flow,
+								     q->flow_mode)];
+	}
+	return weight;
+}
+
+/* Publish our weight and work out our share of the rate from the weights of
+ * all queues, every CAKE_MQ_SYNC_NS while we have packets.
+ */
+static void cake_mq_sync(struct cake_sched_data *q, ktime_t now)
+{
+	struct cake_mq_shared *mq = q->mq;
+	u64 total = 0;
+	unsigned int i;
+	u32 weight;
+
+	if (ktime_before(now, q->mq_next_sync))
+		return;
+	q->mq_next_sync = ktime_add_ns(now, CAKE_MQ_SYNC_NS);
+
+	weight = cake_mq_weight(q);
+	WRITE_ONCE(mq->weights[q->mq_idx], weight);
+
+	/* queues with sparse flows only are just held by the common shaper */
+	if (!weight) {
+		q->mq_share = 1 << 16;
+		return;
+	}
+
+	for (i = 0; i < mq->nr_queues; i++)
+		total += READ_ONCE(mq->weights[i]);
+
+	q->mq_share = clamp_t(u64, div_u64(total << 16, weight),
+			      1 << 16, U32_MAX);
+}
+
+static void cake_mq_idle(struct cake_sched_data *q)
+{
+	if (q->mq_next_sync) {
+		WRITE_ONCE(q->mq->weights[q->mq_idx], 0);
+		q->mq_next_sync = 0;
+	}
+}
+
 static struct sk_buff *cake_dequeue(struct Qdisc *sch)
 {
 	struct cake_sched_data *q = qdisc_priv(sch);
@@ -1981,8 +2184,14 @@ static struct sk_buff *cake_dequeue(struct Qdisc *sch)
 	u32 len;
 
 begin:
-	if (!sch->q.qlen)
+	if (!sch->q.qlen) {
+		if (q->mq)
+			cake_mq_idle(q);
 		return NULL;
+	}
+
+	if (q->mq && q->rate_ns)
+		cake_mq_sync(q, now);
 
 	/* global hard shaper */
 	if (ktime_after(q->time_next_packet, now) &&
@@ -1995,6 +2204,17 @@ static struct sk_buff *cake_dequeue(struct Qdisc *sch)
 		return NULL;
 	}
 
+	/* shaper common to all queues of a cake_mq */
+	if (q->mq && q->rate_ns) {
+		s64 next = atomic64_read(&q->mq->time_next_packet);
+
+		if (next > ktime_to_ns(now)) {
+			sch->qstats.overlimits++;
+			qdisc_watchdog_schedule_ns(&q->watchdog, next);
+			return NULL;
+		}
+	}
+
 	/* Choose a class to work on. */
 	if (!q->rate_ns) {
 		/* In unlimited mode, can't rely on shaper timings, just balance
@@ -2229,6 +2449,9 @@ static void cake_reset(struct Qdisc *sch)
 
 	for (c = 0; c < CAKE_MAX_TINS; c++)
 		cake_clear_tin(sch, c);
+
+	if (q->mq)
+		cake_mq_idle(q);
 }
 
 static const struct nla_policy cake_policy[TCA_CAKE_MAX + 1] = {
@@ -2563,13 +2786,12 @@ static void cake_reconfigure(struct Qdisc *sch)
 				  q->buffer_config_limit));
 }
 
-static int cake_change(struct Qdisc *sch, struct nlattr *opt,
-		       struct netlink_ext_ack *extack)
+/* Everything that can make a change fail is checked here, before applying
+ * it, so that cake_mq can apply a change to all its queues or to none.
+ */
+static int cake_parse_opt(struct nlattr *opt, struct nlattr **tb,
+			  struct netlink_ext_ack *extack)
 {
-	struct cake_sched_data *q = qdisc_priv(sch);
-	struct nlattr *tb[TCA_CAKE_MAX + 1];
-	u16 rate_flags;
-	u8 flow_mode;
 	int err;
 
 	err = nla_parse_nested_deprecated(tb, TCA_CAKE_MAX, opt, cake_policy,
@@ -2577,17 +2799,28 @@ static int cake_change(struct Qdisc *sch, struct nlattr *opt,
 	if (err < 0)
 		return err;
 
-	flow_mode = q->flow_mode;
+#if !IS_ENABLED(CONFIG_NF_CONNTRACK)
 	if (tb[TCA_CAKE_NAT]) {
-#if IS_ENABLED(CONFIG_NF_CONNTRACK)
-		flow_mode &= ~CAKE_FLOW_NAT_FLAG;
-		flow_mode |= CAKE_FLOW_NAT_FLAG *
-			!!nla_get_u32(tb[TCA_CAKE_NAT]);
-#else
 		NL_SET_ERR_MSG_ATTR(extack, tb[TCA_CAKE_NAT],
 				    "No conntrack support in kernel");
 		return -EOPNOTSUPP;
+	}
 #endif
+
+	return 0;
+}
+
+static void cake_apply_opt(struct Qdisc *sch, struct nlattr **tb)
+{
+	struct cake_sched_data *q = qdisc_priv(sch);
+	u16 rate_flags;
+	u8 flow_mode;
+
+	flow_mode = q->flow_mode;
+	if (tb[TCA_CAKE_NAT]) {
+		flow_mode &= ~CAKE_FLOW_NAT_FLAG;
+		flow_mode |= CAKE_FLOW_NAT_FLAG *
+			!!nla_get_u32(tb[TCA_CAKE_NAT]);
 	}
 
 	if (tb[TCA_CAKE_BASE_RATE64])
@@ -2693,16 +2926,60 @@ static int cake_change(struct Qdisc *sch, struct nlattr *opt,
 		cake_reconfigure(sch);
 		sch_tree_unlock(sch);
 	}
+}
+
+static int cake_change(struct Qdisc *sch, struct nlattr *opt,
+		       struct netlink_ext_ack *extack)
+{
+	struct nlattr *tb[TCA_CAKE_MAX + 1];
+	int err;
 
+	err = cake_parse_opt(opt, tb, extack);
+	if (err)
+		return err;
+
+	cake_apply_opt(sch, tb);
 	return 0;
 }
 
+static void cake_mq_put(struct cake_mq_shared *mq)
+{
+	if (refcount_dec_and_test(&mq->refcnt))
+		kvfree(mq);
+}
+
+/* Take the bulk flows of an instance going away out of the shared counts */
+static void cake_mq_unbind(struct cake_sched_data *q)
+{
+	struct cake_mq_shared *mq = q->mq;
+	int i, j;
+
+	for (i = 0; i < CAKE_MAX_TINS; i++) {
+		struct cake_tin_data *b = &q->tins[i];
+
+		for (j = 0; j < CAKE_QUEUES; j++) {
+			struct cake_host *h = &b->hosts[j];
+
+			atomic_sub(h->srchost_bulk_flow_count,
+				   cake_mq_srchost(b, h->srchost_tag));
+			atomic_sub(h->dsthost_bulk_flow_count,
+				   cake_mq_dsthost(b, h->dsthost_tag));
+		}
+		b->mq_hosts = NULL;
+	}
+	WRITE_ONCE(mq->weights[q->mq_idx], 0);
+	q->mq = NULL;
+	cake_mq_put(mq);
+}
+
 static void cake_destroy(struct Qdisc *sch)
 {
 	struct cake_sched_data *q = qdisc_priv(sch);
 
 	qdisc_watchdog_cancel(&q->watchdog);
 	tcf_block_put(q->block);
+	if (q->mq)
+		cake_mq_unbind(q);
 	kvfree(q->tins);
 }
 
@@ -3117,13 +3394,301 @@ static struct Qdisc_ops cake_qdisc_ops __read_mostly = {
 };
 MODULE_ALIAS_NET_SCH("cake");
 
+struct cake_mq_sched {
+	struct Qdisc		**qdiscs;	/* until attached */
+	struct cake_mq_shared	*shared;
+};
+
+static struct Qdisc *cake_mq_child(struct Qdisc *sch, unsigned int ntx)
+{
+	struct cake_mq_sched *priv = qdisc_priv(sch);
+	struct net_device *dev = qdisc_dev(sch);
+	struct cake_sched_data *q;
+	struct Qdisc *qdisc;
+
+	if (priv->qdiscs)
+		qdisc = priv->qdiscs[ntx];
+	else
+		qdisc = rtnl_dereference(netdev_get_tx_queue(dev, ntx)->qdisc_sleeping);
+
+	if (!qdisc || qdisc->ops != &cake_qdisc_ops)
+		return NULL;
+
+	q = qdisc_priv(qdisc);
+	return q->mq == priv->shared ? qdisc : NULL;
+}
+
+static int cake_mq_change(struct Qdisc *sch, struct nlattr *opt,
+			  struct netlink_ext_ack *extack)
+{
+	struct net_device *dev = qdisc_dev(sch);
+	struct nlattr *tb[TCA_CAKE_MAX + 1];
+	struct Qdisc *qdisc;
+	unsigned int ntx;
+	int err;
+
+	/* validate once, so that the queues never end up with mixed configs */
+	err = cake_parse_opt(opt, tb, extack);
+	if (err)
+		return err;
+
+	for (ntx = 0; ntx < dev->num_tx_queues; ntx++) {
+		qdisc = cake_mq_child(sch, ntx);
+		if (qdisc)
+			cake_apply_opt(qdisc, tb);
+	}
+	return 0;
+}
+
+static void cake_mq_destroy(struct Qdisc *sch)
+{
+	struct cake_mq_sched *priv = qdisc_priv(sch);
+	struct net_device *dev = qdisc_dev(sch);
+	unsigned int ntx;
+
+	if (priv->qdiscs) {
+		for (ntx = 0;
+		     ntx < dev->num_tx_queues && priv->qdiscs[ntx]; ntx++)
+			qdisc_put(priv->qdiscs[ntx]);
+		kfree(priv->qdiscs);
+	}
+	if (priv->shared)
+		cake_mq_put(priv->shared);
+}
+
+static int cake_mq_init(struct Qdisc *sch, struct nlattr *opt,
+			struct netlink_ext_ack *extack)
+{
+	struct cake_mq_sched *priv = qdisc_priv(sch);
+	struct net_device *dev = qdisc_dev(sch);
+	struct cake_mq_shared *mq;
+	struct cake_sched_data *q;
+	struct Qdisc *qdisc;
+	unsigned int ntx;
+	int i;
+
+	if (sch->parent != TC_H_ROOT) {
+		NL_SET_ERR_MSG(extack, "cake_mq can only be used as root qdisc");
+		return -EOPNOTSUPP;
+	}
+
+	if (!netif_is_multiqueue(dev)) {
+		NL_SET_ERR_MSG(extack, "cake_mq needs a multiqueue device");
+		return -EOPNOTSUPP;
+	}
+
+	mq = kvzalloc(struct_size(mq, weights, dev->num_tx_queues),
+		      GFP_KERNEL);
+	if (!mq)
+		return -ENOMEM;
+	refcount_set(&mq->refcnt, 1);
+	mq->nr_queues = dev->num_tx_queues;
+	priv->shared = mq;
+
+	/* pre-allocate qdiscs, attachment can't fail */
+	priv->qdiscs = kcalloc(dev->num_tx_queues, sizeof(priv->qdiscs[0]),
+			       GFP_KERNEL);
+	if (!priv->qdiscs)
+		return -ENOMEM;
+
+	for (ntx = 0; ntx < dev->num_tx_queues; ntx++) {
+		qdisc = qdisc_create_dflt(netdev_get_tx_queue(dev, ntx),
+					  &cake_qdisc_ops,
+					  TC_H_MAKE(TC_H_MAJ(sch->handle),
+						    TC_H_MIN(ntx + 1)),
+					  extack);
+		if (!qdisc)
+			return -ENOMEM;
+		priv->qdiscs[ntx] = qdisc;
+		qdisc->flags |= TCQ_F_ONETXQUEUE | TCQ_F_NOPARENT;
+
+		q = qdisc_priv(qdisc);
+		refcount_inc(&mq->refcnt);
+		q->mq = mq;
+		q->mq_idx = ntx;
+		q->mq_share = 1 << 16;
+		for (i = 0; i < CAKE_MAX_TINS; i++)
+			q->tins[i].mq_hosts = mq->hosts[i];
+	}
+
+	sch->flags |= TCQ_F_MQROOT;
+
+	return opt ? cake_mq_change(sch, opt, extack) : 0;
+}
+
+static void cake_mq_attach(struct Qdisc *sch)
+{
+	struct cake_mq_sched *priv = qdisc_priv(sch);
+	struct net_device *dev = qdisc_dev(sch);
+	struct Qdisc *qdisc, *old;
+	unsigned int ntx;
+
+	for (ntx = 0; ntx < dev->num_tx_queues; ntx++) {
+		qdisc = priv->qdiscs[ntx];
+		old = dev_graft_qdisc(qdisc->dev_queue, qdisc);
+		if (old)
+			qdisc_put(old);
+		if (ntx < dev->real_num_tx_queues)
+			qdisc_hash_add(qdisc, false);
+	}
+	kfree(priv->qdiscs);
+	priv->qdiscs = NULL;
+}
+
+static void cake_mq_change_real_num_tx(struct Qdisc *sch,
+				       unsigned int new_real_tx)
+{
+	struct net_device *dev = qdisc_dev(sch);
+	struct Qdisc *qdisc;
+	unsigned int ntx;
+
+	for (ntx = new_real_tx; ntx < dev->real_num_tx_queues; ntx++) {
+		qdisc = cake_mq_child(sch, ntx);
+		if (qdisc)
+			qdisc_hash_del(qdisc);
+	}
+	for (ntx = dev->real_num_tx_queues; ntx < new_real_tx; ntx++) {
+		qdisc = cake_mq_child(sch, ntx);
+		if (qdisc)
+			qdisc_hash_add(qdisc, false);
+	}
+}
+
+static int cake_mq_dump(struct Qdisc *sch, struct sk_buff *skb)
+{
+	struct net_device *dev = qdisc_dev(sch);
+	struct Qdisc *qdisc;
+	unsigned int ntx;
+
+	sch->q.qlen = 0;
+	gnet_stats_basic_sync_init(&sch->bstats);
+	memset(&sch->qstats, 0, sizeof(sch->qstats));
+
+	for (ntx = 0; ntx < dev->num_tx_queues; ntx++) {
+		qdisc = rtnl_dereference(netdev_get_tx_queue(dev, ntx)->qdisc_sleeping);
+		spin_lock_bh(qdisc_lock(qdisc));
+
+		gnet_stats_add_basic(&sch->bstats, qdisc->cpu_bstats,
+				     &qdisc->bstats, false);
+		gnet_stats_add_queue(&sch->qstats, qdisc->cpu_qstats,
+				     &qdisc->qstats);
+		sch->q.qlen += qdisc_qlen(qdisc);
+
+		spin_unlock_bh(qdisc_lock(qdisc));
+	}
+
+	/* all instances share the same configuration */
+	qdisc = cake_mq_child(sch, 0);
+	return qdisc ? cake_dump(qdisc, skb) : -1;
+}
+
+static struct netdev_queue *cake_mq_queue_get(struct Qdisc *sch,
+					      unsigned long cl)
+{
+	struct net_device *dev = qdisc_dev(sch);
+	unsigned long ntx = cl - 1;
+
+	if (ntx >= dev->num_tx_queues)
+		return NULL;
+	return netdev_get_tx_queue(dev, ntx);
+}
+
+static struct Qdisc *cake_mq_leaf(struct Qdisc *sch, unsigned long cl)
+{
+	struct netdev_queue *dev_queue = cake_mq_queue_get(sch, cl);
+
+	return rtnl_dereference(dev_queue->qdisc_sleeping);
+}
+
+static unsigned long cake_mq_find(struct Qdisc *sch, u32 classid)
+{
+	unsigned int ntx = TC_H_MIN(classid);
+
+	if (!cake_mq_queue_get(sch, ntx))
+		return 0;
+	return ntx;
+}
+
+static int cake_mq_dump_class(struct Qdisc *sch, unsigned long cl,
+			      struct sk_buff *skb, struct tcmsg *tcm)
+{
+	struct netdev_queue *dev_queue = cake_mq_queue_get(sch, cl);
+
+	tcm->tcm_parent = TC_H_ROOT;
+	tcm->tcm_handle |= TC_H_MIN(cl);
+	tcm->tcm_info = rtnl_dereference(dev_queue->qdisc_sleeping)->handle;
+	return 0;
+}
+
+static int cake_mq_dump_class_stats(struct Qdisc *sch, unsigned long cl,
+				    struct gnet_dump *d)
+{
+	struct netdev_queue *dev_queue = cake_mq_queue_get(sch, cl);
+
+	sch = rtnl_dereference(dev_queue->qdisc_sleeping);
+	if (gnet_stats_copy_basic(d, sch->cpu_bstats, &sch->bstats, true) < 0 ||
+	    qdisc_qstats_copy(d, sch) < 0)
+		return -1;
+	return 0;
+}
+
+static void cake_mq_walk(struct Qdisc *sch, struct qdisc_walker *arg)
+{
+	struct net_device *dev = qdisc_dev(sch);
+	unsigned int ntx;
+
+	if (arg->stop)
+		return;
+
+	arg->count = arg->skip;
+	for (ntx = arg->skip; ntx < dev->num_tx_queues; ntx++) {
+		if (!tc_qdisc_stats_dump(sch, ntx + 1, arg))
+			break;
+	}
+}
+
+/* No .graft: the instances are bound to each other, they can't be replaced
+ * one by one.
+ */
+static const struct Qdisc_class_ops cake_mq_class_ops = {
+	.leaf		=	cake_mq_leaf,
+	.find		=	cake_mq_find,
+	.walk		=	cake_mq_walk,
+	.dump		=	cake_mq_dump_class,
+	.dump_stats	=	cake_mq_dump_class_stats,
+};
+
+static struct Qdisc_ops cake_mq_qdisc_ops __read_mostly = {
+	.cl_ops		=	&cake_mq_class_ops,
+	.id		=	"cake_mq",
+	.priv_size	=	sizeof(struct cake_mq_sched),
+	.init		=	cake_mq_init,
+	.destroy	=	cake_mq_destroy,
+	.attach		=	cake_mq_attach,
+	.change		=	cake_mq_change,
+	.change_real_num_tx =	cake_mq_change_real_num_tx,
+	.dump		=	cake_mq_dump,
+	.owner		=	THIS_MODULE,
+};
+MODULE_ALIAS_NET_SCH("cake_mq");
+
 static int __init cake_module_init(void)
 {
-	return register_qdisc(&cake_qdisc_ops);
+	int err;
+
+	err = register_qdisc(&cake_qdisc_ops);
+	if (err)
+		return err;
+
+	err = register_qdisc(&cake_mq_qdisc_ops);
+	if (err)
+		unregister_qdisc(&cake_qdisc_ops);
+	return err;
 }
 
 static void __exit cake_module_exit(void)
 {
+	unregister_qdisc(&cake_mq_qdisc_ops);
 	unregister_qdisc(&cake_qdisc_ops);
 }
 
@@ -19,7 +19,8 @@
  *  packets to respect rate limitation.
  *
  *  enqueue() :
- *   - lookup one RB tree (out of 1024 or more) to find the flow.
+ *   - lookup one RB tree (out of 1024 or more) to find the flow,
+ *     unless it is the flow last found in this tree.
  *     If non existent flow, create it, add it to the tree.
  *     Add skb to the per flow list of skb (fifo).
  *   - Use a special fifo for high prio packets
@@ -122,6 +123,7 @@ struct fq_sched_data {
 	u32		orphan_mask;	/* mask for orphaned skb */
 	u32		low_rate_threshold;
 	struct rb_root	*fq_root;
+	struct fq_flow	**fq_hot;	/* last flow found in each fq_root[] tree */
 	u8		rate_enable;
 	u8		fq_trees_log;
 	u8		horizon_drop;
@@ -255,10 +257,9 @@ static bool fq_gc_candidate(const struct fq_flow *f)
 	       time_after(jiffies, f->age + FQ_GC_AGE);
 }
 
-static void fq_gc(struct fq_sched_data *q,
-		  struct rb_root *root,
-		  struct sock *sk)
+static void fq_gc(struct fq_sched_data *q, u32 idx, struct sock *sk)
 {
+	struct rb_root *root = &q->fq_root[idx];
 	struct rb_node **p, *parent;
 	void *tofree[FQ_GC_MAX];
 	struct fq_flow *f;
@@ -291,6 +292,8 @@ static void fq_gc(struct fq_sched_data *q,
 	for (i = fcnt; i > 0; ) {
 		f = tofree[--i];
 		rb_erase(&f->fq_node, root);
+		if (q->fq_hot[idx] == f)
+			q->fq_hot[idx] = NULL;
 	}
 	q->flows -= fcnt;
 	q->inactive_flows -= fcnt;
@@ -359,6 +362,7 @@ static struct fq_flow *fq_classify(struct Qdisc *sch, struct sk_buff *skb,
 	struct sock *sk = skb->sk;
 	struct rb_root *root;
 	struct fq_flow *f;
+	u32 idx;
 
 	/* SYNACK messages are attached to a TCP_NEW_SYN_RECV request socket
 	 * or a listener (SYNCOOKIE mode)
@@ -400,9 +404,19 @@ static struct fq_flow *fq_classify(struct Qdisc *sch, struct sk_buff *skb,
 		return &q->internal;
 	}
 
-	root = &q->fq_root[hash_ptr(sk, q->fq_trees_log)];
+	idx = hash_ptr(sk, q->fq_trees_log);
+
+	/* Packets of a flow mostly arrive in trains (TSO/GSO, cwnd bursts),
+	 * so the flow found for the previous packet hashed in this tree is
+	 * very likely the one we want. Skip the tree walk and the gc then.
+	 */
+	f = q->fq_hot[idx];
+	if (likely(f && f->sk == sk))
+		goto found;
+
+	root = &q->fq_root[idx];
 
-	fq_gc(q, root, sk);
+	fq_gc(q, idx, sk);
 
 	p = &root->rb_node;
 	parent = NULL;
@@ -411,23 +425,8 @@ static struct fq_flow *fq_classify(struct Qdisc *sch, struct sk_buff *skb,
 
 		f = rb_entry(parent, struct fq_flow, fq_node);
 		if (f->sk == sk) {
-			/* socket might have been reallocated, so check
-			 * if its sk_hash is the same.
-			 * It not, we need to refill credit with
-			 * initial quantum
-			 */
-			if (unlikely(skb->sk == sk &&
-				     f->socket_hash != sk->sk_hash)) {
-				f->credit = q->initial_quantum;
-				f->socket_hash = sk->sk_hash;
-				if (q->rate_enable)
-					smp_store_release(&sk->sk_pacing_status,
-							  SK_PACING_FQ);
-				if (fq_flow_is_throttled(f))
-					fq_flow_unset_throttled(q, f);
-				f->time_next_packet = 0ULL;
-			}
-			return f;
+			q->fq_hot[idx] = f;
+			goto found;
 		}
 		if (f->sk > sk)
 			p = &parent->rb_right;
@@ -454,10 +453,29 @@ static struct fq_flow *fq_classify(struct Qdisc *sch, struct sk_buff *skb,
 
 	rb_link_node(&f->fq_node, parent, p);
 	rb_insert_color(&f->fq_node, root);
+	q->fq_hot[idx] = f;
 
 	q->flows++;
 	q->inactive_flows++;
 	return f;
+
+found:
+	/* socket might have been reallocated, so check
+	 * if its sk_hash is the same.
+	 * It not, we need to refill credit with
+	 * initial quantum
+	 */
+	if (unlikely(skb->sk == sk && f->socket_hash != sk->sk_hash)) {
+		f->credit = q->initial_quantum;
+		f->socket_hash = sk->sk_hash;
+		if (q->rate_enable)
+			smp_store_release(&sk->sk_pacing_status,
+					  SK_PACING_FQ);
+		if (fq_flow_is_throttled(f))
+			fq_flow_unset_throttled(q, f);
+		f->time_next_packet = 0ULL;
+	}
+	return f;
 }
 
 static struct sk_buff *fq_peek(struct fq_flow *flow)
@@ -816,6 +834,7 @@ static void fq_reset(struct Qdisc *sch)
 
 			kmem_cache_free(fq_flow_cachep, f);
 		}
+		q->fq_hot[idx] = NULL;
 	}
 	for (idx = 0; idx < FQ_BANDS; idx++) {
 		q->band_flows[idx].new_flows.first = NULL;
@@ -881,20 +900,27 @@ static int fq_resize(struct Qdisc *sch, u32 log)
 {
 	struct fq_sched_data *q = qdisc_priv(sch);
 	struct rb_root *array;
+	struct fq_flow **hot;
 	void *old_fq_root;
 	u32 idx;
 
 	if (q->fq_root && log == q->fq_trees_log)
 		return 0;
 
-	/* If XPS was setup, we can allocate memory on right NUMA node */
-	array = kvmalloc_node(sizeof(struct rb_root) << log, GFP_KERNEL | __GFP_RETRY_MAYFAIL,
+	/* The fq_hot[] cache lives right after the trees.
+	 * If XPS was setup, we can allocate memory on right NUMA node
+	 */
+	array = kvmalloc_node((sizeof(struct rb_root) + sizeof(*hot)) << log,
+			      GFP_KERNEL | __GFP_RETRY_MAYFAIL,
 			      netdev_queue_numa_node_read(sch->dev_queue));
 	if (!array)
 		return -ENOMEM;
 
-	for (idx = 0; idx < (1U << log); idx++)
+	hot = (struct fq_flow **)(array + (1U << log));
+	for (idx = 0; idx < (1U << log); idx++) {
 		array[idx] = RB_ROOT;
+		hot[idx] = NULL;
+	}
 
 	sch_tree_lock(sch);
 
@@ -903,6 +929,7 @@ static int fq_resize(struct Qdisc *sch, u32 log)
 		fq_rehash(q, old_fq_root, q->fq_trees_log, array, log);
 
 	q->fq_root = array;
+	q->fq_hot = hot;
 	WRITE_ONCE(q->fq_trees_log, log);
 
 	sch_tree_unlock(sch);
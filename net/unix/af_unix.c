@@ -646,6 +646,7 @@ static void unix_sock_destructor(struct sock *sk)
 	struct unix_sock *u = unix_sk(sk);
 
 	skb_queue_purge(&sk->sk_receive_queue);
+	skb_queue_purge(&sk->sk_error_queue);
 
 	DEBUG_NET_WARN_ON_ONCE(refcount_read(&sk->sk_wmem_alloc));
 	DEBUG_NET_WARN_ON_ONCE(!sk_unhashed(sk));
@@ -824,6 +825,8 @@ static int unix_compat_ioctl(struct socket *sock, unsigned int cmd, unsigned lon
 static int unix_shutdown(struct socket *, int);
 static int unix_stream_sendmsg(struct socket *, struct msghdr *, size_t);
 static int unix_stream_recvmsg(struct socket *, struct msghdr *, size_t, int);
+static int unix_stream_setsockopt(struct socket *, int, int, sockptr_t,
+				  unsigned int);
 static ssize_t unix_stream_splice_read(struct socket *,  loff_t *ppos,
 				       struct pipe_inode_info *, size_t size,
 				       unsigned int flags);
@@ -899,6 +902,7 @@ static const struct proto_ops unix_stream_ops = {
 #endif
 	.listen =	unix_listen,
 	.shutdown =	unix_shutdown,
+	.setsockopt =	unix_stream_setsockopt,
 	.sendmsg =	unix_stream_sendmsg,
 	.recvmsg =	unix_stream_recvmsg,
 	.read_skb =	unix_stream_read_skb,
@@ -1073,6 +1077,7 @@ static int unix_create(struct net *net, struct socket *sock, int protocol,
 	switch (sock->type) {
 	case SOCK_STREAM:
 		sock->ops = &unix_stream_ops;
+		set_bit(SOCK_CUSTOM_SOCKOPT, &sock->flags);
 		break;
 		/*
 		 *	Believe it or not BSD has AF_UNIX, SOCK_RAW though
@@ -1741,6 +1746,8 @@ static void unix_sock_inherit_flags(const struct socket *old,
 		set_bit(SOCK_PASSPIDFD, &new->flags);
 	if (test_bit(SOCK_PASSSEC, &old->flags))
 		set_bit(SOCK_PASSSEC, &new->flags);
+	if (test_bit(SOCK_CUSTOM_SOCKOPT, &old->flags))
+		set_bit(SOCK_CUSTOM_SOCKOPT, &new->flags);
 }
 
 static int unix_accept(struct socket *sock, struct socket *newsock,
@@ -2238,11 +2245,60 @@ static int queue_oob(struct socket *sock, struct msghdr *msg, struct sock *other
 }
 #endif
 
+/* Stream sockets handle SO_ZEROCOPY, which sock_setsockopt() refuses for
+ * AF_UNIX, and leave all other socket level options to it.
+ */
+static int unix_stream_setsockopt(struct socket *sock, int level, int optname,
+				  sockptr_t optval, unsigned int optlen)
+{
+	int val;
+
+	if (level != SOL_SOCKET)
+		return -EOPNOTSUPP;
+	if (optname != SO_ZEROCOPY)
+		return sock_setsockopt(sock, level, optname, optval, optlen);
+
+	if (optlen < sizeof(val))
+		return -EINVAL;
+	if (copy_from_sockptr(&val, optval, sizeof(val)))
+		return -EFAULT;
+	if (val < 0 || val > 1)
+		return -EINVAL;
+
+	lock_sock(sock->sk);
+	sock_valbool_flag(sock->sk, SOCK_ZEROCOPY, val);
+	release_sock(sock->sk);
+	return 0;
+}
+
+/* Attaches the user pages of up to @size bytes to @skb. @uarg completes
+ * once the receiver has copied them out and freed the skb.
+ */
+static int unix_stream_zerocopy_fill(struct sk_buff *skb, struct msghdr *msg,
+				     int size, struct ubuf_info *uarg)
+{
+	int err;
+
+	/* Keep two messages in the pipe so it schedules better */
+	size = min_t(int, size, (READ_ONCE(skb->sk->sk_sndbuf) >> 1) - 64);
+
+	err = __zerocopy_sg_from_iter(msg, NULL, skb, &msg->msg_iter, size);
+	/* Out of frags, the rest goes into the next skb */
+	if (err == -EMSGSIZE && skb->len)
+		err = 0;
+	if (err)
+		return err;
+
+	skb_zcopy_set(skb, uarg, NULL);
+	return skb->len;
+}
+
 static int unix_stream_sendmsg(struct socket *sock, struct msghdr *msg,
 			       size_t len)
 {
 	struct sock *sk = sock->sk;
 	struct sock *other = NULL;
+	struct ubuf_info *uarg = NULL;
 	int err, size;
 	struct sk_buff *skb;
 	int sent = 0;
@@ -2279,10 +2335,20 @@ static int unix_stream_sendmsg(struct socket *sock, struct msghdr *msg,
 	if (READ_ONCE(sk->sk_shutdown) & SEND_SHUTDOWN)
 		goto pipe_err;
 
+	if ((msg->msg_flags & MSG_ZEROCOPY) && len &&
+	    !(msg->msg_flags & MSG_SPLICE_PAGES) &&
+	    sock_flag(sk, SOCK_ZEROCOPY)) {
+		uarg = msg_zerocopy_realloc(sk, len, NULL);
+		if (!uarg) {
+			err = -ENOBUFS;
+			goto out_err;
+		}
+	}
+
 	while (sent < len) {
 		size = len - sent;
 
-		if (unlikely(msg->msg_flags & MSG_SPLICE_PAGES)) {
+		if (unlikely(msg->msg_flags & MSG_SPLICE_PAGES) || uarg) {
 			skb = sock_alloc_send_pskb(sk, 0, 0,
 						   msg->msg_flags & MSG_DONTWAIT,
 						   &err, 0);
@@ -2322,6 +2388,13 @@ static int unix_stream_sendmsg(struct socket *sock, struct msghdr *msg,
 			}
 			size = err;
 			refcount_add(size, &sk->sk_wmem_alloc);
+		} else if (uarg) {
+			err = unix_stream_zerocopy_fill(skb, msg, size, uarg);
+			if (err < 0) {
+				kfree_skb(skb);
+				goto out_err;
+			}
+			size = err;
 		} else {
 			skb_put(skb, size - data_len);
 			skb->data_len = data_len;
@@ -2357,6 +2430,7 @@ static int unix_stream_sendmsg(struct socket *sock, struct msghdr *msg,
 #endif
 
 	scm_destroy(&scm);
+	net_zcopy_put(uarg);
 
 	return sent;
 
@@ -2369,6 +2443,10 @@ static int unix_stream_sendmsg(struct socket *sock, struct msghdr *msg,
 	err = -EPIPE;
 out_err:
 	scm_destroy(&scm);
+	if (sent)
+		net_zcopy_put(uarg);
+	else
+		net_zcopy_put_abort(uarg, true);
 	return sent ? : err;
 }
 
@@ -2748,6 +2826,12 @@ static int unix_stream_read_skb(struct sock *sk, skb_read_actor_t recv_actor)
 	}
 #endif
 
+	/* The skb may be kept around, don't let it pin MSG_ZEROCOPY pages */
+	if (unlikely(skb_orphan_frags_rx(skb, GFP_KERNEL))) {
+		kfree_skb(skb);
+		return -ENOMEM;
+	}
+
 	return recv_actor(sk, skb);
 }
 
@@ -2992,9 +3076,14 @@ static int unix_stream_recvmsg(struct socket *sock, struct msghdr *msg,
 	struct sock *sk = sock->sk;
 	const struct proto *prot = READ_ONCE(sk->sk_prot);
 
-	if (prot != &unix_stream_proto)
+	if (prot != &unix_stream_proto && !(flags & MSG_ERRQUEUE))
 		return prot->recvmsg(sk, msg, size, flags, NULL);
 #endif
+	/* MSG_ZEROCOPY completions */
+	if (unlikely(flags & MSG_ERRQUEUE))
+		return sock_recv_errqueue(sock->sk, msg, size, SOL_SOCKET,
+					  SO_ZEROCOPY);
+
 	return unix_stream_read_generic(&state, true);
 }
 
@@ -3002,6 +3091,12 @@ static int unix_stream_splice_actor(struct sk_buff *skb,
 				    int skip, int chunk,
 				    struct unix_stream_read_state *state)
 {
+	/* Pipe buffers outlive the skb, so they must not point into the
+	 * sender's MSG_ZEROCOPY pages once its completion is sent.
+	 */
+	if (unlikely(skb_orphan_frags_rx(skb, GFP_KERNEL)))
+		return -ENOMEM;
+
 	return skb_splice_bits(skb, state->socket->sk,
 			       UNIXCB(skb).consumed + skip,
 			       state->pipe, chunk, state->splice_flags);
@@ -3220,7 +3315,8 @@ static __poll_t unix_poll(struct file *file, struct socket *sock, poll_table *wa
 	state = READ_ONCE(sk->sk_state);
 
 	/* exceptional events? */
-	if (READ_ONCE(sk->sk_err))
+	if (READ_ONCE(sk->sk_err) ||
+	    !skb_queue_empty_lockless(&sk->sk_error_queue))
 		mask |= EPOLLERR;
 	if (shutdown == SHUTDOWN_MASK)
 		mask |= EPOLLHUP;
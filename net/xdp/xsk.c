@@ -152,39 +152,49 @@ static int __xsk_rcv_zc(struct xdp_sock *xs, struct xdp_buff_xsk *xskb, u32 len,
 	return 0;
 }
 
+/* Room in the Rx ring has been checked by the caller. */
+static void xsk_rcv_zc_desc(struct xdp_sock *xs, struct xdp_buff_xsk *xskb,
+			    u32 len, u32 flags)
+{
+	xskq_prod_write_desc(xs->rx, xp_get_handle(xskb, xskb->pool), len,
+			     flags);
+	xp_release(xskb);
+}
+
 static int xsk_rcv_zc(struct xdp_sock *xs, struct xdp_buff *xdp, u32 len)
 {
 	struct xdp_buff_xsk *xskb = container_of(xdp, struct xdp_buff_xsk, xdp);
-	u32 frags = xdp_buff_has_frags(xdp);
 	struct xdp_buff_xsk *pos, *tmp;
 	struct list_head *xskb_list;
-	u32 contd = 0;
+	u32 nb_desc;
 	int err;
 
-	if (frags)
-		contd = XDP_PKT_CONTD;
+	if (likely(!xdp_buff_has_frags(xdp))) {
+		err = __xsk_rcv_zc(xs, xskb, len, 0);
+		if (err)
+			xsk_buff_free(xdp);
+		return err;
+	}
 
-	err = __xsk_rcv_zc(xs, xskb, len, contd);
-	if (err)
-		goto err;
-	if (likely(!frags))
-		return 0;
+	/* Reserve all descriptors of the packet at once, so that it is never
+	 * queued partially and the ring is only checked once.
+	 */
+	nb_desc = 1 + xdp_get_shared_info_from_buff(xdp)->nr_frags;
+	if (xskq_prod_nb_free(xs->rx, nb_desc) < nb_desc) {
+		xs->rx_queue_full++;
+		xsk_buff_free(xdp);
+		return -ENOBUFS;
+	}
 
+	xsk_rcv_zc_desc(xs, xskb, len, XDP_PKT_CONTD);
 	xskb_list = &xskb->pool->xskb_list;
 	list_for_each_entry_safe(pos, tmp, xskb_list, list_node) {
-		if (list_is_singular(xskb_list))
-			contd = 0;
-		len = pos->xdp.data_end - pos->xdp.data;
-		err = __xsk_rcv_zc(xs, pos, len, contd);
-		if (err)
-			goto err;
 		list_del(&pos->list_node);
+		xsk_rcv_zc_desc(xs, pos, pos->xdp.data_end - pos->xdp.data,
+				list_empty(xskb_list) ? 0 : XDP_PKT_CONTD);
 	}
 
 	return 0;
-err:
-	xsk_buff_free(xdp);
-	return err;
 }
 
 static void *xsk_copy_xdp_start(struct xdp_buff *from)
@@ -284,7 +294,8 @@ static int __xsk_rcv(struct xdp_sock *xs, struct xdp_buff *xdp, u32 len)
 		rem -= copied;
 
 		xskb = container_of(xsk_xdp, struct xdp_buff_xsk, xdp);
-		__xsk_rcv_zc(xs, xskb, copied - meta_len, rem ? XDP_PKT_CONTD : 0);
+		xsk_rcv_zc_desc(xs, xskb, copied - meta_len,
+				rem ? XDP_PKT_CONTD : 0);
 		meta_len = 0;
 	} while (rem);
 
@@ -314,8 +325,18 @@ static int xsk_rcv_check(struct xdp_sock *xs, struct xdp_buff *xdp, u32 len)
 	if (!xsk_is_bound(xs))
 		return -ENXIO;
 
-	if (xs->dev != xdp->rxq->dev || xs->queue_id != xdp->rxq->queue_index)
+	if (xs->dev != xdp->rxq->dev)
+		return -EINVAL;
+
+	/* Fan-out members are copy-mode sockets fed from any queue, but
+	 * never with buffers of another socket's zero-copy pool.
+	 */
+	if (xsk_is_fanout(xs)) {
+		if (xdp->rxq->mem.type == MEM_TYPE_XSK_BUFF_POOL)
+			return -EINVAL;
+	} else if (xs->queue_id != xdp->rxq->queue_index) {
 		return -EINVAL;
+	}
 
 	if (len > xsk_pool_get_rx_frame_size(xs->pool) && !xs->sg) {
 		xs->rx_dropped++;
@@ -337,6 +358,9 @@ int xsk_generic_rcv(struct xdp_sock *xs, struct xdp_buff *xdp)
 	u32 len = xdp_get_buff_len(xdp);
 	int err;
 
+	if (unlikely(xsk_is_fanout(xs)))
+		xs = xsk_fanout_target(xs, xdp);
+
 	spin_lock_bh(&xs->rx_lock);
 	err = xsk_rcv_check(xs, xdp, len);
 	if (!err) {
@@ -367,20 +391,44 @@ static int xsk_rcv(struct xdp_sock *xs, struct xdp_buff *xdp)
 	return err;
 }
 
+static void xsk_add_flush(struct xdp_sock *xs)
+{
+	if (!xs->flush_node.prev) {
+		struct list_head *flush_list = bpf_net_ctx_get_xskmap_flush_list();
+
+		list_add(&xs->flush_node, flush_list);
+	}
+}
+
+/* A fan-out member may be fed from several CPUs. The first one to queue a
+ * packet flushes it, for the others too, under rx_lock.
+ */
+static int xsk_fanout_redirect(struct xdp_sock *xs, struct xdp_buff *xdp)
+{
+	int err;
+
+	xs = xsk_fanout_target(xs, xdp);
+
+	spin_lock(&xs->rx_lock);
+	err = xsk_rcv(xs, xdp);
+	if (!err)
+		xsk_add_flush(xs);
+	spin_unlock(&xs->rx_lock);
+	return err;
+}
+
 int __xsk_map_redirect(struct xdp_sock *xs, struct xdp_buff *xdp)
 {
 	int err;
 
+	if (unlikely(xsk_is_fanout(xs)))
+		return xsk_fanout_redirect(xs, xdp);
+
 	err = xsk_rcv(xs, xdp);
 	if (err)
 		return err;
 
-	if (!xs->flush_node.prev) {
-		struct list_head *flush_list = bpf_net_ctx_get_xskmap_flush_list();
-
-		list_add(&xs->flush_node, flush_list);
-	}
-
+	xsk_add_flush(xs);
 	return 0;
 }
 
@@ -389,6 +437,13 @@ void __xsk_map_flush(struct list_head *flush_list)
 	struct xdp_sock *xs, *tmp;
 
 	list_for_each_entry_safe(xs, tmp, flush_list, flush_node) {
+		if (unlikely(xsk_is_fanout(xs))) {
+			spin_lock(&xs->rx_lock);
+			xsk_flush(xs);
+			__list_del_clearprev(&xs->flush_node);
+			spin_unlock(&xs->rx_lock);
+			continue;
+		}
 		xsk_flush(xs);
 		__list_del_clearprev(&xs->flush_node);
 	}
@@ -1031,6 +1086,7 @@ static void xsk_unbind_dev(struct xdp_sock *xs)
 
 	/* Wait for driver to stop using the xdp socket. */
 	xp_del_xsk(xs->pool, xs);
+	xsk_fanout_leave(xs);
 	synchronize_net();
 	dev_put(dev);
 }
@@ -1158,7 +1214,9 @@ static int xsk_bind(struct socket *sock, struct sockaddr *addr, int addr_len)
 
 	flags = sxdp->sxdp_flags;
 	if (flags & ~(XDP_SHARED_UMEM | XDP_COPY | XDP_ZEROCOPY |
-		      XDP_USE_NEED_WAKEUP | XDP_USE_SG))
+		      XDP_USE_NEED_WAKEUP | XDP_USE_SG | XDP_FANOUT))
+		return -EINVAL;
+	if ((flags & XDP_FANOUT) && (flags & XDP_ZEROCOPY))
 		return -EINVAL;
 
 	bound_dev_if = READ_ONCE(sk->sk_bound_dev_if);
@@ -1215,6 +1273,19 @@ static int xsk_bind(struct socket *sock, struct sockaddr *addr, int addr_len)
 			goto out_unlock;
 		}
 
+		if (flags & XDP_FANOUT) {
+			/* Members need a fill ring of their own */
+			if (umem_xs->queue_id == qid && umem_xs->dev == dev)
+				err = -EINVAL;
+			else
+				err = xsk_fanout_join(xs, dev, umem_xs->umem,
+						      qid);
+			if (err) {
+				sockfd_put(sock);
+				goto out_unlock;
+			}
+		}
+
 		if (umem_xs->queue_id != qid || umem_xs->dev != dev) {
 			/* Share the umem with another socket on another qid
 			 * and/or device.
@@ -1270,6 +1341,13 @@ static int xsk_bind(struct socket *sock, struct sockaddr *addr, int addr_len)
 		goto out_unlock;
 	} else {
 		/* This xsk has its own umem. */
+		if (flags & XDP_FANOUT) {
+			err = xsk_fanout_join(xs, dev, xs->umem, qid);
+			if (err)
+				goto out_unlock;
+			flags |= XDP_COPY;
+		}
+
 		xs->pool = xp_create_and_assign_umem(xs, xs->umem);
 		if (!xs->pool) {
 			err = -ENOMEM;
@@ -1304,6 +1382,8 @@ static int xsk_bind(struct socket *sock, struct sockaddr *addr, int addr_len)
 
 out_unlock:
 	if (err) {
+		xsk_fanout_leave(xs);
+		xsk_fanout_release(xs);
 		dev_put(dev);
 	} else {
 		/* Matches smp_rmb() in bind() for shared umem
@@ -1687,6 +1767,7 @@ static void xsk_destruct(struct sock *sk)
 	if (!sock_flag(sk, SOCK_DEAD))
 		return;
 
+	xsk_fanout_release(xs);
 	if (!xp_put_pool(xs->pool))
 		xdp_put_umem(xs->umem, !xs->pool);
 }
@@ -45,4 +45,16 @@ void xsk_clear_pool_at_qid(struct net_device *dev, u16 queue_id);
 int xsk_reg_pool_at_qid(struct net_device *dev, struct xsk_buff_pool *pool,
 			u16 queue_id);
 
+int xsk_fanout_join(struct xdp_sock *xs, struct net_device *dev,
+		    struct xdp_umem *umem, u16 qid);
+void xsk_fanout_leave(struct xdp_sock *xs);
+void xsk_fanout_release(struct xdp_sock *xs);
+struct xdp_sock *xsk_fanout_target(struct xdp_sock *xs, struct xdp_buff *xdp);
+
+/* Fan-out members can be fed from several CPUs and serialize on rx_lock */
+static inline bool xsk_is_fanout(struct xdp_sock *xs)
+{
+	return rcu_access_pointer(xs->sk.sk_user_data);
+}
+
 #endif /* XSK_H_ */
@@ -365,8 +365,10 @@ static void __xp_dma_unmap(struct xsk_dma_map *dma_map, unsigned long attrs)
 		dma = &dma_map->dma_pages[i];
 		if (*dma) {
 			*dma &= ~XSK_NEXT_PG_CONTIG_MASK;
-			dma_unmap_page_attrs(dma_map->dev, *dma, PAGE_SIZE,
-					     DMA_BIDIRECTIONAL, attrs);
+			if (dma_map->dev)
+				dma_unmap_page_attrs(dma_map->dev, *dma,
+						     PAGE_SIZE,
+						     DMA_BIDIRECTIONAL, attrs);
 			*dma = 0;
 		}
 	}
@@ -458,6 +460,15 @@ int xp_dma_map(struct xsk_buff_pool *pool, struct device *dev,
 		return -ENOMEM;
 
 	for (i = 0; i < dma_map->dma_pages_cnt; i++) {
+		/*
+		 * Software devices without a DMA device only access the
+		 * buffers through the CPU, record the physical addresses for
+		 * the contiguity checks of unaligned chunks.
+		 */
+		if (!dev) {
+			dma_map->dma_pages[i] = page_to_phys(pages[i]);
+			continue;
+		}
 		dma = dma_map_page_attrs(dev, pages[i], 0, PAGE_SIZE,
 					 DMA_BIDIRECTIONAL, attrs);
 		if (dma_mapping_error(dev, dma)) {
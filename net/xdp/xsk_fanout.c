@@ -0,0 +1,226 @@
+// SPDX-License-Identifier: GPL-2.0
+/* AF_XDP socket fan-out
+ *
+ * Sockets bound with XDP_FANOUT to queues of the same device and sharing a
+ * UMEM form a group. Each member receives what arrives on its own queue,
+ * and the queues without a member are spread evenly over the members, so
+ * that a few consumers can serve all queues of a device. The XDP program
+ * redirects to any member; the kernel picks the member serving the queue.
+ */
+
+#include <linux/mutex.h>
+#include <linux/netdevice.h>
+#include <linux/rculist.h>
+#include <linux/slab.h>
+#include <net/sock.h>
+#include <net/xdp_sock.h>
+
+#include "xsk.h"
+
+#define XSK_FANOUT_MAX	64
+
+/* Member serving each rx queue of the device */
+struct xsk_fanout_map {
+	struct rcu_head rcu;
+	u32 nr_queues;
+	struct xdp_sock *socks[];
+};
+
+struct xsk_fanout {
+	struct list_head list;
+	refcount_t users;
+	struct net_device *dev;
+	struct xdp_umem *umem;
+	u32 nr_members;
+	struct xdp_sock *members[XSK_FANOUT_MAX];
+	u16 queues[XSK_FANOUT_MAX];
+	struct xsk_fanout_map __rcu *map;
+	struct rcu_head rcu;
+};
+
+static LIST_HEAD(xsk_fanout_list);
+static DEFINE_MUTEX(xsk_fanout_mutex);
+
+static struct xsk_fanout *xsk_fanout_get(struct xdp_sock *xs)
+{
+	return rcu_dereference_protected(__sk_user_data(&xs->sk), 1);
+}
+
+static int xsk_fanout_update_map(struct xsk_fanout *f)
+{
+	u32 i, q, next = 0, nr_queues = f->dev->real_num_rx_queues;
+	struct xsk_fanout_map *map = NULL, *old;
+
+	if (f->nr_members) {
+		map = kzalloc(struct_size(map, socks, nr_queues), GFP_KERNEL);
+		if (!map)
+			return -ENOMEM;
+		map->nr_queues = nr_queues;
+
+		for (i = 0; i < f->nr_members; i++) {
+			q = f->queues[i];
+			if (q < nr_queues)
+				map->socks[q] = f->members[i];
+		}
+		for (q = 0; q < nr_queues; q++) {
+			if (map->socks[q])
+				continue;
+			map->socks[q] = f->members[next++ % f->nr_members];
+		}
+	}
+
+	old = rcu_replace_pointer(f->map, map,
+				  lockdep_is_held(&xsk_fanout_mutex));
+	if (old)
+		kfree_rcu(old, rcu);
+	return 0;
+}
+
+/* Hands the queues of @xs over to the remaining members in place, for when
+ * the map can't be rebuilt. Readers see either @xs, which the caller waits
+ * for them to let go of, or its replacement.
+ */
+static void xsk_fanout_unmap(struct xsk_fanout *f, struct xdp_sock *xs)
+{
+	struct xsk_fanout_map *map;
+	u32 q, next = 0;
+
+	map = rcu_dereference_protected(f->map,
+					lockdep_is_held(&xsk_fanout_mutex));
+	for (q = 0; q < map->nr_queues; q++)
+		if (map->socks[q] == xs)
+			WRITE_ONCE(map->socks[q],
+				   f->members[next++ % f->nr_members]);
+}
+
+/* Called from bind(). The socket enters the map right away, before
+ * xp_assign_dev(), so other members may redirect to it early: xsk_rcv_check()
+ * drops those packets until the socket is bound.
+ */
+int xsk_fanout_join(struct xdp_sock *xs, struct net_device *dev,
+		    struct xdp_umem *umem, u16 qid)
+{
+	struct xsk_fanout *f;
+	u32 i;
+	int err;
+
+	/* The fill ring of a zero-copy socket is consumed by its driver
+	 * without taking rx_lock, so only copy-mode sockets can be fed from
+	 * other queues.
+	 */
+	if (umem->zc)
+		return -EOPNOTSUPP;
+
+	mutex_lock(&xsk_fanout_mutex);
+	list_for_each_entry(f, &xsk_fanout_list, list) {
+		if (f->dev == dev && f->umem == umem)
+			goto found;
+	}
+
+	f = kzalloc(sizeof(*f), GFP_KERNEL);
+	if (!f) {
+		err = -ENOMEM;
+		goto out;
+	}
+	refcount_set(&f->users, 1);
+	f->dev = dev;
+	f->umem = umem;
+	list_add(&f->list, &xsk_fanout_list);
+	goto add;
+
+found:
+	err = -EBUSY;
+	if (f->nr_members == XSK_FANOUT_MAX)
+		goto out;
+	/* Members on one queue would share a fill ring */
+	err = -EINVAL;
+	for (i = 0; i < f->nr_members; i++)
+		if (f->queues[i] == qid)
+			goto out;
+	refcount_inc(&f->users);
+
+add:
+	f->members[f->nr_members] = xs;
+	f->queues[f->nr_members++] = qid;
+	err = xsk_fanout_update_map(f);
+	if (err) {
+		f->nr_members--;
+		if (refcount_dec_and_test(&f->users)) {
+			list_del(&f->list);
+			kfree(f);
+		}
+		goto out;
+	}
+	rcu_assign_sk_user_data(&xs->sk, f);
+out:
+	mutex_unlock(&xsk_fanout_mutex);
+	return err;
+}
+
+/* Called on unbind, before waiting for the data path to let go of @xs. */
+void xsk_fanout_leave(struct xdp_sock *xs)
+{
+	struct xsk_fanout *f = xsk_fanout_get(xs);
+	u32 i;
+
+	if (!f)
+		return;
+
+	mutex_lock(&xsk_fanout_mutex);
+	for (i = 0; i < f->nr_members; i++) {
+		if (f->members[i] != xs)
+			continue;
+		f->nr_members--;
+		f->members[i] = f->members[f->nr_members];
+		f->queues[i] = f->queues[f->nr_members];
+		/* Only a map with members left is allocated, so there is
+		 * always one to take over from @xs.
+		 */
+		if (xsk_fanout_update_map(f))
+			xsk_fanout_unmap(f, xs);
+		break;
+	}
+	mutex_unlock(&xsk_fanout_mutex);
+}
+
+/* Drops the reference of @xs to its group, once the data path is done with
+ * it. The group stays around as long as any socket refers to it.
+ */
+void xsk_fanout_release(struct xdp_sock *xs)
+{
+	struct xsk_fanout *f = xsk_fanout_get(xs);
+	struct xsk_fanout_map *map;
+
+	if (!f)
+		return;
+
+	rcu_assign_sk_user_data(&xs->sk, NULL);
+	if (!refcount_dec_and_test(&f->users))
+		return;
+
+	mutex_lock(&xsk_fanout_mutex);
+	list_del(&f->list);
+	map = rcu_dereference_protected(f->map, 1);
+	mutex_unlock(&xsk_fanout_mutex);
+
+	if (map)
+		kfree_rcu(map, rcu);
+	kfree_rcu(f, rcu);
+}
+
+/* Returns the member serving the rx queue of @xdp, or @xs if there is none. */
+struct xdp_sock *xsk_fanout_target(struct xdp_sock *xs, struct xdp_buff *xdp)
+{
+	struct xsk_fanout *f = rcu_dereference_sk_user_data(&xs->sk);
+	u32 q = xdp->rxq->queue_index;
+	struct xsk_fanout_map *map;
+
+	if (xdp->rxq->dev != xs->dev)
+		return xs;
+
+	map = rcu_dereference(f->map);
+	if (!map || q >= map->nr_queues)
+		return xs;
+
+	return READ_ONCE(map->socks[q]);
+}
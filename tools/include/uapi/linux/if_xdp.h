@@ -31,6 +31,11 @@
  * such frames will be dropped.
  */
 #define XDP_USE_SG	(1 << 4)
+/* Join the fan-out group of the sockets bound to other queues of the same
+ * device with the same UMEM. Each member receives from its own queue, and
+ * queues without a member are spread over the members. Copy mode only.
+ */
+#define XDP_FANOUT	(1 << 5)
 
 /* Flags for xsk_umem_config flags */
 #define XDP_UMEM_UNALIGNED_CHUNK_FLAG	(1 << 0)
@@ -0,0 +1,319 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * sched-psi.c
+ *
+ * psi: Benchmark for context switch cost at different cgroup depths
+ *
+ * Two processes ping-pong over a pair of pipes on a single CPU, like
+ * 'perf bench sched pipe', with each process in its own chain of nested
+ * cgroup2 directories. Every context switch updates the pressure state
+ * of all cgroups below their common parent, so the cost per switch
+ * grows with the depth of the chains. Comparing kernels booted with
+ * different psi= and psi_defer_levels= settings shows the cost of PSI
+ * aggregation at each depth.
+ */
+#include <subcmd/parse-options.h>
+#include "bench.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <mntent.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <linux/kernel.h>
+#include <linux/time64.h>
+
+#define LOOPS_DEFAULT		200000
+#define MAX_DEPTH_DEFAULT	8
+
+static int loops = LOOPS_DEFAULT;
+static int max_depth = MAX_DEPTH_DEFAULT;
+static int min_depth = 1;
+static int cpu;
+
+static const struct option options[] = {
+	OPT_INTEGER('l', "loop",	&loops,		"Specify number of loops per depth"),
+	OPT_INTEGER('m', "min-depth",	&min_depth,	"Specify the lowest cgroup depth to run at"),
+	OPT_INTEGER('d', "max-depth",	&max_depth,	"Specify the highest cgroup depth to run at"),
+	OPT_INTEGER('c', "cpu",		&cpu,		"Specify the CPU to run the processes on"),
+	OPT_END()
+};
+
+static const char * const bench_sched_psi_usage[] = {
+	"perf bench sched psi <options>",
+	NULL
+};
+
+static int cgroup2_mountpoint(char *buf, size_t size)
+{
+	struct mntent *mnt;
+	FILE *fp;
+	int ret = -1;
+
+	fp = setmntent("/proc/mounts", "r");
+	if (fp == NULL)
+		return -1;
+
+	while ((mnt = getmntent(fp)) != NULL) {
+		if (strcmp(mnt->mnt_type, "cgroup2"))
+			continue;
+		if (strlen(mnt->mnt_dir) < size) {
+			strcpy(buf, mnt->mnt_dir);
+			ret = 0;
+		}
+		break;
+	}
+
+	endmntent(fp);
+	return ret;
+}
+
+/* @base/@name/1/2/.../@depth-1 */
+static void chain_path(char *buf, size_t size, const char *base,
+		       const char *name, int depth)
+{
+	int len, i;
+
+	len = snprintf(buf, size, "%s/%s", base, name);
+	for (i = 1; i < depth; i++)
+		len += snprintf(buf + len, size - len, "/%d", i);
+}
+
+static int chain_create(const char *base, const char *name, int depth)
+{
+	char path[PATH_MAX];
+	int i;
+
+	for (i = 1; i <= depth; i++) {
+		chain_path(path, sizeof(path), base, name, i);
+		if (mkdir(path, 0755) && errno != EEXIST) {
+			int saved_errno = errno;
+
+			fprintf(stderr, "Cannot create cgroup %s: %s\n",
+				path, strerror(saved_errno));
+			if (saved_errno == EACCES && geteuid() > 0)
+				fprintf(stderr, " Hint: try to run as root\n");
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static void chain_destroy(const char *base, const char *name, int depth)
+{
+	char path[PATH_MAX];
+
+	for (; depth > 0; depth--) {
+		chain_path(path, sizeof(path), base, name, depth);
+		rmdir(path);
+	}
+}
+
+static int enter_cgroup(const char *path)
+{
+	char procs[PATH_MAX + 16];
+	int fd, ret;
+
+	snprintf(procs, sizeof(procs), "%s/cgroup.procs", path);
+	fd = open(procs, O_WRONLY);
+	if (fd < 0)
+		return -1;
+
+	/* "0" moves the writing process */
+	ret = write(fd, "0\n", 2);
+	close(fd);
+
+	return ret == 2 ? 0 : -1;
+}
+
+static void worker(const char *cgrp, int nr, int ready, int go,
+		   int pipe_read, int pipe_write)
+{
+	cpu_set_t cpuset;
+	int i, m = 0;
+	char c = 0;
+
+	CPU_ZERO(&cpuset);
+	CPU_SET(cpu, &cpuset);
+	if (sched_setaffinity(0, sizeof(cpuset), &cpuset)) {
+		fprintf(stderr, "Cannot bind to CPU %d\n", cpu);
+		exit(1);
+	}
+
+	if (enter_cgroup(cgrp)) {
+		fprintf(stderr, "Cannot enter cgroup %s\n", cgrp);
+		exit(1);
+	}
+
+	BUG_ON(write(ready, &c, 1) != 1);
+	BUG_ON(read(go, &c, 1) != 1);
+
+	for (i = 0; i < loops; i++) {
+		if (!nr) {
+			BUG_ON(read(pipe_read, &m, sizeof(int)) != sizeof(int));
+			BUG_ON(write(pipe_write, &m, sizeof(int)) != sizeof(int));
+		} else {
+			BUG_ON(write(pipe_write, &m, sizeof(int)) != sizeof(int));
+			BUG_ON(read(pipe_read, &m, sizeof(int)) != sizeof(int));
+		}
+	}
+
+	exit(0);
+}
+
+/* Returns the runtime in usecs, or 0 on failure */
+static unsigned long long run_depth(const char *base, int depth)
+{
+	static const char * const names[2] = { "a", "b" };
+	int pipe_1[2], pipe_2[2], ready[2], go[2];
+	struct timeval start, stop, diff;
+	char cgrp[PATH_MAX];
+	pid_t pids[2] = { -1, -1 };
+	unsigned long long result_usec = 0;
+	int t, wait_stat;
+	char c = 0;
+
+	for (t = 0; t < 2; t++) {
+		if (chain_create(base, names[t], depth))
+			goto out_destroy;
+	}
+
+	BUG_ON(pipe(pipe_1) || pipe(pipe_2) || pipe(ready) || pipe(go));
+
+	for (t = 0; t < 2; t++) {
+		chain_path(cgrp, sizeof(cgrp), base, names[t], depth);
+
+		pids[t] = fork();
+		BUG_ON(pids[t] < 0);
+		if (!pids[t]) {
+			if (!t)
+				worker(cgrp, t, ready[1], go[0], pipe_1[0], pipe_2[1]);
+			else
+				worker(cgrp, t, ready[1], go[0], pipe_2[0], pipe_1[1]);
+		}
+	}
+
+	close(ready[1]);
+	for (t = 0; t < 2; t++) {
+		if (read(ready[0], &c, 1) != 1)
+			goto out_kill;
+	}
+
+	gettimeofday(&start, NULL);
+	for (t = 0; t < 2; t++)
+		BUG_ON(write(go[1], &c, 1) != 1);
+
+	for (t = 0; t < 2; t++) {
+		BUG_ON(waitpid(pids[t], &wait_stat, 0) != pids[t]);
+		pids[t] = -1;
+		if (!WIFEXITED(wait_stat) || WEXITSTATUS(wait_stat))
+			goto out_kill;
+	}
+	gettimeofday(&stop, NULL);
+
+	timersub(&stop, &start, &diff);
+	result_usec = diff.tv_sec * USEC_PER_SEC + diff.tv_usec;
+
+out_kill:
+	for (t = 0; t < 2; t++) {
+		if (pids[t] > 0) {
+			kill(pids[t], SIGKILL);
+			waitpid(pids[t], NULL, 0);
+		}
+	}
+	close(pipe_1[0]);
+	close(pipe_1[1]);
+	close(pipe_2[0]);
+	close(pipe_2[1]);
+	close(ready[0]);
+	close(go[0]);
+	close(go[1]);
+out_destroy:
+	for (t = 0; t < 2; t++)
+		chain_destroy(base, names[t], depth);
+
+	return result_usec;
+}
+
+int bench_sched_psi(int argc, const char **argv)
+{
+	char mnt[PATH_MAX], base[PATH_MAX];
+	unsigned long long result_usec, base_usec = 0;
+	int depth, ret = 0;
+
+	argc = parse_options(argc, argv, options, bench_sched_psi_usage, 0);
+
+	if (argc || min_depth < 1 || max_depth < min_depth || loops <= 0) {
+		usage_with_options(bench_sched_psi_usage, options);
+		exit(EXIT_FAILURE);
+	}
+
+	if (cgroup2_mountpoint(mnt, sizeof(mnt))) {
+		fprintf(stderr, "cgroup2 is not mounted\n");
+		return -1;
+	}
+
+	snprintf(base, sizeof(base), "%s/perf-bench-psi-%d", mnt, getpid());
+	if (mkdir(base, 0755)) {
+		int saved_errno = errno;
+
+		fprintf(stderr, "Cannot create cgroup %s: %s\n", base, strerror(saved_errno));
+		if (saved_errno == EACCES && geteuid() > 0)
+			fprintf(stderr, " Hint: try to run as root\n");
+		return -1;
+	}
+
+	if (bench_format == BENCH_FORMAT_DEFAULT) {
+		printf("# Executed %d pipe operations between two processes on CPU %d per cgroup depth\n\n",
+		       loops, cpu);
+		printf(" %6s %14s %14s %14s\n", "depth", "usecs/op", "ops/sec",
+		       "vs. first");
+	}
+
+	for (depth = min_depth; depth <= max_depth; depth++) {
+		double usecs_op;
+
+		result_usec = run_depth(base, depth);
+		if (!result_usec) {
+			fprintf(stderr, "Benchmark failed at depth %d\n", depth);
+			ret = -1;
+			break;
+		}
+		if (!base_usec)
+			base_usec = result_usec;
+
+		usecs_op = (double)result_usec / (double)loops;
+
+		switch (bench_format) {
+		case BENCH_FORMAT_DEFAULT:
+			printf(" %6d %14lf %14d %+13.1lf%%\n", depth, usecs_op,
+			       (int)((double)loops /
+				     ((double)result_usec / (double)USEC_PER_SEC)),
+			       ((double)result_usec / (double)base_usec - 1) * 100);
+			break;
+
+		case BENCH_FORMAT_SIMPLE:
+			printf("%d %lf\n", depth, usecs_op);
+			break;
+
+		default:
+			/* reaching here is something disaster */
+			fprintf(stderr, "Unknown format:%d\n", bench_format);
+			exit(1);
+			break;
+		}
+		fflush(stdout);
+	}
+
+	rmdir(base);
+	return ret;
+}
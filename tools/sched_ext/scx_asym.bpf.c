@@ -0,0 +1,509 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * A capacity-aware scheduler for asymmetric (big.LITTLE) CPUs.
+ *
+ * CPUs are split into two classes at init time according to their capacity as
+ * reported by scx_bpf_cpuperf_cap(): CPUs whose capacity is at least
+ * @big_cap_pct percent of the most performant CPU are "big", the rest are
+ * "little". On an RK3588, the four Cortex-A76 cores end up big and the four
+ * Cortex-A55 cores little.
+ *
+ * Each task carries a capacity-invariant utilization estimate which is
+ * maintained by the scheduler itself, as PELT isn't updated for SCX tasks. The
+ * estimate is an exponentially weighted moving average of the fraction of
+ * wall time the task spends running, scaled by the capacity and current
+ * performance level of the CPU it ran on. A task is placed on the big CPUs
+ * if either
+ *
+ * - its utilization doesn't fit in @misfit_pct percent of a little CPU, or
+ * - it is latency sensitive, which this scheduler approximates with a
+ *   negative nice value (can be disabled with -L).
+ *
+ * Everything else is considered background work and goes to the little CPUs.
+ * There is one vtime-ordered DSQ per class. Idle big CPUs pull from the little
+ * DSQ and little CPUs pull from the big DSQ when their own DSQ is empty so that
+ * no CPU idles while work is pending. A task that ended up on a little CPU and
+ * grew too large for it is a "misfit": ops.tick() preempts it as soon as a big
+ * CPU goes idle and ops.enqueue() kicks the idle big CPU to pick it up.
+ *
+ * When selecting an idle CPU, the cluster of the previous CPU is tried first
+ * using scx_bpf_get_cluster_cpumask() to stay within the same cache and
+ * frequency domain.
+ *
+ * On systems with symmetric CPU capacities (scx_bpf_asym_cpucapacity()
+ * returns false), all CPUs are treated as big and the scheduler degenerates
+ * into a global weighted vtime scheduler similar to scx_simple.
+ *
+ * The scheduler can be exercised without big.LITTLE hardware by booting an
+ * arm64 QEMU "virt" machine with a device tree declaring asymmetric
+ * "capacity-dmips-mhz" properties in the cpu nodes. See README.md.
+ */
+#include <scx/common.bpf.h>
+
+char _license[] SEC("license") = "GPL";
+
+enum consts {
+	BIG_DSQ			= 0,
+	LITTLE_DSQ		= 1,
+	NICE_0_WEIGHT		= 100,
+	UTIL_EWMA_SHIFT		= 2,	/* new sample weighs 1/4 */
+};
+
+/* topology kfuncs, see kernel/sched/ext.c */
+bool scx_bpf_asym_cpucapacity(void) __ksym __weak;
+const struct cpumask *scx_bpf_get_cluster_cpumask(s32 cpu) __ksym __weak;
+
+const volatile u64 slice_ns = SCX_SLICE_DFL;
+const volatile u32 big_cap_pct = 80;
+const volatile u32 misfit_pct = 80;
+const volatile bool latency_boost = true;
+const volatile bool no_spill;
+
+/* Detected topology, exported to userspace */
+u32 nr_big_cpus, nr_little_cpus;
+u32 big_cap, little_cap;
+u32 big_util_thresh;
+
+/* Statistics */
+u64 nr_local_big, nr_local_little, nr_spilled;
+u64 nr_queued_big, nr_queued_little;
+u64 nr_misfits, nr_pulled_big, nr_pulled_little;
+
+static u64 vtime_now;
+UEI_DEFINE(uei);
+
+private(ASYM) struct bpf_cpumask __kptr *big_cpumask;
+private(ASYM) struct bpf_cpumask __kptr *little_cpumask;
+
+/* Per-task scheduling context */
+struct task_ctx {
+	u64	running_at;	/* when the task last started running */
+	u64	last_stop;	/* when the task last stopped running */
+	u32	util;		/* capacity-invariant util, [0, SCX_CPUPERF_ONE] */
+	bool	want_big;
+};
+
+struct {
+	__uint(type, BPF_MAP_TYPE_TASK_STORAGE);
+	__uint(map_flags, BPF_F_NO_PREALLOC);
+	__type(key, int);
+	__type(value, struct task_ctx);
+} task_ctx_stor SEC(".maps");
+
+static inline bool vtime_before(u64 a, u64 b)
+{
+	return (s64)(a - b) < 0;
+}
+
+static struct task_ctx *lookup_task_ctx(struct task_struct *p)
+{
+	struct task_ctx *tctx;
+
+	if (!(tctx = bpf_task_storage_get(&task_ctx_stor, p, 0, 0))) {
+		scx_bpf_error("task_ctx lookup failed");
+		return NULL;
+	}
+	return tctx;
+}
+
+static const struct cpumask *class_cpumask(bool big)
+{
+	struct bpf_cpumask *mask;
+
+	mask = big ? big_cpumask : little_cpumask;
+	if (!mask) {
+		scx_bpf_error("%s cpumask not initialized", big ? "big" : "little");
+		return NULL;
+	}
+	return (const struct cpumask *)mask;
+}
+
+static bool cpu_is_big(s32 cpu)
+{
+	const struct cpumask *big = class_cpumask(true);
+
+	return big && bpf_cpumask_test_cpu(cpu, big);
+}
+
+/*
+ * Decide which class of CPUs @p should run on. Heavy tasks need big CPUs. A
+ * task which has been classified big is demoted only after its utilization
+ * drops below 3/4 of the threshold so that tasks hovering around the threshold
+ * don't bounce between the clusters.
+ */
+static bool task_wants_big(struct task_struct *p, struct task_ctx *tctx)
+{
+	u32 thresh = big_util_thresh;
+
+	if (!nr_little_cpus)
+		return true;
+	if (latency_boost && p->scx.weight > NICE_0_WEIGHT)
+		return true;
+	if (tctx->want_big)
+		thresh = thresh * 3 / 4;
+
+	return tctx->util >= thresh;
+}
+
+/*
+ * Try to claim an idle CPU in @mask. The previous CPU is tried first, then its
+ * cluster siblings and finally the whole @mask. The caller must make sure that
+ * the task is allowed to run on all CPUs in @mask.
+ */
+static s32 pick_idle_in(s32 prev_cpu, const struct cpumask *mask)
+{
+	const struct cpumask *cluster;
+	s32 cpu;
+
+	if (bpf_cpumask_test_cpu(prev_cpu, mask) &&
+	    scx_bpf_test_and_clear_cpu_idle(prev_cpu))
+		return prev_cpu;
+
+	if (bpf_ksym_exists(scx_bpf_get_cluster_cpumask)) {
+		cluster = scx_bpf_get_cluster_cpumask(prev_cpu);
+		cpu = -EBUSY;
+		if (bpf_cpumask_subset(cluster, mask))
+			cpu = scx_bpf_pick_idle_cpu(cluster, 0);
+		scx_bpf_put_cpumask(cluster);
+		if (cpu >= 0)
+			return cpu;
+	}
+
+	return scx_bpf_pick_idle_cpu(mask, 0);
+}
+
+s32 BPF_STRUCT_OPS(asym_select_cpu, struct task_struct *p, s32 prev_cpu, u64 wake_flags)
+{
+	const struct cpumask *mask;
+	struct task_ctx *tctx;
+	bool is_idle = false;
+	s32 cpu;
+
+	if (!(tctx = lookup_task_ctx(p)))
+		return prev_cpu;
+
+	tctx->want_big = task_wants_big(p, tctx);
+
+	if (!(mask = class_cpumask(tctx->want_big)))
+		return prev_cpu;
+
+	/*
+	 * Tasks with restricted affinity, e.g. per-CPU kthreads, can't follow
+	 * the class placement. Let the default idle selection handle them.
+	 */
+	if (!bpf_cpumask_subset(mask, p->cpus_ptr)) {
+		cpu = scx_bpf_select_cpu_dfl(p, prev_cpu, wake_flags, &is_idle);
+		if (is_idle)
+			scx_bpf_dsq_insert(p, SCX_DSQ_LOCAL, slice_ns, 0);
+		return cpu;
+	}
+
+	cpu = pick_idle_in(prev_cpu, mask);
+	if (cpu >= 0) {
+		if (tctx->want_big)
+			__sync_fetch_and_add(&nr_local_big, 1);
+		else
+			__sync_fetch_and_add(&nr_local_little, 1);
+		scx_bpf_dsq_insert(p, SCX_DSQ_LOCAL, slice_ns, 0);
+		return cpu;
+	}
+
+	/*
+	 * No idle CPU in the preferred class. Rather than waiting, run on an
+	 * idle CPU of the other class. If a big task lands on a little CPU,
+	 * it'll be migrated back through the misfit path once a big CPU frees
+	 * up.
+	 */
+	if (!no_spill && nr_little_cpus &&
+	    (mask = class_cpumask(!tctx->want_big)) &&
+	    bpf_cpumask_subset(mask, p->cpus_ptr)) {
+		cpu = pick_idle_in(prev_cpu, mask);
+		if (cpu >= 0) {
+			__sync_fetch_and_add(&nr_spilled, 1);
+			scx_bpf_dsq_insert(p, SCX_DSQ_LOCAL, slice_ns, 0);
+			return cpu;
+		}
+	}
+
+	return prev_cpu;
+}
+
+void BPF_STRUCT_OPS(asym_enqueue, struct task_struct *p, u64 enq_flags)
+{
+	const struct cpumask *mask;
+	struct task_ctx *tctx;
+	u64 vtime = p->scx.dsq_vtime;
+	u64 dsq_id;
+	bool big;
+	s32 cpu;
+
+	if (!(tctx = lookup_task_ctx(p)))
+		return;
+
+	tctx->want_big = task_wants_big(p, tctx);
+
+	/*
+	 * A task whose affinity excludes the whole preferred class, e.g. a
+	 * per-CPU kthread of a little CPU, would starve on its DSQ: it is
+	 * only consumed by the other class when their own DSQ is empty.
+	 */
+	big = tctx->want_big;
+	if (!(mask = class_cpumask(big)))
+		return;
+	if (nr_little_cpus && !bpf_cpumask_intersects(mask, p->cpus_ptr)) {
+		big = !big;
+		if (!(mask = class_cpumask(big)))
+			return;
+	}
+
+	if (big) {
+		dsq_id = BIG_DSQ;
+		__sync_fetch_and_add(&nr_queued_big, 1);
+	} else {
+		dsq_id = LITTLE_DSQ;
+		__sync_fetch_and_add(&nr_queued_little, 1);
+	}
+
+	/*
+	 * Limit the amount of budget that an idling task can accumulate to
+	 * one slice.
+	 */
+	if (vtime_before(vtime, vtime_now - slice_ns))
+		vtime = vtime_now - slice_ns;
+
+	scx_bpf_dsq_insert_vtime(p, dsq_id, slice_ns, vtime, enq_flags);
+
+	/*
+	 * If a CPU of the chosen class is idle, wake it up to pick up @p.
+	 * This is what moves a preempted misfit task over to a big CPU.
+	 */
+	cpu = scx_bpf_pick_idle_cpu(mask, 0);
+	if (cpu >= 0 && bpf_cpumask_test_cpu(cpu, p->cpus_ptr))
+		scx_bpf_kick_cpu(cpu, SCX_KICK_IDLE);
+}
+
+void BPF_STRUCT_OPS(asym_dispatch, s32 cpu, struct task_struct *prev)
+{
+	if (cpu_is_big(cpu)) {
+		if (scx_bpf_dsq_move_to_local(BIG_DSQ))
+			return;
+		if (scx_bpf_dsq_move_to_local(LITTLE_DSQ))
+			__sync_fetch_and_add(&nr_pulled_little, 1);
+	} else {
+		if (scx_bpf_dsq_move_to_local(LITTLE_DSQ))
+			return;
+		if (scx_bpf_dsq_move_to_local(BIG_DSQ))
+			__sync_fetch_and_add(&nr_pulled_big, 1);
+	}
+}
+
+void BPF_STRUCT_OPS(asym_tick, struct task_struct *p)
+{
+	const struct cpumask *idle, *big;
+	struct task_ctx *tctx;
+	s32 cpu = scx_bpf_task_cpu(p);
+	bool has_idle_big;
+
+	if (!nr_little_cpus || cpu_is_big(cpu))
+		return;
+	if (!(tctx = lookup_task_ctx(p)) || !tctx->want_big)
+		return;
+	if (!(big = class_cpumask(true)))
+		return;
+
+	/*
+	 * @p belongs on a big CPU but is running on a little one. Preempt it
+	 * if there is an idle big CPU it can move to.
+	 */
+	idle = scx_bpf_get_idle_cpumask();
+	has_idle_big = bpf_cpumask_intersects(idle, big) &&
+		       bpf_cpumask_intersects(big, p->cpus_ptr);
+	scx_bpf_put_idle_cpumask(idle);
+
+	if (has_idle_big) {
+		__sync_fetch_and_add(&nr_misfits, 1);
+		p->scx.slice = 0;
+	}
+}
+
+void BPF_STRUCT_OPS(asym_running, struct task_struct *p)
+{
+	struct task_ctx *tctx;
+
+	if ((tctx = lookup_task_ctx(p)))
+		tctx->running_at = bpf_ktime_get_ns();
+
+	/*
+	 * Global vtime always progresses forward as tasks start executing. The
+	 * test and update can be performed concurrently from multiple CPUs and
+	 * thus racy. Any error should be contained and temporary.
+	 */
+	if (vtime_before(vtime_now, p->scx.dsq_vtime))
+		vtime_now = p->scx.dsq_vtime;
+}
+
+void BPF_STRUCT_OPS(asym_stopping, struct task_struct *p, bool runnable)
+{
+	struct task_ctx *tctx;
+	s32 cpu = scx_bpf_task_cpu(p);
+	u64 now = bpf_ktime_get_ns();
+	u64 exec, window, sample;
+
+	p->scx.dsq_vtime += (slice_ns - p->scx.slice) * NICE_0_WEIGHT / p->scx.weight;
+
+	if (!(tctx = lookup_task_ctx(p)))
+		return;
+
+	/*
+	 * Update the utilization estimate. @exec is the time spent running
+	 * since ops.running() scaled to the most performant CPU running at its
+	 * highest frequency. @window is the wall time since the task last
+	 * stopped, which includes the time spent sleeping and waiting.
+	 */
+	exec = now - tctx->running_at;
+	exec = exec * scx_bpf_cpuperf_cap(cpu) / SCX_CPUPERF_ONE;
+	exec = exec * scx_bpf_cpuperf_cur(cpu) / SCX_CPUPERF_ONE;
+
+	window = now - tctx->last_stop;
+	if (!tctx->last_stop || window < exec)
+		window = exec;
+	tctx->last_stop = now;
+
+	if (!window)
+		return;
+
+	sample = exec * SCX_CPUPERF_ONE / window;
+	if (sample > SCX_CPUPERF_ONE)
+		sample = SCX_CPUPERF_ONE;
+
+	tctx->util -= tctx->util >> UTIL_EWMA_SHIFT;
+	tctx->util += sample >> UTIL_EWMA_SHIFT;
+}
+
+void BPF_STRUCT_OPS(asym_enable, struct task_struct *p)
+{
+	p->scx.dsq_vtime = vtime_now;
+}
+
+s32 BPF_STRUCT_OPS(asym_init_task, struct task_struct *p,
+		   struct scx_init_task_args *args)
+{
+	struct task_ctx *tctx;
+
+	tctx = bpf_task_storage_get(&task_ctx_stor, p, 0,
+				    BPF_LOCAL_STORAGE_GET_F_CREATE);
+	if (!tctx)
+		return -ENOMEM;
+
+	/*
+	 * New tasks start with no utilization and thus on the little CPUs.
+	 * The ones that turn out to be heavy get promoted as misfits.
+	 */
+	tctx->last_stop = bpf_ktime_get_ns();
+	return 0;
+}
+
+void BPF_STRUCT_OPS(asym_dump_task, struct scx_dump_ctx *dctx, struct task_struct *p)
+{
+	struct task_ctx *tctx;
+
+	if (!(tctx = bpf_task_storage_get(&task_ctx_stor, p, 0, 0)))
+		return;
+
+	scx_bpf_dump("ASYM: util=%u want_big=%d", tctx->util, tctx->want_big);
+}
+
+/*
+ * Classify CPUs into big and little according to their capacity and publish
+ * the resulting cpumasks.
+ */
+static s32 init_cpumasks(void)
+{
+	struct bpf_cpumask *big, *little;
+	u32 nr_cpu_ids = scx_bpf_nr_cpu_ids();
+	u32 max_cap = 0, min_big_cap = SCX_CPUPERF_ONE, max_little_cap = 0;
+	bool asym = true;
+	s32 cpu;
+
+	if (bpf_ksym_exists(scx_bpf_asym_cpucapacity))
+		asym = scx_bpf_asym_cpucapacity();
+
+	bpf_for(cpu, 0, nr_cpu_ids) {
+		u32 cap = scx_bpf_cpuperf_cap(cpu);
+
+		if (cap > max_cap)
+			max_cap = cap;
+	}
+
+	big = bpf_cpumask_create();
+	if (!big)
+		return -ENOMEM;
+	little = bpf_cpumask_create();
+	if (!little) {
+		bpf_cpumask_release(big);
+		return -ENOMEM;
+	}
+
+	bpf_for(cpu, 0, nr_cpu_ids) {
+		u32 cap = scx_bpf_cpuperf_cap(cpu);
+
+		if (!asym || cap * 100 >= max_cap * big_cap_pct) {
+			bpf_cpumask_set_cpu(cpu, big);
+			nr_big_cpus++;
+			if (cap < min_big_cap)
+				min_big_cap = cap;
+		} else {
+			bpf_cpumask_set_cpu(cpu, little);
+			nr_little_cpus++;
+			if (cap > max_little_cap)
+				max_little_cap = cap;
+		}
+	}
+
+	big_cap = min_big_cap;
+	little_cap = max_little_cap;
+	big_util_thresh = little_cap * misfit_pct / 100;
+
+	big = bpf_kptr_xchg(&big_cpumask, big);
+	if (big)
+		bpf_cpumask_release(big);
+	little = bpf_kptr_xchg(&little_cpumask, little);
+	if (little)
+		bpf_cpumask_release(little);
+
+	return 0;
+}
+
+s32 BPF_STRUCT_OPS_SLEEPABLE(asym_init)
+{
+	s32 ret;
+
+	ret = init_cpumasks();
+	if (ret)
+		return ret;
+
+	ret = scx_bpf_create_dsq(BIG_DSQ, -1);
+	if (ret)
+		return ret;
+
+	return scx_bpf_create_dsq(LITTLE_DSQ, -1);
+}
+
+void BPF_STRUCT_OPS(asym_exit, struct scx_exit_info *ei)
+{
+	UEI_RECORD(uei, ei);
+}
+
+SCX_OPS_DEFINE(asym_ops,
+	       .select_cpu		= (void *)asym_select_cpu,
+	       .enqueue			= (void *)asym_enqueue,
+	       .dispatch		= (void *)asym_dispatch,
+	       .tick			= (void *)asym_tick,
+	       .running			= (void *)asym_running,
+	       .stopping		= (void *)asym_stopping,
+	       .enable			= (void *)asym_enable,
+	       .init_task		= (void *)asym_init_task,
+	       .dump_task		= (void *)asym_dump_task,
+	       .init			= (void *)asym_init,
+	       .exit			= (void *)asym_exit,
+	       .name			= "asym");
@@ -0,0 +1,118 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#include <stdio.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <libgen.h>
+#include <bpf/bpf.h>
+#include <scx/common.h>
+#include "scx_asym.bpf.skel.h"
+
+const char help_fmt[] =
+"A capacity-aware sched_ext scheduler for asymmetric CPUs.\n"
+"\n"
+"See the top-level comment in .bpf.c for more details.\n"
+"\n"
+"Usage: %s [-s SLICE_US] [-b PCT] [-m PCT] [-L] [-S] [-v]\n"
+"\n"
+"  -s SLICE_US   Override slice duration\n"
+"  -b PCT        Minimum capacity of big CPUs in percent of the largest (default: 80)\n"
+"  -m PCT        Utilization in percent of a little CPU above which a task is\n"
+"                a misfit and moved to big CPUs (default: 80)\n"
+"  -L            Don't place negative nice tasks on big CPUs\n"
+"  -S            Don't spill tasks to idle CPUs of the other class\n"
+"  -v            Print libbpf debug messages\n"
+"  -h            Display this help and exit\n";
+
+static bool verbose;
+static volatile int exit_req;
+
+static int libbpf_print_fn(enum libbpf_print_level level, const char *format, va_list args)
+{
+	if (level == LIBBPF_DEBUG && !verbose)
+		return 0;
+	return vfprintf(stderr, format, args);
+}
+
+static void sigint_handler(int dummy)
+{
+	exit_req = 1;
+}
+
+int main(int argc, char **argv)
+{
+	struct scx_asym *skel;
+	struct bpf_link *link;
+	__u64 seq = 0, ecode;
+	__s32 opt;
+
+	libbpf_set_print(libbpf_print_fn);
+	signal(SIGINT, sigint_handler);
+	signal(SIGTERM, sigint_handler);
+restart:
+	skel = SCX_OPS_OPEN(asym_ops, scx_asym);
+
+	while ((opt = getopt(argc, argv, "s:b:m:LSvh")) != -1) {
+		switch (opt) {
+		case 's':
+			skel->rodata->slice_ns = strtoull(optarg, NULL, 0) * 1000;
+			break;
+		case 'b':
+			skel->rodata->big_cap_pct = strtoul(optarg, NULL, 0);
+			break;
+		case 'm':
+			skel->rodata->misfit_pct = strtoul(optarg, NULL, 0);
+			break;
+		case 'L':
+			skel->rodata->latency_boost = false;
+			break;
+		case 'S':
+			skel->rodata->no_spill = true;
+			break;
+		case 'v':
+			verbose = true;
+			break;
+		default:
+			fprintf(stderr, help_fmt, basename(argv[0]));
+			return opt != 'h';
+		}
+	}
+
+	SCX_BUG_ON(skel->rodata->big_cap_pct > 100 || skel->rodata->misfit_pct > 100,
+		   "Percentages must be in [0, 100]");
+
+	SCX_OPS_LOAD(skel, asym_ops, scx_asym, uei);
+	link = SCX_OPS_ATTACH(skel, asym_ops, scx_asym);
+
+	printf("big CPUs: %u (capacity >= %u)  little CPUs: %u (capacity <= %u)  misfit util: %u\n",
+	       skel->bss->nr_big_cpus, skel->bss->big_cap,
+	       skel->bss->nr_little_cpus, skel->bss->little_cap,
+	       skel->bss->big_util_thresh);
+	if (!skel->bss->nr_little_cpus)
+		printf("WARNING : CPU capacities are symmetric, running as a global vtime scheduler\n");
+
+	while (!exit_req && !UEI_EXITED(skel, uei)) {
+		printf("[SEQ %llu]\n", seq++);
+		printf("local   : big=%10" PRIu64 " little=%10" PRIu64 "  spilled=%10" PRIu64 "\n",
+		       skel->bss->nr_local_big,
+		       skel->bss->nr_local_little,
+		       skel->bss->nr_spilled);
+		printf("queued  : big=%10" PRIu64 " little=%10" PRIu64 "\n",
+		       skel->bss->nr_queued_big,
+		       skel->bss->nr_queued_little);
+		printf("balance : misfit=%10" PRIu64 " pulled_big=%10" PRIu64 " pulled_little=%10" PRIu64 "\n",
+		       skel->bss->nr_misfits,
+		       skel->bss->nr_pulled_big,
+		       skel->bss->nr_pulled_little);
+		fflush(stdout);
+		sleep(1);
+	}
+
+	bpf_link__destroy(link);
+	ecode = UEI_REPORT(skel, uei);
+	scx_asym__destroy(skel);
+
+	if (UEI_ECODE_RESTART(ecode))
+		goto restart;
+	return 0;
+}
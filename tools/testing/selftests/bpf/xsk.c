@@ -670,7 +670,8 @@ int xsk_socket__create_shared(struct xsk_socket **xsk_ptr,
 	sxdp.sxdp_ifindex = ctx->ifindex;
 	sxdp.sxdp_queue_id = ctx->queue_id;
 	if (umem->refcount > 1) {
-		sxdp.sxdp_flags |= XDP_SHARED_UMEM;
+		sxdp.sxdp_flags |= XDP_SHARED_UMEM |
+				   (xsk->config.bind_flags & XDP_FANOUT);
 		sxdp.sxdp_shared_umem_fd = umem->fd;
 	} else {
 		sxdp.sxdp_flags = xsk->config.bind_flags;
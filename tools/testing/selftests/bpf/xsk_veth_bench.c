@@ -0,0 +1,338 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Compare the packet rate of AF_XDP sockets on a veth pair in copy and in
+ * zero-copy mode, with small and with full-sized frames.
+ *
+ * One thread sends from a socket on the first interface as fast as the
+ * rings allow, another receives on a socket of the second interface, to
+ * which the peer frames are redirected by xsk_def_prog.
+ *
+ * The fan-out run sends on queue 2 and receives with two XDP_FANOUT sockets
+ * sharing a UMEM on queues 0 and 1: the program only knows the first one,
+ * and the kernel hands the frames to the member serving queue 2.
+ */
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <getopt.h>
+#include <net/if.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/if_ether.h>
+#include <linux/if_link.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+
+#include "xsk.h"
+#include "xsk_xdp_progs.skel.h"
+#include "../kselftest.h"
+
+#define NUM_FRAMES	4096
+#define FRAME_SIZE	XSK_UMEM__DEFAULT_FRAME_SIZE
+#define BATCH_SIZE	64
+#define RX_FRAMES	XSK_RING_PROD__DEFAULT_NUM_DESCS
+
+enum bench_mode {
+	BENCH_COPY,
+	BENCH_ZEROCOPY,
+	BENCH_FANOUT,
+};
+
+static const char * const mode_names[] = {
+	[BENCH_COPY]		= "copy",
+	[BENCH_ZEROCOPY]	= "zero-copy",
+	[BENCH_FANOUT]		= "fan-out",
+};
+
+static unsigned int sizes[] = { 64, 1500 };
+static unsigned int runtime = 3;
+static unsigned int pkt_size;
+static const char *ifname_tx, *ifname_rx;
+
+struct bench_sock {
+	struct xsk_xdp_progs *skel;
+	struct xsk_umem *umem;
+	struct xsk_socket *xsk;
+	struct xsk_ring_prod fq, tx;
+	struct xsk_ring_cons cq, rx;
+	void *bufs;
+	__u64 first_frame;
+	int ifindex;
+	unsigned long long pkts;
+	volatile bool *stop;
+};
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int sock_open(struct bench_sock *s, const char *ifname, __u32 queue,
+		     bool rx, __u16 bind_flags)
+{
+	struct xsk_socket_config cfg = {
+		.rx_size = XSK_RING_CONS__DEFAULT_NUM_DESCS,
+		.tx_size = XSK_RING_PROD__DEFAULT_NUM_DESCS,
+		.bind_flags = bind_flags | XDP_USE_NEED_WAKEUP,
+	};
+	size_t size = (size_t)NUM_FRAMES * FRAME_SIZE;
+	int ret;
+
+	s->ifindex = if_nametoindex(ifname);
+	if (!s->ifindex)
+		return -errno;
+
+	s->bufs = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (s->bufs == MAP_FAILED)
+		return -errno;
+	ret = xsk_umem__create(&s->umem, s->bufs, size, &s->fq, &s->cq, NULL);
+	if (ret)
+		return ret;
+
+	/* NAPI, which runs zero-copy TX on veth, needs a program too */
+	s->skel = xsk_xdp_progs__open_and_load();
+	if (!s->skel)
+		return -errno;
+	ret = xsk_attach_xdp_program(s->skel->progs.xsk_def_prog, s->ifindex,
+				     XDP_FLAGS_DRV_MODE);
+	if (ret)
+		return ret;
+
+	ret = xsk_socket__create(&s->xsk, s->ifindex, queue, s->umem,
+				 rx ? &s->rx : NULL, rx ? NULL : &s->tx, &cfg);
+	if (ret)
+		return ret;
+	if (rx)
+		return xsk_update_xskmap(s->skel->maps.xsk, s->xsk, 0);
+	return 0;
+}
+
+/* Second fan-out member, on the UMEM of @first and fed by its program */
+static int sock_open_member(struct bench_sock *s, struct bench_sock *first,
+			    __u32 queue)
+{
+	struct xsk_socket_config cfg = {
+		.rx_size = XSK_RING_CONS__DEFAULT_NUM_DESCS,
+		.tx_size = XSK_RING_PROD__DEFAULT_NUM_DESCS,
+		.bind_flags = XDP_FANOUT,
+	};
+
+	s->bufs = first->bufs;
+	s->first_frame = RX_FRAMES;
+	s->ifindex = first->ifindex;
+	return xsk_socket__create_shared(&s->xsk, s->ifindex, queue,
+					 first->umem, &s->rx, NULL, &s->fq,
+					 &s->cq, &cfg);
+}
+
+static void sock_close(struct bench_sock *s)
+{
+	if (s->xsk)
+		xsk_socket__delete(s->xsk);
+	if (s->skel) {
+		xsk_detach_xdp_program(s->ifindex, XDP_FLAGS_DRV_MODE);
+		xsk_xdp_progs__destroy(s->skel);
+	}
+	if (s->umem)
+		xsk_umem__delete(s->umem);
+	if (s->bufs && s->bufs != MAP_FAILED)
+		munmap(s->bufs, (size_t)NUM_FRAMES * FRAME_SIZE);
+	memset(s, 0, sizeof(*s));
+}
+
+static void *tx_thread(void *arg)
+{
+	struct bench_sock *s = arg;
+	unsigned int outstanding = 0, next = 0;
+	int fd = xsk_socket__fd(s->xsk);
+	__u32 i, idx, n;
+
+	/* All frames carry the same packet, they are never rewritten */
+	for (i = 0; i < NUM_FRAMES; i++) {
+		struct ethhdr *eth = xsk_umem__get_data(s->bufs,
+							(__u64)i * FRAME_SIZE);
+
+		memset(eth, 0, pkt_size);
+		memset(eth->h_dest, 0xff, ETH_ALEN);
+		eth->h_proto = htons(ETH_P_802_EX1);
+	}
+
+	while (!*s->stop) {
+		n = xsk_ring_cons__peek(&s->cq, BATCH_SIZE, &idx);
+		if (n) {
+			xsk_ring_cons__release(&s->cq, n);
+			outstanding -= n;
+			s->pkts += n;
+		}
+
+		n = NUM_FRAMES - outstanding;
+		if (n > BATCH_SIZE)
+			n = BATCH_SIZE;
+		n = xsk_ring_prod__reserve(&s->tx, n, &idx);
+		for (i = 0; i < n; i++) {
+			struct xdp_desc *desc = xsk_ring_prod__tx_desc(&s->tx,
+								       idx + i);
+
+			desc->addr = (__u64)next * FRAME_SIZE;
+			desc->len = pkt_size;
+			desc->options = 0;
+			next = (next + 1) % NUM_FRAMES;
+		}
+		xsk_ring_prod__submit(&s->tx, n);
+		outstanding += n;
+
+		if (xsk_ring_prod__needs_wakeup(&s->tx))
+			sendto(fd, NULL, 0, MSG_DONTWAIT, NULL, 0);
+	}
+	return NULL;
+}
+
+static void *rx_thread(void *arg)
+{
+	struct bench_sock *s = arg;
+	int fd = xsk_socket__fd(s->xsk);
+	__u32 i, idx_rx, idx_fq, n;
+
+	n = xsk_ring_prod__reserve(&s->fq, RX_FRAMES, &idx_fq);
+	for (i = 0; i < n; i++)
+		*xsk_ring_prod__fill_addr(&s->fq, idx_fq + i) =
+			(s->first_frame + i) * FRAME_SIZE;
+	xsk_ring_prod__submit(&s->fq, n);
+
+	while (!*s->stop) {
+		n = xsk_ring_cons__peek(&s->rx, BATCH_SIZE, &idx_rx);
+		if (!n) {
+			if (xsk_ring_prod__needs_wakeup(&s->fq))
+				recvfrom(fd, NULL, 0, MSG_DONTWAIT, NULL, NULL);
+			continue;
+		}
+
+		/* Hand the buffers straight back to the fill ring */
+		while (xsk_ring_prod__reserve(&s->fq, n, &idx_fq) != n)
+			if (*s->stop)
+				return NULL;
+		for (i = 0; i < n; i++) {
+			const struct xdp_desc *desc;
+
+			desc = xsk_ring_cons__rx_desc(&s->rx, idx_rx + i);
+			*xsk_ring_prod__fill_addr(&s->fq, idx_fq + i) =
+				xsk_umem__extract_addr(desc->addr);
+		}
+		xsk_ring_prod__submit(&s->fq, n);
+		xsk_ring_cons__release(&s->rx, n);
+		s->pkts += n;
+	}
+	return NULL;
+}
+
+static void run_mode(enum bench_mode mode)
+{
+	const char *name = mode_names[mode];
+	__u16 bind_flags = mode == BENCH_ZEROCOPY ? XDP_ZEROCOPY : XDP_COPY;
+	struct bench_sock tx = {}, rx = {}, member = {};
+	bool fanout = mode == BENCH_FANOUT;
+	pthread_t tx_tid, rx_tid, member_tid;
+	volatile bool stop = false;
+	double start, elapsed;
+	int ret;
+
+	ret = sock_open(&rx, ifname_rx, 0, true,
+			fanout ? XDP_FANOUT : bind_flags);
+	if (!ret && fanout)
+		ret = sock_open_member(&member, &rx, 1);
+	if (!ret)
+		ret = sock_open(&tx, ifname_tx, fanout ? 2 : 0, false,
+				bind_flags);
+	if (ret) {
+		if (mode != BENCH_COPY && ret == -EOPNOTSUPP)
+			ksft_test_result_skip("%s: not supported\n", name);
+		else
+			ksft_test_result_fail("%s: setup failed: %s\n", name,
+					      strerror(-ret));
+		goto out;
+	}
+
+	tx.stop = rx.stop = member.stop = &stop;
+	pthread_create(&rx_tid, NULL, rx_thread, &rx);
+	if (fanout)
+		pthread_create(&member_tid, NULL, rx_thread, &member);
+	pthread_create(&tx_tid, NULL, tx_thread, &tx);
+
+	start = now();
+	sleep(runtime);
+	stop = true;
+	pthread_join(tx_tid, NULL);
+	pthread_join(rx_tid, NULL);
+	if (fanout)
+		pthread_join(member_tid, NULL);
+	elapsed = now() - start;
+
+	ksft_print_msg("%-9s %4u B  tx %10.0f pps  rx %10.0f pps\n", name,
+		       pkt_size, tx.pkts / elapsed,
+		       (rx.pkts + member.pkts) / elapsed);
+	ksft_test_result(rx.pkts + member.pkts, "%s: %u byte packets\n", name,
+			 pkt_size);
+out:
+	sock_close(&tx);
+	/* The member only borrows the UMEM and program of the first socket */
+	if (member.xsk)
+		xsk_socket__delete(member.xsk);
+	sock_close(&rx);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int nr_sizes = ARRAY_SIZE(sizes), i;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "i:s:t:")) != -1) {
+		switch (opt) {
+		case 'i':
+			if (!ifname_tx)
+				ifname_tx = optarg;
+			else
+				ifname_rx = optarg;
+			break;
+		case 's':
+			sizes[0] = atoi(optarg);
+			nr_sizes = 1;
+			break;
+		case 't':
+			runtime = atoi(optarg) ?: 1;
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (!ifname_tx || !ifname_rx || sizes[0] < ETH_HLEN ||
+	    sizes[0] > FRAME_SIZE - XDP_PACKET_HEADROOM)
+		goto usage;
+
+	ksft_print_header();
+	ksft_set_plan(nr_sizes * ARRAY_SIZE(mode_names));
+	ksft_print_msg("%s -> %s, %us per mode\n", ifname_tx, ifname_rx,
+		       runtime);
+
+	for (i = 0; i < nr_sizes; i++) {
+		pkt_size = sizes[i];
+		run_mode(BENCH_COPY);
+		run_mode(BENCH_ZEROCOPY);
+		run_mode(BENCH_FANOUT);
+	}
+
+	ksft_finished();
+
+usage:
+	fprintf(stderr, "Usage: %s -i TX_IF -i RX_IF [-s size] [-t seconds]\n",
+		argv[0]);
+	return KSFT_FAIL;
+}
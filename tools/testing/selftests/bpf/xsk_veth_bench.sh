@@ -0,0 +1,25 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Packet rate of AF_XDP sockets on a veth pair, in copy and zero-copy mode,
+# and with fan-out over the queues of the receiving end.
+#
+# Usage: sudo ./xsk_veth_bench.sh [-s packet size] [-t seconds per mode]
+
+. xsk_prereqs.sh
+
+VETH0=xskb0
+VETH1=xskb1
+
+validate_root_exec
+validate_veth_support ${VETH0}
+validate_ip_utility
+
+trap "cleanup_exit ${VETH0} ${VETH1}" EXIT
+
+ip link add ${VETH0} numtxqueues 4 numrxqueues 4 type veth \
+	peer name ${VETH1} numtxqueues 4 numrxqueues 4 || test_exit $ksft_fail
+ip link set ${VETH0} up
+ip link set ${VETH1} up
+
+./xsk_veth_bench -i ${VETH0} -i ${VETH1} "$@"
@@ -0,0 +1,345 @@
+// SPDX-License-Identifier: GPL-2.0
+
+#define _GNU_SOURCE
+#include <linux/limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../kselftest.h"
+#include "cgroup_util.h"
+
+#define USEC_PER_SEC	1000000L
+#define NSEC_PER_USEC	1000L
+#define NR_CHILDREN	32
+#define NR_DEPTH	4
+#define HOG_USEC	(2 * USEC_PER_SEC)
+#define NR_LAT_BUCKETS	32
+
+struct stat_reader {
+	pthread_t thread;
+	const char *cgroup;
+	volatile bool *stop;
+	long nr_reads;
+	long nr_errors;
+	long nr_backwards;
+	long max_nsec;
+	long lat_hist[NR_LAT_BUCKETS];	/* log2 buckets of read latency in ns */
+};
+
+static long now_nsec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static int hog_cpu(const char *cgroup, void *arg)
+{
+	long deadline = now_nsec() + (long)arg * NSEC_PER_USEC;
+
+	while (now_nsec() < deadline)
+		;
+	return 0;
+}
+
+/*
+ * Read cpu.stat of @reader->cgroup in a loop, recording the latency of each
+ * read. Every read flushes the cgroup's rstat subtree. usage_usec must never
+ * go backwards.
+ */
+static void *stat_reader_fn(void *arg)
+{
+	struct stat_reader *reader = arg;
+	long prev = 0;
+
+	while (!*reader->stop) {
+		long start, lat, usage;
+		int bucket = 0;
+
+		start = now_nsec();
+		usage = cg_read_key_long(reader->cgroup, "cpu.stat",
+					 "usage_usec");
+		lat = now_nsec() - start;
+
+		reader->nr_reads++;
+		if (usage < 0) {
+			reader->nr_errors++;
+			continue;
+		}
+		if (usage < prev)
+			reader->nr_backwards++;
+		prev = usage;
+
+		if (lat > reader->max_nsec)
+			reader->max_nsec = lat;
+		while (bucket < NR_LAT_BUCKETS - 1 && (1L << (bucket + 1)) <= lat)
+			bucket++;
+		reader->lat_hist[bucket]++;
+	}
+
+	return NULL;
+}
+
+/* upper bound of the latency bucket the @pct percentile falls into */
+static long lat_percentile(struct stat_reader *readers, int nr, int pct)
+{
+	long hist[NR_LAT_BUCKETS] = {}, total = 0, sum = 0;
+	int i, b;
+
+	for (i = 0; i < nr; i++) {
+		for (b = 0; b < NR_LAT_BUCKETS; b++) {
+			hist[b] += readers[i].lat_hist[b];
+			total += readers[i].lat_hist[b];
+		}
+	}
+
+	for (b = 0; b < NR_LAT_BUCKETS; b++) {
+		sum += hist[b];
+		if (sum * 100 >= total * pct)
+			return 1L << (b + 1);
+	}
+	return 1L << NR_LAT_BUCKETS;
+}
+
+static int start_readers(struct stat_reader *readers, char **cgroups, int nr,
+			 volatile bool *stop)
+{
+	int i;
+
+	for (i = 0; i < nr; i++) {
+		memset(&readers[i], 0, sizeof(readers[i]));
+		readers[i].cgroup = cgroups[i];
+		readers[i].stop = stop;
+		if (pthread_create(&readers[i].thread, NULL, stat_reader_fn,
+				   &readers[i]))
+			break;
+	}
+
+	return i;
+}
+
+static int stop_readers(struct stat_reader *readers, int nr, const char *name)
+{
+	long nr_reads = 0, max_nsec = 0;
+	int i, ret = KSFT_PASS;
+
+	for (i = 0; i < nr; i++) {
+		pthread_join(readers[i].thread, NULL);
+		nr_reads += readers[i].nr_reads;
+		if (readers[i].max_nsec > max_nsec)
+			max_nsec = readers[i].max_nsec;
+		if (readers[i].nr_errors || readers[i].nr_backwards) {
+			ksft_print_msg("%s: %s: %ld read errors, usage went backwards %ld times\n",
+				       name, readers[i].cgroup,
+				       readers[i].nr_errors,
+				       readers[i].nr_backwards);
+			ret = KSFT_FAIL;
+		}
+	}
+
+	ksft_print_msg("%s: %d readers, %ld reads, latency p50 < %ldus p99 < %ldus max %ldus\n",
+		       name, nr, nr_reads,
+		       lat_percentile(readers, nr, 50) / NSEC_PER_USEC,
+		       lat_percentile(readers, nr, 99) / NSEC_PER_USEC,
+		       max_nsec / NSEC_PER_USEC);
+
+	return ret;
+}
+
+/*
+ * Many sibling cgroups, each with a CPU hog, and one reader per cgroup plus
+ * one on their parent continuously reading cpu.stat. This is the pattern of
+ * many containers reading their own stats at the same time. Reads on
+ * disjoint subtrees can be flushed concurrently. Once the hogs are done, the
+ * parent's usage must be exactly the sum of the children's.
+ */
+static int test_rstat_siblings(const char *root)
+{
+	struct stat_reader readers[NR_CHILDREN + 1];
+	char *cgroups[NR_CHILDREN + 1] = {};
+	pid_t pids[NR_CHILDREN];
+	int i, nr_pids = 0, nr_readers = 0, ret = KSFT_FAIL;
+	volatile bool stop = false;
+	long sum = 0, usage;
+	char *parent;
+
+	parent = cg_name(root, "rstat_test_siblings");
+	if (!parent || cg_create(parent))
+		goto cleanup;
+	cgroups[NR_CHILDREN] = parent;
+
+	for (i = 0; i < NR_CHILDREN; i++) {
+		cgroups[i] = cg_name_indexed(parent, "child", i);
+		if (!cgroups[i] || cg_create(cgroups[i]))
+			goto cleanup;
+	}
+
+	nr_readers = start_readers(readers, cgroups, NR_CHILDREN + 1, &stop);
+	if (nr_readers != NR_CHILDREN + 1)
+		goto cleanup_readers;
+
+	for (i = 0; i < NR_CHILDREN; i++) {
+		pids[i] = cg_run_nowait(cgroups[i], hog_cpu, (void *)HOG_USEC);
+		if (pids[i] < 0)
+			goto cleanup_readers;
+		nr_pids++;
+	}
+
+	while (nr_pids)
+		waitpid(pids[--nr_pids], NULL, 0);
+
+	ret = KSFT_PASS;
+cleanup_readers:
+	stop = true;
+	if (stop_readers(readers, nr_readers, "siblings") != KSFT_PASS)
+		ret = KSFT_FAIL;
+	while (nr_pids) {
+		kill(pids[--nr_pids], SIGKILL);
+		waitpid(pids[nr_pids], NULL, 0);
+	}
+	if (ret != KSFT_PASS)
+		goto cleanup;
+
+	for (i = 0; i < NR_CHILDREN; i++) {
+		usage = cg_read_key_long(cgroups[i], "cpu.stat", "usage_usec");
+		if (usage <= 0) {
+			ret = KSFT_FAIL;
+			goto cleanup;
+		}
+		sum += usage;
+	}
+
+	usage = cg_read_key_long(parent, "cpu.stat", "usage_usec");
+	if (usage != sum) {
+		ksft_print_msg("parent usage %ld != sum of children %ld\n",
+			       usage, sum);
+		ret = KSFT_FAIL;
+	}
+
+cleanup:
+	for (i = NR_CHILDREN; i >= 0; i--) {
+		if (!cgroups[i])
+			continue;
+		cg_destroy(cgroups[i]);
+		free(cgroups[i]);
+	}
+
+	return ret;
+}
+
+/*
+ * A chain of nested cgroups with a CPU hog in the leaf and one reader per
+ * level. Flushes of the levels overlap and have to wait for each other or
+ * get coalesced. Once the hog is done, all levels must report the same
+ * usage.
+ */
+static int test_rstat_nested(const char *root)
+{
+	struct stat_reader readers[NR_DEPTH];
+	char *cgroups[NR_DEPTH] = {};
+	int i, nr_readers = 0, ret = KSFT_FAIL;
+	volatile bool stop = false;
+	long usage, leaf_usage;
+	pid_t pid = -1;
+
+	for (i = 0; i < NR_DEPTH; i++) {
+		cgroups[i] = cg_name(i ? cgroups[i - 1] : root,
+				     i ? "nested" : "rstat_test_nested");
+		if (!cgroups[i] || cg_create(cgroups[i]))
+			goto cleanup;
+	}
+
+	nr_readers = start_readers(readers, cgroups, NR_DEPTH, &stop);
+	if (nr_readers != NR_DEPTH)
+		goto cleanup_readers;
+
+	pid = cg_run_nowait(cgroups[NR_DEPTH - 1], hog_cpu, (void *)HOG_USEC);
+	if (pid < 0)
+		goto cleanup_readers;
+	waitpid(pid, NULL, 0);
+	pid = -1;
+
+	ret = KSFT_PASS;
+cleanup_readers:
+	stop = true;
+	if (stop_readers(readers, nr_readers, "nested") != KSFT_PASS)
+		ret = KSFT_FAIL;
+	if (pid > 0) {
+		kill(pid, SIGKILL);
+		waitpid(pid, NULL, 0);
+	}
+	if (ret != KSFT_PASS)
+		goto cleanup;
+
+	leaf_usage = cg_read_key_long(cgroups[NR_DEPTH - 1], "cpu.stat",
+				      "usage_usec");
+	if (leaf_usage <= 0) {
+		ret = KSFT_FAIL;
+		goto cleanup;
+	}
+
+	for (i = 0; i < NR_DEPTH - 1; i++) {
+		usage = cg_read_key_long(cgroups[i], "cpu.stat", "usage_usec");
+		if (usage != leaf_usage) {
+			ksft_print_msg("level %d usage %ld != leaf usage %ld\n",
+				       i, usage, leaf_usage);
+			ret = KSFT_FAIL;
+		}
+	}
+
+cleanup:
+	for (i = NR_DEPTH - 1; i >= 0; i--) {
+		if (!cgroups[i])
+			continue;
+		cg_destroy(cgroups[i]);
+		free(cgroups[i]);
+	}
+
+	return ret;
+}
+
+#define T(x) { x, #x }
+struct rstat_test {
+	int (*fn)(const char *root);
+	const char *name;
+} tests[] = {
+	T(test_rstat_siblings),
+	T(test_rstat_nested),
+};
+#undef T
+
+int main(int argc, char *argv[])
+{
+	char root[PATH_MAX];
+	int i, ret = EXIT_SUCCESS;
+
+	if (cg_find_unified_root(root, sizeof(root), NULL))
+		ksft_exit_skip("cgroup v2 isn't mounted\n");
+
+	ksft_print_header();
+	ksft_set_plan(ARRAY_SIZE(tests));
+
+	for (i = 0; i < ARRAY_SIZE(tests); i++) {
+		switch (tests[i].fn(root)) {
+		case KSFT_PASS:
+			ksft_test_result_pass("%s\n", tests[i].name);
+			break;
+		case KSFT_SKIP:
+			ksft_test_result_skip("%s\n", tests[i].name);
+			break;
+		default:
+			ret = EXIT_FAILURE;
+			ksft_test_result_fail("%s\n", tests[i].name);
+			break;
+		}
+	}
+
+	return ret;
+}
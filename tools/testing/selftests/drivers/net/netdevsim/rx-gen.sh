@@ -0,0 +1,124 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0-only
+#
+# Receive rate of the netdevsim packet generator, with packets spread over
+# the queues by RSS, for a few combinations of GRO, threaded NAPI and
+# interrupt coalescing. Checks that the generator delivers everything it
+# was asked to when not rate limited, and that a rate limited run misses
+# packets once the rate exceeds what the queues get polled for.
+
+NSIM_ID=$((RANDOM % 1024))
+NSIM_DEV_SYS=/sys/bus/netdevsim/devices/netdevsim$NSIM_ID
+NSIM_DEV_DFS=/sys/kernel/debug/netdevsim/netdevsim$NSIM_ID/ports/0
+NSIM_NETDEV=
+QUEUES=4
+COUNT=${COUNT:-2000000}
+num_passes=0
+num_errors=0
+ksft_skip=4
+
+cleanup_nsim() {
+	if [ -e "$NSIM_DEV_SYS" ]; then
+		echo 0 > "$NSIM_DEV_DFS/rx_gen/count"
+		echo "$NSIM_ID" > /sys/bus/netdevsim/del_device
+	fi
+}
+trap cleanup_nsim EXIT
+
+rx_packets() {
+	cat /sys/class/net/"$NSIM_NETDEV"/statistics/rx_packets
+}
+
+rx_missed() {
+	cat /sys/class/net/"$NSIM_NETDEV"/statistics/rx_missed_errors
+}
+
+# generate COUNT packets and print the rate they were received at
+run_gen() {
+	local start end before after
+
+	before=$(rx_packets)
+	start=$(date +%s%N)
+	echo "$COUNT" > "$NSIM_DEV_DFS/rx_gen/count"
+	while [ "$(cat "$NSIM_DEV_DFS/rx_gen/count")" != 0 ]; do
+		sleep 0.1
+	done
+	end=$(date +%s%N)
+	after=$(rx_packets)
+
+	echo $(((after - before) * 1000000000 / (end - start))) \
+		$((after - before))
+}
+
+check_run() {
+	local name=$1
+	local out pps received
+
+	out=$(run_gen)
+	read -r pps received <<< "$out"
+	if [ "$received" -ne "$COUNT" ]; then
+		echo "FAIL: $name: received $received of $COUNT packets"
+		((num_errors++))
+		return
+	fi
+	printf "%-40s %10d pps\n" "$name" "$pps"
+	((num_passes++))
+}
+
+if ! ethtool -h > /dev/null 2>&1; then
+	echo "SKIP: ethtool not available"
+	exit $ksft_skip
+fi
+
+modprobe netdevsim &> /dev/null
+if [ ! -w /sys/bus/netdevsim/new_device ]; then
+	echo "SKIP: netdevsim not available"
+	exit $ksft_skip
+fi
+
+echo "$NSIM_ID 1 $QUEUES" > /sys/bus/netdevsim/new_device
+udevadm settle
+NSIM_NETDEV=$(ls "$NSIM_DEV_SYS/net")
+if [ ! -d "$NSIM_DEV_DFS/rx_gen" ]; then
+	echo "SKIP: netdevsim has no packet generator"
+	exit $ksft_skip
+fi
+
+ip link set dev "$NSIM_NETDEV" up
+ip addr add 198.18.0.2/24 dev "$NSIM_NETDEV"
+echo 1 > "$NSIM_DEV_DFS/ethtool/rss/enabled"
+echo 64 > "$NSIM_DEV_DFS/rx_gen/flows"
+
+for threaded in 0 1; do
+	echo $threaded > /sys/class/net/"$NSIM_NETDEV"/threaded
+	for gro in on off; do
+		ethtool -K "$NSIM_NETDEV" gro $gro
+		for coal in "0 0" "50 64"; do
+			read -r usecs frames <<< "$coal"
+			ethtool -C "$NSIM_NETDEV" rx-usecs "$usecs" \
+				rx-frames "$frames"
+			check_run "threaded $threaded gro $gro rx-usecs $usecs"
+		done
+	done
+done
+
+# a rate far above what a single queue can take has to overrun the ring
+ethtool -C "$NSIM_NETDEV" rx-usecs 1000 rx-frames 0
+echo 1 > "$NSIM_DEV_DFS/rx_gen/flows"
+echo 100000000 > "$NSIM_DEV_DFS/rx_gen/rate_pps"
+missed=$(rx_missed)
+run_gen > /dev/null
+missed=$(($(rx_missed) - missed))
+if [ "$missed" -gt 0 ]; then
+	((num_passes++))
+else
+	echo "FAIL: no packets missed at 100Mpps with 1ms interrupts"
+	((num_errors++))
+fi
+
+echo "PASSED all $((num_passes)) checks"
+if [ $num_errors -ne 0 ]; then
+	echo "FAILED $num_errors checks"
+	exit 1
+fi
+exit 0
@@ -0,0 +1,110 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Decompression throughput of EROFS per compression algorithm.
+#
+# The same tree is packed with every algorithm mkfs.erofs supports, and read
+# back with cold caches.  Throughput is computed from the per-superblock
+# decompression statistics in /sys/fs/erofs/<dev>/, so I/O time is left out.
+#
+# Usage: decompress_bench.sh [-s size_mb] [-C pcluster_bytes] [-w workers]
+
+ksft_skip=4
+
+size_mb=64
+pcluster=65536
+workers=1
+
+while getopts "s:C:w:" opt; do
+	case $opt in
+	s) size_mb=$OPTARG ;;
+	C) pcluster=$OPTARG ;;
+	w) workers=$OPTARG ;;
+	*) echo "Usage: $0 [-s size_mb] [-C pcluster_bytes] [-w workers]"
+	   exit 1 ;;
+	esac
+done
+
+if [ "$(id -u)" -ne 0 ]; then
+	echo "SKIP: needs root to mount"
+	exit $ksft_skip
+fi
+if ! command -v mkfs.erofs > /dev/null; then
+	echo "SKIP: mkfs.erofs not found"
+	exit $ksft_skip
+fi
+modprobe -q erofs
+if ! grep -qw erofs /proc/filesystems; then
+	echo "SKIP: erofs not supported"
+	exit $ksft_skip
+fi
+
+tmp=$(mktemp -d /tmp/erofs_bench.XXXXXX)
+src=$tmp/src
+mnt=$tmp/mnt
+img=$tmp/img
+mkdir -p "$src" "$mnt"
+
+cleanup()
+{
+	mountpoint -q "$mnt" && umount "$mnt"
+	rm -rf "$tmp"
+}
+trap cleanup EXIT
+
+# Text-like data and runs of zeroes, for moderate compression ratios
+for i in $(seq 0 $((size_mb / 4 - 1))); do
+	{
+		head -c $((2 << 20)) /dev/urandom | base64
+		head -c $((2 << 20)) /dev/zero
+	} | head -c $((4 << 20)) > "$src/file$i"
+done
+
+# mount_stat <name> prints a decompression counter of the mounted image
+mount_stat()
+{
+	cat "/sys/fs/erofs/$dev/$1"
+}
+
+ret=0
+for alg in lz4 lz4hc deflate lzma zstd; do
+	if ! mkfs.erofs -q -z$alg -C$pcluster "$img" "$src" > /dev/null 2>&1; then
+		echo "SKIP: $alg: not supported by mkfs.erofs"
+		continue
+	fi
+	if ! mount -t erofs -o loop,ro "$img" "$mnt" 2> /dev/null; then
+		echo "SKIP: $alg: not supported by the kernel"
+		continue
+	fi
+	dev=$(basename "$(findmnt -no SOURCE "$mnt")")
+	[ -w "/sys/fs/erofs/$dev/max_decompress_workers" ] &&
+		echo "$workers" > "/sys/fs/erofs/$dev/max_decompress_workers"
+
+	sync
+	echo 3 > /proc/sys/vm/drop_caches
+	start=$(date +%s%N)
+	if ! diff -r "$src" "$mnt" > /dev/null; then
+		echo "FAIL: $alg: data mismatch"
+		ret=1
+		umount "$mnt"
+		continue
+	fi
+	elapsed=$(($(date +%s%N) - start))
+
+	bytes=$(mount_stat decompressed_bytes)
+	ns=$(mount_stat decompress_time_ns)
+	bounced=$(mount_stat bounced_pclusters)
+	pclusters=$(mount_stat decompressed_pclusters)
+	umount "$mnt"
+
+	if [ "${ns:-0}" -eq 0 ]; then
+		echo "FAIL: $alg: no decompression statistics"
+		ret=1
+		continue
+	fi
+	printf "%-8s %8d MB/s decompression %8d MB/s read  %d/%d pclusters bounced\n" \
+		"$alg" $((bytes * 1000 / ns)) \
+		$((size_mb * 1000000000 / elapsed)) "$bounced" "$pclusters"
+done
+
+exit $ret
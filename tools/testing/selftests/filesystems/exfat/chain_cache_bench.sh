@@ -0,0 +1,79 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Random read throughput of a fragmented exFAT file against a contiguous one.
+#
+# Two files are written a block at a time in turn, so that every cluster of
+# them is a fragment of its own, and a third one in one go.  Each file is
+# then read at random offsets with O_DIRECT after a remount, so that all
+# file to disk cluster lookups start out walking the FAT.
+#
+# Usage: chain_cache_bench.sh [-s size_mb] [-t seconds]
+
+ksft_skip=4
+
+size_mb=64
+runtime=5
+
+while getopts "s:t:" opt; do
+	case $opt in
+	s) size_mb=$OPTARG ;;
+	t) runtime=$OPTARG ;;
+	*) echo "Usage: $0 [-s size_mb] [-t seconds]"
+	   exit 1 ;;
+	esac
+done
+
+if [ "$(id -u)" -ne 0 ]; then
+	echo "SKIP: needs root to mount"
+	exit $ksft_skip
+fi
+if ! command -v mkfs.exfat > /dev/null; then
+	echo "SKIP: mkfs.exfat not found"
+	exit $ksft_skip
+fi
+modprobe -q exfat
+if ! grep -qw exfat /proc/filesystems; then
+	echo "SKIP: exfat not supported"
+	exit $ksft_skip
+fi
+
+dir=$(dirname "$(readlink -f "$0")")
+tmp=$(mktemp -d /tmp/exfat_bench.XXXXXX)
+mnt=$tmp/mnt
+img=$tmp/img
+mkdir -p "$mnt"
+
+cleanup()
+{
+	mountpoint -q "$mnt" && umount "$mnt"
+	rm -rf "$tmp"
+}
+trap cleanup EXIT
+
+truncate -s $((size_mb * 4 + 64))M "$img"
+if ! mkfs.exfat -c 4096 "$img" > /dev/null 2>&1; then
+	echo "FAIL: mkfs.exfat"
+	exit 1
+fi
+mount -o loop "$img" "$mnt" || exit 1
+
+blocks=$((size_mb * 256))
+"$dir/chain_rw" write $blocks "$mnt/frag0" "$mnt/frag1" || exit 1
+"$dir/chain_rw" write $blocks "$mnt/contig" || exit 1
+
+# read_iops <file> prints the random reads per second of a cold inode
+read_iops()
+{
+	umount "$mnt" && mount -o loop "$img" "$mnt" || return 1
+	"$dir/chain_rw" read "$runtime" "$mnt/$1"
+}
+
+contig=$(read_iops contig) || { echo "FAIL: contiguous read"; exit 1; }
+frag=$(read_iops frag1) || { echo "FAIL: fragmented read"; exit 1; }
+
+printf "%d MB, 4k clusters, random 4k reads for %ds\n" "$size_mb" "$runtime"
+printf "contiguous %10d reads/s\n" "$contig"
+printf "fragmented %10d reads/s (%d%% of contiguous)\n" "$frag" \
+	$((frag * 100 / contig))
+exit 0
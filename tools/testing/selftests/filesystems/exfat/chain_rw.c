@@ -0,0 +1,132 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Helper for chain_cache_bench.sh.
+ *
+ *   chain_rw write <blocks> <file>...
+ *	Append <blocks> 4k blocks to each file in turn, so that the clusters
+ *	of the files interleave on disk when there is more than one.
+ *   chain_rw read <seconds> <file>
+ *	Read random 4k blocks with O_DIRECT for <seconds>, check their
+ *	contents and print the reads per second.
+ */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define BLOCK_SIZE	4096
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Each block starts with its index in the file */
+static void fill_block(char *buf, uint64_t index)
+{
+	memset(buf, (int)index, BLOCK_SIZE);
+	memcpy(buf, &index, sizeof(index));
+}
+
+static int do_write(unsigned long blocks, int nr, char **files)
+{
+	char buf[BLOCK_SIZE];
+	unsigned long b;
+	int *fds, i;
+
+	fds = calloc(nr, sizeof(*fds));
+	if (!fds)
+		return -ENOMEM;
+	for (i = 0; i < nr; i++) {
+		fds[i] = open(files[i], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fds[i] < 0) {
+			perror(files[i]);
+			return -errno;
+		}
+	}
+
+	for (b = 0; b < blocks; b++) {
+		fill_block(buf, b);
+		for (i = 0; i < nr; i++) {
+			if (write(fds[i], buf, BLOCK_SIZE) != BLOCK_SIZE) {
+				perror(files[i]);
+				return -EIO;
+			}
+		}
+	}
+
+	for (i = 0; i < nr; i++) {
+		fsync(fds[i]);
+		close(fds[i]);
+	}
+	free(fds);
+	return 0;
+}
+
+static int do_read(unsigned int seconds, const char *file)
+{
+	unsigned long long reads = 0;
+	unsigned int seed = 1;
+	double start, elapsed;
+	uint64_t blocks, b;
+	struct stat st;
+	char *buf;
+	int fd;
+
+	fd = open(file, O_RDONLY | O_DIRECT);
+	if (fd < 0 || fstat(fd, &st)) {
+		perror(file);
+		return -errno;
+	}
+	blocks = st.st_size / BLOCK_SIZE;
+	if (!blocks || posix_memalign((void **)&buf, BLOCK_SIZE, BLOCK_SIZE))
+		return -EINVAL;
+
+	start = now();
+	do {
+		b = ((uint64_t)rand_r(&seed) << 16 ^ rand_r(&seed)) % blocks;
+		if (pread(fd, buf, BLOCK_SIZE, b * BLOCK_SIZE) != BLOCK_SIZE) {
+			perror(file);
+			return -EIO;
+		}
+		if (memcmp(buf, &b, sizeof(b))) {
+			fprintf(stderr, "%s: bad data in block %llu\n", file,
+				(unsigned long long)b);
+			return -EIO;
+		}
+		reads++;
+		elapsed = now() - start;
+	} while (elapsed < seconds);
+
+	printf("%.0f\n", reads / elapsed);
+	free(buf);
+	close(fd);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int ret;
+
+	if (argc >= 4 && !strcmp(argv[1], "write"))
+		ret = do_write(strtoul(argv[2], NULL, 0), argc - 3, argv + 3);
+	else if (argc == 4 && !strcmp(argv[1], "read"))
+		ret = do_read(atoi(argv[2]) ?: 1, argv[3]);
+	else {
+		fprintf(stderr,
+			"Usage: %s write <blocks> <file>...\n"
+			"       %s read <seconds> <file>\n", argv[0], argv[0]);
+		return 1;
+	}
+	return ret ? 1 : 0;
+}
@@ -0,0 +1,235 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Compare metadata-heavy workloads on a passthrough FUSE server with and
+ * without FUSE_PASSTHROUGH_META, which lets the kernel serve readdir and
+ * getattr from the backing files.
+ *
+ * Entries are cached, but attributes are not, as for a server exposing a
+ * tree that may change underneath it.  The workloads are an "ls -lR" walk
+ * doing readdir and lstat, and repeated stat() of all files.
+ */
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "fuse_server.h"
+#include "../../kselftest.h"
+
+static unsigned int nr_dirs = 16;
+static unsigned int nr_files = 256;
+static unsigned int passes = 5;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int create_tree(const char *src)
+{
+	char path[PATH_MAX];
+	unsigned int d, f;
+	int fd;
+
+	for (d = 0; d < nr_dirs; d++) {
+		snprintf(path, sizeof(path), "%s/d%u", src, d);
+		if (mkdir(path, 0755))
+			return -errno;
+		for (f = 0; f < nr_files; f++) {
+			snprintf(path, sizeof(path), "%s/d%u/f%u", src, d, f);
+			fd = open(path, O_WRONLY | O_CREAT, 0644);
+			if (fd < 0)
+				return -errno;
+			close(fd);
+		}
+	}
+	return 0;
+}
+
+static void remove_tree(const char *src)
+{
+	char path[PATH_MAX];
+	unsigned int d, f;
+
+	for (d = 0; d < nr_dirs; d++) {
+		for (f = 0; f < nr_files; f++) {
+			snprintf(path, sizeof(path), "%s/d%u/f%u", src, d, f);
+			unlink(path);
+		}
+		snprintf(path, sizeof(path), "%s/d%u", src, d);
+		rmdir(path);
+	}
+	rmdir(src);
+}
+
+/* readdir and lstat like "ls -lR", returns the number of entries or -errno */
+static long walk(const char *path)
+{
+	struct dirent *de;
+	struct stat st;
+	long nr = 0;
+	DIR *dir;
+
+	dir = opendir(path);
+	if (!dir)
+		return -errno;
+
+	while ((de = readdir(dir))) {
+		char child[PATH_MAX];
+
+		if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, ".."))
+			continue;
+		if (fstatat(dirfd(dir), de->d_name, &st, AT_SYMLINK_NOFOLLOW)) {
+			nr = -errno;
+			break;
+		}
+		nr++;
+		if (S_ISDIR(st.st_mode)) {
+			long ret;
+
+			snprintf(child, sizeof(child), "%s/%s", path, de->d_name);
+			ret = walk(child);
+			if (ret < 0) {
+				nr = ret;
+				break;
+			}
+			nr += ret;
+		}
+	}
+	closedir(dir);
+	return nr;
+}
+
+static int stat_all(const char *mnt)
+{
+	char path[PATH_MAX];
+	unsigned int d, f;
+	struct stat st;
+
+	for (d = 0; d < nr_dirs; d++) {
+		for (f = 0; f < nr_files; f++) {
+			snprintf(path, sizeof(path), "%s/d%u/f%u", mnt, d, f);
+			if (stat(path, &st))
+				return -errno;
+		}
+	}
+	return 0;
+}
+
+static void run_mode(const char *src, const char *mnt, bool passthrough)
+{
+	const char *name = passthrough ? "passthrough" : "server";
+	long expected = nr_dirs * (nr_files + 1);
+	struct fuse_server srv = {
+		.src = src,
+		.mnt = mnt,
+		.passthrough_meta = passthrough,
+		.entry_timeout = 3600,
+		.attr_timeout = 0,
+	};
+	double start, walk_time = 0, stat_time = 0;
+	unsigned int i;
+	long nr;
+	int ret;
+
+	ret = fuse_server_start(&srv);
+	if (ret) {
+		ksft_test_result_fail("%s: mounting failed: %s\n", name,
+				      strerror(-ret));
+		return;
+	}
+
+	if (passthrough && !srv.passthrough_negotiated) {
+		ksft_test_result_skip("%s: FUSE_PASSTHROUGH_META not supported\n",
+				      name);
+		fuse_server_stop(&srv);
+		return;
+	}
+
+	/* Populate the dentry cache, and attach the backing files */
+	nr = walk(mnt);
+	for (i = 0; nr == expected && i < passes; i++) {
+		start = now();
+		nr = walk(mnt);
+		walk_time += now() - start;
+
+		start = now();
+		ret = stat_all(mnt);
+		stat_time += now() - start;
+		if (ret)
+			nr = ret;
+	}
+	fuse_server_stop(&srv);
+
+	if (nr != expected) {
+		ksft_test_result_fail("%s: walk found %ld entries, expected %ld\n",
+				      name, nr, expected);
+		return;
+	}
+
+	ksft_print_msg("%-11s ls -lR %10.0f entries/s  stat %10.0f files/s\n",
+		       name, expected * passes / walk_time,
+		       (double)nr_dirs * nr_files * passes / stat_time);
+	ksft_test_result_pass("%s: metadata walk\n", name);
+}
+
+int main(int argc, char **argv)
+{
+	char src[] = "/tmp/fuse_meta_src.XXXXXX";
+	char mnt[] = "/tmp/fuse_meta_mnt.XXXXXX";
+	int opt, ret;
+
+	while ((opt = getopt(argc, argv, "d:f:p:")) != -1) {
+		switch (opt) {
+		case 'd':
+			nr_dirs = atoi(optarg) ?: 1;
+			break;
+		case 'f':
+			nr_files = atoi(optarg) ?: 1;
+			break;
+		case 'p':
+			passes = atoi(optarg) ?: 1;
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-d dirs] [-f files] [-p passes]\n",
+				argv[0]);
+			return KSFT_FAIL;
+		}
+	}
+
+	ksft_print_header();
+
+	if (geteuid())
+		ksft_exit_skip("needs root to mount\n");
+	if (access("/dev/fuse", R_OK | W_OK))
+		ksft_exit_skip("/dev/fuse not available\n");
+
+	if (!mkdtemp(src) || !mkdtemp(mnt))
+		ksft_exit_fail_msg("mkdtemp: %s\n", strerror(errno));
+	ret = create_tree(src);
+	if (ret)
+		ksft_exit_fail_msg("cannot create tree: %s\n", strerror(-ret));
+
+	ksft_set_plan(2);
+	ksft_print_msg("%u dirs of %u files, %u passes\n", nr_dirs, nr_files,
+		       passes);
+
+	run_mode(src, mnt, false);
+	run_mode(src, mnt, true);
+
+	remove_tree(src);
+	rmdir(mnt);
+	ksft_finished();
+}
@@ -0,0 +1,767 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Minimal passthrough FUSE server, talking to the kernel either through
+ * read()/write() on /dev/fuse or through io_uring commands on per-CPU
+ * queues.  Raw syscalls are used, so neither libfuse nor liburing is
+ * needed.
+ */
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/syscall.h>
+#include <linux/fuse.h>
+#include <linux/io_uring.h>
+
+#include "fuse_server.h"
+
+struct fuse_server_queue {
+	struct fuse_server *srv;
+	unsigned int qid;
+	pthread_t thread;
+	bool started;
+
+	int ring_fd;
+	unsigned int *sq_head, *sq_tail, *sq_mask, *sq_array;
+	unsigned int *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	void *sq_ring, *cq_ring;
+	size_t sq_ring_sz, cq_ring_sz, sqes_sz;
+
+	void **bufs;
+};
+
+static uint64_t node_hash(const char *path)
+{
+	uint64_t h = 5381;
+
+	while (*path)
+		h = h * 33 + (unsigned char)*path++;
+	return h % FUSE_SERVER_NODE_HASH;
+}
+
+/* Returns the nodeid for @path, adding it on first lookup */
+static uint64_t node_get(struct fuse_server *srv, const char *path)
+{
+	uint64_t h = node_hash(path), nodeid = 0;
+	struct fuse_server_node *node;
+
+	pthread_mutex_lock(&srv->lock);
+	for (node = srv->hash[h]; node; node = node->next) {
+		if (!strcmp(node->path, path)) {
+			nodeid = node->nodeid;
+			goto out;
+		}
+	}
+
+	if (srv->nr_nodes == srv->max_nodes) {
+		uint64_t max = srv->max_nodes ? srv->max_nodes * 2 : 1024;
+		void *nodes = realloc(srv->nodes, max * sizeof(*srv->nodes));
+
+		if (!nodes)
+			goto out;
+		srv->nodes = nodes;
+		srv->max_nodes = max;
+	}
+
+	node = calloc(1, sizeof(*node));
+	if (!node)
+		goto out;
+	node->path = strdup(path);
+	if (!node->path) {
+		free(node);
+		goto out;
+	}
+	srv->nodes[srv->nr_nodes++] = node;
+	node->nodeid = srv->nr_nodes;
+	node->next = srv->hash[h];
+	srv->hash[h] = node;
+	nodeid = node->nodeid;
+out:
+	pthread_mutex_unlock(&srv->lock);
+	return nodeid;
+}
+
+/* Nodes are never freed before the server stops */
+static struct fuse_server_node *node_find(struct fuse_server *srv,
+					  uint64_t nodeid)
+{
+	struct fuse_server_node *node = NULL;
+
+	pthread_mutex_lock(&srv->lock);
+	if (nodeid && nodeid <= srv->nr_nodes)
+		node = srv->nodes[nodeid - 1];
+	pthread_mutex_unlock(&srv->lock);
+	return node;
+}
+
+/* Returns a backing id for @fd, or a negative errno */
+static int backing_open(struct fuse_server *srv, int fd)
+{
+	struct fuse_backing_map map = { .fd = fd };
+	int id;
+
+	id = ioctl(srv->dev_fd, FUSE_DEV_IOC_BACKING_OPEN, &map);
+	return id < 0 ? -errno : id;
+}
+
+static void backing_close(struct fuse_server *srv, int id)
+{
+	uint32_t backing_id = id;
+
+	ioctl(srv->dev_fd, FUSE_DEV_IOC_BACKING_CLOSE, &backing_id);
+}
+
+/*
+ * Let the kernel take the attributes of @node from the source file.  The
+ * inode has to exist, so this is done on its first FUSE_GETATTR rather
+ * than on FUSE_LOOKUP.
+ */
+static void node_attach(struct fuse_server *srv, struct fuse_server_node *node)
+{
+	struct fuse_backing_attach attach = { .nodeid = node->nodeid };
+	int fd, id;
+
+	if (__atomic_exchange_n(&node->attached, true, __ATOMIC_RELAXED))
+		return;
+
+	fd = open(node->path, O_PATH | O_NOFOLLOW);
+	if (fd < 0)
+		return;
+	id = backing_open(srv, fd);
+	close(fd);
+	if (id < 0)
+		return;
+
+	attach.backing_id = id;
+	ioctl(srv->dev_fd, FUSE_DEV_IOC_BACKING_ATTACH, &attach);
+	/* The inode keeps its own reference to the backing file */
+	backing_close(srv, id);
+}
+
+/* Directory handles are DIR pointers, or tagged backing ids */
+#define DIR_FH_BACKING	1ULL
+
+static void fill_attr(struct fuse_attr *attr, const struct stat *st)
+{
+	memset(attr, 0, sizeof(*attr));
+	attr->ino = st->st_ino;
+	attr->size = st->st_size;
+	attr->blocks = st->st_blocks;
+	attr->atime = st->st_atim.tv_sec;
+	attr->atimensec = st->st_atim.tv_nsec;
+	attr->mtime = st->st_mtim.tv_sec;
+	attr->mtimensec = st->st_mtim.tv_nsec;
+	attr->ctime = st->st_ctim.tv_sec;
+	attr->ctimensec = st->st_ctim.tv_nsec;
+	attr->mode = st->st_mode;
+	attr->nlink = st->st_nlink;
+	attr->uid = st->st_uid;
+	attr->gid = st->st_gid;
+	attr->rdev = st->st_rdev;
+	attr->blksize = st->st_blksize;
+}
+
+static int do_init(struct fuse_server *srv, const struct fuse_init_in *in,
+		   struct fuse_init_out *out)
+{
+	uint64_t flags = in->flags;
+	uint64_t want = FUSE_ASYNC_READ | FUSE_BIG_WRITES | FUSE_MAX_PAGES |
+			FUSE_INIT_EXT;
+
+	if (flags & FUSE_INIT_EXT)
+		flags |= (uint64_t)in->flags2 << 32;
+	if (srv->uring)
+		want |= FUSE_OVER_IO_URING;
+	if (srv->passthrough_meta)
+		want |= FUSE_PASSTHROUGH | FUSE_PASSTHROUGH_META;
+	want &= flags;
+	srv->uring_negotiated = want & FUSE_OVER_IO_URING;
+	srv->passthrough_negotiated = (want & FUSE_PASSTHROUGH) &&
+				      (want & FUSE_PASSTHROUGH_META);
+
+	memset(out, 0, sizeof(*out));
+	out->major = FUSE_KERNEL_VERSION;
+	out->minor = FUSE_KERNEL_MINOR_VERSION;
+	out->max_readahead = in->max_readahead;
+	out->flags = want;
+	out->flags2 = want >> 32;
+	out->max_background = 64;
+	out->congestion_threshold = 48;
+	out->max_write = FUSE_SERVER_MAX_WRITE;
+	out->max_pages = FUSE_SERVER_MAX_WRITE / 4096;
+	out->time_gran = 1;
+	if (srv->passthrough_negotiated)
+		out->max_stack_depth = 1;
+	return sizeof(*out);
+}
+
+static void fill_entry(struct fuse_server *srv, struct fuse_entry_out *out,
+		       uint64_t nodeid, const struct stat *st)
+{
+	memset(out, 0, sizeof(*out));
+	out->nodeid = nodeid;
+	out->entry_valid = srv->entry_timeout;
+	out->attr_valid = srv->attr_timeout;
+	fill_attr(&out->attr, st);
+}
+
+/*
+ * Handle one request.  @out may point to the same buffer as @in, so the
+ * input is consumed before any output is written.  Returns the length of
+ * the reply, or 0 if the request has no reply.
+ */
+static size_t handle_request(struct fuse_server *srv, void *in, size_t in_len,
+			     void *out, size_t out_size)
+{
+	struct fuse_in_header ih = *(struct fuse_in_header *)in;
+	struct fuse_out_header *oh = out;
+	struct fuse_server_node *node = node_find(srv, ih.nodeid);
+	const char *path = node ? node->path : NULL;
+	void *arg = (char *)in + sizeof(ih);
+	void *res = (char *)out + sizeof(*oh);
+	size_t res_size = out_size - sizeof(*oh);
+	char child[PATH_MAX];
+	struct stat st;
+	ssize_t ret = 0;
+
+	if (in_len < sizeof(ih))
+		return 0;
+
+	switch (ih.opcode) {
+	case FUSE_INIT:
+		ret = do_init(srv, arg, res);
+		break;
+
+	case FUSE_FORGET:
+	case FUSE_BATCH_FORGET:
+	case FUSE_INTERRUPT:
+		return 0;
+
+	case FUSE_LOOKUP: {
+		uint64_t nodeid;
+
+		if (!path) {
+			ret = -ENOENT;
+			break;
+		}
+		snprintf(child, sizeof(child), "%s/%s", path, (char *)arg);
+		if (lstat(child, &st)) {
+			ret = -errno;
+			break;
+		}
+		nodeid = node_get(srv, child);
+		if (!nodeid) {
+			ret = -ENOMEM;
+			break;
+		}
+		fill_entry(srv, res, nodeid, &st);
+		ret = sizeof(struct fuse_entry_out);
+		break;
+	}
+
+	case FUSE_GETATTR: {
+		struct fuse_attr_out *ao = res;
+
+		if (!path || lstat(path, &st)) {
+			ret = path ? -errno : -ENOENT;
+			break;
+		}
+		memset(ao, 0, sizeof(*ao));
+		ao->attr_valid = srv->attr_timeout;
+		fill_attr(&ao->attr, &st);
+		ret = sizeof(*ao);
+		if (srv->passthrough_negotiated)
+			node_attach(srv, node);
+		break;
+	}
+
+	case FUSE_OPEN: {
+		struct fuse_open_in oi = *(struct fuse_open_in *)arg;
+		struct fuse_open_out *oo = res;
+		int fd;
+
+		fd = path ? open(path, oi.flags & ~(O_CREAT | O_EXCL | O_NOCTTY)) :
+			    -1;
+		if (fd < 0) {
+			ret = path ? -errno : -ENOENT;
+			break;
+		}
+		memset(oo, 0, sizeof(*oo));
+		oo->fh = fd;
+		/* Every read and write is a request, not served from cache */
+		oo->open_flags = FOPEN_DIRECT_IO;
+		ret = sizeof(*oo);
+		break;
+	}
+
+	case FUSE_READ: {
+		struct fuse_read_in ri = *(struct fuse_read_in *)arg;
+
+		ret = pread(ri.fh, res, ri.size < res_size ? ri.size : res_size,
+			    ri.offset);
+		if (ret < 0)
+			ret = -errno;
+		break;
+	}
+
+	case FUSE_WRITE: {
+		struct fuse_write_in wi = *(struct fuse_write_in *)arg;
+		struct fuse_write_out *wo = res;
+
+		ret = pwrite(wi.fh, (char *)arg + sizeof(wi), wi.size, wi.offset);
+		if (ret < 0) {
+			ret = -errno;
+			break;
+		}
+		memset(wo, 0, sizeof(*wo));
+		wo->size = ret;
+		ret = sizeof(*wo);
+		break;
+	}
+
+	case FUSE_FLUSH:
+	case FUSE_FSYNC:
+		break;
+
+	case FUSE_RELEASE:
+		close(((struct fuse_release_in *)arg)->fh);
+		break;
+
+	case FUSE_OPENDIR: {
+		struct fuse_open_out *oo = res;
+		DIR *dir;
+
+		if (path && srv->passthrough_negotiated) {
+			int fd = open(path, O_RDONLY | O_DIRECTORY);
+			int id = fd < 0 ? -errno : backing_open(srv, fd);
+
+			if (fd >= 0)
+				close(fd);
+			if (id > 0) {
+				memset(oo, 0, sizeof(*oo));
+				oo->fh = ((uint64_t)id << 1) | DIR_FH_BACKING;
+				oo->open_flags = FOPEN_PASSTHROUGH;
+				oo->backing_id = id;
+				ret = sizeof(*oo);
+				break;
+			}
+		}
+
+		dir = path ? opendir(path) : NULL;
+		if (!dir) {
+			ret = path ? -errno : -ENOENT;
+			break;
+		}
+		memset(oo, 0, sizeof(*oo));
+		oo->fh = (uintptr_t)dir;
+		ret = sizeof(*oo);
+		break;
+	}
+
+	case FUSE_READDIR: {
+		struct fuse_read_in ri = *(struct fuse_read_in *)arg;
+		DIR *dir = (DIR *)(uintptr_t)ri.fh;
+		size_t size = ri.size < res_size ? ri.size : res_size;
+		struct dirent *de;
+
+		seekdir(dir, ri.offset);
+		while ((de = readdir(dir))) {
+			struct fuse_dirent *fde = (void *)((char *)res + ret);
+			size_t namelen = strlen(de->d_name);
+			size_t len = FUSE_DIRENT_ALIGN(FUSE_NAME_OFFSET + namelen);
+
+			if (ret + len > size)
+				break;
+			fde->ino = de->d_ino;
+			fde->off = telldir(dir);
+			fde->namelen = namelen;
+			fde->type = de->d_type;
+			memcpy(fde->name, de->d_name, namelen);
+			memset(fde->name + namelen, 0,
+			       len - FUSE_NAME_OFFSET - namelen);
+			ret += len;
+		}
+		break;
+	}
+
+	case FUSE_RELEASEDIR: {
+		uint64_t fh = ((struct fuse_release_in *)arg)->fh;
+
+		if (fh & DIR_FH_BACKING)
+			backing_close(srv, fh >> 1);
+		else
+			closedir((DIR *)(uintptr_t)fh);
+		break;
+	}
+
+	case FUSE_STATFS: {
+		struct fuse_statfs_out *so = res;
+		struct statvfs sv;
+
+		if (statvfs(srv->src, &sv)) {
+			ret = -errno;
+			break;
+		}
+		memset(so, 0, sizeof(*so));
+		so->st.blocks = sv.f_blocks;
+		so->st.bfree = sv.f_bfree;
+		so->st.bavail = sv.f_bavail;
+		so->st.files = sv.f_files;
+		so->st.ffree = sv.f_ffree;
+		so->st.bsize = sv.f_bsize;
+		so->st.frsize = sv.f_frsize;
+		so->st.namelen = sv.f_namemax;
+		ret = sizeof(*so);
+		break;
+	}
+
+	case FUSE_DESTROY:
+		break;
+
+	default:
+		ret = -ENOSYS;
+		break;
+	}
+
+	oh->unique = ih.unique;
+	if (ret < 0) {
+		oh->error = ret;
+		oh->len = sizeof(*oh);
+	} else {
+		oh->error = 0;
+		oh->len = sizeof(*oh) + ret;
+	}
+	return oh->len;
+}
+
+static void *dev_thread(void *arg)
+{
+	struct fuse_server *srv = arg;
+	void *buf = malloc(FUSE_SERVER_BUF_LEN);
+	ssize_t len;
+
+	if (!buf)
+		return NULL;
+
+	for (;;) {
+		len = read(srv->dev_fd, buf, FUSE_SERVER_BUF_LEN);
+		if (len < 0) {
+			if (errno == EINTR || errno == ENOENT)
+				continue;
+			/* ENODEV once the connection is gone */
+			break;
+		}
+		len = handle_request(srv, buf, len, buf, FUSE_SERVER_BUF_LEN);
+		/* ENOENT if the request was interrupted meanwhile */
+		if (len && write(srv->dev_fd, buf, len) < 0 && errno == ENODEV)
+			break;
+	}
+	free(buf);
+	return NULL;
+}
+
+static int queue_setup_ring(struct fuse_server_queue *q, unsigned int entries)
+{
+	struct io_uring_params p;
+
+	memset(&p, 0, sizeof(p));
+	q->ring_fd = syscall(__NR_io_uring_setup, entries, &p);
+	if (q->ring_fd < 0)
+		return -errno;
+
+	q->sq_ring_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	q->cq_ring_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (q->cq_ring_sz > q->sq_ring_sz)
+			q->sq_ring_sz = q->cq_ring_sz;
+		q->cq_ring_sz = q->sq_ring_sz;
+	}
+
+	q->sq_ring = mmap(NULL, q->sq_ring_sz, PROT_READ | PROT_WRITE,
+			  MAP_SHARED | MAP_POPULATE, q->ring_fd,
+			  IORING_OFF_SQ_RING);
+	if (q->sq_ring == MAP_FAILED)
+		return -errno;
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		q->cq_ring = q->sq_ring;
+	} else {
+		q->cq_ring = mmap(NULL, q->cq_ring_sz, PROT_READ | PROT_WRITE,
+				  MAP_SHARED | MAP_POPULATE, q->ring_fd,
+				  IORING_OFF_CQ_RING);
+		if (q->cq_ring == MAP_FAILED)
+			return -errno;
+	}
+
+	q->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+	q->sqes = mmap(NULL, q->sqes_sz, PROT_READ | PROT_WRITE,
+		       MAP_SHARED | MAP_POPULATE, q->ring_fd, IORING_OFF_SQES);
+	if (q->sqes == MAP_FAILED)
+		return -errno;
+
+	q->sq_head = (void *)((char *)q->sq_ring + p.sq_off.head);
+	q->sq_tail = (void *)((char *)q->sq_ring + p.sq_off.tail);
+	q->sq_mask = (void *)((char *)q->sq_ring + p.sq_off.ring_mask);
+	q->sq_array = (void *)((char *)q->sq_ring + p.sq_off.array);
+	q->cq_head = (void *)((char *)q->cq_ring + p.cq_off.head);
+	q->cq_tail = (void *)((char *)q->cq_ring + p.cq_off.tail);
+	q->cq_mask = (void *)((char *)q->cq_ring + p.cq_off.ring_mask);
+	q->cqes = (void *)((char *)q->cq_ring + p.cq_off.cqes);
+	return 0;
+}
+
+static void queue_free_ring(struct fuse_server_queue *q)
+{
+	if (q->sqes && q->sqes != MAP_FAILED)
+		munmap(q->sqes, q->sqes_sz);
+	if (q->cq_ring && q->cq_ring != MAP_FAILED && q->cq_ring != q->sq_ring)
+		munmap(q->cq_ring, q->cq_ring_sz);
+	if (q->sq_ring && q->sq_ring != MAP_FAILED)
+		munmap(q->sq_ring, q->sq_ring_sz);
+	if (q->ring_fd >= 0)
+		close(q->ring_fd);
+}
+
+/* Queue a command for buffer @i, the caller submits it */
+static void queue_prep_cmd(struct fuse_server_queue *q, unsigned int i,
+			   uint32_t cmd_op, uint64_t commit_id)
+{
+	unsigned int tail = *q->sq_tail;
+	unsigned int idx = tail & *q->sq_mask;
+	struct io_uring_sqe *sqe = &q->sqes[idx];
+	struct fuse_uring_cmd_req *req = (void *)sqe->cmd;
+
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = IORING_OP_URING_CMD;
+	sqe->fd = q->srv->dev_fd;
+	sqe->cmd_op = cmd_op;
+	sqe->addr = (uintptr_t)q->bufs[i];
+	sqe->len = FUSE_SERVER_BUF_LEN;
+	sqe->user_data = i;
+	req->commit_id = commit_id;
+	req->qid = q->qid;
+
+	q->sq_array[idx] = idx;
+	__atomic_store_n(q->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+static void *queue_thread(void *arg)
+{
+	struct fuse_server_queue *q = arg;
+	struct fuse_server *srv = q->srv;
+	unsigned int i, active, to_submit;
+	cpu_set_t cpuset;
+
+	/* Run where the requests of the queue are issued */
+	CPU_ZERO(&cpuset);
+	CPU_SET(q->qid, &cpuset);
+	sched_setaffinity(0, sizeof(cpuset), &cpuset);
+
+	for (i = 0; i < srv->queue_depth; i++)
+		queue_prep_cmd(q, i, FUSE_URING_CMD_REGISTER, 0);
+	active = to_submit = srv->queue_depth;
+
+	while (active) {
+		unsigned int head, tail;
+		int ret;
+
+		ret = syscall(__NR_io_uring_enter, q->ring_fd, to_submit, 1,
+			      IORING_ENTER_GETEVENTS, NULL, 0);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		to_submit = 0;
+
+		head = *q->cq_head;
+		tail = __atomic_load_n(q->cq_tail, __ATOMIC_ACQUIRE);
+		for (; head != tail; head++) {
+			struct io_uring_cqe *cqe = &q->cqes[head & *q->cq_mask];
+			struct fuse_in_header *ih;
+			uint64_t unique;
+			size_t len;
+
+			i = cqe->user_data;
+			if (cqe->res < 0) {
+				/*
+				 * -ENOTCONN and -ENOENT once the connection
+				 * is aborted, anything else is a failure.
+				 */
+				if (cqe->res != -ENOTCONN &&
+				    cqe->res != -ENOENT && !srv->uring_err)
+					srv->uring_err = cqe->res;
+				active--;
+				continue;
+			}
+
+			ih = q->bufs[i];
+			unique = ih->unique;
+			len = handle_request(srv, ih, cqe->res, ih,
+					     FUSE_SERVER_BUF_LEN);
+			if (!len) {
+				/* Only requests with a reply are queued */
+				active--;
+				continue;
+			}
+			queue_prep_cmd(q, i, FUSE_URING_CMD_COMMIT_AND_FETCH,
+				       unique);
+			to_submit++;
+		}
+		__atomic_store_n(q->cq_head, head, __ATOMIC_RELEASE);
+	}
+	return NULL;
+}
+
+static int queue_start(struct fuse_server *srv, struct fuse_server_queue *q,
+		       unsigned int qid)
+{
+	unsigned int i;
+	int ret;
+
+	q->srv = srv;
+	q->qid = qid;
+	q->ring_fd = -1;
+
+	q->bufs = calloc(srv->queue_depth, sizeof(*q->bufs));
+	if (!q->bufs)
+		return -ENOMEM;
+	for (i = 0; i < srv->queue_depth; i++) {
+		q->bufs[i] = malloc(FUSE_SERVER_BUF_LEN);
+		if (!q->bufs[i])
+			return -ENOMEM;
+	}
+
+	ret = queue_setup_ring(q, srv->queue_depth * 2);
+	if (ret)
+		return ret;
+
+	ret = pthread_create(&q->thread, NULL, queue_thread, q);
+	if (ret)
+		return -ret;
+	q->started = true;
+	return 0;
+}
+
+static void queue_free(struct fuse_server *srv, struct fuse_server_queue *q)
+{
+	unsigned int i;
+
+	if (q->started)
+		pthread_join(q->thread, NULL);
+	queue_free_ring(q);
+	if (q->bufs) {
+		for (i = 0; i < srv->queue_depth; i++)
+			free(q->bufs[i]);
+		free(q->bufs);
+	}
+}
+
+int fuse_server_start(struct fuse_server *srv)
+{
+	char opts[128];
+	struct stat st;
+	int i, ret;
+
+	pthread_mutex_init(&srv->lock, NULL);
+	srv->nr_queues = 0;
+	srv->uring_err = 0;
+	if (!srv->queue_depth)
+		srv->queue_depth = 8;
+	if (!srv->nr_dev_threads)
+		srv->nr_dev_threads = 1;
+
+	if (!node_get(srv, srv->src))
+		return -ENOMEM;
+
+	srv->dev_fd = open("/dev/fuse", O_RDWR | O_CLOEXEC);
+	if (srv->dev_fd < 0)
+		return -errno;
+
+	if (stat(srv->src, &st))
+		return -errno;
+	snprintf(opts, sizeof(opts),
+		 "fd=%d,rootmode=%o,user_id=0,group_id=0,allow_other",
+		 srv->dev_fd, st.st_mode & S_IFMT);
+	if (mount("selftest", srv->mnt, "fuse.selftest", MS_NOSUID | MS_NODEV,
+		  opts)) {
+		ret = -errno;
+		close(srv->dev_fd);
+		return ret;
+	}
+
+	srv->dev_threads = calloc(srv->nr_dev_threads, sizeof(pthread_t));
+	if (!srv->dev_threads)
+		return -ENOMEM;
+	for (i = 0; i < srv->nr_dev_threads; i++)
+		pthread_create(&srv->dev_threads[i], NULL, dev_thread, srv);
+
+	/* Waits for FUSE_INIT to complete */
+	if (stat(srv->mnt, &st))
+		return -errno;
+
+	if (!srv->uring)
+		return 0;
+	if (!srv->uring_negotiated) {
+		srv->uring_err = -EOPNOTSUPP;
+		return 0;
+	}
+
+	srv->queues = calloc(sysconf(_SC_NPROCESSORS_CONF),
+			     sizeof(*srv->queues));
+	if (!srv->queues)
+		return -ENOMEM;
+	for (i = 0; i < sysconf(_SC_NPROCESSORS_CONF); i++) {
+		ret = queue_start(srv, &srv->queues[i], i);
+		srv->nr_queues++;
+		if (ret) {
+			srv->uring_err = ret;
+			break;
+		}
+	}
+	return 0;
+}
+
+void fuse_server_stop(struct fuse_server *srv)
+{
+	uint64_t i;
+
+	/* Aborts the connection, which completes all commands */
+	umount2(srv->mnt, MNT_DETACH);
+
+	for (i = 0; i < (uint64_t)srv->nr_queues; i++)
+		queue_free(srv, &srv->queues[i]);
+	free(srv->queues);
+	srv->queues = NULL;
+	srv->nr_queues = 0;
+
+	close(srv->dev_fd);
+	for (i = 0; i < (uint64_t)srv->nr_dev_threads; i++)
+		pthread_join(srv->dev_threads[i], NULL);
+	free(srv->dev_threads);
+	srv->dev_threads = NULL;
+
+	for (i = 0; i < srv->nr_nodes; i++) {
+		free(srv->nodes[i]->path);
+		free(srv->nodes[i]);
+	}
+	free(srv->nodes);
+	srv->nodes = NULL;
+	srv->nr_nodes = srv->max_nodes = 0;
+	memset(srv->hash, 0, sizeof(srv->hash));
+	pthread_mutex_destroy(&srv->lock);
+}
@@ -0,0 +1,75 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Minimal passthrough FUSE server for the selftests, mirroring a source
+ * directory at a mountpoint.  Requests are served either by threads reading
+ * /dev/fuse or by per-CPU io_uring queues.
+ */
+#ifndef __SELFTESTS_FUSE_SERVER_H
+#define __SELFTESTS_FUSE_SERVER_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Largest write the server accepts, sizes the request buffers */
+#define FUSE_SERVER_MAX_WRITE	(128 * 1024)
+#define FUSE_SERVER_BUF_LEN	(FUSE_SERVER_MAX_WRITE + 4096)
+
+#define FUSE_SERVER_NODE_HASH	4096
+
+struct fuse_server_node {
+	char *path;
+	uint64_t nodeid;
+	/* Attributes are taken from the backing file by the kernel */
+	bool attached;
+	struct fuse_server_node *next;
+};
+
+struct fuse_server_queue;
+
+struct fuse_server {
+	const char *src;
+	const char *mnt;
+	int dev_fd;
+
+	/* Serve requests over io_uring instead of read()/write() */
+	bool uring;
+	/* The kernel accepted FUSE_OVER_IO_URING in FUSE_INIT */
+	bool uring_negotiated;
+	/* First error a queue got from a FUSE_URING_CMD_REGISTER */
+	int uring_err;
+
+	/* Pass readdir and getattr through to the source directory */
+	bool passthrough_meta;
+	/* The kernel accepted FUSE_PASSTHROUGH_META in FUSE_INIT */
+	bool passthrough_negotiated;
+
+	/* io_uring commands per queue */
+	unsigned int queue_depth;
+	/* Attribute and entry timeouts in seconds */
+	unsigned int attr_timeout;
+	unsigned int entry_timeout;
+
+	int nr_dev_threads;
+	pthread_t *dev_threads;
+	int nr_queues;
+	struct fuse_server_queue *queues;
+
+	pthread_mutex_t lock;
+	struct fuse_server_node *hash[FUSE_SERVER_NODE_HASH];
+	struct fuse_server_node **nodes;
+	uint64_t nr_nodes;
+	uint64_t max_nodes;
+};
+
+/*
+ * Mount @srv->src on @srv->mnt and start serving it.  Returns 0, or a
+ * negative errno.  With @srv->uring set, the io_uring queues are
+ * registered once FUSE_INIT completed; @srv->uring_err tells whether that
+ * worked.
+ */
+int fuse_server_start(struct fuse_server *srv);
+void fuse_server_stop(struct fuse_server *srv);
+
+#endif /* __SELFTESTS_FUSE_SERVER_H */
@@ -0,0 +1,270 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Compare 4k random read IOPS and latency of a passthrough FUSE server
+ * serving requests through /dev/fuse and through per-CPU io_uring queues.
+ *
+ * One client thread per CPU reads from a file opened with FOPEN_DIRECT_IO,
+ * so that every read is a FUSE request.
+ */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "fuse_server.h"
+#include "../../kselftest.h"
+
+#define FILE_SIZE	(64 << 20)
+#define BLOCK_SIZE	4096
+
+/* Latency histogram with 1us buckets, the last one collects the rest */
+#define HIST_BUCKETS	10000
+
+static unsigned int runtime = 3;
+static int nr_cpus;
+
+struct client {
+	pthread_t thread;
+	int cpu;
+	const char *path;
+	volatile bool *stop;
+	unsigned long long ops;
+	unsigned int *hist;
+	int err;
+};
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void *client_thread(void *arg)
+{
+	struct client *c = arg;
+	unsigned int seed = c->cpu;
+	char buf[BLOCK_SIZE];
+	cpu_set_t cpuset;
+	int fd;
+
+	CPU_ZERO(&cpuset);
+	CPU_SET(c->cpu, &cpuset);
+	sched_setaffinity(0, sizeof(cpuset), &cpuset);
+
+	fd = open(c->path, O_RDONLY);
+	if (fd < 0) {
+		c->err = -errno;
+		return NULL;
+	}
+
+	while (!*c->stop) {
+		off_t off = (off_t)(rand_r(&seed) % (FILE_SIZE / BLOCK_SIZE)) *
+			    BLOCK_SIZE;
+		unsigned long long start = now_ns(), us;
+
+		if (pread(fd, buf, BLOCK_SIZE, off) != BLOCK_SIZE) {
+			c->err = -EIO;
+			break;
+		}
+		us = (now_ns() - start) / 1000;
+		c->hist[us < HIST_BUCKETS ? us : HIST_BUCKETS - 1]++;
+		c->ops++;
+	}
+	close(fd);
+	return NULL;
+}
+
+static unsigned int hist_percentile(const unsigned int *hist,
+				    unsigned long long total, double pct)
+{
+	unsigned long long want = total * pct / 100, sum = 0;
+	unsigned int i;
+
+	for (i = 0; i < HIST_BUCKETS; i++) {
+		sum += hist[i];
+		if (sum > want)
+			return i;
+	}
+	return HIST_BUCKETS;
+}
+
+/* Returns 0, or a negative errno */
+static int run_clients(const char *path, const char *name)
+{
+	unsigned long long total = 0;
+	volatile bool stop = false;
+	struct client *clients;
+	unsigned int *hist;
+	int i, ret = 0;
+
+	clients = calloc(nr_cpus, sizeof(*clients));
+	hist = calloc(HIST_BUCKETS, sizeof(*hist));
+	if (!clients || !hist)
+		return -ENOMEM;
+
+	for (i = 0; i < nr_cpus; i++) {
+		clients[i].cpu = i;
+		clients[i].path = path;
+		clients[i].stop = &stop;
+		clients[i].hist = calloc(HIST_BUCKETS, sizeof(*hist));
+		if (!clients[i].hist)
+			return -ENOMEM;
+		pthread_create(&clients[i].thread, NULL, client_thread,
+			       &clients[i]);
+	}
+
+	sleep(runtime);
+	stop = true;
+
+	for (i = 0; i < nr_cpus; i++) {
+		unsigned int b;
+
+		pthread_join(clients[i].thread, NULL);
+		if (clients[i].err && !ret)
+			ret = clients[i].err;
+		total += clients[i].ops;
+		for (b = 0; b < HIST_BUCKETS; b++)
+			hist[b] += clients[i].hist[b];
+		free(clients[i].hist);
+	}
+
+	if (!ret)
+		ksft_print_msg("%-9s %10llu IOPS  p50 %5u us  p99 %5u us\n",
+			       name, total / runtime,
+			       hist_percentile(hist, total, 50),
+			       hist_percentile(hist, total, 99));
+
+	free(hist);
+	free(clients);
+	return ret;
+}
+
+static int create_file(const char *path)
+{
+	char buf[BLOCK_SIZE];
+	int fd, i;
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		return -errno;
+	for (i = 0; i < FILE_SIZE / BLOCK_SIZE; i++) {
+		memset(buf, i, sizeof(buf));
+		if (write(fd, buf, sizeof(buf)) != sizeof(buf)) {
+			close(fd);
+			return -EIO;
+		}
+	}
+	close(fd);
+	return 0;
+}
+
+static bool enable_uring(void)
+{
+	int fd = open("/sys/module/fuse/parameters/enable_uring", O_WRONLY);
+	bool ok;
+
+	if (fd < 0)
+		return false;
+	ok = write(fd, "Y", 1) == 1;
+	close(fd);
+	return ok;
+}
+
+static void run_mode(const char *src, const char *mnt, bool uring)
+{
+	const char *name = uring ? "io_uring" : "/dev/fuse";
+	struct fuse_server srv = {
+		.src = src,
+		.mnt = mnt,
+		.uring = uring,
+		/* Same number of server threads for both transports */
+		.nr_dev_threads = uring ? 1 : nr_cpus,
+	};
+	char path[PATH_MAX];
+	int ret;
+
+	ret = fuse_server_start(&srv);
+	if (ret) {
+		ksft_test_result_fail("%s: mounting failed: %s\n", name,
+				      strerror(-ret));
+		return;
+	}
+
+	if (uring && srv.uring_err) {
+		ksft_test_result_skip("%s: not supported: %s\n", name,
+				      strerror(-srv.uring_err));
+		fuse_server_stop(&srv);
+		return;
+	}
+
+	snprintf(path, sizeof(path), "%s/data", mnt);
+	ret = run_clients(path, name);
+	fuse_server_stop(&srv);
+
+	if (!ret && uring && srv.uring_err)
+		ret = srv.uring_err;
+	ksft_test_result(!ret, "%s: 4k random read\n", name);
+}
+
+int main(int argc, char **argv)
+{
+	char src[] = "/tmp/fuse_uring_src.XXXXXX";
+	char mnt[] = "/tmp/fuse_uring_mnt.XXXXXX";
+	char path[PATH_MAX];
+	bool uring_ok;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "t:")) != -1) {
+		switch (opt) {
+		case 't':
+			runtime = atoi(optarg) ?: 1;
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-t seconds]\n", argv[0]);
+			return KSFT_FAIL;
+		}
+	}
+
+	ksft_print_header();
+
+	if (geteuid())
+		ksft_exit_skip("needs root to mount\n");
+	if (access("/dev/fuse", R_OK | W_OK))
+		ksft_exit_skip("/dev/fuse not available\n");
+
+	nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (!mkdtemp(src) || !mkdtemp(mnt))
+		ksft_exit_fail_msg("mkdtemp: %s\n", strerror(errno));
+	snprintf(path, sizeof(path), "%s/data", src);
+	if (create_file(path))
+		ksft_exit_fail_msg("cannot create %s\n", path);
+
+	ksft_set_plan(2);
+	ksft_print_msg("%d clients, %us per transport\n", nr_cpus, runtime);
+
+	run_mode(src, mnt, false);
+
+	uring_ok = enable_uring();
+	if (!uring_ok)
+		ksft_test_result_skip("io_uring: cannot set enable_uring\n");
+	else
+		run_mode(src, mnt, true);
+
+	unlink(path);
+	rmdir(src);
+	rmdir(mnt);
+	ksft_finished();
+}
@@ -0,0 +1,222 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Throughput of large messages over a unix stream socket pair, copied into
+ * the socket and with MSG_ZEROCOPY.
+ *
+ * With MSG_ZEROCOPY the receiver copies straight out of the pages of the
+ * sender, which gets its buffers back through completions on the error
+ * queue. The sender cycles through a few buffers and waits for the
+ * completion of the oldest one before reusing it.
+ */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <getopt.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <linux/errqueue.h>
+
+#include "../../kselftest.h"
+
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY	60
+#endif
+
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY	0x4000000
+#endif
+
+#define NR_BUFS		8
+
+static size_t msg_size = 4 << 20;
+static unsigned int runtime = 3;
+
+struct bench {
+	int fd[2];
+	bool zerocopy;
+	char *bufs;
+	unsigned long long sent, received;
+	unsigned int completed, copied;
+	volatile bool stop;
+};
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Reads the completions on the error queue, returns false if there are none */
+static bool read_completions(struct bench *b)
+{
+	char control[CMSG_SPACE(sizeof(struct sock_extended_err))];
+	struct msghdr msg = {
+		.msg_control = control,
+		.msg_controllen = sizeof(control),
+	};
+	struct sock_extended_err *serr;
+	struct cmsghdr *cm;
+
+	if (recvmsg(b->fd[0], &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+		if (errno != EAGAIN)
+			ksft_exit_fail_msg("recvmsg(MSG_ERRQUEUE): %s\n",
+					   strerror(errno));
+		return false;
+	}
+
+	cm = CMSG_FIRSTHDR(&msg);
+	if (!cm || cm->cmsg_level != SOL_SOCKET ||
+	    cm->cmsg_type != SO_ZEROCOPY)
+		ksft_exit_fail_msg("unexpected cmsg\n");
+
+	serr = (void *)CMSG_DATA(cm);
+	if (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY || serr->ee_errno)
+		ksft_exit_fail_msg("unexpected completion\n");
+
+	/* ee_info..ee_data is the range of completed sends */
+	b->completed = serr->ee_data + 1;
+	if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+		b->copied++;
+	return true;
+}
+
+static void wait_completion(struct bench *b, unsigned int id)
+{
+	struct pollfd pfd = { .fd = b->fd[0] };
+
+	while ((int)(b->completed - id) <= 0 && !b->stop) {
+		if (read_completions(b))
+			continue;
+		poll(&pfd, 1, 100);
+	}
+}
+
+static void *tx_thread(void *arg)
+{
+	struct bench *b = arg;
+	int flags = b->zerocopy ? MSG_ZEROCOPY : 0;
+	unsigned int id;
+	ssize_t ret;
+
+	for (id = 0; !b->stop; id++) {
+		char *buf = b->bufs + (id % NR_BUFS) * msg_size;
+
+		if (b->zerocopy && id >= NR_BUFS)
+			wait_completion(b, id - NR_BUFS);
+		memset(buf, id, 64);
+
+		ret = send(b->fd[0], buf, msg_size, flags);
+		if (ret < 0) {
+			if (errno != EINTR)
+				break;
+			ret = 0;
+		}
+		b->sent += ret;
+		/* Only full sends complete as one notification */
+		if (b->zerocopy && ret != msg_size)
+			ksft_exit_fail_msg("short send: %zd\n", ret);
+	}
+	shutdown(b->fd[0], SHUT_WR);
+	return NULL;
+}
+
+static void *rx_thread(void *arg)
+{
+	struct bench *b = arg;
+	ssize_t ret;
+	char *buf;
+
+	buf = mmap(NULL, msg_size, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (buf == MAP_FAILED)
+		ksft_exit_fail_msg("mmap: %s\n", strerror(errno));
+
+	while ((ret = recv(b->fd[1], buf, msg_size, MSG_WAITALL)) > 0)
+		b->received += ret;
+
+	munmap(buf, msg_size);
+	return NULL;
+}
+
+static void run_mode(bool zerocopy)
+{
+	const char *name = zerocopy ? "zerocopy" : "copy";
+	struct bench b = { .zerocopy = zerocopy };
+	int one = 1, sndbuf = 2 * msg_size;
+	pthread_t tx_tid, rx_tid;
+	double start, elapsed;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, b.fd))
+		ksft_exit_fail_msg("socketpair: %s\n", strerror(errno));
+	setsockopt(b.fd[0], SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+
+	if (zerocopy &&
+	    setsockopt(b.fd[0], SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one))) {
+		ksft_test_result_skip("%s: SO_ZEROCOPY: %s\n", name,
+				      strerror(errno));
+		goto out;
+	}
+
+	b.bufs = mmap(NULL, NR_BUFS * msg_size, PROT_READ | PROT_WRITE,
+		      MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+	if (b.bufs == MAP_FAILED)
+		ksft_exit_fail_msg("mmap: %s\n", strerror(errno));
+
+	pthread_create(&rx_tid, NULL, rx_thread, &b);
+	pthread_create(&tx_tid, NULL, tx_thread, &b);
+
+	start = now();
+	sleep(runtime);
+	b.stop = true;
+	pthread_join(tx_tid, NULL);
+	pthread_join(rx_tid, NULL);
+	elapsed = now() - start;
+
+	ksft_print_msg("%-8s %8.2f GB/s\n", name, b.received / elapsed / 1e9);
+	if (zerocopy && b.copied)
+		ksft_print_msg("%u completions reported a copy\n", b.copied);
+	ksft_test_result(b.received && b.received == b.sent,
+			 "%s: %zu byte messages\n", name, msg_size);
+	munmap(b.bufs, NR_BUFS * msg_size);
+out:
+	close(b.fd[0]);
+	close(b.fd[1]);
+}
+
+int main(int argc, char **argv)
+{
+	int opt;
+
+	while ((opt = getopt(argc, argv, "s:t:")) != -1) {
+		switch (opt) {
+		case 's':
+			msg_size = strtoul(optarg, NULL, 0) ?: 1;
+			break;
+		case 't':
+			runtime = atoi(optarg) ?: 1;
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-s msg size] [-t seconds]\n",
+				argv[0]);
+			return KSFT_FAIL;
+		}
+	}
+
+	ksft_print_header();
+	ksft_set_plan(2);
+	ksft_print_msg("%zu byte messages, %us per mode\n", msg_size, runtime);
+
+	run_mode(false);
+	run_mode(true);
+
+	ksft_finished();
+}
@@ -0,0 +1,91 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Throughput of cake and cake_mq shaping a multiqueue veth, and the split of
+# the link between two hosts with different numbers of flows.
+#
+# The sender has two addresses, 10.0.0.1 and 10.0.0.3, and shapes with
+# dual-srchost isolation, so that the two of them should get even shares
+# of the link, however many flows they have and whichever tx queues these
+# flows are hashed to.
+#
+# Usage: ./cake_mq_bench.sh [-b bandwidth] [-q tx queues] [-P flows] [-t seconds]
+
+source lib.sh
+
+bandwidth=10gbit
+queues=$(nproc)
+flows=8
+runtime=10
+
+usage() {
+	echo "Usage: $0 [-b bandwidth] [-q tx queues] [-P flows] [-t seconds]"
+	exit $ksft_fail
+}
+
+while getopts "b:q:P:t:h" opt; do
+	case $opt in
+	b) bandwidth=$OPTARG ;;
+	q) queues=$OPTARG ;;
+	P) flows=$OPTARG ;;
+	t) runtime=$OPTARG ;;
+	*) usage ;;
+	esac
+done
+
+if ! command -v iperf3 >/dev/null; then
+	echo "SKIP: iperf3 not found"
+	exit $ksft_skip
+fi
+
+setup_ns NS_SND NS_RCV || exit $ksft_skip
+tmp1=$(mktemp)
+tmp3=$(mktemp)
+trap 'rm -f "$tmp1" "$tmp3"; cleanup_all_ns' EXIT
+
+ip -netns "$NS_SND" link add veth0 numtxqueues "$queues" numrxqueues "$queues" \
+	type veth peer name veth1 netns "$NS_RCV" \
+	numtxqueues "$queues" numrxqueues "$queues" || exit $ksft_skip
+ip -netns "$NS_SND" addr add 10.0.0.1/24 dev veth0
+ip -netns "$NS_SND" addr add 10.0.0.3/24 dev veth0
+ip -netns "$NS_RCV" addr add 10.0.0.2/24 dev veth1
+ip -netns "$NS_SND" link set veth0 up
+ip -netns "$NS_RCV" link set veth1 up
+
+ip netns exec "$NS_RCV" iperf3 -s -D -p 5201
+ip netns exec "$NS_RCV" iperf3 -s -D -p 5202
+sleep 1
+
+# prints the goodput in Mbit/s of an iperf3 client run
+goodput() {
+	ip netns exec "$NS_SND" iperf3 -c 10.0.0.2 -t "$runtime" -J "$@" |
+		sed -n 's/.*"bits_per_second":[[:space:]]*\([0-9.e+]*\).*/\1/p' |
+		tail -n 1 | awk '{ printf "%.0f\n", $1 / 1e6 }'
+}
+
+run() {
+	local qdisc=$1
+	local total host1 host3
+
+	if ! tc -netns "$NS_SND" qdisc replace dev veth0 root handle 1: \
+	     "$qdisc" bandwidth "$bandwidth" besteffort dual-srchost \
+	     2>/dev/null; then
+		echo "SKIP: $qdisc"
+		return
+	fi
+
+	total=$(goodput -p 5201 -P "$flows")
+	printf "%-8s %2u flows: %6u Mbit/s\n" "$qdisc" "$flows" "$total"
+
+	goodput -p 5201 -B 10.0.0.1 -P "$flows" > "$tmp1" &
+	goodput -p 5202 -B 10.0.0.3 -P 1 > "$tmp3" &
+	wait
+	host1=$(cat "$tmp1")
+	host3=$(cat "$tmp3")
+	printf "%-8s hosts:    %6u Mbit/s with %u flows, %u Mbit/s with 1 flow\n" \
+	       "$qdisc" "$host1" "$flows" "$host3"
+}
+
+echo "$queues tx queues, shaped to $bandwidth"
+run cake
+run cake_mq
@@ -0,0 +1,253 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * IPv6 route lookups per second with a large synthetic table.
+ *
+ * With -g, prints the routes of the table as ip batch commands. Otherwise,
+ * sends small UDP datagrams from an unconnected socket to addresses
+ * within those routes, so that every send looks its route up, and reports
+ * the rate and the CPU time per send. The routes point to a gateway on a
+ * dummy device, which drops everything.
+ *
+ * The prefixes are drawn with a fixed seed from a few blocks, with the
+ * lengths weighted roughly as in the global table.
+ */
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <getopt.h>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+#include "../kselftest.h"
+
+#define NR_DSTS		65536
+
+static const unsigned int blocks[] = {
+	0x2001, 0x2400, 0x2401, 0x2402, 0x2403, 0x2404, 0x2405, 0x2406,
+	0x2600, 0x2601, 0x2602, 0x2603, 0x2604, 0x2605, 0x2606, 0x2607,
+	0x2800, 0x2801, 0x2803, 0x2804, 0x2a00, 0x2a01, 0x2a02, 0x2a03,
+	0x2a04, 0x2a05, 0x2a06, 0x2a07, 0x2a09, 0x2a0a, 0x2a0b, 0x2a0c,
+};
+
+static const struct {
+	unsigned int len;
+	unsigned int weight;
+} lens[] = {
+	{ 48, 50 }, { 44, 9 }, { 40, 8 }, { 32, 8 }, { 36, 6 }, { 46, 5 },
+	{ 47, 4 }, { 29, 4 }, { 64, 3 }, { 24, 2 }, { 20, 1 },
+};
+
+static unsigned int nr_routes = 200000;
+static unsigned int runtime = 3;
+static uint64_t seed = 0x2545f4914f6cdd1dULL;
+
+static uint64_t rnd(void)
+{
+	seed ^= seed << 13;
+	seed ^= seed >> 7;
+	seed ^= seed << 17;
+	return seed;
+}
+
+/* splitmix64, so that route n is the same whoever asks for it */
+static uint64_t hash(uint64_t x)
+{
+	x += 0x9e3779b97f4a7c15ULL;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double cpu_time(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 +
+	       ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+}
+
+/* Keeps the first @len bits of @addr, randomizes the others if @fill */
+static void mask_addr(struct in6_addr *addr, unsigned int len, int fill)
+{
+	unsigned int i;
+
+	for (i = 0; i < 16; i++) {
+		unsigned int keep = len > i * 8 ? len - i * 8 : 0;
+		uint8_t mask = keep >= 8 ? 0xff : (uint8_t)(0xff00 >> keep);
+
+		addr->s6_addr[i] &= mask;
+		if (fill)
+			addr->s6_addr[i] |= rnd() & ~mask;
+	}
+}
+
+/* Route @n of the table, returns its prefix length */
+static unsigned int gen_route(unsigned int n, struct in6_addr *addr)
+{
+	uint64_t r = hash(n), hi = hash(r) >> 16;
+	unsigned int i, w = r % 100;
+
+	for (i = 0; w >= lens[i].weight; i++)
+		w -= lens[i].weight;
+
+	hi |= (uint64_t)blocks[(r >> 32) % ARRAY_SIZE(blocks)] << 48;
+	memset(addr, 0, sizeof(*addr));
+	for (w = 0; w < 8; w++)
+		addr->s6_addr[w] = hi >> (56 - w * 8);
+	mask_addr(addr, lens[i].len, 0);
+	return lens[i].len;
+}
+
+static void print_routes(const char *via, const char *dev)
+{
+	char buf[INET6_ADDRSTRLEN];
+	struct in6_addr addr;
+	unsigned int i, len;
+
+	for (i = 0; i < nr_routes; i++) {
+		len = gen_route(i, &addr);
+		printf("route replace %s/%u via %s dev %s\n",
+		       inet_ntop(AF_INET6, &addr, buf, sizeof(buf)), len, via,
+		       dev);
+	}
+}
+
+static int read_index_sysctl(void)
+{
+	FILE *f = fopen("/proc/sys/net/ipv6/route/lookup_index", "r");
+	int val = -1;
+
+	if (f) {
+		if (fscanf(f, "%d", &val) != 1)
+			val = -1;
+		fclose(f);
+	}
+	return val;
+}
+
+static void bench(const char *src)
+{
+	struct sockaddr_in6 addr = { .sin6_family = AF_INET6 };
+	struct sockaddr_in6 *dsts;
+	unsigned long long sent = 0, failed = 0;
+	double start, cpu, elapsed;
+	unsigned int i, len;
+	char buf[16] = {};
+	int fd, index;
+
+	dsts = calloc(NR_DSTS, sizeof(*dsts));
+	if (!dsts)
+		ksft_exit_fail_msg("calloc: %s\n", strerror(errno));
+
+	/* Addresses within random routes of the same table */
+	for (i = 0; i < NR_DSTS; i++) {
+		struct in6_addr prefix;
+
+		len = gen_route(rnd() % nr_routes, &prefix);
+		mask_addr(&prefix, len, 1);
+
+		dsts[i].sin6_family = AF_INET6;
+		dsts[i].sin6_port = htons(9);
+		dsts[i].sin6_addr = prefix;
+	}
+
+	fd = socket(AF_INET6, SOCK_DGRAM, 0);
+	if (fd < 0)
+		ksft_exit_fail_msg("socket: %s\n", strerror(errno));
+	if (inet_pton(AF_INET6, src, &addr.sin6_addr) != 1)
+		ksft_exit_fail_msg("bad address %s\n", src);
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)))
+		ksft_exit_fail_msg("bind: %s\n", strerror(errno));
+
+	index = read_index_sysctl();
+	start = now();
+	cpu = cpu_time();
+	while (now() - start < runtime) {
+		for (i = 0; i < NR_DSTS; i++) {
+			if (sendto(fd, buf, sizeof(buf), 0,
+				   (struct sockaddr *)&dsts[i],
+				   sizeof(dsts[i])) < 0)
+				failed++;
+		}
+		sent += NR_DSTS;
+	}
+	elapsed = now() - start;
+	cpu = cpu_time() - cpu;
+
+	ksft_print_msg("lookup_index %d: %10.0f lookups/s  %6.0f ns CPU/lookup\n",
+		       index, sent / elapsed, cpu * 1e9 / sent);
+	if (failed)
+		ksft_print_msg("%llu sends failed\n", failed);
+	ksft_test_result(!failed, "%u routes\n", nr_routes);
+
+	close(fd);
+	free(dsts);
+}
+
+int main(int argc, char **argv)
+{
+	const char *src = NULL, *dev = "dummy0", *via = "fe80::1";
+	int opt, gen = 0;
+
+	while ((opt = getopt(argc, argv, "gn:t:s:d:v:")) != -1) {
+		switch (opt) {
+		case 'g':
+			gen = 1;
+			break;
+		case 'n':
+			nr_routes = strtoul(optarg, NULL, 0) ?: 1;
+			break;
+		case 't':
+			runtime = atoi(optarg) ?: 1;
+			break;
+		case 's':
+			src = optarg;
+			break;
+		case 'd':
+			dev = optarg;
+			break;
+		case 'v':
+			via = optarg;
+			break;
+		default:
+			goto usage;
+		}
+	}
+
+	if (gen) {
+		print_routes(via, dev);
+		return 0;
+	}
+	if (!src)
+		goto usage;
+
+	ksft_print_header();
+	ksft_set_plan(1);
+	ksft_print_msg("%u routes, %us\n", nr_routes, runtime);
+	bench(src);
+	ksft_finished();
+
+usage:
+	fprintf(stderr,
+		"Usage: %s -g [-n routes] [-d dev] [-v gateway]\n"
+		"       %s -s src [-n routes] [-t seconds]\n",
+		argv[0], argv[0]);
+	return KSFT_FAIL;
+}
@@ -0,0 +1,56 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Route lookups per second with a synthetic full IPv6 table, with the
+# lookup index of the FIB and with the tree alone, and the memory both
+# take.
+#
+# Usage: ./fib6_index_bench.sh [-n routes] [-t seconds per run]
+
+source lib.sh
+
+routes=200000
+runtime=3
+
+while getopts "n:t:" opt; do
+	case $opt in
+	n) routes=$OPTARG ;;
+	t) runtime=$OPTARG ;;
+	*) echo "Usage: $0 [-n routes] [-t seconds]"; exit 1 ;;
+	esac
+done
+
+setup_ns NS || exit $ksft_skip
+trap cleanup_all_ns EXIT
+
+if ! ip netns exec "$NS" test -e /proc/net/rt6_index; then
+	echo "SKIP: no IPv6 lookup index"
+	exit $ksft_skip
+fi
+
+ip -netns "$NS" link add dummy0 type dummy || exit $ksft_skip
+ip -netns "$NS" link set dummy0 up
+ip -netns "$NS" addr add fd00::1/128 dev dummy0 nodad
+
+echo "Loading $routes routes"
+./fib6_index_bench -g -n "$routes" | ip -netns "$NS" -batch - || exit 1
+
+# The index is built in the background, wait until no slot falls back
+for _ in $(seq 60); do
+	pending=$(ip netns exec "$NS" awk '$1 == 254 { print $5 }' \
+		/proc/net/rt6_index)
+	[ "$pending" = 0 ] && break
+	sleep 1
+done
+
+ret=0
+for index in 1 0; do
+	ip netns exec "$NS" sysctl -qw net.ipv6.route.lookup_index=$index
+	ip netns exec "$NS" ./fib6_index_bench -s fd00::1 -n "$routes" \
+		-t "$runtime" || ret=1
+done
+
+nodes=$(ip netns exec "$NS" awk '{ print $1 }' /proc/net/rt6_stats)
+echo "fib6 tree: $((16#$nodes)) nodes"
+ip netns exec "$NS" cat /proc/net/rt6_index
+exit $ret
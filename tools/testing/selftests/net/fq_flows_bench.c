@@ -0,0 +1,159 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Enqueue cost of the fq qdisc as a function of the number of flows and of
+ * how many packets of a flow arrive back to back.
+ *
+ * Each flow is a connected UDP socket. The sender walks the sockets in
+ * turn and sends a train of small datagrams on each, so that fq has to
+ * look up a different flow for every train. Run it against a device with
+ * fq as root qdisc and its fast path disabled (eg with a maxrate) to have
+ * every packet classified.
+ */
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <getopt.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+#include "../kselftest.h"
+
+#define PAYLOAD_LEN	64
+
+struct bench_run {
+	unsigned int flows;
+	unsigned int train;
+};
+
+static const struct bench_run runs[] = {
+	{ 1, 1 },
+	{ 64, 1 },
+	{ 64, 16 },
+	{ 1024, 1 },
+	{ 1024, 16 },
+	{ 8192, 1 },
+	{ 8192, 16 },
+};
+
+static unsigned int runtime = 2;
+static struct sockaddr_in dst;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double cpu_time(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 +
+	       ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+}
+
+static void run_one(const struct bench_run *run)
+{
+	char buf[PAYLOAD_LEN] = {};
+	unsigned long long pkts = 0;
+	double start, cpu, elapsed;
+	unsigned int i, j, n;
+	int *fds;
+
+	fds = calloc(run->flows, sizeof(*fds));
+	if (!fds)
+		ksft_exit_fail_msg("calloc: %s\n", strerror(errno));
+
+	for (n = 0; n < run->flows; n++) {
+		fds[n] = socket(AF_INET, SOCK_DGRAM, 0);
+		if (fds[n] < 0)
+			break;
+		if (connect(fds[n], (struct sockaddr *)&dst, sizeof(dst))) {
+			close(fds[n]);
+			break;
+		}
+	}
+	if (n < run->flows) {
+		ksft_test_result_fail("%u flows: socket %u: %s\n",
+				      run->flows, n, strerror(errno));
+		goto out;
+	}
+
+	start = now();
+	cpu = cpu_time();
+	while (now() - start < runtime) {
+		for (i = 0; i < run->flows; i++) {
+			for (j = 0; j < run->train; j++) {
+				if (send(fds[i], buf, sizeof(buf), 0) < 0 &&
+				    errno != ENOBUFS) {
+					ksft_test_result_fail("send: %s\n",
+							      strerror(errno));
+					goto out;
+				}
+			}
+		}
+		pkts += run->flows * run->train;
+	}
+	elapsed = now() - start;
+	cpu = cpu_time() - cpu;
+
+	ksft_print_msg("%5u flows  train %2u  %10.0f pps  %6.0f ns CPU/pkt\n",
+		       run->flows, run->train, pkts / elapsed,
+		       cpu * 1e9 / pkts);
+	ksft_test_result_pass("%u flows, trains of %u\n", run->flows,
+			      run->train);
+out:
+	while (n--)
+		close(fds[n]);
+	free(fds);
+}
+
+int main(int argc, char **argv)
+{
+	struct rlimit rlim = { 16384, 16384 };
+	const char *addr = NULL;
+	unsigned int i;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "d:t:")) != -1) {
+		switch (opt) {
+		case 'd':
+			addr = optarg;
+			break;
+		case 't':
+			runtime = atoi(optarg) ?: 1;
+			break;
+		default:
+			goto usage;
+		}
+	}
+	dst.sin_family = AF_INET;
+	dst.sin_port = htons(8000);
+	if (!addr || inet_pton(AF_INET, addr, &dst.sin_addr) != 1)
+		goto usage;
+
+	ksft_print_header();
+	if (setrlimit(RLIMIT_NOFILE, &rlim))
+		ksft_exit_skip("setrlimit: %s\n", strerror(errno));
+
+	ksft_set_plan(ARRAY_SIZE(runs));
+	ksft_print_msg("%u byte datagrams to %s, %us per run\n", PAYLOAD_LEN,
+		       addr, runtime);
+	for (i = 0; i < ARRAY_SIZE(runs); i++)
+		run_one(&runs[i]);
+	ksft_finished();
+
+usage:
+	fprintf(stderr, "Usage: %s -d IPv4 address [-t seconds]\n", argv[0]);
+	return KSFT_FAIL;
+}
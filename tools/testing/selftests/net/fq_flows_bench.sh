@@ -0,0 +1,27 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Enqueue cost of the fq qdisc for a growing number of flows, with packets
+# of a flow sent one at a time or in trains, on a dummy device.
+#
+# A per flow maxrate high enough to never throttle keeps fq from taking
+# its fast path, so that every packet is classified to a flow.
+#
+# Usage: ./fq_flows_bench.sh [-t seconds per run]
+
+source lib.sh
+
+setup_ns NS || exit $ksft_skip
+trap cleanup_all_ns EXIT
+
+ip -netns "$NS" link add dummy0 type dummy || exit $ksft_skip
+ip -netns "$NS" link set dummy0 up
+ip -netns "$NS" addr add 10.0.0.1/24 dev dummy0
+tc -netns "$NS" qdisc replace dev dummy0 root fq buckets 1024 \
+	maxrate 30gbit limit 100000 flow_limit 1000 || exit $ksft_skip
+
+ip netns exec "$NS" ./fq_flows_bench -d 10.0.0.2 "$@"
+ret=$?
+
+tc -netns "$NS" -s qdisc show dev dummy0
+exit $ret
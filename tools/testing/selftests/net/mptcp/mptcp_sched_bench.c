@@ -0,0 +1,261 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Goodput and request latency of an MPTCP connection, to compare packet
+ * schedulers over shaped links.
+ *
+ * The server sinks bulk transfers and echoes requests. The client waits for
+ * the additional subflows to join before measuring, then either sends as
+ * much as it can for a while, or sends small requests one at a time and
+ * reports percentiles of their round trip times.
+ */
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#ifndef IPPROTO_MPTCP
+#define IPPROTO_MPTCP 262
+#endif
+
+#define BULK_LEN	(64 * 1024)
+#define REQ_LEN		1024
+
+static const char *cfg_host;
+static int cfg_port = 12000;
+static int cfg_time = 5;
+static int cfg_count = 500;
+static char cfg_mode = 'b';
+
+static void die_perror(const char *msg)
+{
+	perror(msg);
+	exit(1);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void xwrite(int fd, const void *buf, size_t len)
+{
+	ssize_t ret;
+
+	while (len) {
+		ret = write(fd, buf, len);
+		if (ret < 0)
+			die_perror("write");
+		buf += ret;
+		len -= ret;
+	}
+}
+
+static int xread(int fd, void *buf, size_t len)
+{
+	size_t done = 0;
+	ssize_t ret;
+
+	while (done < len) {
+		ret = read(fd, buf + done, len - done);
+		if (ret < 0)
+			die_perror("read");
+		if (!ret)
+			return -1;
+		done += ret;
+	}
+	return 0;
+}
+
+static void serve(int fd)
+{
+	static char buf[BULK_LEN];
+	int one = 1;
+	char mode;
+
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+	if (xread(fd, &mode, 1))
+		return;
+
+	if (mode == 'b') {
+		while (read(fd, buf, sizeof(buf)) > 0)
+			;
+		return;
+	}
+
+	while (!xread(fd, buf, REQ_LEN))
+		xwrite(fd, buf, REQ_LEN);
+}
+
+static void server(void)
+{
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_port = htons(cfg_port),
+	};
+	int one = 1, fd, conn;
+
+	fd = socket(AF_INET, SOCK_STREAM, IPPROTO_MPTCP);
+	if (fd < 0)
+		die_perror("socket");
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+	    listen(fd, 16))
+		die_perror("bind/listen");
+
+	for (;;) {
+		conn = accept(fd, NULL, NULL);
+		if (conn < 0)
+			die_perror("accept");
+		serve(conn);
+		close(conn);
+	}
+}
+
+static int client_connect(void)
+{
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_port = htons(cfg_port),
+	};
+	int one = 1, fd;
+
+	if (inet_pton(AF_INET, cfg_host, &addr.sin_addr) != 1) {
+		fprintf(stderr, "bad address %s\n", cfg_host);
+		exit(1);
+	}
+
+	fd = socket(AF_INET, SOCK_STREAM, IPPROTO_MPTCP);
+	if (fd < 0)
+		die_perror("socket");
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)))
+		die_perror("connect");
+
+	/* let the path manager add the other subflows */
+	sleep(1);
+	xwrite(fd, &cfg_mode, 1);
+	return fd;
+}
+
+static void client_bulk(void)
+{
+	static char buf[BULK_LEN];
+	unsigned long long sent = 0;
+	double start, elapsed;
+	int fd;
+
+	fd = client_connect();
+	start = now();
+	while (now() - start < cfg_time) {
+		xwrite(fd, buf, sizeof(buf));
+		sent += sizeof(buf);
+	}
+	shutdown(fd, SHUT_WR);
+	/* count the time until the server got everything */
+	while (read(fd, buf, sizeof(buf)) > 0)
+		;
+	elapsed = now() - start;
+	close(fd);
+
+	printf("goodput %.2f Mbit/s\n", sent * 8 / elapsed / 1e6);
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void client_latency(void)
+{
+	char buf[REQ_LEN] = {};
+	double *rtt, start;
+	int fd, i;
+
+	rtt = calloc(cfg_count, sizeof(*rtt));
+	if (!rtt)
+		die_perror("calloc");
+
+	fd = client_connect();
+	for (i = 0; i < cfg_count; i++) {
+		start = now();
+		xwrite(fd, buf, sizeof(buf));
+		if (xread(fd, buf, sizeof(buf))) {
+			fprintf(stderr, "server closed the connection\n");
+			exit(1);
+		}
+		rtt[i] = (now() - start) * 1e3;
+	}
+	close(fd);
+
+	qsort(rtt, cfg_count, sizeof(*rtt), cmp_double);
+	printf("latency p50 %.1f ms p99 %.1f ms max %.1f ms\n",
+	       rtt[cfg_count / 2], rtt[cfg_count * 99 / 100],
+	       rtt[cfg_count - 1]);
+	free(rtt);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s -l [-p port]\n"
+		"       %s -c addr [-p port] [-m bulk|latency] [-t seconds] [-n requests]\n",
+		prog, prog);
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	bool listener = false;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "lc:p:m:t:n:")) != -1) {
+		switch (opt) {
+		case 'l':
+			listener = true;
+			break;
+		case 'c':
+			cfg_host = optarg;
+			break;
+		case 'p':
+			cfg_port = atoi(optarg);
+			break;
+		case 'm':
+			cfg_mode = optarg[0] == 'l' ? 'l' : 'b';
+			break;
+		case 't':
+			cfg_time = atoi(optarg) ?: 1;
+			break;
+		case 'n':
+			cfg_count = atoi(optarg) ?: 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (listener)
+		server();
+	if (!cfg_host)
+		usage(argv[0]);
+
+	if (cfg_mode == 'b')
+		client_bulk();
+	else
+		client_latency();
+	return 0;
+}
@@ -0,0 +1,174 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+
+# Compare the packet schedulers over two links shaped with netem: a fast,
+# clean one and a slower one with a longer, jittery delay and some loss,
+# like Ethernet next to LTE. For each scheduler, report the goodput of a
+# bulk transfer and the latency percentiles of small requests.
+#
+# The schedulers to run can be given on the command line, which allows to
+# include BPF schedulers registered beforehand.
+
+# Double quotes to prevent globbing and word splitting is recommended in new
+# code but we accept it, especially because there were too many before having
+# address all other issues detected by shellcheck.
+#shellcheck disable=SC2086
+
+. "$(dirname "${0}")/mptcp_lib.sh"
+
+ns1=""
+ns2=""
+ns3=""
+ret=0
+server_pid=0
+port=12000
+runtime=5
+requests=500
+MPTCP_LIB_TEST_FORMAT="%02u %-50s"
+
+usage() {
+	echo "Usage: $0 [ -d ] [ -t seconds ] [ -n requests ] [ scheduler ... ]"
+	echo -e "\t-d: debug this script"
+	echo -e "\t-t: duration of the bulk transfers (default: ${runtime})"
+	echo -e "\t-n: number of requests for the latency runs (default: ${requests})"
+}
+
+# This function is used in the cleanup trap
+#shellcheck disable=SC2317
+cleanup()
+{
+	mptcp_lib_kill_wait "${server_pid}"
+	mptcp_lib_ns_exit "${ns1}" "${ns2}" "${ns3}"
+}
+
+mptcp_lib_check_mptcp
+mptcp_lib_check_tools ip tc
+
+#  "$ns1"              ns2                    ns3
+#     ns1eth1    ns2eth1   ns2eth3      ns3eth1
+#            netem: 50mbit, 5ms
+#     ns1eth2    ns2eth2
+#            netem: 20mbit, 40ms +- 10ms, 1% loss
+
+setup()
+{
+	trap cleanup EXIT
+
+	mptcp_lib_ns_init ns1 ns2 ns3
+
+	ip link add ns1eth1 netns "$ns1" type veth peer name ns2eth1 netns "$ns2"
+	ip link add ns1eth2 netns "$ns1" type veth peer name ns2eth2 netns "$ns2"
+	ip link add ns2eth3 netns "$ns2" type veth peer name ns3eth1 netns "$ns3"
+
+	ip -net "$ns1" addr add 10.0.1.1/24 dev ns1eth1
+	ip -net "$ns1" link set ns1eth1 up
+	ip -net "$ns1" route add default via 10.0.1.2
+	ip -net "$ns1" addr add 10.0.2.1/24 dev ns1eth2
+	ip -net "$ns1" link set ns1eth2 up
+	ip -net "$ns1" route add default via 10.0.2.2 metric 101
+
+	mptcp_lib_pm_nl_set_limits "${ns1}" 1 1
+	mptcp_lib_pm_nl_add_endpoint "${ns1}" 10.0.2.1 dev ns1eth2 flags subflow
+
+	ip -net "$ns2" addr add 10.0.1.2/24 dev ns2eth1
+	ip -net "$ns2" link set ns2eth1 up
+	ip -net "$ns2" addr add 10.0.2.2/24 dev ns2eth2
+	ip -net "$ns2" link set ns2eth2 up
+	ip -net "$ns2" addr add 10.0.3.2/24 dev ns2eth3
+	ip -net "$ns2" link set ns2eth3 up
+	ip netns exec "$ns2" sysctl -q net.ipv4.ip_forward=1
+
+	ip -net "$ns3" addr add 10.0.3.3/24 dev ns3eth1
+	ip -net "$ns3" link set ns3eth1 up
+	ip -net "$ns3" route add default via 10.0.3.2
+
+	mptcp_lib_pm_nl_set_limits "${ns3}" 1 1
+
+	tc -n $ns1 qdisc add dev ns1eth1 root netem rate 50mbit delay 5ms
+	tc -n $ns2 qdisc add dev ns2eth1 root netem rate 50mbit delay 5ms
+	tc -n $ns1 qdisc add dev ns1eth2 root netem rate 20mbit \
+		delay 40ms 10ms distribution normal loss 1%
+	tc -n $ns2 qdisc add dev ns2eth2 root netem rate 20mbit \
+		delay 40ms 10ms distribution normal loss 1%
+
+	ip netns exec $ns3 ./mptcp_sched_bench -l -p $port &
+	server_pid=$!
+	mptcp_lib_wait_local_port_listen "${ns3}" "${port}"
+}
+
+run_bench()
+{
+	local sched=$1
+	local mode=$2
+	local out
+
+	mptcp_lib_print_title "${sched}: ${mode}"
+	if ! out=$(ip netns exec $ns1 ./mptcp_sched_bench -c 10.0.3.3 \
+			-p $port -m $mode -t $runtime -n $requests); then
+		mptcp_lib_pr_fail
+		mptcp_lib_result_fail "${sched}: ${mode}"
+		ret=${KSFT_FAIL}
+		return
+	fi
+
+	mptcp_lib_pr_ok
+	mptcp_lib_pr_info "${out}"
+	mptcp_lib_result_pass "${sched}: ${mode}"
+}
+
+run_sched()
+{
+	local sched=$1
+	local ns
+
+	if ! ip netns exec $ns1 sysctl -n net.mptcp.available_schedulers |
+	     grep -qw "${sched}"; then
+		mptcp_lib_print_title "${sched}"
+		mptcp_lib_pr_skip "scheduler not available"
+		mptcp_lib_result_skip "${sched}"
+		return
+	fi
+
+	# the scheduler is picked when a socket is created
+	for ns in $ns1 $ns3; do
+		ip netns exec $ns sysctl -q net.mptcp.scheduler="${sched}"
+	done
+
+	run_bench "${sched}" bulk
+	run_bench "${sched}" latency
+}
+
+while getopts "dht:n:" option; do
+	case "$option" in
+	"h")
+		usage $0
+		exit ${KSFT_PASS}
+		;;
+	"d")
+		set -x
+		;;
+	"t")
+		runtime=$OPTARG
+		;;
+	"n")
+		requests=$OPTARG
+		;;
+	"?")
+		usage $0
+		exit ${KSFT_FAIL}
+		;;
+	esac
+done
+shift $((OPTIND - 1))
+
+scheds=("$@")
+[ ${#scheds[@]} -eq 0 ] && scheds=(default minrtt redundant)
+
+setup
+mptcp_lib_subtests_last_ts_reset
+for sched in "${scheds[@]}"; do
+	run_sched "${sched}"
+done
+
+mptcp_lib_result_print_all_tap
+exit $ret
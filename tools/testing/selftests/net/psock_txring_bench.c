@@ -0,0 +1,257 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Packet rate and CPU cost per packet of a TPACKET_V3 tx ring bypassing
+ * the qdisc, with each frame handed to the device on its own and with
+ * PACKET_TX_BATCH.
+ *
+ * All frames of the ring are queued, then sent with one blocking send(),
+ * which returns once the device is done with them. The GSO run sends
+ * 64KB UDP frames described by a virtio_net_hdr.
+ */
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <getopt.h>
+#include <linux/if_packet.h>
+#include <linux/virtio_net.h>
+#include <net/ethernet.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+#include "../kselftest.h"
+
+#ifndef PACKET_TX_BATCH
+#define PACKET_TX_BATCH		25
+#endif
+
+#define BATCH			64
+#define GSO_LEN			64000
+#define GSO_MSS			(ETH_DATA_LEN - sizeof(struct iphdr) - \
+				 sizeof(struct udphdr))
+
+struct bench_run {
+	const char *name;
+	unsigned int len;
+	unsigned int batch;
+	bool gso;
+};
+
+static const struct bench_run runs[] = {
+	{ "unbatched", 64, 0, false },
+	{ "batched", 64, BATCH, false },
+	{ "unbatched", 1500, 0, false },
+	{ "batched", 1500, BATCH, false },
+	{ "gso batched", GSO_LEN, BATCH, true },
+};
+
+static unsigned int runtime = 3;
+static int ifindex;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double cpu_time(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 +
+	       ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+}
+
+static void build_packet(void *buf, unsigned int len)
+{
+	struct ethhdr *eth = buf;
+	struct iphdr *iph = (void *)(eth + 1);
+	struct udphdr *udph = (void *)(iph + 1);
+
+	memset(buf, 0, len);
+	memset(eth->h_dest, 0xff, ETH_ALEN);
+	eth->h_proto = htons(ETH_P_IP);
+
+	iph->version = 4;
+	iph->ihl = 5;
+	iph->ttl = 8;
+	iph->protocol = IPPROTO_UDP;
+	iph->saddr = htonl(INADDR_LOOPBACK);
+	iph->daddr = htonl(INADDR_LOOPBACK + 1);
+	iph->tot_len = htons(len - sizeof(*eth));
+
+	udph->source = htons(8001);
+	udph->dest = htons(8000);
+	udph->len = htons(len - sizeof(*eth) - sizeof(*iph));
+}
+
+static void build_vnet_hdr(struct virtio_net_hdr *vh)
+{
+	memset(vh, 0, sizeof(*vh));
+	vh->flags = VIRTIO_NET_HDR_F_NEEDS_CSUM;
+	vh->gso_type = VIRTIO_NET_HDR_GSO_UDP_L4;
+	vh->hdr_len = ETH_HLEN + sizeof(struct iphdr) + sizeof(struct udphdr);
+	vh->gso_size = GSO_MSS;
+	vh->csum_start = ETH_HLEN + sizeof(struct iphdr);
+	vh->csum_offset = offsetof(struct udphdr, check);
+}
+
+static int sock_open(const struct bench_run *run, struct tpacket_req3 *req,
+		     void **ring)
+{
+	int ver = TPACKET_V3, one = 1, batch = run->batch, fd;
+	struct sockaddr_ll addr = {
+		.sll_family = AF_PACKET,
+		.sll_protocol = htons(ETH_P_IP),
+		.sll_ifindex = ifindex,
+	};
+
+	fd = socket(AF_PACKET, SOCK_RAW, 0);
+	if (fd < 0)
+		return -errno;
+
+	if (setsockopt(fd, SOL_PACKET, PACKET_VERSION, &ver, sizeof(ver)) ||
+	    setsockopt(fd, SOL_PACKET, PACKET_QDISC_BYPASS, &one,
+		       sizeof(one)) ||
+	    (run->gso && setsockopt(fd, SOL_PACKET, PACKET_VNET_HDR, &one,
+				    sizeof(one))) ||
+	    setsockopt(fd, SOL_PACKET, PACKET_TX_BATCH, &batch,
+		       sizeof(batch)) ||
+	    setsockopt(fd, SOL_PACKET, PACKET_TX_RING, req, sizeof(*req)))
+		goto err;
+
+	*ring = mmap(NULL, (size_t)req->tp_block_size * req->tp_block_nr,
+		     PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (*ring == MAP_FAILED)
+		goto err;
+
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)))
+		goto err;
+	return fd;
+err:
+	ver = -errno;
+	close(fd);
+	return ver;
+}
+
+static void run_one(const struct bench_run *run)
+{
+	unsigned int hdr_off = TPACKET3_HDRLEN - sizeof(struct sockaddr_ll);
+	unsigned int vnet_len = run->gso ? sizeof(struct virtio_net_hdr) : 0;
+	unsigned int frame_size = run->gso ? 1 << 17 : 1 << 11;
+	struct tpacket_req3 req = {
+		.tp_block_size = frame_size < 1 << 16 ? 1 << 16 : frame_size,
+		.tp_frame_size = frame_size,
+	};
+	unsigned long long pkts = 0;
+	double start, cpu, elapsed;
+	unsigned int i, nr_frames;
+	void *ring;
+	int fd;
+
+	req.tp_block_nr = (run->gso ? 64 : 256) * frame_size / req.tp_block_size;
+	req.tp_frame_nr = req.tp_block_nr * (req.tp_block_size / frame_size);
+	nr_frames = req.tp_frame_nr;
+
+	fd = sock_open(run, &req, &ring);
+	if (fd == -ENOPROTOOPT && run->batch) {
+		ksft_test_result_skip("%s: PACKET_TX_BATCH not supported\n",
+				      run->name);
+		return;
+	}
+	if (fd < 0) {
+		ksft_test_result_fail("%s: setup failed: %s\n", run->name,
+				      strerror(-fd));
+		return;
+	}
+
+	/* All frames carry the same packet, they are never rewritten */
+	for (i = 0; i < nr_frames; i++) {
+		struct tpacket3_hdr *hdr = ring + (size_t)i * frame_size;
+		void *data = (void *)hdr + hdr_off;
+
+		if (run->gso)
+			build_vnet_hdr(data);
+		build_packet(data + vnet_len, run->len);
+		hdr->tp_len = vnet_len + run->len;
+		hdr->tp_next_offset = 0;
+	}
+
+	start = now();
+	cpu = cpu_time();
+	while (now() - start < runtime) {
+		for (i = 0; i < nr_frames; i++) {
+			struct tpacket3_hdr *hdr = ring + (size_t)i * frame_size;
+
+			__atomic_store_n(&hdr->tp_status, TP_STATUS_SEND_REQUEST,
+					 __ATOMIC_RELEASE);
+		}
+		if (send(fd, NULL, 0, 0) < 0) {
+			ksft_test_result_fail("%s: send: %s\n", run->name,
+					      strerror(errno));
+			goto out;
+		}
+		pkts += nr_frames;
+	}
+	elapsed = now() - start;
+	cpu = cpu_time() - cpu;
+
+	ksft_print_msg("%-11s %5u B  %10.0f pps  %7.0f ns CPU/pkt\n",
+		       run->name, run->len, pkts / elapsed, cpu * 1e9 / pkts);
+	ksft_test_result_pass("%s: %u byte frames\n", run->name, run->len);
+out:
+	munmap(ring, (size_t)req.tp_block_size * req.tp_block_nr);
+	close(fd);
+}
+
+int main(int argc, char **argv)
+{
+	const char *ifname = NULL;
+	unsigned int i;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "i:t:")) != -1) {
+		switch (opt) {
+		case 'i':
+			ifname = optarg;
+			break;
+		case 't':
+			runtime = atoi(optarg) ?: 1;
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (!ifname)
+		goto usage;
+
+	ksft_print_header();
+	ifindex = if_nametoindex(ifname);
+	if (!ifindex)
+		ksft_exit_fail_msg("%s: %s\n", ifname, strerror(errno));
+
+	ksft_set_plan(ARRAY_SIZE(runs));
+	ksft_print_msg("TPACKET_V3 tx ring on %s, %us per run\n", ifname,
+		       runtime);
+	for (i = 0; i < ARRAY_SIZE(runs); i++)
+		run_one(&runs[i]);
+	ksft_finished();
+
+usage:
+	fprintf(stderr, "Usage: %s -i IF [-t seconds]\n", argv[0]);
+	return KSFT_FAIL;
+}
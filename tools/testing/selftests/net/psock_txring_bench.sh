@@ -0,0 +1,18 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Packet rate and CPU cost of a TPACKET_V3 tx ring on a veth pair, with and
+# without PACKET_TX_BATCH.
+#
+# Usage: ./psock_txring_bench.sh [-t seconds per run]
+
+source lib.sh
+
+setup_ns NS || exit $ksft_skip
+trap cleanup_all_ns EXIT
+
+ip -netns "$NS" link add veth0 type veth peer name veth1 || exit $ksft_skip
+ip -netns "$NS" link set veth0 up
+ip -netns "$NS" link set veth1 up
+
+ip netns exec "$NS" ./psock_txring_bench -i veth0 "$@"
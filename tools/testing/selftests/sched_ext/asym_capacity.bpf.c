@@ -0,0 +1,81 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * A scheduler that records what the capacity and topology kfuncs report for
+ * every CPU so that userspace can compare it against sysfs.
+ */
+
+#include <scx/common.bpf.h>
+
+char _license[] SEC("license") = "GPL";
+
+#define MAX_CPUS 512
+
+bool scx_bpf_asym_cpucapacity(void) __ksym;
+s32 scx_bpf_cpu_cluster_id(s32 cpu) __ksym;
+const struct cpumask *scx_bpf_get_cluster_cpumask(s32 cpu) __ksym;
+
+UEI_DEFINE(uei);
+
+bool asym;
+u32 nr_cpus;
+u32 cpu_cap[MAX_CPUS];
+s32 cpu_cluster_id[MAX_CPUS];
+bool cluster_has_cpu[MAX_CPUS];
+u64 nr_cluster_mismatches;
+
+s32 BPF_STRUCT_OPS(asym_capacity_select_cpu, struct task_struct *p,
+		   s32 prev_cpu, u64 wake_flags)
+{
+	const struct cpumask *cluster;
+	bool is_idle = false;
+	s32 cpu;
+
+	cpu = scx_bpf_select_cpu_dfl(p, prev_cpu, wake_flags, &is_idle);
+	if (is_idle)
+		scx_bpf_dsq_insert(p, SCX_DSQ_LOCAL, SCX_SLICE_DFL, 0);
+
+	/* every CPU must share a cluster with itself */
+	cluster = scx_bpf_get_cluster_cpumask(cpu);
+	if (!bpf_cpumask_test_cpu(cpu, cluster))
+		__sync_fetch_and_add(&nr_cluster_mismatches, 1);
+	scx_bpf_put_cpumask(cluster);
+
+	return cpu;
+}
+
+s32 BPF_STRUCT_OPS_SLEEPABLE(asym_capacity_init)
+{
+	const struct cpumask *cluster;
+	s32 cpu;
+
+	asym = scx_bpf_asym_cpucapacity();
+	nr_cpus = scx_bpf_nr_cpu_ids();
+
+	bpf_for(cpu, 0, nr_cpus) {
+		if (cpu >= MAX_CPUS)
+			break;
+
+		cpu_cap[cpu] = scx_bpf_cpuperf_cap(cpu);
+		cpu_cluster_id[cpu] = scx_bpf_cpu_cluster_id(cpu);
+
+		cluster = scx_bpf_get_cluster_cpumask(cpu);
+		cluster_has_cpu[cpu] = bpf_cpumask_test_cpu(cpu, cluster);
+		scx_bpf_put_cpumask(cluster);
+	}
+
+	return 0;
+}
+
+void BPF_STRUCT_OPS(asym_capacity_exit, struct scx_exit_info *ei)
+{
+	UEI_RECORD(uei, ei);
+}
+
+SEC(".struct_ops.link")
+struct sched_ext_ops asym_capacity_ops = {
+	.select_cpu		= (void *) asym_capacity_select_cpu,
+	.init			= (void *) asym_capacity_init,
+	.exit			= (void *) asym_capacity_exit,
+	.name			= "asym_capacity",
+	.timeout_ms		= 1000U,
+};
@@ -0,0 +1,148 @@
+// SPDX-License-Identifier: GPL-2.0
+#include <bpf/bpf.h>
+#include <scx/common.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "asym_capacity.bpf.skel.h"
+#include "scx_test.h"
+
+#define MAX_CPUS 512
+
+static int read_sysfs_int(int cpu, const char *attr, long *val)
+{
+	char path[128];
+	FILE *f;
+	int ret;
+
+	snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/%s",
+		 cpu, attr);
+	f = fopen(path, "r");
+	if (!f)
+		return -1;
+	ret = fscanf(f, "%ld", val) == 1 ? 0 : -1;
+	fclose(f);
+	return ret;
+}
+
+/*
+ * Parse /sys/devices/system/cpu/online into @online. Possible but offline
+ * CPUs aren't attached to any sched domain and have no cluster cpumask.
+ */
+static int read_online_cpus(bool *online, int nr_cpus)
+{
+	int first, last, cpu;
+	char sep;
+	FILE *f;
+
+	f = fopen("/sys/devices/system/cpu/online", "r");
+	if (!f)
+		return -1;
+
+	while (fscanf(f, "%d", &first) == 1) {
+		last = first;
+		sep = fgetc(f);
+		if (sep == '-') {
+			if (fscanf(f, "%d", &last) != 1)
+				break;
+			sep = fgetc(f);
+		}
+		for (cpu = first; cpu <= last && cpu < nr_cpus; cpu++)
+			online[cpu] = true;
+		if (sep != ',')
+			break;
+	}
+
+	fclose(f);
+	return 0;
+}
+
+static enum scx_test_status setup(void **ctx)
+{
+	struct asym_capacity *skel;
+
+	skel = asym_capacity__open_and_load();
+	SCX_FAIL_IF(!skel, "Failed to open and load skel");
+
+	*ctx = skel;
+
+	return SCX_TEST_PASS;
+}
+
+static enum scx_test_status run(void *ctx)
+{
+	struct asym_capacity *skel = ctx;
+	struct bpf_link *link;
+	long cap, min_cap = -1, max_cap = -1, cluster_id;
+	bool online[MAX_CPUS] = {};
+	int cpu, nr_cpus;
+
+	link = bpf_map__attach_struct_ops(skel->maps.asym_capacity_ops);
+	SCX_FAIL_IF(!link, "Failed to attach scheduler");
+
+	/* let a few wakeups go through select_cpu() */
+	sleep(1);
+
+	SCX_EQ(skel->data->uei.kind, EXIT_KIND(SCX_EXIT_NONE));
+	SCX_EQ(skel->bss->nr_cluster_mismatches, 0);
+
+	nr_cpus = skel->bss->nr_cpus;
+	if (nr_cpus > MAX_CPUS)
+		nr_cpus = MAX_CPUS;
+
+	SCX_FAIL_IF(read_online_cpus(online, nr_cpus),
+		    "Failed to read the online CPUs");
+
+	for (cpu = 0; cpu < nr_cpus; cpu++) {
+		if (!online[cpu])
+			continue;
+
+		SCX_FAIL_IF(!skel->bss->cluster_has_cpu[cpu],
+			    "CPU %d missing from its cluster cpumask", cpu);
+
+		if (!read_sysfs_int(cpu, "topology/cluster_id", &cluster_id) &&
+		    cluster_id >= 0)
+			SCX_FAIL_IF(skel->bss->cpu_cluster_id[cpu] != cluster_id,
+				    "CPU %d cluster %d != sysfs %ld", cpu,
+				    skel->bss->cpu_cluster_id[cpu], cluster_id);
+
+		if (read_sysfs_int(cpu, "cpu_capacity", &cap))
+			continue;
+
+		SCX_FAIL_IF(skel->bss->cpu_cap[cpu] != cap,
+			    "CPU %d capacity %u != sysfs %ld", cpu,
+			    skel->bss->cpu_cap[cpu], cap);
+
+		if (min_cap < 0 || cap < min_cap)
+			min_cap = cap;
+		if (cap > max_cap)
+			max_cap = cap;
+	}
+
+	/* without cpu_capacity in sysfs, asymmetry can't be cross-checked */
+	if (min_cap >= 0)
+		SCX_FAIL_IF(skel->bss->asym != (min_cap != max_cap),
+			    "asym_cpucapacity=%d but capacities range [%ld, %ld]",
+			    skel->bss->asym, min_cap, max_cap);
+
+	bpf_link__destroy(link);
+
+	return SCX_TEST_PASS;
+}
+
+static void cleanup(void *ctx)
+{
+	struct asym_capacity *skel = ctx;
+
+	asym_capacity__destroy(skel);
+}
+
+struct scx_test asym_capacity = {
+	.name = "asym_capacity",
+	.description = "Verify the CPU capacity and cluster topology kfuncs "
+		       "against sysfs",
+	.setup = setup,
+	.run = run,
+	.cleanup = cleanup,
+};
+REGISTER_SCX_TEST(&asym_capacity)
@@ -0,0 +1,115 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Throughput of a WireGuard tunnel between two namespaces connected by a veth
+# pair, for TCP and for UDP, in both directions.
+#
+# wg1 (192.168.241.1) in the first namespace talks to wg2 (192.168.241.2) in
+# the second one over veth1 (10.0.0.1) and veth2 (10.0.0.2).
+#
+# The encrypted packets of a peer leave as UDP GSO packets, which veth passes
+# on unsplit up to the UDP socket of the other side, so the numbers for large
+# TCP transfers are mostly a measure of the crypto. Pass -o "gso off" to have
+# them split before veth instead, or a runtime with -t.
+
+set -e
+
+exec 3>&1
+export LANG=C
+ksft_skip=4
+ns1="wg-bench-$$-1"
+ns2="wg-bench-$$-2"
+runtime=10
+offload=
+
+pretty() { echo -e "\x1b[32m\x1b[1m[+] ${1:+NS$1: }${2}\x1b[0m" >&3; }
+pp() { pretty "" "$*"; "$@"; }
+n1() { pretty 1 "$*"; ip netns exec $ns1 "$@"; }
+n2() { pretty 2 "$*"; ip netns exec $ns2 "$@"; }
+ip1() { pretty 1 "ip $*"; ip -n $ns1 "$@"; }
+ip2() { pretty 2 "ip $*"; ip -n $ns2 "$@"; }
+
+usage() {
+	echo "Usage: $0 [-t seconds] [-o \"ethtool offload settings\"]"
+	exit 1
+}
+
+while getopts "t:o:h" opt; do
+	case $opt in
+	t) runtime=$OPTARG ;;
+	o) offload=$OPTARG ;;
+	*) usage ;;
+	esac
+done
+
+for tool in wg iperf3 ethtool; do
+	if ! command -v $tool >/dev/null; then
+		echo "SKIP: $tool not found"
+		exit $ksft_skip
+	fi
+done
+if [[ $(id -u) -ne 0 ]]; then
+	echo "SKIP: needs root"
+	exit $ksft_skip
+fi
+
+cleanup() {
+	set +e
+	exec 2>/dev/null
+	ip netns pids $ns1 | xargs -r kill
+	ip netns pids $ns2 | xargs -r kill
+	ip netns del $ns1
+	ip netns del $ns2
+	exit
+}
+trap cleanup EXIT
+
+pp ip netns add $ns1
+pp ip netns add $ns2
+ip1 link set up dev lo
+ip2 link set up dev lo
+
+ip1 link add veth1 type veth peer name veth2 netns $ns2
+ip1 addr add 10.0.0.1/24 dev veth1
+ip2 addr add 10.0.0.2/24 dev veth2
+ip1 link set up dev veth1
+ip2 link set up dev veth2
+if [[ -n $offload ]]; then
+	n1 ethtool -K veth1 $offload
+	n2 ethtool -K veth2 $offload
+fi
+
+key1="$(pp wg genkey)"
+key2="$(pp wg genkey)"
+pub1="$(pp wg pubkey <<<"$key1")"
+pub2="$(pp wg pubkey <<<"$key2")"
+
+ip1 link add wg1 type wireguard
+ip2 link add wg2 type wireguard
+n1 wg set wg1 private-key <(echo "$key1") listen-port 1 \
+	peer "$pub2" allowed-ips 192.168.241.2/32 endpoint 10.0.0.2:2
+n2 wg set wg2 private-key <(echo "$key2") listen-port 2 \
+	peer "$pub1" allowed-ips 192.168.241.1/32 endpoint 10.0.0.1:1
+ip1 addr add 192.168.241.1/24 dev wg1
+ip2 addr add 192.168.241.2/24 dev wg2
+ip1 link set up dev wg1
+ip2 link set up dev wg2
+
+n1 ping -c 1 -W 2 192.168.241.2 >/dev/null
+
+run() {
+	local name="$1"
+
+	shift
+	n2 iperf3 -s -1 -D
+	sleep 1
+	printf "%-16s" "$name" >&3
+	n1 iperf3 -c 192.168.241.2 -t "$runtime" -J "$@" |
+		sed -n 's/.*"bits_per_second":[[:space:]]*\([0-9.e+]*\).*/\1/p' |
+		tail -n 1 | awk '{ printf "%8.2f Gbit/s\n", $1 / 1e9 }' >&3
+}
+
+run "TCP"
+run "TCP reverse" -R
+run "UDP 1400 B" -u -b 0 -l 1400
+run "UDP 1400 B x4" -u -b 0 -l 1400 -P 4